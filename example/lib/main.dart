@@ -1,5 +1,6 @@
 import 'dart:async';
 import 'dart:math' as math;
+import 'dart:typed_data';
 
 import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi.dart';
 import 'package:flutter/material.dart';
@@ -951,10 +952,16 @@ class _Ball {
 class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProviderStateMixin {
   Space? _space;
   final List<_Ball> _balls = [];
+  final Map<Body, _Ball> _ballsByBody = {};
   Ticker? _ticker;
   Duration _lastTime = Duration.zero;
   final ValueNotifier<int> _frameCounter = ValueNotifier(0);
 
+  // Body transforms exported once per frame: x, y and angle columns.
+  Float32List _transforms = Float32List(0);
+  final List<Body> _transformBodies = [];
+  int _transformCount = 0;
+
   bool _isInitialized = false;
   final double _scale = 2;
   int _ballCount = 0;
@@ -1001,23 +1008,26 @@ class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProvider
     pixels.shuffle(random);
     final selectedPixels = pixels.take(maxBalls);
 
+    final positions = <double>[];
     for (final (x, y) in selectedPixels) {
       final xJitter = 0.05 * random.nextDouble();
       final yJitter = 0.05 * random.nextDouble();
 
-      final px = _scale * (x - _imageWidth / 2 + xJitter);
-      final py = _scale * (_imageHeight / 2 - y + yJitter);
-
-      final body = Body.dynamic(1, double.infinity)..position = Vector(px, py);
-
-      final shape = CircleShape(body, ballRadius * _scale)
-        ..elasticity = 0.0
-        ..friction = 0.0;
+      positions
+        ..add(_scale * (x - _imageWidth / 2 + xJitter))
+        ..add(_scale * (_imageHeight / 2 - y + yJitter));
+    }
 
-      space
-        ..addBody(body)
-        ..addShape(shape);
-      _balls.add(_Ball(body, shape, ballRadius * _scale));
+    // One native call creates every ball instead of several calls per ball.
+    final spawned = space.spawnCircles(
+      positions,
+      radii: [ballRadius * _scale],
+      moments: [double.infinity],
+      frictions: [0],
+      elasticities: [0],
+    );
+    for (var i = 0; i < spawned.bodies.length; i++) {
+      _addBall(_Ball(spawned.bodies[i], spawned.shapes[i], ballRadius * _scale));
       _ballCount++;
     }
   }
@@ -1036,17 +1046,21 @@ class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProvider
     space
       ..addBody(body)
       ..addShape(shape);
-    _balls.add(_Ball(body, shape, bulletRadius, isSmashBall: true));
+    _addBall(_Ball(body, shape, bulletRadius, isSmashBall: true));
+  }
+
+  void _addBall(_Ball ball) {
+    _balls.add(ball);
+    _ballsByBody[ball.body] = ball;
   }
 
   void _resetDemo() {
-    for (final ball in _balls) {
-      _space?.removeShape(ball.shape);
-      _space?.removeBody(ball.body);
-      ball.shape.dispose();
-      ball.body.dispose();
-    }
+    _space?.despawn(
+      bodies: [for (final ball in _balls) ball.body],
+      shapes: [for (final ball in _balls) ball.shape],
+    );
     _balls.clear();
+    _ballsByBody.clear();
     _ballCount = 0;
 
     if (_space != null) {
@@ -1070,10 +1084,21 @@ class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProvider
     if (dt <= 0 || dt > 1.0) return;
 
     _space!.step(1.0 / 60.0);
+    _exportTransforms(_space!);
 
     _frameCounter.value++;
   }
 
+  /// Reads every body transform with a single native call instead of one call per body.
+  void _exportTransforms(Space space) {
+    var count = space.exportTransforms(_transforms, bodies: _transformBodies);
+    if (count * 3 > _transforms.length) {
+      _transforms = Float32List(count * 3);
+      count = space.exportTransforms(_transforms, bodies: _transformBodies);
+    }
+    _transformCount = count;
+  }
+
   @override
   Widget build(BuildContext context) {
     final safePadding = MediaQuery.paddingOf(context);
@@ -1086,7 +1111,15 @@ class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProvider
           ValueListenableBuilder<int>(
             valueListenable: _frameCounter,
             builder: (context, frame, child) {
-              return CustomPaint(size: size, painter: _LogoPainter(_balls, _scale));
+              return CustomPaint(
+                size: size,
+                painter: _LogoPainter(
+                  _transforms,
+                  _transformCount,
+                  _transformBodies,
+                  _ballsByBody,
+                ),
+              );
             },
           ),
           Positioned(
@@ -1134,13 +1167,8 @@ class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProvider
   @override
   void dispose() {
     _ticker?.dispose();
-    for (final ball in _balls) {
-      _space?.removeShape(ball.shape);
-      _space?.removeBody(ball.body);
-      ball.shape.dispose();
-      ball.body.dispose();
-    }
     _balls.clear();
+    _ballsByBody.clear();
     _space?.dispose();
     _frameCounter.dispose();
     super.dispose();
@@ -1148,10 +1176,12 @@ class _LogoSmashDemoState extends State<LogoSmashDemo> with SingleTickerProvider
 }
 
 class _LogoPainter extends CustomPainter {
-  _LogoPainter(this.balls, this.scale);
+  _LogoPainter(this.transforms, this.count, this.bodies, this.ballsByBody);
 
-  final List<_Ball> balls;
-  final double scale;
+  final Float32List transforms;
+  final int count;
+  final List<Body> bodies;
+  final Map<Body, _Ball> ballsByBody;
 
   @override
   void paint(Canvas canvas, Size size) {
@@ -1165,9 +1195,13 @@ class _LogoPainter extends CustomPainter {
     final logoPaint = Paint()..color = logoColor;
     final smashPaint = Paint()..color = smashColor;
 
-    for (final ball in balls) {
-      final x = ball.body.positionX;
-      final y = ball.body.positionY;
+    final rows = transforms.length ~/ 3;
+    for (var i = 0; i < count && i < rows; i++) {
+      final ball = ballsByBody[bodies[i]];
+      if (ball == null) continue;
+
+      final x = transforms[i];
+      final y = transforms[rows + i];
 
       if (!x.isFinite || !y.isFinite) continue;
 
@@ -2,11 +2,20 @@ export 'src/arbiter.dart';
 export 'src/body.dart';
 export 'src/body_type.dart';
 export 'src/bounding_box.dart';
+export 'src/broadphase.dart';
 export 'src/chipmunk.dart';
+export 'src/collision_event.dart';
+export 'src/collision_rule.dart';
+export 'src/command_buffer.dart';
 export 'src/constraint.dart';
 export 'src/moment.dart';
 export 'src/platform/chipmunk_bindings.dart';
 export 'src/query_info.dart';
+export 'src/sensor_event.dart';
 export 'src/shape.dart';
 export 'src/space.dart';
+export 'src/space_stats.dart';
+export 'src/step_profile.dart';
+export 'src/trace.dart';
 export 'src/vector.dart';
+export 'src/worker_pool.dart';
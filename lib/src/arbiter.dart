@@ -1,3 +1,4 @@
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
 
 /// Information about a contact point in a collision.
@@ -44,8 +45,8 @@ class ContactPointSet {
 /// They should not be stored or referenced outside of callbacks.
 ///
 /// Note: Arbiter methods are available in the generated bindings but are not yet
-/// exposed in the platform bindings layer. They will be added when collision callbacks
-/// are fully implemented.
+/// exposed in the platform bindings layer. Collisions are reported without Dart callbacks
+/// through [Space.setCollisionEvents] and [Space.drainCollisionEvents].
 class Arbiter {
   /// Creates an Arbiter from a native pointer (for internal use).
   Arbiter.fromNative(this._native);
@@ -2,6 +2,7 @@ import 'package:chipmunk2d_physics_ffi/src/body_type.dart';
 import 'package:chipmunk2d_physics_ffi/src/platform/chipmunk_bindings.dart';
 import 'package:chipmunk2d_physics_ffi/src/shape.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+import 'package:meta/meta.dart';
 
 /// A physics body that can have forces applied to it and can collide.
 ///
@@ -275,6 +276,12 @@ class Body {
     }
   }
 
+  /// Marks this body as disposed after its native memory was freed by its space (for internal use).
+  @internal
+  void markDisposed() {
+    _disposed = true;
+  }
+
   @override
   String toString() => 'Body(position: $position, velocity: $velocity, angle: $angle)';
 }
@@ -0,0 +1,33 @@
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+
+/// How a [Space] finds the pairs of shapes that may collide, see [Space.broadphase].
+enum Broadphase {
+  /// Bounding box trees, Chipmunk's default. They handle shapes of any size well.
+  bbTree(0),
+
+  /// Spatial hashes, faster for many shapes of similar sizes when their cells are sized for them.
+  spatialHash(1),
+
+  /// Spatial hashes or bounding box trees, picked and sized from the number and sizes of the shapes.
+  auto(2)
+  ;
+
+  const Broadphase(this.value);
+
+  /// Creates a Broadphase from a native `CP_FFI_BROADPHASE_*` value.
+  factory Broadphase.fromValue(int value) {
+    switch (value) {
+      case 0:
+        return Broadphase.bbTree;
+      case 1:
+        return Broadphase.spatialHash;
+      case 2:
+        return Broadphase.auto;
+      default:
+        throw ArgumentError('Invalid broadphase value: $value');
+    }
+  }
+
+  /// The native `CP_FFI_BROADPHASE_*` value.
+  final int value;
+}
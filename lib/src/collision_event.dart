@@ -0,0 +1,77 @@
+import 'package:chipmunk2d_physics_ffi/src/shape.dart';
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+
+/// The collision handler callback that queued a [CollisionEvent].
+enum CollisionEventType {
+  /// Two shapes just started touching for the first time this step.
+  begin(1),
+
+  /// Two shapes are touching during this step, before the collision response is processed.
+  preSolve(2),
+
+  /// Two shapes are touching and their collision response has been processed.
+  postSolve(4),
+
+  /// Two shapes stopped touching for the first time this step, or one of them was removed.
+  separate(8)
+  ;
+
+  const CollisionEventType(this.value);
+
+  /// Creates a CollisionEventType from a native `CP_FFI_COLLISION_*` value.
+  factory CollisionEventType.fromValue(int value) {
+    switch (value) {
+      case 1:
+        return CollisionEventType.begin;
+      case 2:
+        return CollisionEventType.preSolve;
+      case 4:
+        return CollisionEventType.postSolve;
+      case 8:
+        return CollisionEventType.separate;
+      default:
+        throw ArgumentError('Invalid collision event type value: $value');
+    }
+  }
+
+  /// The native `CP_FFI_COLLISION_*` value.
+  final int value;
+}
+
+/// A collision recorded natively during a step.
+///
+/// See [Space.setCollisionEvents] and [Space.drainCollisionEvents].
+class CollisionEvent {
+  /// Creates a new CollisionEvent.
+  const CollisionEvent({
+    required this.type,
+    required this.shapeA,
+    required this.shapeB,
+    required this.normal,
+    required this.point,
+    required this.totalImpulse,
+    required this.totalKineticEnergy,
+  });
+
+  /// The callback that queued this event.
+  final CollisionEventType type;
+
+  /// The shape with the first collision type of the pair.
+  final Shape shapeA;
+
+  /// The shape with the second collision type of the pair.
+  final Shape shapeB;
+
+  /// The collision normal, or [Vector.zero] if the shapes had no contact point.
+  final Vector normal;
+
+  /// The first contact point on the surface of [shapeA], or [Vector.zero] if the shapes had no contact point.
+  final Vector point;
+
+  /// The impulse applied to resolve the collision. Only set for [CollisionEventType.postSolve] events.
+  final Vector totalImpulse;
+
+  /// The energy lost in the collision. Only set for [CollisionEventType.postSolve] events.
+  final double totalKineticEnergy;
+}
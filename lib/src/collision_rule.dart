@@ -0,0 +1,44 @@
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+
+/// Static collision decisions for a pair of collision types, evaluated natively during the step.
+///
+/// Rules cover the common cases that would otherwise need a Dart callback per contact. Set them with
+/// [Space.setCollisionRule] or [Space.setCollisionRules].
+///
+/// ```dart
+/// space.setCollisionRules({
+///   (bulletType, bulletType): CollisionRule.ignore,
+///   (platformType, playerType): const CollisionRule.oneWay(Vector(0, 1)),
+///   (playerType, pickupType): const CollisionRule(firstContactOnly: true),
+/// });
+/// ```
+class CollisionRule {
+  /// Creates a collision rule combining the given behaviors.
+  const CollisionRule({
+    this.ignored = false,
+    this.oneWayDirection,
+    this.firstContactOnly = false,
+  });
+
+  /// Creates a one-way rule: shapes collide along [direction] only, like a platform that can be jumped
+  /// through from below with a direction of `Vector(0, 1)`.
+  const CollisionRule.oneWay(Vector direction) : this(oneWayDirection: direction);
+
+  /// A rule that does nothing, restoring the default collision behavior.
+  static const CollisionRule none = CollisionRule();
+
+  /// A rule that makes the pair never collide.
+  static const CollisionRule ignore = CollisionRule(ignored: true);
+
+  /// Whether shapes of the pair never collide.
+  final bool ignored;
+
+  /// If not null, collisions whose normal (pointing from the shape of the first collision type to the
+  /// shape of the second one) goes against this direction are ignored until the shapes separate.
+  final Vector? oneWayDirection;
+
+  /// Whether only the first step of contact is resolved, the collision being ignored afterwards until the
+  /// shapes separate.
+  final bool firstContactOnly;
+}
@@ -0,0 +1,235 @@
+import 'dart:typed_data';
+
+import 'package:chipmunk2d_physics_ffi/src/body.dart';
+import 'package:chipmunk2d_physics_ffi/src/constraint.dart';
+import 'package:chipmunk2d_physics_ffi/src/shape.dart';
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+
+// Opcodes, mirroring `CP_FFI_CMD_*` from `chipmunk2d_physics_ffi.h`.
+const _bodySetPosition = 1;
+const _bodySetVelocity = 2;
+const _bodySetAngle = 3;
+const _bodySetAngularVelocity = 4;
+const _bodySetForce = 5;
+const _bodySetTorque = 6;
+const _bodyApplyForceAtWorldPoint = 7;
+const _bodyApplyForceAtLocalPoint = 8;
+const _bodyApplyImpulseAtWorldPoint = 9;
+const _bodyApplyImpulseAtLocalPoint = 10;
+const _bodyActivate = 11;
+const _shapeSetFriction = 12;
+const _shapeSetElasticity = 13;
+const _shapeSetSurfaceVelocity = 14;
+const _shapeSetFilter = 15;
+const _shapeSetCollisionType = 16;
+const _shapeSetSensor = 17;
+const _constraintSetMaxForce = 18;
+const _simpleMotorSetRate = 19;
+
+/// Records mutations of bodies, shapes and constraints so they can be applied in a single native call.
+///
+/// Each recorded command has the same effect as the matching setter or method, but the whole buffer is
+/// applied by one [Space.executeCommands] call instead of one native call per mutation. This matters most
+/// on the web, where every call goes through JavaScript interop.
+///
+/// ```dart
+/// final commands = CommandBuffer();
+/// for (final enemy in enemies) {
+///   commands.applyImpulseAtWorldPoint(enemy.body, enemy.push, enemy.body.position);
+/// }
+/// commands.setMotorRate(motor, 2.0);
+/// space.executeCommands(commands);
+/// commands.clear();
+/// ```
+///
+/// Objects referenced by recorded commands must not be disposed before the buffer is executed.
+///
+/// The encoding is a byte stream of commands, each made of a one-byte opcode, the 8-byte handle of its
+/// target and its 8-byte operands, all little-endian.
+class CommandBuffer {
+  /// Creates an empty command buffer with room for [initialCapacity] bytes.
+  CommandBuffer({int initialCapacity = 256}) : _bytes = Uint8List(initialCapacity < 16 ? 16 : initialCapacity) {
+    _data = ByteData.sublistView(_bytes);
+  }
+
+  Uint8List _bytes;
+  late ByteData _data;
+  int _lengthInBytes = 0;
+  int _length = 0;
+
+  /// Number of recorded commands.
+  int get length => _length;
+
+  /// Whether no command was recorded.
+  bool get isEmpty => _length == 0;
+
+  /// Whether at least one command was recorded.
+  bool get isNotEmpty => _length != 0;
+
+  /// Size of the encoded commands in bytes.
+  int get lengthInBytes => _lengthInBytes;
+
+  /// The encoded commands.
+  ///
+  /// The returned view is only valid until the next command is recorded.
+  Uint8List get bytes => Uint8List.sublistView(_bytes, 0, _lengthInBytes);
+
+  /// Removes all recorded commands, keeping the allocated memory for reuse.
+  void clear() {
+    _lengthInBytes = 0;
+    _length = 0;
+  }
+
+  /// Records setting the position of [body].
+  void setPosition(Body body, Vector position) {
+    _begin(_bodySetPosition, body.native, 2);
+    _float(position.x);
+    _float(position.y);
+  }
+
+  /// Records setting the velocity of [body].
+  void setVelocity(Body body, Vector velocity) {
+    _begin(_bodySetVelocity, body.native, 2);
+    _float(velocity.x);
+    _float(velocity.y);
+  }
+
+  /// Records setting the angle of [body], in radians.
+  void setAngle(Body body, double angle) {
+    _begin(_bodySetAngle, body.native, 1);
+    _float(angle);
+  }
+
+  /// Records setting the angular velocity of [body].
+  void setAngularVelocity(Body body, double angularVelocity) {
+    _begin(_bodySetAngularVelocity, body.native, 1);
+    _float(angularVelocity);
+  }
+
+  /// Records setting the force applied to [body] for the next time step.
+  void setForce(Body body, Vector force) {
+    _begin(_bodySetForce, body.native, 2);
+    _float(force.x);
+    _float(force.y);
+  }
+
+  /// Records setting the torque applied to [body] for the next time step.
+  void setTorque(Body body, double torque) {
+    _begin(_bodySetTorque, body.native, 1);
+    _float(torque);
+  }
+
+  /// Records applying a force to [body]. Both the force and point are expressed in world coordinates.
+  void applyForceAtWorldPoint(Body body, Vector force, Vector point) {
+    _vectorPair(_bodyApplyForceAtWorldPoint, body.native, force, point);
+  }
+
+  /// Records applying a force to [body]. Both the force and point are expressed in body local coordinates.
+  void applyForceAtLocalPoint(Body body, Vector force, Vector point) {
+    _vectorPair(_bodyApplyForceAtLocalPoint, body.native, force, point);
+  }
+
+  /// Records applying an impulse to [body]. Both the impulse and point are expressed in world coordinates.
+  void applyImpulseAtWorldPoint(Body body, Vector impulse, Vector point) {
+    _vectorPair(_bodyApplyImpulseAtWorldPoint, body.native, impulse, point);
+  }
+
+  /// Records applying an impulse to [body]. Both the impulse and point are expressed in body local coordinates.
+  void applyImpulseAtLocalPoint(Body body, Vector impulse, Vector point) {
+    _vectorPair(_bodyApplyImpulseAtLocalPoint, body.native, impulse, point);
+  }
+
+  /// Records waking up [body].
+  void activate(Body body) {
+    _begin(_bodyActivate, body.native, 0);
+  }
+
+  /// Records setting the friction of [shape].
+  void setFriction(Shape shape, double friction) {
+    _begin(_shapeSetFriction, shape.native, 1);
+    _float(friction);
+  }
+
+  /// Records setting the elasticity of [shape].
+  void setElasticity(Shape shape, double elasticity) {
+    _begin(_shapeSetElasticity, shape.native, 1);
+    _float(elasticity);
+  }
+
+  /// Records setting the surface velocity of [shape].
+  void setSurfaceVelocity(Shape shape, Vector surfaceVelocity) {
+    _begin(_shapeSetSurfaceVelocity, shape.native, 2);
+    _float(surfaceVelocity.x);
+    _float(surfaceVelocity.y);
+  }
+
+  /// Records setting the collision filter of [shape].
+  void setFilter(Shape shape, ShapeFilter filter) {
+    _begin(_shapeSetFilter, shape.native, 3);
+    _int(filter.group);
+    _int(filter.categories);
+    _int(filter.mask);
+  }
+
+  /// Records setting the collision type of [shape].
+  void setCollisionType(Shape shape, int collisionType) {
+    _begin(_shapeSetCollisionType, shape.native, 1);
+    _int(collisionType);
+  }
+
+  /// Records setting whether [shape] is a sensor.
+  void setSensor(Shape shape, {required bool sensor}) {
+    _begin(_shapeSetSensor, shape.native, 1);
+    _int(sensor ? 1 : 0);
+  }
+
+  /// Records setting the maximum force [constraint] can apply.
+  void setMaxForce(Constraint constraint, double maxForce) {
+    _begin(_constraintSetMaxForce, constraint.native, 1);
+    _float(maxForce);
+  }
+
+  /// Records setting the rate of [motor].
+  void setMotorRate(SimpleMotor motor, double rate) {
+    _begin(_simpleMotorSetRate, motor.native, 1);
+    _float(rate);
+  }
+
+  void _vectorPair(int opcode, int handle, Vector a, Vector b) {
+    _begin(opcode, handle, 4);
+    _float(a.x);
+    _float(a.y);
+    _float(b.x);
+    _float(b.y);
+  }
+
+  void _begin(int opcode, int handle, int operands) {
+    final size = 1 + 8 * (1 + operands);
+    if (_lengthInBytes + size > _bytes.length) {
+      var capacity = _bytes.length * 2;
+      while (capacity < _lengthInBytes + size) {
+        capacity *= 2;
+      }
+      final grown = Uint8List(capacity)..setRange(0, _lengthInBytes, _bytes);
+      _bytes = grown;
+      _data = ByteData.sublistView(grown);
+    }
+    _bytes[_lengthInBytes++] = opcode;
+    _int(handle);
+    _length++;
+  }
+
+  void _float(double value) {
+    _data.setFloat64(_lengthInBytes, value, Endian.little);
+    _lengthInBytes += 8;
+  }
+
+  // Written as two 32-bit halves since `setUint64` is not supported when compiled to JavaScript.
+  void _int(int value) {
+    _data
+      ..setUint32(_lengthInBytes, value % 0x100000000, Endian.little)
+      ..setUint32(_lengthInBytes + 4, value ~/ 0x100000000, Endian.little);
+    _lengthInBytes += 8;
+  }
+}
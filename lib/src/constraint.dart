@@ -1,6 +1,7 @@
 import 'package:chipmunk2d_physics_ffi/src/body.dart';
 import 'package:chipmunk2d_physics_ffi/src/platform/chipmunk_bindings.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+import 'package:meta/meta.dart';
 
 /// Base class for physics constraints (joints).
 ///
@@ -88,6 +89,12 @@ abstract class Constraint {
       _disposed = true;
     }
   }
+
+  /// Marks this constraint as disposed after its native memory was freed by its space (for internal use).
+  @internal
+  void markDisposed() {
+    _disposed = true;
+  }
 }
 
 /// A pin joint keeps two anchor points on two bodies at a fixed distance.
@@ -4,9 +4,12 @@
 library;
 
 import 'dart:ffi' as ffi;
+import 'dart:typed_data';
 
 import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi_bindings_generated.dart' as bindings;
+import 'package:chipmunk2d_physics_ffi/src/arbiter.dart';
 import 'package:chipmunk2d_physics_ffi/src/bounding_box.dart';
+import 'package:chipmunk2d_physics_ffi/src/query_info.dart';
 import 'package:chipmunk2d_physics_ffi/src/shape.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
 import 'package:ffi/ffi.dart' as ffi;
@@ -382,6 +385,11 @@ Vector cpBodyGetRotation(int body) {
   return Vector(v.x, v.y);
 }
 
+/// Get the space a body was added to.
+/// @param body The body.
+/// @return A pointer to the space, or 0 if the body is not in a space.
+int cpBodyGetSpace(int body) => bindings.cp_body_get_space(ffi.Pointer.fromAddress(body)).address;
+
 /// Get the type of a body.
 /// @param body The body.
 /// @return The body type (0=dynamic, 1=kinematic, 2=static).
@@ -708,6 +716,11 @@ void cpShapeSetSensor(int shape, int sensor) => bindings.cp_shape_set_sensor(ffi
 /// @return A pointer to the body.
 int cpShapeGetBody(int shape) => bindings.cp_shape_get_body(ffi.Pointer.fromAddress(shape)).address;
 
+/// Get the space a shape was added to.
+/// @param shape The shape.
+/// @return A pointer to the space, or 0 if the shape is not in a space.
+int cpShapeGetSpace(int shape) => bindings.cp_shape_get_space(ffi.Pointer.fromAddress(shape)).address;
+
 /// Set the body that a shape is attached to.
 /// @param shape The shape.
 /// @param body The body pointer (0 to detach).
@@ -901,6 +914,12 @@ void cpConstraintSetCollideBodies(int constraint, int collideBodies) =>
 double cpConstraintGetImpulse(int constraint) =>
     bindings.cp_constraint_get_impulse(ffi.Pointer.fromAddress(constraint));
 
+/// Get the space a constraint was added to.
+/// @param constraint The constraint.
+/// @return A pointer to the space, or 0 if the constraint is not in a space.
+int cpConstraintGetSpace(int constraint) =>
+    bindings.cp_constraint_get_space(ffi.Pointer.fromAddress(constraint)).address;
+
 /// Get the first body connected by a constraint.
 /// @param constraint The constraint.
 /// @return A pointer to the first body.
@@ -1756,3 +1775,1202 @@ List<double> cpConvexHull(List<double> points, {double tolerance = 0.0}) {
     ..free(firstPtr);
   return result;
 }
+
+void _readBodyHandles(ffi.Pointer<ffi.Pointer<bindings.cpBody>> bodies, int count, List<int> handles) {
+  handles.clear();
+  for (var i = 0; i < count; i++) {
+    handles.add(bodies[i].address);
+  }
+}
+
+/// Export the position, angle and optionally velocity of every body in the space.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportTransformsF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_export_transforms_f32(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+/// Export the position, angle and optionally velocity of every body in the space in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportTransformsF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_export_transforms_f64(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+ffi.Pointer<ffi.Pointer<bindings.cpBody>> _allocBodyHandles(List<int> handles) {
+  final bodies = ffi.malloc<ffi.Pointer<bindings.cpBody>>(handles.length);
+  for (var i = 0; i < handles.length; i++) {
+    bodies[i] = ffi.Pointer.fromAddress(handles[i]);
+  }
+  return bodies;
+}
+
+/// Set the position, angle and optionally velocity of many bodies at once.
+/// Static and kinematic bodies have their shapes reindexed in the same pass.
+/// @param space The space.
+/// @param handles The bodies to update, one per row.
+/// @param state The structure-of-arrays buffer: column c of row i is read from `state[c * handles.length + i]`.
+/// @param velocity Whether to also import the linear and angular velocity columns.
+void cpSpaceImportStatesF32(int space, List<int> handles, Float32List state, {bool velocity = false}) {
+  final bodies = _allocBodyHandles(handles);
+  bindings.cp_space_import_states_f32(
+    ffi.Pointer.fromAddress(space),
+    bodies,
+    state.address,
+    handles.length,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+  );
+  ffi.malloc.free(bodies);
+}
+
+/// Set the position, angle and optionally velocity of many bodies at once from double precision values.
+/// Static and kinematic bodies have their shapes reindexed in the same pass.
+/// @param space The space.
+/// @param handles The bodies to update, one per row.
+/// @param state The structure-of-arrays buffer: column c of row i is read from `state[c * handles.length + i]`.
+/// @param velocity Whether to also import the linear and angular velocity columns.
+void cpSpaceImportStatesF64(int space, List<int> handles, Float64List state, {bool velocity = false}) {
+  final bodies = _allocBodyHandles(handles);
+  bindings.cp_space_import_states_f64(
+    ffi.Pointer.fromAddress(space),
+    bodies,
+    state.address,
+    handles.length,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+  );
+  ffi.malloc.free(bodies);
+}
+
+/// Enable or disable per-step change tracking.
+/// @param space The space.
+/// @param enabled Whether each step records the bodies that moved.
+/// @param epsilon The position/angle change below which a body is not reported.
+void cpSpaceSetChangeTracking(int space, {required bool enabled, double epsilon = 0.0}) =>
+    bindings.cp_space_set_change_tracking(ffi.Pointer.fromAddress(space), enabled ? 1 : 0, epsilon);
+
+/// Get whether per-step change tracking is enabled.
+/// @param space The space.
+/// @return 1 if enabled, 0 otherwise.
+int cpSpaceGetChangeTracking(int space) => bindings.cp_space_get_change_tracking(ffi.Pointer.fromAddress(space));
+
+/// Get the number of bodies that moved during the last step.
+/// @param space The space.
+/// @return The number of changed bodies.
+int cpSpaceGetChangedBodyCount(int space) => bindings.cp_space_get_changed_body_count(ffi.Pointer.fromAddress(space));
+
+/// Export the bodies that moved during the last step, using the layout of cpSpaceExportTransformsF32.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of changed bodies, which may exceed capacity.
+int cpSpaceExportChangedF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_export_changed_f32(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+/// Export the bodies that moved during the last step in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of changed bodies, which may exceed capacity.
+int cpSpaceExportChangedF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_export_changed_f64(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+ffi.Pointer<ffi.Double> _allocDoubles(List<double>? values) {
+  if (values == null) {
+    return ffi.nullptr;
+  }
+  final ptr = ffi.malloc<ffi.Double>(values.length);
+  ptr.asTypedList(values.length).setAll(0, values);
+  return ptr;
+}
+
+/// Native copies of the optional spawn attributes shared by circles and boxes.
+class _SpawnAttributes {
+  _SpawnAttributes({
+    required int sizeCount,
+    required List<double>? masses,
+    required List<double>? moments,
+    required List<double>? frictions,
+    required List<double>? elasticities,
+    required List<ShapeFilter>? filters,
+    required List<int>? collisionTypes,
+  }) : masses = _allocDoubles(masses),
+       moments = _allocDoubles(moments),
+       frictions = _allocDoubles(frictions),
+       elasticities = _allocDoubles(elasticities),
+       filters = filters == null ? ffi.nullptr : ffi.malloc<bindings.cpShapeFilter>(filters.length),
+       collisionTypes = collisionTypes == null ? ffi.nullptr : ffi.malloc<ffi.UintPtr>(collisionTypes.length),
+       uniform = _spawnUniformFlags(sizeCount, [
+         masses?.length,
+         moments?.length,
+         frictions?.length,
+         elasticities?.length,
+         filters?.length,
+         collisionTypes?.length,
+       ]) {
+    if (filters != null) {
+      for (var i = 0; i < filters.length; i++) {
+        this.filters[i]
+          ..group = filters[i].group
+          ..categories = filters[i].categories
+          ..mask = filters[i].mask;
+      }
+    }
+    if (collisionTypes != null) {
+      for (var i = 0; i < collisionTypes.length; i++) {
+        this.collisionTypes[i] = collisionTypes[i];
+      }
+    }
+  }
+
+  final ffi.Pointer<ffi.Double> masses;
+  final ffi.Pointer<ffi.Double> moments;
+  final ffi.Pointer<ffi.Double> frictions;
+  final ffi.Pointer<ffi.Double> elasticities;
+  final ffi.Pointer<bindings.cpShapeFilter> filters;
+  final ffi.Pointer<ffi.UintPtr> collisionTypes;
+  final int uniform;
+
+  void free() {
+    for (final ptr in <ffi.Pointer>[masses, moments, frictions, elasticities, filters, collisionTypes]) {
+      if (ptr != ffi.nullptr) {
+        ffi.malloc.free(ptr);
+      }
+    }
+  }
+}
+
+/// Builds the CP_FFI_SPAWN_UNIFORM_* flags: the size comes first, then the attributes in flag order.
+int _spawnUniformFlags(int sizeCount, List<int?> attributeCounts) {
+  var uniform = sizeCount == 1 ? bindings.CP_FFI_SPAWN_UNIFORM_SIZE : 0;
+  for (var i = 0; i < attributeCounts.length; i++) {
+    if (attributeCounts[i] == 1) {
+      uniform |= bindings.CP_FFI_SPAWN_UNIFORM_MASS << i;
+    }
+  }
+  return uniform;
+}
+
+({List<int> bodies, List<int> shapes}) _readSpawned(
+  ffi.Pointer<ffi.Pointer<bindings.cpBody>> bodies,
+  ffi.Pointer<ffi.Pointer<bindings.cpShape>> shapes,
+  int count,
+) {
+  return (
+    bodies: [for (var i = 0; i < count; i++) bodies[i].address],
+    shapes: [for (var i = 0; i < count; i++) shapes[i].address],
+  );
+}
+
+/// Create dynamic bodies with one circle shape each and add them to the space.
+/// Attribute lists hold one value per object, or a single value shared by every object.
+/// @param space The space.
+/// @param positions The flattened list of body positions [x1, y1, x2, y2, ...].
+/// @param radii The circle radii.
+/// @param masses The body masses, 1 by default.
+/// @param moments The body moments of inertia, computed from the shape by default.
+/// @param frictions The shape friction coefficients, 0 by default.
+/// @param elasticities The shape elasticities, 0 by default.
+/// @param filters The shape collision filters, colliding with everything by default.
+/// @param collisionTypes The shape collision types, 0 by default.
+/// @return The handles of the created bodies and shapes, empty if the space is locked.
+({List<int> bodies, List<int> shapes}) cpSpaceSpawnCircles(
+  int space,
+  List<double> positions,
+  List<double> radii, {
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+}) {
+  final count = positions.length ~/ 2;
+  final attributes = _SpawnAttributes(
+    sizeCount: radii.length,
+    masses: masses,
+    moments: moments,
+    frictions: frictions,
+    elasticities: elasticities,
+    filters: filters,
+    collisionTypes: collisionTypes,
+  );
+  final positionsPtr = _allocDoubles(positions);
+  final radiiPtr = _allocDoubles(radii);
+  final bodies = ffi.malloc<ffi.Pointer<bindings.cpBody>>(count);
+  final shapes = ffi.malloc<ffi.Pointer<bindings.cpShape>>(count);
+  final spawned = bindings.cp_space_spawn_circles(
+    ffi.Pointer.fromAddress(space),
+    count,
+    positionsPtr.cast(),
+    radiiPtr,
+    attributes.masses,
+    attributes.moments,
+    attributes.frictions,
+    attributes.elasticities,
+    attributes.filters,
+    attributes.collisionTypes,
+    attributes.uniform,
+    bodies,
+    shapes,
+  );
+  final result = _readSpawned(bodies, shapes, spawned);
+  attributes.free();
+  ffi.malloc
+    ..free(positionsPtr)
+    ..free(radiiPtr)
+    ..free(bodies)
+    ..free(shapes);
+  return result;
+}
+
+/// Create dynamic bodies with one box shape each and add them to the space.
+/// Attribute lists hold one value per object, or a single value shared by every object.
+/// @param space The space.
+/// @param positions The flattened list of body positions [x1, y1, x2, y2, ...].
+/// @param sizes The flattened list of box sizes [width1, height1, width2, height2, ...].
+/// @param radius The corner radius shared by every box.
+/// @param masses The body masses, 1 by default.
+/// @param moments The body moments of inertia, computed from the shape by default.
+/// @param frictions The shape friction coefficients, 0 by default.
+/// @param elasticities The shape elasticities, 0 by default.
+/// @param filters The shape collision filters, colliding with everything by default.
+/// @param collisionTypes The shape collision types, 0 by default.
+/// @return The handles of the created bodies and shapes, empty if the space is locked.
+({List<int> bodies, List<int> shapes}) cpSpaceSpawnBoxes(
+  int space,
+  List<double> positions,
+  List<double> sizes,
+  double radius, {
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+}) {
+  final count = positions.length ~/ 2;
+  final attributes = _SpawnAttributes(
+    sizeCount: sizes.length ~/ 2,
+    masses: masses,
+    moments: moments,
+    frictions: frictions,
+    elasticities: elasticities,
+    filters: filters,
+    collisionTypes: collisionTypes,
+  );
+  final positionsPtr = _allocDoubles(positions);
+  final sizesPtr = _allocDoubles(sizes);
+  final bodies = ffi.malloc<ffi.Pointer<bindings.cpBody>>(count);
+  final shapes = ffi.malloc<ffi.Pointer<bindings.cpShape>>(count);
+  final spawned = bindings.cp_space_spawn_boxes(
+    ffi.Pointer.fromAddress(space),
+    count,
+    positionsPtr.cast(),
+    sizesPtr.cast(),
+    radius,
+    attributes.masses,
+    attributes.moments,
+    attributes.frictions,
+    attributes.elasticities,
+    attributes.filters,
+    attributes.collisionTypes,
+    attributes.uniform,
+    bodies,
+    shapes,
+  );
+  final result = _readSpawned(bodies, shapes, spawned);
+  attributes.free();
+  ffi.malloc
+    ..free(positionsPtr)
+    ..free(sizesPtr)
+    ..free(bodies)
+    ..free(shapes);
+  return result;
+}
+
+/// Remove objects from the space and free them in a single call.
+/// Objects that are in no space are only freed, objects of another space are ignored.
+/// @param space The space.
+/// @param constraints The constraints to remove and free.
+/// @param shapes The shapes to remove and free.
+/// @param bodies The bodies to remove and free.
+/// @return true if the objects were freed immediately, false if the space is locked and the work was
+/// deferred until the end of the current step.
+bool cpSpaceDespawn(
+  int space, {
+  List<int> constraints = const [],
+  List<int> shapes = const [],
+  List<int> bodies = const [],
+}) {
+  final handles = ffi.malloc<ffi.Pointer<ffi.Void>>(constraints.length + shapes.length + bodies.length);
+  var i = 0;
+  for (final handle in [...constraints, ...shapes, ...bodies]) {
+    handles[i++] = ffi.Pointer.fromAddress(handle);
+  }
+  final done = bindings.cp_space_despawn(
+    ffi.Pointer.fromAddress(space),
+    handles.cast(),
+    constraints.length,
+    (handles + constraints.length).cast(),
+    shapes.length,
+    (handles + constraints.length + shapes.length).cast(),
+    bodies.length,
+  );
+  ffi.malloc.free(handles);
+  return done != 0;
+}
+
+/// Execute a command buffer against the space in a single call.
+/// @param space The space.
+/// @param commands The encoded commands, see `CommandBuffer` for the format.
+/// @return The number of commands executed, which is smaller than the number of encoded commands
+/// only if the buffer is malformed.
+int cpSpaceExecuteCommands(int space, Uint8List commands) {
+  return bindings.cp_space_execute_commands(ffi.Pointer.fromAddress(space), commands.address, commands.length);
+}
+
+/// Queue collision events for a pair of collision types.
+/// @param space The space.
+/// @param typeA The first collision type.
+/// @param typeB The second collision type.
+/// @param events The `CP_FFI_COLLISION_*` bits of the callbacks that queue an event, 0 to stop queuing.
+void cpSpaceSetCollisionEvents(int space, int typeA, int typeB, int events) =>
+    bindings.cp_space_set_collision_events(ffi.Pointer.fromAddress(space), typeA, typeB, events);
+
+/// Set the number of collision events queued before new ones are dropped.
+/// @param space The space.
+/// @param capacity The capacity of the event buffer.
+void cpSpaceSetCollisionEventCapacity(int space, int capacity) =>
+    bindings.cp_space_set_collision_event_capacity(ffi.Pointer.fromAddress(space), capacity);
+
+/// Get the number of queued collision events.
+/// @param space The space.
+/// @return The number of events waiting to be drained.
+int cpSpaceGetCollisionEventCount(int space) =>
+    bindings.cp_space_get_collision_event_count(ffi.Pointer.fromAddress(space));
+
+/// Get the number of collision events dropped because the buffer was full since it was last emptied.
+/// @param space The space.
+/// @return The number of dropped events.
+int cpSpaceGetDroppedCollisionEvents(int space) =>
+    bindings.cp_space_get_dropped_collision_events(ffi.Pointer.fromAddress(space));
+
+/// Move queued collision events, oldest first, into out.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param shapes Filled with the handles of the two shapes of each drained event, interleaved.
+/// @param capacity The number of rows in each column of out.
+/// @return The number of drained events.
+int cpSpaceDrainCollisionEvents(int space, Float64List out, List<int> shapes, int capacity) {
+  final shapesPtr = ffi.malloc<ffi.Pointer<bindings.cpShape>>(capacity * 2);
+  final count = bindings.cp_space_drain_collision_events(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    shapesPtr,
+    capacity,
+  );
+  shapes.clear();
+  for (var i = 0; i < count; i++) {
+    shapes
+      ..add(shapesPtr[i].address)
+      ..add(shapesPtr[capacity + i].address);
+  }
+  ffi.malloc.free(shapesPtr);
+  return count;
+}
+
+/// Start or stop tracking the shapes overlapping a shape, usually a sensor.
+/// @param space The space.
+/// @param shape The tracked shape.
+/// @param enabled Whether enter and exit events are queued for the shape after each step.
+void cpSpaceSetSensorTracking(int space, int shape, {required bool enabled}) => bindings
+    .cp_space_set_sensor_tracking(ffi.Pointer.fromAddress(space), ffi.Pointer.fromAddress(shape), enabled ? 1 : 0);
+
+/// Get the number of queued sensor events.
+/// @param space The space.
+/// @return The number of events waiting to be drained.
+int cpSpaceGetSensorEventCount(int space) => bindings.cp_space_get_sensor_event_count(ffi.Pointer.fromAddress(space));
+
+/// Move queued sensor events, oldest first, into types and shapes.
+/// @param space The space.
+/// @param types Filled with the `CP_FFI_SENSOR_*` type of each drained event.
+/// @param shapes Filled with the handles of the tracked shape and the other shape of each event, interleaved.
+/// @param capacity The maximum number of events to drain.
+/// @return The number of drained events.
+int cpSpaceDrainSensorEvents(int space, List<int> types, List<int> shapes, int capacity) {
+  final typesPtr = ffi.malloc<ffi.Int>(capacity);
+  final shapesPtr = ffi.malloc<ffi.Pointer<bindings.cpShape>>(capacity * 2);
+  final count = bindings.cp_space_drain_sensor_events(ffi.Pointer.fromAddress(space), typesPtr, shapesPtr, capacity);
+  types.clear();
+  shapes.clear();
+  for (var i = 0; i < count; i++) {
+    types.add(typesPtr[i]);
+    shapes
+      ..add(shapesPtr[i].address)
+      ..add(shapesPtr[capacity + i].address);
+  }
+  ffi.malloc
+    ..free(typesPtr)
+    ..free(shapesPtr);
+  return count;
+}
+
+/// Get the shapes overlapping a tracked shape at the end of the last step.
+/// @param space The space.
+/// @param sensor The tracked shape.
+/// @param shapes Filled with the handles of the overlapping shapes.
+void cpSpaceGetSensorOverlaps(int space, int sensor, List<int> shapes) {
+  var capacity = 16;
+  while (true) {
+    final out = ffi.malloc<ffi.Pointer<bindings.cpShape>>(capacity);
+    final count = bindings.cp_space_get_sensor_overlaps(
+      ffi.Pointer.fromAddress(space),
+      ffi.Pointer.fromAddress(sensor),
+      out,
+      capacity,
+    );
+    if (count <= capacity) {
+      shapes.clear();
+      for (var i = 0; i < count; i++) {
+        shapes.add(out[i].address);
+      }
+      ffi.malloc.free(out);
+      return;
+    }
+    ffi.malloc.free(out);
+    capacity = count;
+  }
+}
+
+/// Set the native collision rules of a pair of collision types.
+/// @param space The space.
+/// @param typeA The first collision type.
+/// @param typeB The second collision type.
+/// @param rules The `CP_FFI_RULE_*` bits of the rules to apply, 0 to remove them.
+/// @param oneWayX The x component of the direction the pair collides along with `CP_FFI_RULE_ONE_WAY`.
+/// @param oneWayY The y component of the direction the pair collides along with `CP_FFI_RULE_ONE_WAY`.
+void cpSpaceSetCollisionRule(int space, int typeA, int typeB, int rules, double oneWayX, double oneWayY) {
+  final direction = ffi.Struct.create<bindings.cpVect>()
+    ..x = oneWayX
+    ..y = oneWayY;
+  bindings.cp_space_set_collision_rule(ffi.Pointer.fromAddress(space), typeA, typeB, rules, direction);
+}
+
+/// Find the shapes overlapping a shape.
+/// @param space The space.
+/// @param shape The shape to test, which does not need to be added to the space.
+/// @param capacity The maximum number of results to read.
+/// @param shapes Filled with the handles of up to capacity overlapping shapes.
+/// @param sets Filled with the contact point set of each shape in shapes.
+/// @return The total number of overlapping shapes, which may exceed capacity.
+int cpSpaceShapeQuery(int space, int shape, int capacity, List<int> shapes, List<ContactPointSet> sets) {
+  final shapesPtr = ffi.malloc<ffi.Pointer<bindings.cpShape>>(capacity);
+  final setsPtr = ffi.malloc<bindings.cpContactPointSet>(capacity);
+  final total = bindings.cp_space_shape_query(
+    ffi.Pointer.fromAddress(space),
+    ffi.Pointer.fromAddress(shape),
+    shapesPtr,
+    setsPtr,
+    capacity,
+  );
+  shapes.clear();
+  sets.clear();
+  for (var i = 0; i < total && i < capacity; i++) {
+    shapes.add(shapesPtr[i].address);
+    final set = setsPtr[i];
+    sets.add(
+      ContactPointSet(
+        count: set.count,
+        normal: Vector(set.normal.x, set.normal.y),
+        points: [
+          for (var j = 0; j < set.count; j++)
+            ContactPoint(
+              pointA: Vector(set.points[j].pointA.x, set.points[j].pointA.y),
+              pointB: Vector(set.points[j].pointB.x, set.points[j].pointB.y),
+              distance: set.points[j].distance,
+            ),
+        ],
+      ),
+    );
+  }
+  ffi.malloc
+    ..free(shapesPtr)
+    ..free(setsPtr);
+  return total;
+}
+
+/// Set the number of native worker threads running large batches alongside the calling thread.
+/// @param count The number of workers, 0 to run batches on the calling thread only, or a negative value to
+/// restore the default of one worker per CPU beyond the first.
+void cpFfiSetWorkerThreadCount(int count) => bindings.cp_ffi_set_worker_thread_count(count);
+
+/// Get the number of native worker threads, always 0 when threads are not supported.
+/// @return The number of workers.
+int cpFfiGetWorkerThreadCount() => bindings.cp_ffi_get_worker_thread_count();
+
+ffi.Pointer<bindings.cpShapeFilter> _allocFilters(List<ShapeFilter> filters) {
+  if (filters.isEmpty) {
+    return ffi.nullptr;
+  }
+  final ptr = ffi.malloc<bindings.cpShapeFilter>(filters.length);
+  for (var i = 0; i < filters.length; i++) {
+    ptr[i]
+      ..group = filters[i].group
+      ..categories = filters[i].categories
+      ..mask = filters[i].mask;
+  }
+  return ptr;
+}
+
+void _readShapeHandles(ffi.Pointer<ffi.Pointer<bindings.cpShape>> ptr, int count, List<int> handles) {
+  handles.clear();
+  for (var i = 0; i < count; i++) {
+    handles.add(ptr[i].address);
+  }
+}
+
+/// Run many first-hit segment queries in one call.
+/// @param space The space.
+/// @param segments Five values per segment: start x, start y, end x, end y and radius.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param hits Filled with five values per segment: hit point x, point y, normal x, normal y and alpha.
+/// @param shapes Filled with the handle of the first shape hit by each segment, or 0 on a miss.
+/// @return The number of segments that hit a shape.
+int cpSpaceSegmentQueryFirstBatch(
+  int space,
+  Float64List segments,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) {
+  final count = segments.length ~/ 5;
+  final filtersPtr = _allocFilters(filters);
+  final shapesPtr = ffi.malloc<ffi.Pointer<bindings.cpShape>>(count);
+  final hitCount = bindings.cp_space_segment_query_first_batch(
+    ffi.Pointer.fromAddress(space),
+    segments.address,
+    count,
+    filtersPtr,
+    filters.length,
+    shapesPtr,
+    hits.address,
+  );
+  _readShapeHandles(shapesPtr, count, shapes);
+  ffi.malloc
+    ..free(filtersPtr)
+    ..free(shapesPtr);
+  return hitCount;
+}
+
+/// Run many nearest point queries in one call.
+/// @param space The space.
+/// @param points Three values per query: x, y and maximum distance.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param hits Filled with five values per query: nearest point x, point y, distance, gradient x and gradient y.
+/// @param shapes Filled with the handle of the nearest shape of each query, or 0 if none is within range.
+/// @return The number of queries with a shape in range.
+int cpSpacePointQueryNearestBatch(
+  int space,
+  Float64List points,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) {
+  final count = points.length ~/ 3;
+  final filtersPtr = _allocFilters(filters);
+  final shapesPtr = ffi.malloc<ffi.Pointer<bindings.cpShape>>(count);
+  final hitCount = bindings.cp_space_point_query_nearest_batch(
+    ffi.Pointer.fromAddress(space),
+    points.address,
+    count,
+    filtersPtr,
+    filters.length,
+    shapesPtr,
+    hits.address,
+  );
+  _readShapeHandles(shapesPtr, count, shapes);
+  ffi.malloc
+    ..free(filtersPtr)
+    ..free(shapesPtr);
+  return hitCount;
+}
+
+/// Run many bounding box queries in one call.
+/// @param space The space.
+/// @param bbs Four values per query: left, bottom, right and top.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param capacity The maximum number of shapes reported per query.
+/// @param shapes Filled with capacity handles per query, the shapes overlapping the box followed by zeros.
+/// @param counts Filled with the total number of shapes overlapping each box, which may exceed capacity.
+void cpSpaceBBQueryBatch(
+  int space,
+  Float64List bbs,
+  List<ShapeFilter> filters,
+  int capacity,
+  List<int> shapes,
+  List<int> counts,
+) {
+  final count = bbs.length ~/ 4;
+  final filtersPtr = _allocFilters(filters);
+  final shapesPtr = ffi.malloc<ffi.Pointer<bindings.cpShape>>(count * capacity);
+  final countsPtr = ffi.malloc<ffi.Int>(count);
+  bindings.cp_space_bb_query_batch(
+    ffi.Pointer.fromAddress(space),
+    bbs.address,
+    count,
+    filtersPtr,
+    filters.length,
+    shapesPtr,
+    capacity,
+    countsPtr,
+  );
+  shapes.clear();
+  counts.clear();
+  for (var i = 0; i < count; i++) {
+    final found = countsPtr[i];
+    counts.add(found);
+    for (var j = 0; j < capacity; j++) {
+      shapes.add(j < found ? shapesPtr[i * capacity + j].address : 0);
+    }
+  }
+  ffi.malloc
+    ..free(filtersPtr)
+    ..free(shapesPtr)
+    ..free(countsPtr);
+}
+
+/// Find every shape within a distance of a point.
+/// @param space The space.
+/// @param x The x coordinate of the point.
+/// @param y The y coordinate of the point.
+/// @param maxDistance The maximum distance from the point to a shape's surface.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the nearest capacity results, sorted by distance.
+/// @return The total number of shapes in range, which may exceed capacity.
+int cpSpacePointQuery(
+  int space,
+  double x,
+  double y,
+  double maxDistance,
+  ShapeFilter filter,
+  int capacity,
+  List<PointQueryInfo> out,
+) {
+  final point = ffi.Struct.create<bindings.cpVect>()
+    ..x = x
+    ..y = y;
+  final infos = ffi.malloc<bindings.cpPointQueryInfo>(capacity);
+  final total = bindings.cp_space_point_query(
+    ffi.Pointer.fromAddress(space),
+    point,
+    maxDistance,
+    bindings.cp_shape_filter_new(filter.group, filter.categories, filter.mask),
+    infos,
+    capacity,
+  );
+  out.clear();
+  for (var i = 0; i < total && i < capacity; i++) {
+    final info = infos[i];
+    out.add(
+      PointQueryInfo(
+        shapePtr: info.shape.address,
+        point: Vector(info.point.x, info.point.y),
+        distance: info.distance,
+        gradient: Vector(info.gradient.x, info.gradient.y),
+      ),
+    );
+  }
+  ffi.malloc.free(infos);
+  return total;
+}
+
+/// Find every shape along a segment.
+/// @param space The space.
+/// @param startX The x coordinate of the segment start.
+/// @param startY The y coordinate of the segment start.
+/// @param endX The x coordinate of the segment end.
+/// @param endY The y coordinate of the segment end.
+/// @param radius The radius of the segment.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the first capacity results along the segment, sorted by alpha.
+/// @return The total number of shapes hit, which may exceed capacity.
+int cpSpaceSegmentQuery(
+  int space,
+  double startX,
+  double startY,
+  double endX,
+  double endY,
+  double radius,
+  ShapeFilter filter,
+  int capacity,
+  List<SegmentQueryInfo> out,
+) {
+  final start = ffi.Struct.create<bindings.cpVect>()
+    ..x = startX
+    ..y = startY;
+  final end = ffi.Struct.create<bindings.cpVect>()
+    ..x = endX
+    ..y = endY;
+  final infos = ffi.malloc<bindings.cpSegmentQueryInfo>(capacity);
+  final total = bindings.cp_space_segment_query(
+    ffi.Pointer.fromAddress(space),
+    start,
+    end,
+    radius,
+    bindings.cp_shape_filter_new(filter.group, filter.categories, filter.mask),
+    infos,
+    capacity,
+  );
+  out.clear();
+  for (var i = 0; i < total && i < capacity; i++) {
+    final info = infos[i];
+    out.add(
+      SegmentQueryInfo(
+        shapePtr: info.shape.address,
+        point: Vector(info.point.x, info.point.y),
+        normal: Vector(info.normal.x, info.normal.y),
+        alpha: info.alpha,
+      ),
+    );
+  }
+  ffi.malloc.free(infos);
+  return total;
+}
+
+/// Find every shape whose bounding box overlaps a bounding box.
+/// @param space The space.
+/// @param bb The bounding box.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the handles of up to capacity overlapping shapes.
+/// @return The total number of overlapping shapes, which may exceed capacity.
+int cpSpaceBBQuery(int space, BoundingBox bb, ShapeFilter filter, int capacity, List<int> out) {
+  final box = ffi.Struct.create<bindings.cpBB>()
+    ..l = bb.left
+    ..b = bb.bottom
+    ..r = bb.right
+    ..t = bb.top;
+  final shapes = ffi.malloc<ffi.Pointer<bindings.cpShape>>(capacity);
+  final total = bindings.cp_space_bb_query(
+    ffi.Pointer.fromAddress(space),
+    box,
+    bindings.cp_shape_filter_new(filter.group, filter.categories, filter.mask),
+    shapes,
+    capacity,
+  );
+  _readShapeHandles(shapes, total < capacity ? total : capacity, out);
+  ffi.malloc.free(shapes);
+  return total;
+}
+
+/// Set the render id of a shape, stored in its user data.
+/// @param shape The shape.
+/// @param renderId The render id, 0 to hide the shape from visibility queries.
+void cpShapeSetRenderId(int shape, int renderId) =>
+    bindings.cp_shape_set_render_id(ffi.Pointer.fromAddress(shape), renderId);
+
+/// Get the render id of a shape.
+/// @param shape The shape.
+/// @return The render id, 0 if none was set.
+int cpShapeGetRenderId(int shape) => bindings.cp_shape_get_render_id(ffi.Pointer.fromAddress(shape));
+
+/// Find the shapes with a render id whose bounding box intersects a viewport.
+/// @param space The space.
+/// @param viewport The viewport in world coordinates.
+/// @param filter The shape filter of the query.
+/// @param instances Filled with the body position x, position y and angle of each visible shape.
+/// @param renderIds Optionally filled with the render id of each visible shape.
+/// @param shapes Optionally filled with the handle of each visible shape.
+/// @return The total number of visible shapes, which may exceed the capacity of instances.
+int cpSpaceQueryVisible(
+  int space,
+  BoundingBox viewport,
+  ShapeFilter filter,
+  Float32List instances, {
+  Uint32List? renderIds,
+  List<int>? shapes,
+}) {
+  final capacity = instances.length ~/ 3;
+  final box = ffi.Struct.create<bindings.cpBB>()
+    ..l = viewport.left
+    ..b = viewport.bottom
+    ..r = viewport.right
+    ..t = viewport.top;
+  final shapesPtr = shapes == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpShape>>(capacity);
+  final count = bindings.cp_space_query_visible(
+    ffi.Pointer.fromAddress(space),
+    box,
+    bindings.cp_shape_filter_new(filter.group, filter.categories, filter.mask),
+    instances.address,
+    renderIds?.address ?? ffi.nullptr,
+    shapesPtr,
+    capacity,
+  );
+  if (shapes != null) {
+    _readShapeHandles(shapesPtr, count < capacity ? count : capacity, shapes);
+    ffi.malloc.free(shapesPtr);
+  }
+  return count;
+}
+
+/// Sweep a shape along a translation and find the first shape it touches.
+/// @param space The space.
+/// @param shape The cast shape, placed by its body's transform. It does not need to be added to the space.
+/// @param dx The x component of the translation.
+/// @param dy The y component of the translation.
+/// @param tolerance The gap below which the shapes are considered touching.
+/// @return The hit, or null if the shape can travel the whole translation.
+ShapeCastInfo? cpSpaceShapeCast(int space, int shape, double dx, double dy, double tolerance) {
+  final translation = ffi.Struct.create<bindings.cpVect>()
+    ..x = dx
+    ..y = dy;
+  final info = ffi.malloc<bindings.cpSegmentQueryInfo>();
+  final hit = bindings.cp_space_shape_cast(
+    ffi.Pointer.fromAddress(space),
+    ffi.Pointer.fromAddress(shape),
+    translation,
+    tolerance,
+    info,
+  );
+  final result = hit == ffi.nullptr
+      ? null
+      : ShapeCastInfo(
+          shapePtr: hit.address,
+          point: Vector(info.ref.point.x, info.ref.point.y),
+          normal: Vector(info.ref.normal.x, info.ref.normal.y),
+          alpha: info.ref.alpha,
+        );
+  ffi.malloc.free(info);
+  return result;
+}
+
+/// Allocate and initialize a space running Chipmunk's multi-threaded solver.
+/// Returns a pointer to the new space, a regular one where the solver is not available.
+int cpHastySpaceNew() => bindings.cp_hasty_space_new().address;
+
+/// Set the number of solver threads of a hasty space.
+/// @param space The space.
+/// @param threads The number of threads, or 0 for one per CPU.
+void cpHastySpaceSetThreads(int space, int threads) =>
+    bindings.cp_hasty_space_set_threads(ffi.Pointer.fromAddress(space), threads);
+
+/// Get the number of solver threads of a hasty space.
+/// @param space The space.
+/// @return The number of threads, 1 for a regular space.
+int cpHastySpaceGetThreads(int space) => bindings.cp_hasty_space_get_threads(ffi.Pointer.fromAddress(space));
+
+/// Step many spaces forward in time by dt, spread over the worker pool.
+/// @param spaces The spaces to step, each at most once.
+/// @param dt The time step.
+void cpSpaceStepMany(List<int> spaces, double dt) {
+  final handles = ffi.malloc<ffi.Pointer<bindings.cpSpace>>(spaces.length);
+  for (var i = 0; i < spaces.length; i++) {
+    handles[i] = ffi.Pointer.fromAddress(spaces[i]);
+  }
+  bindings.cp_space_step_many(handles, spaces.length, dt);
+  ffi.malloc.free(handles);
+}
+
+/// Start stepping the space forward in time by dt on a background thread.
+/// Waits for the previous asynchronous step first.
+/// @param space The space to step.
+/// @param dt The time step.
+void cpSpaceStepAsync(int space, double dt) => bindings.cp_space_step_async(ffi.Pointer.fromAddress(space), dt);
+
+/// Wait for the asynchronous step of the space to finish.
+/// @param space The space.
+void cpSpaceStepWait(int space) => bindings.cp_space_step_wait(ffi.Pointer.fromAddress(space));
+
+/// Check whether an asynchronous step of the space is still running.
+/// @param space The space.
+/// @return Non-zero while the step runs.
+int cpSpaceIsStepping(int space) => bindings.cp_space_is_stepping(ffi.Pointer.fromAddress(space));
+
+/// Read the body states published by the last asynchronous step, using the layout of cpSpaceExportTransformsF32.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also read the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the snapshot, which may exceed capacity.
+int cpSpaceReadSnapshotF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_read_snapshot_f32(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+/// Read the body states published by the last asynchronous step in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also read the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the snapshot, which may exceed capacity.
+int cpSpaceReadSnapshotF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_read_snapshot_f64(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    velocity ? bindings.CP_FFI_STATE_VELOCITY : 0,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+/// Add the frame time to the space's accumulator and run the fixed steps that fit in it.
+/// @param space The space.
+/// @param frameDt The time elapsed since the last frame.
+/// @param fixedDt The duration of each step.
+/// @param maxSubsteps The maximum number of steps to run, the time beyond them being dropped.
+/// @return The number of steps run.
+int cpSpaceAdvance(int space, double frameDt, double fixedDt, int maxSubsteps) =>
+    bindings.cp_space_advance(ffi.Pointer.fromAddress(space), frameDt, fixedDt, maxSubsteps);
+
+/// Get the fraction of a fixed step left in the space's accumulator.
+/// @param space The space.
+/// @return A value between 0 and 1.
+double cpSpaceGetInterpolationAlpha(int space) =>
+    bindings.cp_space_get_interpolation_alpha(ffi.Pointer.fromAddress(space));
+
+/// Export the position and angle of every body blended between the last two fixed steps.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportInterpolatedF32(int space, Float32List out, int capacity, {List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_export_interpolated_f32(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+/// Export the position and angle of every body blended between the last two fixed steps in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportInterpolatedF64(int space, Float64List out, int capacity, {List<int>? handles}) {
+  final bodies = handles == null ? ffi.nullptr : ffi.malloc<ffi.Pointer<bindings.cpBody>>(capacity);
+  final count = bindings.cp_space_export_interpolated_f64(
+    ffi.Pointer.fromAddress(space),
+    out.address,
+    capacity,
+    bodies,
+  );
+  if (handles != null) {
+    _readBodyHandles(bodies, count < capacity ? count : capacity, handles);
+    ffi.malloc.free(bodies);
+  }
+  return count;
+}
+
+/// Switch the spatial indexes of the space between bounding box trees and spatial hashes.
+/// @param space The space, which must not be locked.
+/// @param mode The CP_FFI_BROADPHASE_* mode.
+/// @param dim The cell size of a spatial hash, ignored by the other modes.
+/// @param count The cell count of a spatial hash, ignored by the other modes.
+void cpSpaceSetBroadphase(int space, int mode, double dim, int count) =>
+    bindings.cp_space_set_broadphase(ffi.Pointer.fromAddress(space), mode, dim, count);
+
+/// Get the broadphase mode requested for the space.
+/// @param space The space.
+/// @return The CP_FFI_BROADPHASE_* mode.
+int cpSpaceGetBroadphase(int space) => bindings.cp_space_get_broadphase(ffi.Pointer.fromAddress(space));
+
+/// Check whether the spatial indexes of the space currently are spatial hashes.
+/// @param space The space.
+/// @return Non-zero for spatial hashes.
+int cpSpaceUsesSpatialHash(int space) => bindings.cp_space_uses_spatial_hash(ffi.Pointer.fromAddress(space));
+
+/// Get the cell size of the spatial hash of the space.
+/// @param space The space.
+/// @return The cell size, or 0 without a spatial hash.
+double cpSpaceGetSpatialHashDim(int space) => bindings.cp_space_get_spatial_hash_dim(ffi.Pointer.fromAddress(space));
+
+/// Get the cell count of the spatial hash of the space.
+/// @param space The space.
+/// @return The cell count, or 0 without a spatial hash.
+int cpSpaceGetSpatialHashCount(int space) => bindings.cp_space_get_spatial_hash_count(ffi.Pointer.fromAddress(space));
+
+/// Check whether the library was built with the step profiler.
+/// @return Non-zero if it was.
+int cpFfiProfilingAvailable() => bindings.cp_ffi_profiling_available();
+
+/// Record the phase timings of the last steps of the space.
+/// @param space The space.
+/// @param history The number of steps to keep, or 0 to stop recording.
+void cpSpaceSetProfiling(int space, int history) =>
+    bindings.cp_space_set_profiling(ffi.Pointer.fromAddress(space), history);
+
+/// Get the number of steps whose timings are kept.
+/// @param space The space.
+/// @return The history length, or 0 when profiling is disabled.
+int cpSpaceGetProfiling(int space) => bindings.cp_space_get_profiling(ffi.Pointer.fromAddress(space));
+
+/// Read the phase timings of the last recorded steps, oldest first.
+/// @param space The space.
+/// @param capacity The maximum number of steps to read.
+/// @return CP_FFI_PROFILE_PHASES values in seconds per step.
+Float64List cpSpaceGetProfile(int space, int capacity) {
+  final out = ffi.malloc<ffi.Double>(capacity * bindings.CP_FFI_PROFILE_PHASES);
+  final count = bindings.cp_space_get_profile(ffi.Pointer.fromAddress(space), out, capacity);
+  final result = Float64List.fromList(out.asTypedList(count * bindings.CP_FFI_PROFILE_PHASES));
+  ffi.malloc.free(out);
+  return result;
+}
+
+/// Read the counters describing a space as left by its last step.
+/// @param space The space.
+/// @return CP_FFI_STATS values indexed by CP_FFI_STAT_*.
+Int32List cpSpaceGetStats(int space) {
+  final out = ffi.malloc<ffi.Int>(bindings.CP_FFI_STATS);
+  bindings.cp_space_get_stats(ffi.Pointer.fromAddress(space), out);
+  final result = Int32List.fromList([for (var i = 0; i < bindings.CP_FFI_STATS; i++) out[i]]);
+  ffi.malloc.free(out);
+  return result;
+}
+
+/// Start a new native trace, dropping the events of the previous one.
+/// @param eventsPerThread The number of events kept per thread.
+void cpFfiTraceStart(int eventsPerThread) => bindings.cp_ffi_trace_start(eventsPerThread);
+
+/// Stop recording the native trace.
+void cpFfiTraceStop() => bindings.cp_ffi_trace_stop();
+
+/// Check whether the native trace is recording.
+/// @return 1 while recording, 0 otherwise.
+int cpFfiTraceIsRecording() => bindings.cp_ffi_trace_is_recording();
+
+/// Write the events of the current or last native trace as Chrome trace JSON.
+/// @param path The path of the file to write.
+/// @return The number of events written, or -1 if the file cannot be opened.
+int cpFfiTraceWrite(String path) {
+  final pathPtr = path.toNativeUtf8();
+  final written = bindings.cp_ffi_trace_write(pathPtr.cast());
+  ffi.malloc.free(pathPtr);
+  return written;
+}
+
+/// Serialize the state of the space into a snapshot.
+/// @param space The space.
+/// @param out The buffer the snapshot is written to.
+/// @return The size of the snapshot, which is only complete in out when it is at most `out.length`, or 0 if
+/// the space is locked or stepping asynchronously.
+int cpSpaceSnapshot(int space, Uint8List out) =>
+    bindings.cp_space_snapshot(ffi.Pointer.fromAddress(space), out.address, out.length);
+
+/// Rewind the space to a snapshot taken with `cpSpaceSnapshot`.
+/// @param space The space.
+/// @param snapshot The snapshot.
+/// @return 1 if the space was restored, 0 if the snapshot is malformed or does not match the objects of the space.
+int cpSpaceRestore(int space, Uint8List snapshot) =>
+    bindings.cp_space_restore(ffi.Pointer.fromAddress(space), snapshot.address, snapshot.length);
+
+/// Serialize the changes of the space since a reference snapshot into a delta.
+/// @param space The space.
+/// @param reference The reference snapshot.
+/// @param out The buffer the delta is written to.
+/// @return The size of the delta, which is only complete in out when it is at most `out.length`, 0 if the space is
+/// locked or stepping asynchronously, or -1 if the reference is malformed.
+int cpSpaceSnapshotDelta(int space, Uint8List reference, Uint8List out) =>
+    bindings.cp_space_snapshot_delta(
+        ffi.Pointer.fromAddress(space), reference.address, reference.length, out.address, out.length);
+
+/// Rebuild the full snapshot described by a delta.
+/// @param reference The reference snapshot the delta was taken against.
+/// @param delta The delta.
+/// @param out The buffer the snapshot is written to.
+/// @return The size of the snapshot, which is only complete in out when it is at most `out.length`, or -1 if the
+/// delta is malformed or was taken against another reference.
+int cpFfiSnapshotApplyDelta(Uint8List reference, Uint8List delta, Uint8List out) =>
+    bindings.cp_ffi_snapshot_apply_delta(
+        reference.address, reference.length, delta.address, delta.length, out.address, out.length);
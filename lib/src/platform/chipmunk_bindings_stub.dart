@@ -1,7 +1,11 @@
 /// Stub implementation - throws if neither FFI nor JS interop is available.
 library;
 
+import 'dart:typed_data';
+
+import 'package:chipmunk2d_physics_ffi/src/arbiter.dart';
 import 'package:chipmunk2d_physics_ffi/src/bounding_box.dart';
+import 'package:chipmunk2d_physics_ffi/src/query_info.dart';
 import 'package:chipmunk2d_physics_ffi/src/shape.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
 
@@ -317,6 +321,11 @@ void cpBodySetTorque(int body, double torque) => _unsupported();
 /// @return A tuple of (x, y) rotation components.
 Vector cpBodyGetRotation(int body) => _unsupported();
 
+/// Get the space a body was added to.
+/// @param body The body.
+/// @return A pointer to the space, or 0 if the body is not in a space.
+int cpBodyGetSpace(int body) => _unsupported();
+
 /// Get the type of a body.
 /// @param body The body.
 /// @return The body type (0=dynamic, 1=kinematic, 2=static).
@@ -524,6 +533,11 @@ void cpShapeSetSensor(int shape, int sensor) => _unsupported();
 /// @return A pointer to the body.
 int cpShapeGetBody(int shape) => _unsupported();
 
+/// Get the space a shape was added to.
+/// @param shape The shape.
+/// @return A pointer to the space, or 0 if the shape is not in a space.
+int cpShapeGetSpace(int shape) => _unsupported();
+
 /// Set the body that a shape is attached to.
 /// @param shape The shape.
 /// @param body The body pointer (0 to detach).
@@ -673,6 +687,11 @@ void cpConstraintSetCollideBodies(int constraint, int collideBodies) => _unsuppo
 /// @return The impulse.
 double cpConstraintGetImpulse(int constraint) => _unsupported();
 
+/// Get the space a constraint was added to.
+/// @param constraint The constraint.
+/// @return A pointer to the space, or 0 if the constraint is not in a space.
+int cpConstraintGetSpace(int constraint) => _unsupported();
+
 /// Get the first body connected by a constraint.
 /// @param constraint The constraint.
 /// @return A pointer to the first body.
@@ -1186,3 +1205,545 @@ List<double> cpConvexHull(List<double> points, {double tolerance = 0.0}) => _uns
 /// @return The moment of inertia.
 double cpMomentForPoly(double mass, List<double> verts, double offsetX, double offsetY, double radius) =>
     _unsupported();
+
+/// Export the position, angle and optionally velocity of every body in the space.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportTransformsF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) =>
+    _unsupported();
+
+/// Export the position, angle and optionally velocity of every body in the space in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportTransformsF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) =>
+    _unsupported();
+
+/// Set the position, angle and optionally velocity of many bodies at once.
+/// Static and kinematic bodies have their shapes reindexed in the same pass.
+/// @param space The space.
+/// @param handles The bodies to update, one per row.
+/// @param state The structure-of-arrays buffer: column c of row i is read from `state[c * handles.length + i]`.
+/// @param velocity Whether to also import the linear and angular velocity columns.
+void cpSpaceImportStatesF32(int space, List<int> handles, Float32List state, {bool velocity = false}) =>
+    _unsupported();
+
+/// Set the position, angle and optionally velocity of many bodies at once from double precision values.
+/// Static and kinematic bodies have their shapes reindexed in the same pass.
+/// @param space The space.
+/// @param handles The bodies to update, one per row.
+/// @param state The structure-of-arrays buffer: column c of row i is read from `state[c * handles.length + i]`.
+/// @param velocity Whether to also import the linear and angular velocity columns.
+void cpSpaceImportStatesF64(int space, List<int> handles, Float64List state, {bool velocity = false}) =>
+    _unsupported();
+
+/// Enable or disable per-step change tracking.
+/// @param space The space.
+/// @param enabled Whether each step records the bodies that moved.
+/// @param epsilon The position/angle change below which a body is not reported.
+void cpSpaceSetChangeTracking(int space, {required bool enabled, double epsilon = 0.0}) => _unsupported();
+
+/// Get whether per-step change tracking is enabled.
+/// @param space The space.
+/// @return 1 if enabled, 0 otherwise.
+int cpSpaceGetChangeTracking(int space) => _unsupported();
+
+/// Get the number of bodies that moved during the last step.
+/// @param space The space.
+/// @return The number of changed bodies.
+int cpSpaceGetChangedBodyCount(int space) => _unsupported();
+
+/// Export the bodies that moved during the last step, using the layout of cpSpaceExportTransformsF32.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of changed bodies, which may exceed capacity.
+int cpSpaceExportChangedF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) =>
+    _unsupported();
+
+/// Export the bodies that moved during the last step in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of changed bodies, which may exceed capacity.
+int cpSpaceExportChangedF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) =>
+    _unsupported();
+
+/// Create dynamic bodies with one circle shape each and add them to the space.
+/// Attribute lists hold one value per object, or a single value shared by every object.
+/// @param space The space.
+/// @param positions The flattened list of body positions [x1, y1, x2, y2, ...].
+/// @param radii The circle radii.
+/// @param masses The body masses, 1 by default.
+/// @param moments The body moments of inertia, computed from the shape by default.
+/// @param frictions The shape friction coefficients, 0 by default.
+/// @param elasticities The shape elasticities, 0 by default.
+/// @param filters The shape collision filters, colliding with everything by default.
+/// @param collisionTypes The shape collision types, 0 by default.
+/// @return The handles of the created bodies and shapes, empty if the space is locked.
+({List<int> bodies, List<int> shapes}) cpSpaceSpawnCircles(
+  int space,
+  List<double> positions,
+  List<double> radii, {
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+}) => _unsupported();
+
+/// Create dynamic bodies with one box shape each and add them to the space.
+/// Attribute lists hold one value per object, or a single value shared by every object.
+/// @param space The space.
+/// @param positions The flattened list of body positions [x1, y1, x2, y2, ...].
+/// @param sizes The flattened list of box sizes [width1, height1, width2, height2, ...].
+/// @param radius The corner radius shared by every box.
+/// @param masses The body masses, 1 by default.
+/// @param moments The body moments of inertia, computed from the shape by default.
+/// @param frictions The shape friction coefficients, 0 by default.
+/// @param elasticities The shape elasticities, 0 by default.
+/// @param filters The shape collision filters, colliding with everything by default.
+/// @param collisionTypes The shape collision types, 0 by default.
+/// @return The handles of the created bodies and shapes, empty if the space is locked.
+({List<int> bodies, List<int> shapes}) cpSpaceSpawnBoxes(
+  int space,
+  List<double> positions,
+  List<double> sizes,
+  double radius, {
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+}) => _unsupported();
+
+/// Remove objects from the space and free them in a single call.
+/// Objects that are in no space are only freed, objects of another space are ignored.
+/// @param space The space.
+/// @param constraints The constraints to remove and free.
+/// @param shapes The shapes to remove and free.
+/// @param bodies The bodies to remove and free.
+/// @return true if the objects were freed immediately, false if the space is locked and the work was
+/// deferred until the end of the current step.
+bool cpSpaceDespawn(
+  int space, {
+  List<int> constraints = const [],
+  List<int> shapes = const [],
+  List<int> bodies = const [],
+}) => _unsupported();
+
+/// Execute a command buffer against the space in a single call.
+/// @param space The space.
+/// @param commands The encoded commands, see `CommandBuffer` for the format.
+/// @return The number of commands executed, which is smaller than the number of encoded commands
+/// only if the buffer is malformed.
+int cpSpaceExecuteCommands(int space, Uint8List commands) => _unsupported();
+
+/// Queue collision events for a pair of collision types.
+/// @param space The space.
+/// @param typeA The first collision type.
+/// @param typeB The second collision type.
+/// @param events The `CP_FFI_COLLISION_*` bits of the callbacks that queue an event, 0 to stop queuing.
+void cpSpaceSetCollisionEvents(int space, int typeA, int typeB, int events) => _unsupported();
+
+/// Set the number of collision events queued before new ones are dropped.
+/// @param space The space.
+/// @param capacity The capacity of the event buffer.
+void cpSpaceSetCollisionEventCapacity(int space, int capacity) => _unsupported();
+
+/// Get the number of queued collision events.
+/// @param space The space.
+/// @return The number of events waiting to be drained.
+int cpSpaceGetCollisionEventCount(int space) => _unsupported();
+
+/// Get the number of collision events dropped because the buffer was full since it was last emptied.
+/// @param space The space.
+/// @return The number of dropped events.
+int cpSpaceGetDroppedCollisionEvents(int space) => _unsupported();
+
+/// Move queued collision events, oldest first, into out.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param shapes Filled with the handles of the two shapes of each drained event, interleaved.
+/// @param capacity The number of rows in each column of out.
+/// @return The number of drained events.
+int cpSpaceDrainCollisionEvents(int space, Float64List out, List<int> shapes, int capacity) => _unsupported();
+
+/// Start or stop tracking the shapes overlapping a shape, usually a sensor.
+/// @param space The space.
+/// @param shape The tracked shape.
+/// @param enabled Whether enter and exit events are queued for the shape after each step.
+void cpSpaceSetSensorTracking(int space, int shape, {required bool enabled}) => _unsupported();
+
+/// Get the number of queued sensor events.
+/// @param space The space.
+/// @return The number of events waiting to be drained.
+int cpSpaceGetSensorEventCount(int space) => _unsupported();
+
+/// Move queued sensor events, oldest first, into types and shapes.
+/// @param space The space.
+/// @param types Filled with the `CP_FFI_SENSOR_*` type of each drained event.
+/// @param shapes Filled with the handles of the tracked shape and the other shape of each event, interleaved.
+/// @param capacity The maximum number of events to drain.
+/// @return The number of drained events.
+int cpSpaceDrainSensorEvents(int space, List<int> types, List<int> shapes, int capacity) => _unsupported();
+
+/// Get the shapes overlapping a tracked shape at the end of the last step.
+/// @param space The space.
+/// @param sensor The tracked shape.
+/// @param shapes Filled with the handles of the overlapping shapes.
+void cpSpaceGetSensorOverlaps(int space, int sensor, List<int> shapes) => _unsupported();
+
+/// Set the native collision rules of a pair of collision types.
+/// @param space The space.
+/// @param typeA The first collision type.
+/// @param typeB The second collision type.
+/// @param rules The `CP_FFI_RULE_*` bits of the rules to apply, 0 to remove them.
+/// @param oneWayX The x component of the direction the pair collides along with `CP_FFI_RULE_ONE_WAY`.
+/// @param oneWayY The y component of the direction the pair collides along with `CP_FFI_RULE_ONE_WAY`.
+void cpSpaceSetCollisionRule(int space, int typeA, int typeB, int rules, double oneWayX, double oneWayY) =>
+    _unsupported();
+
+/// Find the shapes overlapping a shape.
+/// @param space The space.
+/// @param shape The shape to test, which does not need to be added to the space.
+/// @param capacity The maximum number of results to read.
+/// @param shapes Filled with the handles of up to capacity overlapping shapes.
+/// @param sets Filled with the contact point set of each shape in shapes.
+/// @return The total number of overlapping shapes, which may exceed capacity.
+int cpSpaceShapeQuery(int space, int shape, int capacity, List<int> shapes, List<ContactPointSet> sets) =>
+    _unsupported();
+
+/// Set the number of native worker threads running large batches alongside the calling thread.
+/// @param count The number of workers, 0 to run batches on the calling thread only, or a negative value to
+/// restore the default of one worker per CPU beyond the first.
+void cpFfiSetWorkerThreadCount(int count) => _unsupported();
+
+/// Get the number of native worker threads, always 0 when threads are not supported.
+/// @return The number of workers.
+int cpFfiGetWorkerThreadCount() => _unsupported();
+
+/// Run many first-hit segment queries in one call.
+/// @param space The space.
+/// @param segments Five values per segment: start x, start y, end x, end y and radius.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param hits Filled with five values per segment: hit point x, point y, normal x, normal y and alpha.
+/// @param shapes Filled with the handle of the first shape hit by each segment, or 0 on a miss.
+/// @return The number of segments that hit a shape.
+int cpSpaceSegmentQueryFirstBatch(
+  int space,
+  Float64List segments,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) => _unsupported();
+
+/// Run many nearest point queries in one call.
+/// @param space The space.
+/// @param points Three values per query: x, y and maximum distance.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param hits Filled with five values per query: nearest point x, point y, distance, gradient x and gradient y.
+/// @param shapes Filled with the handle of the nearest shape of each query, or 0 if none is within range.
+/// @return The number of queries with a shape in range.
+int cpSpacePointQueryNearestBatch(
+  int space,
+  Float64List points,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) => _unsupported();
+
+/// Run many bounding box queries in one call.
+/// @param space The space.
+/// @param bbs Four values per query: left, bottom, right and top.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param capacity The maximum number of shapes reported per query.
+/// @param shapes Filled with capacity handles per query, the shapes overlapping the box followed by zeros.
+/// @param counts Filled with the total number of shapes overlapping each box, which may exceed capacity.
+void cpSpaceBBQueryBatch(
+  int space,
+  Float64List bbs,
+  List<ShapeFilter> filters,
+  int capacity,
+  List<int> shapes,
+  List<int> counts,
+) => _unsupported();
+
+/// Find every shape within a distance of a point.
+/// @param space The space.
+/// @param x The x coordinate of the point.
+/// @param y The y coordinate of the point.
+/// @param maxDistance The maximum distance from the point to a shape's surface.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the nearest capacity results, sorted by distance.
+/// @return The total number of shapes in range, which may exceed capacity.
+int cpSpacePointQuery(
+  int space,
+  double x,
+  double y,
+  double maxDistance,
+  ShapeFilter filter,
+  int capacity,
+  List<PointQueryInfo> out,
+) => _unsupported();
+
+/// Find every shape along a segment.
+/// @param space The space.
+/// @param startX The x coordinate of the segment start.
+/// @param startY The y coordinate of the segment start.
+/// @param endX The x coordinate of the segment end.
+/// @param endY The y coordinate of the segment end.
+/// @param radius The radius of the segment.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the first capacity results along the segment, sorted by alpha.
+/// @return The total number of shapes hit, which may exceed capacity.
+int cpSpaceSegmentQuery(
+  int space,
+  double startX,
+  double startY,
+  double endX,
+  double endY,
+  double radius,
+  ShapeFilter filter,
+  int capacity,
+  List<SegmentQueryInfo> out,
+) => _unsupported();
+
+/// Find every shape whose bounding box overlaps a bounding box.
+/// @param space The space.
+/// @param bb The bounding box.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the handles of up to capacity overlapping shapes.
+/// @return The total number of overlapping shapes, which may exceed capacity.
+int cpSpaceBBQuery(int space, BoundingBox bb, ShapeFilter filter, int capacity, List<int> out) => _unsupported();
+
+/// Set the render id of a shape, stored in its user data.
+/// @param shape The shape.
+/// @param renderId The render id, 0 to hide the shape from visibility queries.
+void cpShapeSetRenderId(int shape, int renderId) => _unsupported();
+
+/// Get the render id of a shape.
+/// @param shape The shape.
+/// @return The render id, 0 if none was set.
+int cpShapeGetRenderId(int shape) => _unsupported();
+
+/// Find the shapes with a render id whose bounding box intersects a viewport.
+/// @param space The space.
+/// @param viewport The viewport in world coordinates.
+/// @param filter The shape filter of the query.
+/// @param instances Filled with the body position x, position y and angle of each visible shape.
+/// @param renderIds Optionally filled with the render id of each visible shape.
+/// @param shapes Optionally filled with the handle of each visible shape.
+/// @return The total number of visible shapes, which may exceed the capacity of instances.
+int cpSpaceQueryVisible(
+  int space,
+  BoundingBox viewport,
+  ShapeFilter filter,
+  Float32List instances, {
+  Uint32List? renderIds,
+  List<int>? shapes,
+}) => _unsupported();
+
+/// Sweep a shape along a translation and find the first shape it touches.
+/// @param space The space.
+/// @param shape The cast shape, placed by its body's transform. It does not need to be added to the space.
+/// @param dx The x component of the translation.
+/// @param dy The y component of the translation.
+/// @param tolerance The gap below which the shapes are considered touching.
+/// @return The hit, or null if the shape can travel the whole translation.
+ShapeCastInfo? cpSpaceShapeCast(int space, int shape, double dx, double dy, double tolerance) => _unsupported();
+
+/// Creates a new physics space running Chipmunk's multi-threaded solver.
+/// @return A pointer to the newly created cpSpace.
+int cpHastySpaceNew() => _unsupported();
+
+/// Set the number of solver threads of a hasty space.
+/// @param space The space.
+/// @param threads The number of threads, or 0 for one per CPU.
+void cpHastySpaceSetThreads(int space, int threads) => _unsupported();
+
+/// Get the number of solver threads of a hasty space.
+/// @param space The space.
+/// @return The number of threads, 1 for a regular space.
+int cpHastySpaceGetThreads(int space) => _unsupported();
+
+/// Step many spaces forward in time by dt, spread over the worker pool.
+/// @param spaces The spaces to step, each at most once.
+/// @param dt The time step.
+void cpSpaceStepMany(List<int> spaces, double dt) => _unsupported();
+
+/// Start stepping the space forward in time by dt on a background thread.
+/// @param space The space to step.
+/// @param dt The time step.
+void cpSpaceStepAsync(int space, double dt) => _unsupported();
+
+/// Wait for the asynchronous step of the space to finish.
+/// @param space The space.
+void cpSpaceStepWait(int space) => _unsupported();
+
+/// Check whether an asynchronous step of the space is still running.
+/// @param space The space.
+/// @return Non-zero while the step runs.
+int cpSpaceIsStepping(int space) => _unsupported();
+
+/// Read the body states published by the last asynchronous step.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also read the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the snapshot, which may exceed capacity.
+int cpSpaceReadSnapshotF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) =>
+    _unsupported();
+
+/// Read the body states published by the last asynchronous step in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also read the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the snapshot, which may exceed capacity.
+int cpSpaceReadSnapshotF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) =>
+    _unsupported();
+
+/// Add the frame time to the space's accumulator and run the fixed steps that fit in it.
+/// @param space The space.
+/// @param frameDt The time elapsed since the last frame.
+/// @param fixedDt The duration of each step.
+/// @param maxSubsteps The maximum number of steps to run, the time beyond them being dropped.
+/// @return The number of steps run.
+int cpSpaceAdvance(int space, double frameDt, double fixedDt, int maxSubsteps) => _unsupported();
+
+/// Get the fraction of a fixed step left in the space's accumulator.
+/// @param space The space.
+/// @return A value between 0 and 1.
+double cpSpaceGetInterpolationAlpha(int space) => _unsupported();
+
+/// Export the position and angle of every body blended between the last two fixed steps.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportInterpolatedF32(int space, Float32List out, int capacity, {List<int>? handles}) => _unsupported();
+
+/// Export the position and angle of every body blended between the last two fixed steps in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportInterpolatedF64(int space, Float64List out, int capacity, {List<int>? handles}) => _unsupported();
+
+/// Switch the spatial indexes of the space between bounding box trees and spatial hashes.
+/// @param space The space, which must not be locked.
+/// @param mode The CP_FFI_BROADPHASE_* mode.
+/// @param dim The cell size of a spatial hash, ignored by the other modes.
+/// @param count The cell count of a spatial hash, ignored by the other modes.
+void cpSpaceSetBroadphase(int space, int mode, double dim, int count) => _unsupported();
+
+/// Get the broadphase mode requested for the space.
+/// @param space The space.
+/// @return The CP_FFI_BROADPHASE_* mode.
+int cpSpaceGetBroadphase(int space) => _unsupported();
+
+/// Check whether the spatial indexes of the space currently are spatial hashes.
+/// @param space The space.
+/// @return Non-zero for spatial hashes.
+int cpSpaceUsesSpatialHash(int space) => _unsupported();
+
+/// Get the cell size of the spatial hash of the space.
+/// @param space The space.
+/// @return The cell size, or 0 without a spatial hash.
+double cpSpaceGetSpatialHashDim(int space) => _unsupported();
+
+/// Get the cell count of the spatial hash of the space.
+/// @param space The space.
+/// @return The cell count, or 0 without a spatial hash.
+int cpSpaceGetSpatialHashCount(int space) => _unsupported();
+
+/// Check whether the library was built with the step profiler.
+/// @return Non-zero if it was.
+int cpFfiProfilingAvailable() => _unsupported();
+
+/// Record the phase timings of the last steps of the space.
+/// @param space The space.
+/// @param history The number of steps to keep, or 0 to stop recording.
+void cpSpaceSetProfiling(int space, int history) => _unsupported();
+
+/// Get the number of steps whose timings are kept.
+/// @param space The space.
+/// @return The history length, or 0 when profiling is disabled.
+int cpSpaceGetProfiling(int space) => _unsupported();
+
+/// Read the phase timings of the last recorded steps, oldest first.
+/// @param space The space.
+/// @param capacity The maximum number of steps to read.
+/// @return CP_FFI_PROFILE_PHASES values in seconds per step.
+Float64List cpSpaceGetProfile(int space, int capacity) => _unsupported();
+
+/// Read the counters describing a space as left by its last step.
+/// @param space The space.
+/// @return CP_FFI_STATS values indexed by CP_FFI_STAT_*.
+Int32List cpSpaceGetStats(int space) => _unsupported();
+
+/// Start a new native trace, dropping the events of the previous one.
+/// @param eventsPerThread The number of events kept per thread.
+void cpFfiTraceStart(int eventsPerThread) => _unsupported();
+
+/// Stop recording the native trace.
+void cpFfiTraceStop() => _unsupported();
+
+/// Check whether the native trace is recording.
+/// @return 1 while recording, 0 otherwise.
+int cpFfiTraceIsRecording() => _unsupported();
+
+/// Write the events of the current or last native trace as Chrome trace JSON.
+/// @param path The path of the file to write.
+/// @return The number of events written, or -1 if the file cannot be opened.
+int cpFfiTraceWrite(String path) => _unsupported();
+
+/// Serialize the state of the space into a snapshot.
+/// @param space The space.
+/// @param out The buffer the snapshot is written to.
+/// @return The size of the snapshot, which is only complete in out when it is at most `out.length`, or 0 if
+/// the space is locked or stepping asynchronously.
+int cpSpaceSnapshot(int space, Uint8List out) => _unsupported();
+
+/// Rewind the space to a snapshot taken with `cpSpaceSnapshot`.
+/// @param space The space.
+/// @param snapshot The snapshot.
+/// @return 1 if the space was restored, 0 if the snapshot is malformed or does not match the objects of the space.
+int cpSpaceRestore(int space, Uint8List snapshot) => _unsupported();
+
+/// Serialize the changes of the space since a reference snapshot into a delta.
+/// @param space The space.
+/// @param reference The reference snapshot.
+/// @param out The buffer the delta is written to.
+/// @return The size of the delta, which is only complete in out when it is at most `out.length`, 0 if the space is
+/// locked or stepping asynchronously, or -1 if the reference is malformed.
+int cpSpaceSnapshotDelta(int space, Uint8List reference, Uint8List out) => _unsupported();
+
+/// Rebuild the full snapshot described by a delta.
+/// @param reference The reference snapshot the delta was taken against.
+/// @param delta The delta.
+/// @param out The buffer the snapshot is written to.
+/// @return The size of the snapshot, which is only complete in out when it is at most `out.length`, or -1 if the
+/// delta is malformed or was taken against another reference.
+int cpFfiSnapshotApplyDelta(Uint8List reference, Uint8List delta, Uint8List out) => _unsupported();
@@ -7,8 +7,11 @@ library;
 import 'dart:async';
 import 'dart:js_interop';
 import 'dart:js_interop_unsafe' as js_util;
+import 'dart:typed_data';
 
+import 'package:chipmunk2d_physics_ffi/src/arbiter.dart';
 import 'package:chipmunk2d_physics_ffi/src/bounding_box.dart';
+import 'package:chipmunk2d_physics_ffi/src/query_info.dart';
 import 'package:chipmunk2d_physics_ffi/src/shape.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
 import 'package:web/web.dart' as web;
@@ -283,6 +286,28 @@ Vector _readVect(int ptr) {
   return Vector(_getDouble(ptr), _getDouble(ptr + 8));
 }
 
+/// Creates a typed array view (e.g. `Float32Array`) over [length] elements of the WASM heap at [ptr].
+///
+/// The view must not be kept across native calls: the heap buffer is replaced when memory grows.
+JSObject _heapView(String arrayType, int ptr, int length) {
+  final buffer = _wasmMemory.getProperty('buffer'.toJS) as JSObject?;
+  if (buffer == null) {
+    throw StateError('WASM memory buffer not available');
+  }
+  final constructor = web.window.getProperty(arrayType.toJS) as JSFunction?;
+  if (constructor == null) {
+    throw StateError('$arrayType constructor not available');
+  }
+  final array = constructor.callAsConstructor(buffer, ptr.toJS, length.toJS) as JSObject?;
+  if (array == null) {
+    throw StateError('Failed to create $arrayType view');
+  }
+  return array;
+}
+
+/// Mirrors `CP_FFI_STATE_VELOCITY` from `chipmunk2d_physics_ffi.h`.
+const _stateVelocity = 1;
+
 
 /// Creates a new physics space.
 int cpSpaceNew() {
@@ -637,6 +662,11 @@ Vector cpBodyGetRotation(int body) {
   return result;
 }
 
+/// Get the space a body was added to.
+/// @param body The body.
+/// @return A pointer to the space, or 0 if the body is not in a space.
+int cpBodyGetSpace(int body) => _callInt('_cp_body_get_space', [body.toJS]);
+
 /// Get the type of a body.
 /// @param body The body.
 /// @return The body type (0=dynamic, 1=kinematic, 2=static).
@@ -985,6 +1015,11 @@ void cpShapeSetSensor(int shape, int sensor) => _callVoid('_cp_shape_set_sensor'
 /// @return A pointer to the body.
 int cpShapeGetBody(int shape) => _callInt('_cp_shape_get_body', [shape.toJS]);
 
+/// Get the space a shape was added to.
+/// @param shape The shape.
+/// @return A pointer to the space, or 0 if the shape is not in a space.
+int cpShapeGetSpace(int shape) => _callInt('_cp_shape_get_space', [shape.toJS]);
+
 /// Set the body that a shape is attached to.
 /// @param shape The shape.
 /// @param body The body pointer (0 to detach).
@@ -1207,6 +1242,11 @@ void cpConstraintSetCollideBodies(int constraint, int collideBodies) =>
 /// @return The impulse.
 double cpConstraintGetImpulse(int constraint) => _callDouble('_cp_constraint_get_impulse', [constraint.toJS]);
 
+/// Get the space a constraint was added to.
+/// @param constraint The constraint.
+/// @return A pointer to the space, or 0 if the constraint is not in a space.
+int cpConstraintGetSpace(int constraint) => _callInt('_cp_constraint_get_space', [constraint.toJS]);
+
 /// Get the first body connected by a constraint.
 /// @param constraint The constraint.
 /// @return A pointer to the first body.
@@ -2068,3 +2108,1199 @@ List<double> cpConvexHull(List<double> points, {double tolerance = 0.0}) {
   _free(resultPtr);
   return result;
 }
+
+void _readHandles(int ptr, int count, List<int> handles) {
+  handles.clear();
+  if (count > 0) {
+    // wasm32 pointers are 4 bytes.
+    handles.addAll((_heapView('Uint32Array', ptr, count) as JSUint32Array).toDart);
+  }
+}
+
+/// Export the position, angle and optionally velocity of every body in the space.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportTransformsF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final length = capacity * (velocity ? 6 : 3);
+  final outPtr = _malloc(length * 4);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt(
+    '_cp_space_export_transforms_f32',
+    [space.toJS, outPtr.toJS, capacity.toJS, (velocity ? _stateVelocity : 0).toJS, bodies.toJS],
+  );
+  out.setRange(0, length, (_heapView('Float32Array', outPtr, length) as JSFloat32Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+/// Export the position, angle and optionally velocity of every body in the space in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportTransformsF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final length = capacity * (velocity ? 6 : 3);
+  final outPtr = _malloc(length * 8);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt(
+    '_cp_space_export_transforms_f64',
+    [space.toJS, outPtr.toJS, capacity.toJS, (velocity ? _stateVelocity : 0).toJS, bodies.toJS],
+  );
+  out.setRange(0, length, (_heapView('Float64Array', outPtr, length) as JSFloat64Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+int _allocBodyHandles(List<int> handles) {
+  // wasm32 pointers are 4 bytes.
+  final bodies = _malloc(handles.length * 4);
+  if (handles.isNotEmpty) {
+    _heapView('Uint32Array', bodies, handles.length).callMethod('set'.toJS, Uint32List.fromList(handles).toJS);
+  }
+  return bodies;
+}
+
+/// Set the position, angle and optionally velocity of many bodies at once.
+/// Static and kinematic bodies have their shapes reindexed in the same pass.
+/// @param space The space.
+/// @param handles The bodies to update, one per row.
+/// @param state The structure-of-arrays buffer: column c of row i is read from `state[c * handles.length + i]`.
+/// @param velocity Whether to also import the linear and angular velocity columns.
+void cpSpaceImportStatesF32(int space, List<int> handles, Float32List state, {bool velocity = false}) {
+  final bodies = _allocBodyHandles(handles);
+  final statePtr = _malloc(state.length * 4);
+  _heapView('Float32Array', statePtr, state.length).callMethod('set'.toJS, state.toJS);
+  _callVoid(
+    '_cp_space_import_states_f32',
+    [space.toJS, bodies.toJS, statePtr.toJS, handles.length.toJS, (velocity ? _stateVelocity : 0).toJS],
+  );
+  _free(statePtr);
+  _free(bodies);
+}
+
+/// Set the position, angle and optionally velocity of many bodies at once from double precision values.
+/// Static and kinematic bodies have their shapes reindexed in the same pass.
+/// @param space The space.
+/// @param handles The bodies to update, one per row.
+/// @param state The structure-of-arrays buffer: column c of row i is read from `state[c * handles.length + i]`.
+/// @param velocity Whether to also import the linear and angular velocity columns.
+void cpSpaceImportStatesF64(int space, List<int> handles, Float64List state, {bool velocity = false}) {
+  final bodies = _allocBodyHandles(handles);
+  final statePtr = _malloc(state.length * 8);
+  _heapView('Float64Array', statePtr, state.length).callMethod('set'.toJS, state.toJS);
+  _callVoid(
+    '_cp_space_import_states_f64',
+    [space.toJS, bodies.toJS, statePtr.toJS, handles.length.toJS, (velocity ? _stateVelocity : 0).toJS],
+  );
+  _free(statePtr);
+  _free(bodies);
+}
+
+/// Enable or disable per-step change tracking.
+/// @param space The space.
+/// @param enabled Whether each step records the bodies that moved.
+/// @param epsilon The position/angle change below which a body is not reported.
+void cpSpaceSetChangeTracking(int space, {required bool enabled, double epsilon = 0.0}) =>
+    _callVoid('_cp_space_set_change_tracking', [space.toJS, (enabled ? 1 : 0).toJS, epsilon.toJS]);
+
+/// Get whether per-step change tracking is enabled.
+/// @param space The space.
+/// @return 1 if enabled, 0 otherwise.
+int cpSpaceGetChangeTracking(int space) => _callInt('_cp_space_get_change_tracking', [space.toJS]);
+
+/// Get the number of bodies that moved during the last step.
+/// @param space The space.
+/// @return The number of changed bodies.
+int cpSpaceGetChangedBodyCount(int space) => _callInt('_cp_space_get_changed_body_count', [space.toJS]);
+
+/// Export the bodies that moved during the last step, using the layout of cpSpaceExportTransformsF32.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of changed bodies, which may exceed capacity.
+int cpSpaceExportChangedF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final length = capacity * (velocity ? 6 : 3);
+  final outPtr = _malloc(length * 4);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt(
+    '_cp_space_export_changed_f32',
+    [space.toJS, outPtr.toJS, capacity.toJS, (velocity ? _stateVelocity : 0).toJS, bodies.toJS],
+  );
+  out.setRange(0, length, (_heapView('Float32Array', outPtr, length) as JSFloat32Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+/// Export the bodies that moved during the last step in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also export the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of changed bodies, which may exceed capacity.
+int cpSpaceExportChangedF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final length = capacity * (velocity ? 6 : 3);
+  final outPtr = _malloc(length * 8);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt(
+    '_cp_space_export_changed_f64',
+    [space.toJS, outPtr.toJS, capacity.toJS, (velocity ? _stateVelocity : 0).toJS, bodies.toJS],
+  );
+  out.setRange(0, length, (_heapView('Float64Array', outPtr, length) as JSFloat64Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+int _allocDoubles(List<double>? values) {
+  if (values == null) {
+    return 0;
+  }
+  final ptr = _malloc(values.length * 8);
+  if (values.isNotEmpty) {
+    _heapView('Float64Array', ptr, values.length).callMethod('set'.toJS, Float64List.fromList(values).toJS);
+  }
+  return ptr;
+}
+
+int _allocUint32s(List<int>? values) {
+  if (values == null) {
+    return 0;
+  }
+  final ptr = _malloc(values.length * 4);
+  if (values.isNotEmpty) {
+    _heapView('Uint32Array', ptr, values.length).callMethod('set'.toJS, Uint32List.fromList(values).toJS);
+  }
+  return ptr;
+}
+
+/// Builds the CP_FFI_SPAWN_UNIFORM_* flags: the size comes first, then the attributes in flag order.
+int _spawnUniformFlags(int sizeCount, List<int?> attributeCounts) {
+  var uniform = sizeCount == 1 ? 1 : 0;
+  for (var i = 0; i < attributeCounts.length; i++) {
+    if (attributeCounts[i] == 1) {
+      uniform |= 2 << i;
+    }
+  }
+  return uniform;
+}
+
+/// Copies the optional spawn attributes to the WASM heap, in the argument order of the spawn functions.
+List<int> _allocSpawnAttributes(
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+) {
+  return [
+    _allocDoubles(masses),
+    _allocDoubles(moments),
+    _allocDoubles(frictions),
+    _allocDoubles(elasticities),
+    // cpShapeFilter is {group, categories, mask} with 4-byte fields on wasm32.
+    _allocUint32s(filters == null ? null : [for (final f in filters) ...[f.group, f.categories, f.mask]]),
+    _allocUint32s(collisionTypes),
+  ];
+}
+
+({List<int> bodies, List<int> shapes}) _spawn(
+  String name,
+  List<JSAny?> leadingArgs,
+  List<int> attributes,
+  int uniform,
+  int count,
+) {
+  final bodies = _malloc(count * 4);
+  final shapes = _malloc(count * 4);
+  final spawned = _callInt(name, [
+    ...leadingArgs,
+    for (final ptr in attributes) ptr.toJS,
+    uniform.toJS,
+    bodies.toJS,
+    shapes.toJS,
+  ]);
+  final result = (bodies: <int>[], shapes: <int>[]);
+  _readHandles(bodies, spawned, result.bodies);
+  _readHandles(shapes, spawned, result.shapes);
+  for (final ptr in attributes) {
+    if (ptr != 0) {
+      _free(ptr);
+    }
+  }
+  _free(bodies);
+  _free(shapes);
+  return result;
+}
+
+/// Create dynamic bodies with one circle shape each and add them to the space.
+/// Attribute lists hold one value per object, or a single value shared by every object.
+/// @param space The space.
+/// @param positions The flattened list of body positions [x1, y1, x2, y2, ...].
+/// @param radii The circle radii.
+/// @param masses The body masses, 1 by default.
+/// @param moments The body moments of inertia, computed from the shape by default.
+/// @param frictions The shape friction coefficients, 0 by default.
+/// @param elasticities The shape elasticities, 0 by default.
+/// @param filters The shape collision filters, colliding with everything by default.
+/// @param collisionTypes The shape collision types, 0 by default.
+/// @return The handles of the created bodies and shapes, empty if the space is locked.
+({List<int> bodies, List<int> shapes}) cpSpaceSpawnCircles(
+  int space,
+  List<double> positions,
+  List<double> radii, {
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+}) {
+  final count = positions.length ~/ 2;
+  final uniform = _spawnUniformFlags(radii.length, [
+    masses?.length,
+    moments?.length,
+    frictions?.length,
+    elasticities?.length,
+    filters?.length,
+    collisionTypes?.length,
+  ]);
+  final positionsPtr = _allocDoubles(positions);
+  final radiiPtr = _allocDoubles(radii);
+  final result = _spawn(
+    '_cp_space_spawn_circles',
+    [space.toJS, count.toJS, positionsPtr.toJS, radiiPtr.toJS],
+    _allocSpawnAttributes(masses, moments, frictions, elasticities, filters, collisionTypes),
+    uniform,
+    count,
+  );
+  _free(positionsPtr);
+  _free(radiiPtr);
+  return result;
+}
+
+/// Create dynamic bodies with one box shape each and add them to the space.
+/// Attribute lists hold one value per object, or a single value shared by every object.
+/// @param space The space.
+/// @param positions The flattened list of body positions [x1, y1, x2, y2, ...].
+/// @param sizes The flattened list of box sizes [width1, height1, width2, height2, ...].
+/// @param radius The corner radius shared by every box.
+/// @param masses The body masses, 1 by default.
+/// @param moments The body moments of inertia, computed from the shape by default.
+/// @param frictions The shape friction coefficients, 0 by default.
+/// @param elasticities The shape elasticities, 0 by default.
+/// @param filters The shape collision filters, colliding with everything by default.
+/// @param collisionTypes The shape collision types, 0 by default.
+/// @return The handles of the created bodies and shapes, empty if the space is locked.
+({List<int> bodies, List<int> shapes}) cpSpaceSpawnBoxes(
+  int space,
+  List<double> positions,
+  List<double> sizes,
+  double radius, {
+  List<double>? masses,
+  List<double>? moments,
+  List<double>? frictions,
+  List<double>? elasticities,
+  List<ShapeFilter>? filters,
+  List<int>? collisionTypes,
+}) {
+  final count = positions.length ~/ 2;
+  final uniform = _spawnUniformFlags(sizes.length ~/ 2, [
+    masses?.length,
+    moments?.length,
+    frictions?.length,
+    elasticities?.length,
+    filters?.length,
+    collisionTypes?.length,
+  ]);
+  final positionsPtr = _allocDoubles(positions);
+  final sizesPtr = _allocDoubles(sizes);
+  final result = _spawn(
+    '_cp_space_spawn_boxes',
+    [space.toJS, count.toJS, positionsPtr.toJS, sizesPtr.toJS, radius.toJS],
+    _allocSpawnAttributes(masses, moments, frictions, elasticities, filters, collisionTypes),
+    uniform,
+    count,
+  );
+  _free(positionsPtr);
+  _free(sizesPtr);
+  return result;
+}
+
+/// Remove objects from the space and free them in a single call.
+/// Objects that are in no space are only freed, objects of another space are ignored.
+/// @param space The space.
+/// @param constraints The constraints to remove and free.
+/// @param shapes The shapes to remove and free.
+/// @param bodies The bodies to remove and free.
+/// @return true if the objects were freed immediately, false if the space is locked and the work was
+/// deferred until the end of the current step.
+bool cpSpaceDespawn(
+  int space, {
+  List<int> constraints = const [],
+  List<int> shapes = const [],
+  List<int> bodies = const [],
+}) {
+  final constraintsPtr = _allocUint32s(constraints);
+  final shapesPtr = _allocUint32s(shapes);
+  final bodiesPtr = _allocUint32s(bodies);
+  final done = _callInt('_cp_space_despawn', [
+    space.toJS,
+    constraintsPtr.toJS,
+    constraints.length.toJS,
+    shapesPtr.toJS,
+    shapes.length.toJS,
+    bodiesPtr.toJS,
+    bodies.length.toJS,
+  ]);
+  _free(constraintsPtr);
+  _free(shapesPtr);
+  _free(bodiesPtr);
+  return done != 0;
+}
+
+/// Execute a command buffer against the space in a single call.
+/// @param space The space.
+/// @param commands The encoded commands, see `CommandBuffer` for the format.
+/// @return The number of commands executed, which is smaller than the number of encoded commands
+/// only if the buffer is malformed.
+int cpSpaceExecuteCommands(int space, Uint8List commands) {
+  final ptr = _malloc(commands.length);
+  if (commands.isNotEmpty) {
+    _heapView('Uint8Array', ptr, commands.length).callMethod('set'.toJS, commands.toJS);
+  }
+  final executed = _callInt('_cp_space_execute_commands', [space.toJS, ptr.toJS, commands.length.toJS]);
+  _free(ptr);
+  return executed;
+}
+
+/// Queue collision events for a pair of collision types.
+/// @param space The space.
+/// @param typeA The first collision type.
+/// @param typeB The second collision type.
+/// @param events The `CP_FFI_COLLISION_*` bits of the callbacks that queue an event, 0 to stop queuing.
+void cpSpaceSetCollisionEvents(int space, int typeA, int typeB, int events) =>
+    _callVoid('_cp_space_set_collision_events', [space.toJS, typeA.toJS, typeB.toJS, events.toJS]);
+
+/// Set the number of collision events queued before new ones are dropped.
+/// @param space The space.
+/// @param capacity The capacity of the event buffer.
+void cpSpaceSetCollisionEventCapacity(int space, int capacity) =>
+    _callVoid('_cp_space_set_collision_event_capacity', [space.toJS, capacity.toJS]);
+
+/// Get the number of queued collision events.
+/// @param space The space.
+/// @return The number of events waiting to be drained.
+int cpSpaceGetCollisionEventCount(int space) => _callInt('_cp_space_get_collision_event_count', [space.toJS]);
+
+/// Get the number of collision events dropped because the buffer was full since it was last emptied.
+/// @param space The space.
+/// @return The number of dropped events.
+int cpSpaceGetDroppedCollisionEvents(int space) => _callInt('_cp_space_get_dropped_collision_events', [space.toJS]);
+
+/// Move queued collision events, oldest first, into out.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param shapes Filled with the handles of the two shapes of each drained event, interleaved.
+/// @param capacity The number of rows in each column of out.
+/// @return The number of drained events.
+int cpSpaceDrainCollisionEvents(int space, Float64List out, List<int> shapes, int capacity) {
+  final outPtr = _malloc(capacity * 8 * 8);
+  final shapesPtr = _malloc(capacity * 2 * 4);
+  final count = _callInt(
+    '_cp_space_drain_collision_events',
+    [space.toJS, outPtr.toJS, shapesPtr.toJS, capacity.toJS],
+  );
+  out.setRange(0, capacity * 8, (_heapView('Float64Array', outPtr, capacity * 8) as JSFloat64Array).toDart);
+  final handles = (_heapView('Uint32Array', shapesPtr, capacity * 2) as JSUint32Array).toDart;
+  shapes.clear();
+  for (var i = 0; i < count; i++) {
+    shapes
+      ..add(handles[i])
+      ..add(handles[capacity + i]);
+  }
+  _free(outPtr);
+  _free(shapesPtr);
+  return count;
+}
+
+/// Start or stop tracking the shapes overlapping a shape, usually a sensor.
+/// @param space The space.
+/// @param shape The tracked shape.
+/// @param enabled Whether enter and exit events are queued for the shape after each step.
+void cpSpaceSetSensorTracking(int space, int shape, {required bool enabled}) =>
+    _callVoid('_cp_space_set_sensor_tracking', [space.toJS, shape.toJS, (enabled ? 1 : 0).toJS]);
+
+/// Get the number of queued sensor events.
+/// @param space The space.
+/// @return The number of events waiting to be drained.
+int cpSpaceGetSensorEventCount(int space) => _callInt('_cp_space_get_sensor_event_count', [space.toJS]);
+
+/// Move queued sensor events, oldest first, into types and shapes.
+/// @param space The space.
+/// @param types Filled with the `CP_FFI_SENSOR_*` type of each drained event.
+/// @param shapes Filled with the handles of the tracked shape and the other shape of each event, interleaved.
+/// @param capacity The maximum number of events to drain.
+/// @return The number of drained events.
+int cpSpaceDrainSensorEvents(int space, List<int> types, List<int> shapes, int capacity) {
+  final typesPtr = _malloc(capacity * 4);
+  final shapesPtr = _malloc(capacity * 2 * 4);
+  final count = _callInt(
+    '_cp_space_drain_sensor_events',
+    [space.toJS, typesPtr.toJS, shapesPtr.toJS, capacity.toJS],
+  );
+  _readHandles(typesPtr, count, types);
+  final handles = (_heapView('Uint32Array', shapesPtr, capacity * 2) as JSUint32Array).toDart;
+  shapes.clear();
+  for (var i = 0; i < count; i++) {
+    shapes
+      ..add(handles[i])
+      ..add(handles[capacity + i]);
+  }
+  _free(typesPtr);
+  _free(shapesPtr);
+  return count;
+}
+
+/// Get the shapes overlapping a tracked shape at the end of the last step.
+/// @param space The space.
+/// @param sensor The tracked shape.
+/// @param shapes Filled with the handles of the overlapping shapes.
+void cpSpaceGetSensorOverlaps(int space, int sensor, List<int> shapes) {
+  var capacity = 16;
+  while (true) {
+    final out = _malloc(capacity * 4);
+    final count = _callInt('_cp_space_get_sensor_overlaps', [space.toJS, sensor.toJS, out.toJS, capacity.toJS]);
+    if (count <= capacity) {
+      _readHandles(out, count, shapes);
+      _free(out);
+      return;
+    }
+    _free(out);
+    capacity = count;
+  }
+}
+
+/// Set the native collision rules of a pair of collision types.
+/// @param space The space.
+/// @param typeA The first collision type.
+/// @param typeB The second collision type.
+/// @param rules The `CP_FFI_RULE_*` bits of the rules to apply, 0 to remove them.
+/// @param oneWayX The x component of the direction the pair collides along with `CP_FFI_RULE_ONE_WAY`.
+/// @param oneWayY The y component of the direction the pair collides along with `CP_FFI_RULE_ONE_WAY`.
+void cpSpaceSetCollisionRule(int space, int typeA, int typeB, int rules, double oneWayX, double oneWayY) {
+  final vectPtr = _allocVect(oneWayX, oneWayY);
+  _callVoid('_cp_space_set_collision_rule', [space.toJS, typeA.toJS, typeB.toJS, rules.toJS, vectPtr.toJS]);
+  _free(vectPtr);
+}
+
+/// Find the shapes overlapping a shape.
+/// @param space The space.
+/// @param shape The shape to test, which does not need to be added to the space.
+/// @param capacity The maximum number of results to read.
+/// @param shapes Filled with the handles of up to capacity overlapping shapes.
+/// @param sets Filled with the contact point set of each shape in shapes.
+/// @return The total number of overlapping shapes, which may exceed capacity.
+int cpSpaceShapeQuery(int space, int shape, int capacity, List<int> shapes, List<ContactPointSet> sets) {
+  final shapesPtr = _malloc(capacity * 4);
+  final setsPtr = _malloc(capacity * _contactPointSetSize);
+  final total = _callInt(
+    '_cp_space_shape_query',
+    [space.toJS, shape.toJS, shapesPtr.toJS, setsPtr.toJS, capacity.toJS],
+  );
+  final read = total < capacity ? total : capacity;
+  _readHandles(shapesPtr, read, shapes);
+  sets.clear();
+  if (read > 0) {
+    final doubles = (_heapView('Float64Array', setsPtr, read * _contactPointSetSize ~/ 8) as JSFloat64Array).toDart;
+    final ints = (_heapView('Int32Array', setsPtr, read * _contactPointSetSize ~/ 4) as JSInt32Array).toDart;
+    for (var i = 0; i < read; i++) {
+      sets.add(_readContactPointSet(doubles, ints, i * _contactPointSetSize));
+    }
+  }
+  _free(shapesPtr);
+  _free(setsPtr);
+  return total;
+}
+
+/// Size of `cpContactPointSet` on wasm32: the count, padding, the normal and two contact points.
+const _contactPointSetSize = 104;
+
+ContactPointSet _readContactPointSet(Float64List doubles, Int32List ints, int offset) {
+  final d = offset ~/ 8;
+  final count = ints[offset ~/ 4];
+  return ContactPointSet(
+    count: count,
+    normal: Vector(doubles[d + 1], doubles[d + 2]),
+    points: [
+      for (var j = 0; j < count; j++)
+        ContactPoint(
+          pointA: Vector(doubles[d + 3 + 5 * j], doubles[d + 4 + 5 * j]),
+          pointB: Vector(doubles[d + 5 + 5 * j], doubles[d + 6 + 5 * j]),
+          distance: doubles[d + 7 + 5 * j],
+        ),
+    ],
+  );
+}
+
+/// Set the number of native worker threads running large batches alongside the calling thread.
+/// @param count The number of workers, 0 to run batches on the calling thread only, or a negative value to
+/// restore the default of one worker per CPU beyond the first.
+void cpFfiSetWorkerThreadCount(int count) => _callVoid('_cp_ffi_set_worker_thread_count', [count.toJS]);
+
+/// Get the number of native worker threads, always 0 when threads are not supported.
+/// @return The number of workers.
+int cpFfiGetWorkerThreadCount() => _callInt('_cp_ffi_get_worker_thread_count', []);
+
+int _allocFilters(List<ShapeFilter> filters) =>
+    _allocUint32s([for (final f in filters) ...[f.group, f.categories, f.mask]]);
+
+/// Runs a batch of queries reading five hit values and one shape handle per query.
+int _queryBatchWithHits(
+  String function,
+  int space,
+  Float64List queries,
+  int stride,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) {
+  final count = queries.length ~/ stride;
+  final queriesPtr = _allocDoubles(queries);
+  final filtersPtr = _allocFilters(filters);
+  final shapesPtr = _malloc(count * 4);
+  final hitsPtr = _malloc(count * 5 * 8);
+  final hitCount = _callInt(
+    function,
+    [space.toJS, queriesPtr.toJS, count.toJS, filtersPtr.toJS, filters.length.toJS, shapesPtr.toJS, hitsPtr.toJS],
+  );
+  if (count > 0) {
+    hits.setRange(0, count * 5, (_heapView('Float64Array', hitsPtr, count * 5) as JSFloat64Array).toDart);
+  }
+  _readHandles(shapesPtr, count, shapes);
+  _free(queriesPtr);
+  _free(filtersPtr);
+  _free(shapesPtr);
+  _free(hitsPtr);
+  return hitCount;
+}
+
+/// Run many first-hit segment queries in one call.
+/// @param space The space.
+/// @param segments Five values per segment: start x, start y, end x, end y and radius.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param hits Filled with five values per segment: hit point x, point y, normal x, normal y and alpha.
+/// @param shapes Filled with the handle of the first shape hit by each segment, or 0 on a miss.
+/// @return The number of segments that hit a shape.
+int cpSpaceSegmentQueryFirstBatch(
+  int space,
+  Float64List segments,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) =>
+    _queryBatchWithHits('_cp_space_segment_query_first_batch', space, segments, 5, filters, hits, shapes);
+
+/// Run many nearest point queries in one call.
+/// @param space The space.
+/// @param points Three values per query: x, y and maximum distance.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param hits Filled with five values per query: nearest point x, point y, distance, gradient x and gradient y.
+/// @param shapes Filled with the handle of the nearest shape of each query, or 0 if none is within range.
+/// @return The number of queries with a shape in range.
+int cpSpacePointQueryNearestBatch(
+  int space,
+  Float64List points,
+  List<ShapeFilter> filters,
+  Float64List hits,
+  List<int> shapes,
+) =>
+    _queryBatchWithHits('_cp_space_point_query_nearest_batch', space, points, 3, filters, hits, shapes);
+
+/// Run many bounding box queries in one call.
+/// @param space The space.
+/// @param bbs Four values per query: left, bottom, right and top.
+/// @param filters No filter to collide with all shapes, one filter shared by every query, or one filter per query.
+/// @param capacity The maximum number of shapes reported per query.
+/// @param shapes Filled with capacity handles per query, the shapes overlapping the box followed by zeros.
+/// @param counts Filled with the total number of shapes overlapping each box, which may exceed capacity.
+void cpSpaceBBQueryBatch(
+  int space,
+  Float64List bbs,
+  List<ShapeFilter> filters,
+  int capacity,
+  List<int> shapes,
+  List<int> counts,
+) {
+  final count = bbs.length ~/ 4;
+  final bbsPtr = _allocDoubles(bbs);
+  final filtersPtr = _allocFilters(filters);
+  final shapesPtr = _malloc(count * capacity * 4);
+  final countsPtr = _malloc(count * 4);
+  _callVoid('_cp_space_bb_query_batch', [
+    space.toJS,
+    bbsPtr.toJS,
+    count.toJS,
+    filtersPtr.toJS,
+    filters.length.toJS,
+    shapesPtr.toJS,
+    capacity.toJS,
+    countsPtr.toJS,
+  ]);
+  shapes.clear();
+  counts.clear();
+  if (count > 0) {
+    final found = (_heapView('Int32Array', countsPtr, count) as JSInt32Array).toDart;
+    final handles = (_heapView('Uint32Array', shapesPtr, count * capacity) as JSUint32Array).toDart;
+    for (var i = 0; i < count; i++) {
+      counts.add(found[i]);
+      for (var j = 0; j < capacity; j++) {
+        shapes.add(j < found[i] ? handles[i * capacity + j] : 0);
+      }
+    }
+  }
+  _free(bbsPtr);
+  _free(filtersPtr);
+  _free(shapesPtr);
+  _free(countsPtr);
+}
+
+/// Find every shape within a distance of a point.
+/// @param space The space.
+/// @param x The x coordinate of the point.
+/// @param y The y coordinate of the point.
+/// @param maxDistance The maximum distance from the point to a shape's surface.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the nearest capacity results, sorted by distance.
+/// @return The total number of shapes in range, which may exceed capacity.
+int cpSpacePointQuery(
+  int space,
+  double x,
+  double y,
+  double maxDistance,
+  ShapeFilter filter,
+  int capacity,
+  List<PointQueryInfo> out,
+) {
+  final pointPtr = _allocVect(x, y);
+  final filterPtr = _allocFilters([filter]);
+  final infosPtr = _malloc(capacity * _queryInfoSize);
+  final total = _callInt(
+    '_cp_space_point_query',
+    [space.toJS, pointPtr.toJS, maxDistance.toJS, filterPtr.toJS, infosPtr.toJS, capacity.toJS],
+  );
+  out.clear();
+  for (var i = 0; i < total && i < capacity; i++) {
+    final info = infosPtr + i * _queryInfoSize;
+    out.add(
+      PointQueryInfo(
+        shapePtr: _getInt(info),
+        point: _readVect(info + 8),
+        distance: _getDouble(info + 24),
+        gradient: _readVect(info + 32),
+      ),
+    );
+  }
+  _free(pointPtr);
+  _free(filterPtr);
+  _free(infosPtr);
+  return total;
+}
+
+/// Size of `cpPointQueryInfo` and `cpSegmentQueryInfo` on wasm32: the shape pointer, padding and five doubles.
+const _queryInfoSize = 48;
+
+/// Find every shape along a segment.
+/// @param space The space.
+/// @param startX The x coordinate of the segment start.
+/// @param startY The y coordinate of the segment start.
+/// @param endX The x coordinate of the segment end.
+/// @param endY The y coordinate of the segment end.
+/// @param radius The radius of the segment.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the first capacity results along the segment, sorted by alpha.
+/// @return The total number of shapes hit, which may exceed capacity.
+int cpSpaceSegmentQuery(
+  int space,
+  double startX,
+  double startY,
+  double endX,
+  double endY,
+  double radius,
+  ShapeFilter filter,
+  int capacity,
+  List<SegmentQueryInfo> out,
+) {
+  final startPtr = _allocVect(startX, startY);
+  final endPtr = _allocVect(endX, endY);
+  final filterPtr = _allocFilters([filter]);
+  final infosPtr = _malloc(capacity * _queryInfoSize);
+  final total = _callInt(
+    '_cp_space_segment_query',
+    [space.toJS, startPtr.toJS, endPtr.toJS, radius.toJS, filterPtr.toJS, infosPtr.toJS, capacity.toJS],
+  );
+  out.clear();
+  for (var i = 0; i < total && i < capacity; i++) {
+    final info = infosPtr + i * _queryInfoSize;
+    out.add(
+      SegmentQueryInfo(
+        shapePtr: _getInt(info),
+        point: _readVect(info + 8),
+        normal: _readVect(info + 24),
+        alpha: _getDouble(info + 40),
+      ),
+    );
+  }
+  _free(startPtr);
+  _free(endPtr);
+  _free(filterPtr);
+  _free(infosPtr);
+  return total;
+}
+
+/// Find every shape whose bounding box overlaps a bounding box.
+/// @param space The space.
+/// @param bb The bounding box.
+/// @param filter The shape filter of the query.
+/// @param capacity The maximum number of results to read.
+/// @param out Filled with the handles of up to capacity overlapping shapes.
+/// @return The total number of overlapping shapes, which may exceed capacity.
+int cpSpaceBBQuery(int space, BoundingBox bb, ShapeFilter filter, int capacity, List<int> out) {
+  final bbPtr = _allocDoubles([bb.left, bb.bottom, bb.right, bb.top]);
+  final filterPtr = _allocFilters([filter]);
+  final shapesPtr = _malloc(capacity * 4);
+  final total = _callInt('_cp_space_bb_query', [space.toJS, bbPtr.toJS, filterPtr.toJS, shapesPtr.toJS, capacity.toJS]);
+  _readHandles(shapesPtr, total < capacity ? total : capacity, out);
+  _free(bbPtr);
+  _free(filterPtr);
+  _free(shapesPtr);
+  return total;
+}
+
+/// Set the render id of a shape, stored in its user data.
+/// @param shape The shape.
+/// @param renderId The render id, 0 to hide the shape from visibility queries.
+void cpShapeSetRenderId(int shape, int renderId) =>
+    _callVoid('_cp_shape_set_render_id', [shape.toJS, renderId.toJS]);
+
+/// Get the render id of a shape.
+/// @param shape The shape.
+/// @return The render id, 0 if none was set.
+int cpShapeGetRenderId(int shape) => _callInt('_cp_shape_get_render_id', [shape.toJS]).toUnsigned(32);
+
+/// Find the shapes with a render id whose bounding box intersects a viewport.
+/// @param space The space.
+/// @param viewport The viewport in world coordinates.
+/// @param filter The shape filter of the query.
+/// @param instances Filled with the body position x, position y and angle of each visible shape.
+/// @param renderIds Optionally filled with the render id of each visible shape.
+/// @param shapes Optionally filled with the handle of each visible shape.
+/// @return The total number of visible shapes, which may exceed the capacity of instances.
+int cpSpaceQueryVisible(
+  int space,
+  BoundingBox viewport,
+  ShapeFilter filter,
+  Float32List instances, {
+  Uint32List? renderIds,
+  List<int>? shapes,
+}) {
+  final capacity = instances.length ~/ 3;
+  final viewportPtr = _allocDoubles([viewport.left, viewport.bottom, viewport.right, viewport.top]);
+  final filterPtr = _allocFilters([filter]);
+  final instancesPtr = _malloc(capacity * 3 * 4);
+  final renderIdsPtr = renderIds == null ? 0 : _malloc(capacity * 4);
+  final shapesPtr = shapes == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt('_cp_space_query_visible', [
+    space.toJS,
+    viewportPtr.toJS,
+    filterPtr.toJS,
+    instancesPtr.toJS,
+    renderIdsPtr.toJS,
+    shapesPtr.toJS,
+    capacity.toJS,
+  ]);
+  final written = count < capacity ? count : capacity;
+  if (written > 0) {
+    instances.setRange(0, written * 3, (_heapView('Float32Array', instancesPtr, written * 3) as JSFloat32Array).toDart);
+    renderIds?.setRange(0, written, (_heapView('Uint32Array', renderIdsPtr, written) as JSUint32Array).toDart);
+  }
+  if (shapes != null) {
+    _readHandles(shapesPtr, written, shapes);
+    _free(shapesPtr);
+  }
+  if (renderIds != null) {
+    _free(renderIdsPtr);
+  }
+  _free(viewportPtr);
+  _free(filterPtr);
+  _free(instancesPtr);
+  return count;
+}
+
+/// Sweep a shape along a translation and find the first shape it touches.
+/// @param space The space.
+/// @param shape The cast shape, placed by its body's transform. It does not need to be added to the space.
+/// @param dx The x component of the translation.
+/// @param dy The y component of the translation.
+/// @param tolerance The gap below which the shapes are considered touching.
+/// @return The hit, or null if the shape can travel the whole translation.
+ShapeCastInfo? cpSpaceShapeCast(int space, int shape, double dx, double dy, double tolerance) {
+  final translationPtr = _allocVect(dx, dy);
+  final infoPtr = _malloc(_queryInfoSize);
+  final hit = _callInt(
+    '_cp_space_shape_cast',
+    [space.toJS, shape.toJS, translationPtr.toJS, tolerance.toJS, infoPtr.toJS],
+  );
+  final result = hit == 0
+      ? null
+      : ShapeCastInfo(
+          shapePtr: hit,
+          point: _readVect(infoPtr + 8),
+          normal: _readVect(infoPtr + 24),
+          alpha: _getDouble(infoPtr + 40),
+        );
+  _free(translationPtr);
+  _free(infoPtr);
+  return result;
+}
+
+/// Creates a new physics space. The multi-threaded solver is not built for the web, so this is a
+/// regular space.
+int cpHastySpaceNew() {
+  _ensureInitialized();
+  return _callInt('_cp_hasty_space_new', []);
+}
+
+/// Sets the number of solver threads of a hasty space. Has no effect on the web.
+/// @param space The space.
+/// @param threads The number of threads, or 0 for one per CPU.
+void cpHastySpaceSetThreads(int space, int threads) =>
+    _callVoid('_cp_hasty_space_set_threads', [space.toJS, threads.toJS]);
+
+/// Gets the number of solver threads of a hasty space.
+/// @param space The space.
+/// @return The number of threads, always 1 on the web.
+int cpHastySpaceGetThreads(int space) => _callInt('_cp_hasty_space_get_threads', [space.toJS]);
+
+/// Steps many spaces forward in time by dt. The web build has no worker threads, so they are stepped
+/// one after another.
+/// @param spaces The spaces to step, each at most once.
+/// @param dt The time step.
+void cpSpaceStepMany(List<int> spaces, double dt) {
+  final spacesPtr = _allocUint32s(spaces);
+  _callVoid('_cp_space_step_many', [spacesPtr.toJS, spaces.length.toJS, dt.toJS]);
+  _free(spacesPtr);
+}
+
+/// Steps the space forward in time by dt. The web build has no threads, so the step runs before
+/// returning and publishes its snapshot right away.
+/// @param space The space to step.
+/// @param dt The time step.
+void cpSpaceStepAsync(int space, double dt) => _callVoid('_cp_space_step_async', [space.toJS, dt.toJS]);
+
+/// Waits for the asynchronous step of the space to finish. Returns right away on the web.
+/// @param space The space.
+void cpSpaceStepWait(int space) => _callVoid('_cp_space_step_wait', [space.toJS]);
+
+/// Checks whether an asynchronous step of the space is still running, never the case on the web.
+/// @param space The space.
+/// @return Non-zero while the step runs.
+int cpSpaceIsStepping(int space) => _callInt('_cp_space_is_stepping', [space.toJS]);
+
+/// Reads the body states published by the last asynchronous step, using the layout of cpSpaceExportTransformsF32.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also read the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the snapshot, which may exceed capacity.
+int cpSpaceReadSnapshotF32(int space, Float32List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final length = capacity * (velocity ? 6 : 3);
+  final outPtr = _malloc(length * 4);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt(
+    '_cp_space_read_snapshot_f32',
+    [space.toJS, outPtr.toJS, capacity.toJS, (velocity ? _stateVelocity : 0).toJS, bodies.toJS],
+  );
+  out.setRange(0, length, (_heapView('Float32Array', outPtr, length) as JSFloat32Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+/// Reads the body states published by the last asynchronous step in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param velocity Whether to also read the linear and angular velocity columns.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the snapshot, which may exceed capacity.
+int cpSpaceReadSnapshotF64(int space, Float64List out, int capacity, {bool velocity = false, List<int>? handles}) {
+  final length = capacity * (velocity ? 6 : 3);
+  final outPtr = _malloc(length * 8);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt(
+    '_cp_space_read_snapshot_f64',
+    [space.toJS, outPtr.toJS, capacity.toJS, (velocity ? _stateVelocity : 0).toJS, bodies.toJS],
+  );
+  out.setRange(0, length, (_heapView('Float64Array', outPtr, length) as JSFloat64Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+/// Adds the frame time to the space's accumulator and runs the fixed steps that fit in it.
+/// @param space The space.
+/// @param frameDt The time elapsed since the last frame.
+/// @param fixedDt The duration of each step.
+/// @param maxSubsteps The maximum number of steps to run, the time beyond them being dropped.
+/// @return The number of steps run.
+int cpSpaceAdvance(int space, double frameDt, double fixedDt, int maxSubsteps) =>
+    _callInt('_cp_space_advance', [space.toJS, frameDt.toJS, fixedDt.toJS, maxSubsteps.toJS]);
+
+/// Gets the fraction of a fixed step left in the space's accumulator.
+/// @param space The space.
+/// @return A value between 0 and 1.
+double cpSpaceGetInterpolationAlpha(int space) => _callDouble('_cp_space_get_interpolation_alpha', [space.toJS]);
+
+/// Exports the position and angle of every body blended between the last two fixed steps.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportInterpolatedF32(int space, Float32List out, int capacity, {List<int>? handles}) {
+  final length = capacity * 3;
+  final outPtr = _malloc(length * 4);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt('_cp_space_export_interpolated_f32', [space.toJS, outPtr.toJS, capacity.toJS, bodies.toJS]);
+  out.setRange(0, length, (_heapView('Float32Array', outPtr, length) as JSFloat32Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+/// Exports the position and angle of every body blended between the last two fixed steps in double precision.
+/// @param space The space.
+/// @param out The structure-of-arrays buffer: column c of row i is stored at `out[c * capacity + i]`.
+/// @param capacity The number of rows in each column of out.
+/// @param handles If not null, filled with the body handle of each written row.
+/// @return The number of bodies in the space, which may exceed capacity.
+int cpSpaceExportInterpolatedF64(int space, Float64List out, int capacity, {List<int>? handles}) {
+  final length = capacity * 3;
+  final outPtr = _malloc(length * 8);
+  final bodies = handles == null ? 0 : _malloc(capacity * 4);
+  final count = _callInt('_cp_space_export_interpolated_f64', [space.toJS, outPtr.toJS, capacity.toJS, bodies.toJS]);
+  out.setRange(0, length, (_heapView('Float64Array', outPtr, length) as JSFloat64Array).toDart);
+  _free(outPtr);
+  if (handles != null) {
+    _readHandles(bodies, count < capacity ? count : capacity, handles);
+    _free(bodies);
+  }
+  return count;
+}
+
+/// Switches the spatial indexes of the space between bounding box trees and spatial hashes.
+/// @param space The space, which must not be locked.
+/// @param mode The CP_FFI_BROADPHASE_* mode.
+/// @param dim The cell size of a spatial hash, ignored by the other modes.
+/// @param count The cell count of a spatial hash, ignored by the other modes.
+void cpSpaceSetBroadphase(int space, int mode, double dim, int count) =>
+    _callVoid('_cp_space_set_broadphase', [space.toJS, mode.toJS, dim.toJS, count.toJS]);
+
+/// Gets the broadphase mode requested for the space.
+/// @param space The space.
+/// @return The CP_FFI_BROADPHASE_* mode.
+int cpSpaceGetBroadphase(int space) => _callInt('_cp_space_get_broadphase', [space.toJS]);
+
+/// Checks whether the spatial indexes of the space currently are spatial hashes.
+/// @param space The space.
+/// @return Non-zero for spatial hashes.
+int cpSpaceUsesSpatialHash(int space) => _callInt('_cp_space_uses_spatial_hash', [space.toJS]);
+
+/// Gets the cell size of the spatial hash of the space.
+/// @param space The space.
+/// @return The cell size, or 0 without a spatial hash.
+double cpSpaceGetSpatialHashDim(int space) => _callDouble('_cp_space_get_spatial_hash_dim', [space.toJS]);
+
+/// Gets the cell count of the spatial hash of the space.
+/// @param space The space.
+/// @return The cell count, or 0 without a spatial hash.
+int cpSpaceGetSpatialHashCount(int space) => _callInt('_cp_space_get_spatial_hash_count', [space.toJS]);
+
+/// Mirrors `CP_FFI_PROFILE_PHASES` from `chipmunk2d_physics_ffi.h`.
+const _profilePhases = 10;
+
+/// Checks whether the library was built with the step profiler.
+/// @return Non-zero if it was.
+int cpFfiProfilingAvailable() {
+  _ensureInitialized();
+  return _callInt('_cp_ffi_profiling_available', []);
+}
+
+/// Records the phase timings of the last steps of the space.
+/// @param space The space.
+/// @param history The number of steps to keep, or 0 to stop recording.
+void cpSpaceSetProfiling(int space, int history) => _callVoid('_cp_space_set_profiling', [space.toJS, history.toJS]);
+
+/// Gets the number of steps whose timings are kept.
+/// @param space The space.
+/// @return The history length, or 0 when profiling is disabled.
+int cpSpaceGetProfiling(int space) => _callInt('_cp_space_get_profiling', [space.toJS]);
+
+/// Reads the phase timings of the last recorded steps, oldest first.
+/// @param space The space.
+/// @param capacity The maximum number of steps to read.
+/// @return CP_FFI_PROFILE_PHASES values in seconds per step.
+Float64List cpSpaceGetProfile(int space, int capacity) {
+  final outPtr = _malloc(capacity * _profilePhases * 8);
+  final count = _callInt('_cp_space_get_profile', [space.toJS, outPtr.toJS, capacity.toJS]);
+  final result = Float64List.fromList(
+    (_heapView('Float64Array', outPtr, count * _profilePhases) as JSFloat64Array).toDart,
+  );
+  _free(outPtr);
+  return result;
+}
+
+/// Mirrors `CP_FFI_STATS` from `chipmunk2d_physics_ffi.h`.
+const _stats = 9;
+
+/// Reads the counters describing a space as left by its last step.
+/// @param space The space.
+/// @return CP_FFI_STATS values indexed by CP_FFI_STAT_*.
+Int32List cpSpaceGetStats(int space) {
+  final outPtr = _malloc(_stats * 4);
+  _callVoid('_cp_space_get_stats', [space.toJS, outPtr.toJS]);
+  final result = Int32List.fromList((_heapView('Int32Array', outPtr, _stats) as JSInt32Array).toDart);
+  _free(outPtr);
+  return result;
+}
+
+/// Starts a new native trace, dropping the events of the previous one.
+/// @param eventsPerThread The number of events kept per thread.
+void cpFfiTraceStart(int eventsPerThread) => _callVoid('_cp_ffi_trace_start', [eventsPerThread.toJS]);
+
+/// Stops recording the native trace.
+void cpFfiTraceStop() => _callVoid('_cp_ffi_trace_stop', []);
+
+/// Checks whether the native trace is recording.
+/// @return 1 while recording, 0 otherwise.
+int cpFfiTraceIsRecording() => _callInt('_cp_ffi_trace_is_recording', []);
+
+/// Traces cannot be written to local files from the browser.
+/// @param path The path of the file to write.
+/// @return Never returns.
+int cpFfiTraceWrite(String path) => throw UnsupportedError('Chipmunk2D: traces cannot be written to files on the web.');
+
+/// Serialize the state of the space into a snapshot.
+/// @param space The space.
+/// @param out The buffer the snapshot is written to.
+/// @return The size of the snapshot, which is only complete in out when it is at most `out.length`, or 0 if
+/// the space is locked or stepping asynchronously.
+int cpSpaceSnapshot(int space, Uint8List out) {
+  final ptr = _malloc(out.length);
+  final size = _callInt('_cp_space_snapshot', [space.toJS, ptr.toJS, out.length.toJS]);
+  if (size > 0 && size <= out.length) {
+    out.setRange(0, size, (_heapView('Uint8Array', ptr, size) as JSUint8Array).toDart);
+  }
+  _free(ptr);
+  return size;
+}
+
+/// Rewind the space to a snapshot taken with `cpSpaceSnapshot`.
+/// @param space The space.
+/// @param snapshot The snapshot.
+/// @return 1 if the space was restored, 0 if the snapshot is malformed or does not match the objects of the space.
+int cpSpaceRestore(int space, Uint8List snapshot) {
+  final ptr = _malloc(snapshot.length);
+  if (snapshot.isNotEmpty) {
+    _heapView('Uint8Array', ptr, snapshot.length).callMethod('set'.toJS, snapshot.toJS);
+  }
+  final restored = _callInt('_cp_space_restore', [space.toJS, ptr.toJS, snapshot.length.toJS]);
+  _free(ptr);
+  return restored;
+}
+
+/// Serialize the changes of the space since a reference snapshot into a delta.
+/// @param space The space.
+/// @param reference The reference snapshot.
+/// @param out The buffer the delta is written to.
+/// @return The size of the delta, which is only complete in out when it is at most `out.length`, 0 if the space is
+/// locked or stepping asynchronously, or -1 if the reference is malformed.
+int cpSpaceSnapshotDelta(int space, Uint8List reference, Uint8List out) {
+  final referencePtr = _malloc(reference.length);
+  if (reference.isNotEmpty) {
+    _heapView('Uint8Array', referencePtr, reference.length).callMethod('set'.toJS, reference.toJS);
+  }
+  final ptr = _malloc(out.length);
+  final size = _callInt(
+      '_cp_space_snapshot_delta', [space.toJS, referencePtr.toJS, reference.length.toJS, ptr.toJS, out.length.toJS]);
+  if (size > 0 && size <= out.length) {
+    out.setRange(0, size, (_heapView('Uint8Array', ptr, size) as JSUint8Array).toDart);
+  }
+  _free(ptr);
+  _free(referencePtr);
+  return size;
+}
+
+/// Rebuild the full snapshot described by a delta.
+/// @param reference The reference snapshot the delta was taken against.
+/// @param delta The delta.
+/// @param out The buffer the snapshot is written to.
+/// @return The size of the snapshot, which is only complete in out when it is at most `out.length`, or -1 if the
+/// delta is malformed or was taken against another reference.
+int cpFfiSnapshotApplyDelta(Uint8List reference, Uint8List delta, Uint8List out) {
+  final referencePtr = _malloc(reference.length);
+  if (reference.isNotEmpty) {
+    _heapView('Uint8Array', referencePtr, reference.length).callMethod('set'.toJS, reference.toJS);
+  }
+  final deltaPtr = _malloc(delta.length);
+  if (delta.isNotEmpty) {
+    _heapView('Uint8Array', deltaPtr, delta.length).callMethod('set'.toJS, delta.toJS);
+  }
+  final ptr = _malloc(out.length);
+  final size = _callInt('_cp_ffi_snapshot_apply_delta',
+      [referencePtr.toJS, reference.length.toJS, deltaPtr.toJS, delta.length.toJS, ptr.toJS, out.length.toJS]);
+  if (size > 0 && size <= out.length) {
+    out.setRange(0, size, (_heapView('Uint8Array', ptr, size) as JSUint8Array).toDart);
+  }
+  _free(ptr);
+  _free(deltaPtr);
+  _free(referencePtr);
+  return size;
+}
@@ -1,3 +1,4 @@
+import 'package:chipmunk2d_physics_ffi/src/arbiter.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
 
 /// Information about a point query result.
@@ -49,3 +50,45 @@ class SegmentQueryInfo {
   /// The normalized distance along the query segment in the range [0, 1].
   final double alpha;
 }
+
+/// Information about a shape query result.
+///
+/// Shape queries find the shapes overlapping a given shape.
+class ShapeQueryInfo {
+  /// Creates a new ShapeQueryInfo.
+  const ShapeQueryInfo({
+    required this.shapePtr,
+    required this.contactPointSet,
+  });
+
+  /// The overlapping shape pointer (as int).
+  final int shapePtr;
+
+  /// The contact points between the query shape and the overlapping shape.
+  final ContactPointSet contactPointSet;
+}
+
+/// Information about a shape cast result.
+///
+/// Shape casts sweep a shape along a translation and find the first shape it touches.
+class ShapeCastInfo {
+  /// Creates a new ShapeCastInfo.
+  const ShapeCastInfo({
+    required this.shapePtr,
+    required this.point,
+    required this.normal,
+    required this.alpha,
+  });
+
+  /// The shape pointer (as int) of the shape that was hit.
+  final int shapePtr;
+
+  /// The contact point on the surface of the shape that was hit.
+  final Vector point;
+
+  /// The surface normal of the shape that was hit, pointing towards the cast shape.
+  final Vector normal;
+
+  /// The fraction of the translation travelled before contact, in the range [0, 1].
+  final double alpha;
+}
@@ -0,0 +1,50 @@
+import 'package:chipmunk2d_physics_ffi/src/shape.dart';
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+
+/// Whether a shape started or stopped overlapping a tracked sensor.
+enum SensorEventType {
+  /// The shape started overlapping the sensor during the step.
+  enter(1),
+
+  /// The shape stopped overlapping the sensor during the step.
+  exit(2)
+  ;
+
+  const SensorEventType(this.value);
+
+  /// Creates a SensorEventType from a native `CP_FFI_SENSOR_*` value.
+  factory SensorEventType.fromValue(int value) {
+    switch (value) {
+      case 1:
+        return SensorEventType.enter;
+      case 2:
+        return SensorEventType.exit;
+      default:
+        throw ArgumentError('Invalid sensor event type value: $value');
+    }
+  }
+
+  /// The native `CP_FFI_SENSOR_*` value.
+  final int value;
+}
+
+/// A change in the shapes overlapping a tracked sensor, recorded natively after a step.
+///
+/// See [Space.trackSensor] and [Space.drainSensorEvents].
+class SensorEvent {
+  /// Creates a new SensorEvent.
+  const SensorEvent({
+    required this.type,
+    required this.sensor,
+    required this.other,
+  });
+
+  /// Whether [other] entered or exited [sensor].
+  final SensorEventType type;
+
+  /// The tracked shape.
+  final Shape sensor;
+
+  /// The shape that entered or exited the sensor.
+  final Shape other;
+}
@@ -1,7 +1,9 @@
 import 'package:chipmunk2d_physics_ffi/src/body.dart';
 import 'package:chipmunk2d_physics_ffi/src/bounding_box.dart';
 import 'package:chipmunk2d_physics_ffi/src/platform/chipmunk_bindings.dart';
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+import 'package:meta/meta.dart';
 
 /// Collision filter for shapes that controls which objects can collide.
 ///
@@ -187,6 +189,17 @@ abstract class Shape {
     cpShapeSetSensor(_native, sensor ? 1 : 0);
   }
 
+  /// Identifies what to draw for this shape in [Space.queryVisible], 0 (the default) to skip it.
+  ///
+  /// The render id is an unsigned 32-bit value stored in the native shape's user data.
+  int get renderId {
+    return cpShapeGetRenderId(_native);
+  }
+
+  set renderId(int renderId) {
+    cpShapeSetRenderId(_native, renderId);
+  }
+
   /// Surface velocity of this shape.
   /// Used for moving platforms or conveyor belts.
   Vector get surfaceVelocity {
@@ -223,6 +236,12 @@ abstract class Shape {
       _disposed = true;
     }
   }
+
+  /// Marks this shape as disposed after its native memory was freed by its space (for internal use).
+  @internal
+  void markDisposed() {
+    _disposed = true;
+  }
 }
 
 /// A circle shape.
@@ -236,6 +255,11 @@ class CircleShape extends Shape {
     return CircleShape._(native);
   }
 
+  /// Creates a CircleShape from a native pointer (for internal use).
+  factory CircleShape.fromNative(int native) {
+    return CircleShape._(native);
+  }
+
   CircleShape._(super._native) : super._();
 
   /// Get the offset of the circle shape from the body's center of gravity.
@@ -261,6 +285,11 @@ class BoxShape extends Shape {
     return BoxShape._(native);
   }
 
+  /// Creates a BoxShape from a native pointer (for internal use).
+  factory BoxShape.fromNative(int native) {
+    return BoxShape._(native);
+  }
+
   BoxShape._(super._native) : super._();
 }
 
@@ -1,8 +1,26 @@
+import 'dart:typed_data';
+
+import 'package:chipmunk2d_physics_ffi/src/arbiter.dart';
 import 'package:chipmunk2d_physics_ffi/src/body.dart';
+import 'package:chipmunk2d_physics_ffi/src/bounding_box.dart';
+import 'package:chipmunk2d_physics_ffi/src/broadphase.dart';
+import 'package:chipmunk2d_physics_ffi/src/collision_event.dart';
+import 'package:chipmunk2d_physics_ffi/src/collision_rule.dart';
+import 'package:chipmunk2d_physics_ffi/src/command_buffer.dart';
 import 'package:chipmunk2d_physics_ffi/src/constraint.dart';
 import 'package:chipmunk2d_physics_ffi/src/platform/chipmunk_bindings.dart';
+import 'package:chipmunk2d_physics_ffi/src/query_info.dart';
+import 'package:chipmunk2d_physics_ffi/src/sensor_event.dart';
 import 'package:chipmunk2d_physics_ffi/src/shape.dart';
+import 'package:chipmunk2d_physics_ffi/src/space_stats.dart';
+import 'package:chipmunk2d_physics_ffi/src/step_profile.dart';
 import 'package:chipmunk2d_physics_ffi/src/vector.dart';
+import 'package:chipmunk2d_physics_ffi/src/worker_pool.dart';
+
+// Mirror `CP_FFI_RULE_*` from `chipmunk2d_physics_ffi.h`.
+const _ruleIgnore = 1;
+const _ruleOneWay = 2;
+const _ruleFirstContactOnly = 4;
 
 /// A physics space containing bodies and shapes that can interact.
 ///
@@ -32,12 +50,31 @@ class Space {
     return Space._(native);
   }
 
+  /// Creates a new physics space stepped by Chipmunk's multi-threaded solver.
+  ///
+  /// [threads] is the number of solver threads, or 0 for one per CPU. Chipmunk caps it at a small
+  /// maximum and only spreads the solver over them once the space is big enough, so small scenes
+  /// still step on one thread. The solver is not available on Windows and the web, where this creates
+  /// a regular space. See [threads].
+  factory Space.threaded({int threads = 0}) {
+    final native = cpHastySpaceNew();
+    if (native == 0) {
+      throw Exception('Failed to create space');
+    }
+    cpHastySpaceSetThreads(native, threads);
+    return Space._(native);
+  }
+
   Space._(this._native);
 
   final int _native;
-  final Set<Body> _bodies = {};
-  final Set<Shape> _shapes = {};
-  final Set<Constraint> _constraints = {};
+  final Map<int, Body> _bodies = {};
+  final Map<int, Shape> _shapes = {};
+  final Map<int, Constraint> _constraints = {};
+  int _collisionEventCapacity = 1024;
+  int _droppedCollisionEvents = 0;
+  Float64List _collisionEventBuffer = Float64List(0);
+  final List<int> _collisionEventShapes = [];
   bool _disposed = false;
 
   /// Whether this space has been disposed.
@@ -46,6 +83,60 @@ class Space {
   /// Gets the native pointer (for internal use).
   int get native => _native;
 
+  /// Gets the number of solver threads, always 1 unless the space was created with [Space.threaded].
+  int get threads => cpHastySpaceGetThreads(_native);
+
+  /// Sets the number of solver threads, or 0 for one per CPU.
+  /// Only has an effect on spaces created with [Space.threaded].
+  set threads(int threads) => cpHastySpaceSetThreads(_native, threads);
+
+  /// The broadphase requested with [useBBTree], [useSpatialHash] or [useAutoBroadphase].
+  Broadphase get broadphase => Broadphase.fromValue(cpSpaceGetBroadphase(_native));
+
+  /// Whether the space currently finds collision pairs with spatial hashes.
+  ///
+  /// With [Broadphase.auto], this follows the choice made for the current shapes.
+  bool get usesSpatialHash => cpSpaceUsesSpatialHash(_native) != 0;
+
+  /// The cell size of the spatial hash, or 0 when [usesSpatialHash] is false.
+  double get spatialHashCellSize => cpSpaceGetSpatialHashDim(_native);
+
+  /// The number of cells of the spatial hash, or 0 when [usesSpatialHash] is false.
+  int get spatialHashCellCount => cpSpaceGetSpatialHashCount(_native);
+
+  /// Finds collision pairs with bounding box trees, the default.
+  ///
+  /// Must not be called during a step.
+  void useBBTree() {
+    cpSpaceSetBroadphase(_native, Broadphase.bbTree.value, 0, 0);
+  }
+
+  /// Finds collision pairs with spatial hashes of [cellCount] cells of [cellSize].
+  ///
+  /// A spatial hash beats the default bounding box trees on scenes with many shapes of similar sizes,
+  /// such as particles. [cellSize] should be close to the size of those shapes and [cellCount] about
+  /// ten times their number. Batched queries run on the calling thread while a spatial hash is used.
+  /// Must not be called during a step.
+  void useSpatialHash({required double cellSize, required int cellCount}) {
+    if (cellSize <= 0) {
+      throw ArgumentError.value(cellSize, 'cellSize', 'must be positive');
+    }
+    if (cellCount <= 0) {
+      throw ArgumentError.value(cellCount, 'cellCount', 'must be positive');
+    }
+    cpSpaceSetBroadphase(_native, Broadphase.spatialHash.value, cellSize, cellCount);
+  }
+
+  /// Lets the space pick and size its broadphase from its dynamic shapes.
+  ///
+  /// A spatial hash is used for at least 256 dynamic shapes of similar sizes, with cells of their mean
+  /// size and ten cells per shape, and bounding box trees otherwise. The choice is made now and revisited
+  /// after each [step] where the number of dynamic shapes changed by more than 25% since it was made.
+  /// Must not be called during a step.
+  void useAutoBroadphase() {
+    cpSpaceSetBroadphase(_native, Broadphase.auto.value, 0, 0);
+  }
+
   /// Gets the gravity vector for the space.
   Vector get gravity {
     return cpSpaceGetGravity(_native);
@@ -175,25 +266,151 @@ class Space {
   /// Adds a body to this space.
   void addBody(Body body) {
     cpSpaceAddBody(_native, body.native);
-    _bodies.add(body);
+    _bodies[body.native] = body;
   }
 
   /// Removes a body from this space.
   void removeBody(Body body) {
     cpSpaceRemoveBody(_native, body.native);
-    _bodies.remove(body);
+    _bodies.remove(body.native);
   }
 
   /// Adds a shape to this space.
   void addShape(Shape shape) {
     cpSpaceAddShape(_native, shape.native);
-    _shapes.add(shape);
+    _shapes[shape.native] = shape;
   }
 
   /// Removes a shape from this space.
   void removeShape(Shape shape) {
     cpSpaceRemoveShape(_native, shape.native);
-    _shapes.remove(shape);
+    _shapes.remove(shape.native);
+  }
+
+  /// Creates one dynamic body with a circle shape for each position and adds them to this space with
+  /// a single native call.
+  ///
+  /// [positions] is a flattened list of body positions `[x1, y1, x2, y2, ...]`. Every attribute list
+  /// holds either one value per body or a single value shared by all of them. When omitted, bodies
+  /// get a mass of 1, a moment of inertia computed from the shape, no friction or elasticity, a filter
+  /// colliding with everything and collision type 0.
+  ///
+  /// The created bodies and shapes belong to this space as if added with [addBody] and [addShape].
+  ({List<Body> bodies, List<CircleShape> shapes}) spawnCircles(
+    List<double> positions, {
+    required List<double> radii,
+    List<double>? masses,
+    List<double>? moments,
+    List<double>? frictions,
+    List<double>? elasticities,
+    List<ShapeFilter>? filters,
+    List<int>? collisionTypes,
+  }) {
+    final count = _checkSpawnPositions(positions);
+    _checkSpawnAttributes(count, {
+      'radii': radii.length,
+      'masses': masses?.length,
+      'moments': moments?.length,
+      'frictions': frictions?.length,
+      'elasticities': elasticities?.length,
+      'filters': filters?.length,
+      'collisionTypes': collisionTypes?.length,
+    });
+    final handles = cpSpaceSpawnCircles(
+      _native,
+      positions,
+      radii,
+      masses: masses,
+      moments: moments,
+      frictions: frictions,
+      elasticities: elasticities,
+      filters: filters,
+      collisionTypes: collisionTypes,
+    );
+    return (
+      bodies: _registerSpawnedBodies(handles.bodies, count),
+      shapes: _registerSpawnedShapes(handles.shapes, CircleShape.fromNative),
+    );
+  }
+
+  /// Same as [spawnCircles], but gives each body a box shape.
+  ///
+  /// [sizes] is a flattened list of box sizes `[width1, height1, width2, height2, ...]`, or a single
+  /// size shared by every box. [radius] rounds the corners of every box.
+  ({List<Body> bodies, List<BoxShape> shapes}) spawnBoxes(
+    List<double> positions, {
+    required List<double> sizes,
+    double radius = 0.0,
+    List<double>? masses,
+    List<double>? moments,
+    List<double>? frictions,
+    List<double>? elasticities,
+    List<ShapeFilter>? filters,
+    List<int>? collisionTypes,
+  }) {
+    final count = _checkSpawnPositions(positions);
+    if (sizes.length.isOdd) {
+      throw ArgumentError('Size list must have even number of elements (width, height pairs)');
+    }
+    _checkSpawnAttributes(count, {
+      'sizes': sizes.length ~/ 2,
+      'masses': masses?.length,
+      'moments': moments?.length,
+      'frictions': frictions?.length,
+      'elasticities': elasticities?.length,
+      'filters': filters?.length,
+      'collisionTypes': collisionTypes?.length,
+    });
+    final handles = cpSpaceSpawnBoxes(
+      _native,
+      positions,
+      sizes,
+      radius,
+      masses: masses,
+      moments: moments,
+      frictions: frictions,
+      elasticities: elasticities,
+      filters: filters,
+      collisionTypes: collisionTypes,
+    );
+    return (
+      bodies: _registerSpawnedBodies(handles.bodies, count),
+      shapes: _registerSpawnedShapes(handles.shapes, BoxShape.fromNative),
+    );
+  }
+
+  int _checkSpawnPositions(List<double> positions) {
+    if (positions.length.isOdd) {
+      throw ArgumentError('Position list must have even number of elements (x, y pairs)');
+    }
+    return positions.length ~/ 2;
+  }
+
+  void _checkSpawnAttributes(int count, Map<String, int?> lengths) {
+    lengths.forEach((name, length) {
+      if (length != null && length != 1 && length != count) {
+        throw ArgumentError('$name must hold 1 or $count values, got $length');
+      }
+    });
+  }
+
+  List<Body> _registerSpawnedBodies(List<int> handles, int count) {
+    if (handles.length != count) {
+      throw StateError('Cannot spawn bodies while the space is locked');
+    }
+    final bodies = [for (final handle in handles) Body.fromNative(handle)];
+    for (final body in bodies) {
+      _bodies[body.native] = body;
+    }
+    return bodies;
+  }
+
+  List<T> _registerSpawnedShapes<T extends Shape>(List<int> handles, T Function(int native) create) {
+    final shapes = [for (final handle in handles) create(handle)];
+    for (final shape in shapes) {
+      _shapes[shape.native] = shape;
+    }
+    return shapes;
   }
 
   /// Returns the current (or most recent) time step used with this space.
@@ -225,13 +442,13 @@ class Space {
   /// Adds a constraint to this space.
   void addConstraint(Constraint constraint) {
     cpSpaceAddConstraint(_native, constraint.native);
-    _constraints.add(constraint);
+    _constraints[constraint.native] = constraint;
   }
 
   /// Removes a constraint from this space.
   void removeConstraint(Constraint constraint) {
     cpSpaceRemoveConstraint(_native, constraint.native);
-    _constraints.remove(constraint);
+    _constraints.remove(constraint.native);
   }
 
   /// Steps the physics simulation forward by the given time delta.
@@ -239,39 +456,801 @@ class Space {
     cpSpaceStep(_native, dt);
   }
 
-  /// Disposes of this space and all its resources.
+  /// Steps every space in [spaces] forward by [dt] with a single native call.
   ///
-  /// This will also dispose all bodies, shapes, and constraints that were added to this space.
-  /// Safe to call multiple times (idempotent).
-  void dispose() {
-    if (!_disposed) {
-      for (final constraint in _constraints.toList()) {
-        try {
-          removeConstraint(constraint);
-          constraint.dispose();
-        } on Object {
-          _constraints.remove(constraint);
-        }
-      }
+  /// The spaces are spread over the native worker pool sized with [workerThreadCount], so hundreds of
+  /// independent simulations, such as one per match on a game server, use every core. Threads that run
+  /// out of spaces take over the remaining ones, so a few slow spaces do not hold the others back.
+  /// Returns once every space has been stepped.
+  ///
+  /// The spaces must be distinct. Each one is stepped exactly like [step].
+  static void stepAll(List<Space> spaces, double dt) {
+    final handles = [for (final space in spaces) space._native];
+    if (handles.toSet().length != handles.length) {
+      throw ArgumentError.value(spaces, 'spaces', 'must not contain the same space twice');
+    }
+    cpSpaceStepMany(handles, dt);
+  }
+
+  /// Advances the simulation by the [frameDt] seconds elapsed since the last frame in steps of
+  /// [fixedDt], with a single native call.
+  ///
+  /// The time left over after the last whole step is carried over to the next frame. At most
+  /// [maxSubsteps] steps run per call and the time beyond them is dropped, so a slow frame does not
+  /// snowball into slower ones. Use [exportInterpolatedTransforms] to render the bodies between the
+  /// last two steps. Returns the number of steps run.
+  int advance(double frameDt, {double fixedDt = 1 / 60, int maxSubsteps = 4}) {
+    if (fixedDt <= 0) {
+      throw ArgumentError.value(fixedDt, 'fixedDt', 'must be positive');
+    }
+    if (maxSubsteps < 0) {
+      throw ArgumentError.value(maxSubsteps, 'maxSubsteps', 'must not be negative');
+    }
+    return cpSpaceAdvance(_native, frameDt, fixedDt, maxSubsteps);
+  }
+
+  /// The fraction of a fixed step carried over by the last [advance], between 0 and 1.
+  double get interpolationAlpha => cpSpaceGetInterpolationAlpha(_native);
+
+  /// Writes the position and angle of every body, blended between the last two steps of [advance] by
+  /// [interpolationAlpha], into [out] using the layout of [exportTransforms] without velocity.
+  ///
+  /// Bodies added since the last step are written as they are. Returns the number of bodies in the
+  /// space.
+  int exportInterpolatedTransforms(Float32List out, {List<Body>? bodies}) {
+    final rows = out.length ~/ 3;
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceExportInterpolatedF32(_native, out, rows, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Same as [exportInterpolatedTransforms], but writes double precision values.
+  int exportInterpolatedTransformsFloat64(Float64List out, {List<Body>? bodies}) {
+    final rows = out.length ~/ 3;
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceExportInterpolatedF64(_native, out, rows, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Starts stepping this space forward by [dt] on a native background thread and returns right away.
+  ///
+  /// This overlaps the physics step with the rest of the frame instead of blocking the isolate for
+  /// its whole duration. Until [waitStep] returns, this space and its bodies, shapes and constraints
+  /// must not be used, except for [isStepping], [readSnapshot] and [readSnapshotFloat64], which read
+  /// the transforms published by the previous asynchronous step.
+  ///
+  /// A step still running is waited for before the next one starts. On the web, where there are no
+  /// threads, the step runs before this returns.
+  void stepAsync(double dt) {
+    cpSpaceStepAsync(_native, dt);
+  }
+
+  /// Waits for the step started by [stepAsync] to finish. Returns right away if none is running.
+  void waitStep() {
+    cpSpaceStepWait(_native);
+  }
+
+  /// Whether a step started by [stepAsync] is still running.
+  bool get isStepping => cpSpaceIsStepping(_native) != 0;
+
+  /// Writes the transforms published by the last step of [stepAsync] into [out], using the layout of
+  /// [exportTransforms].
+  ///
+  /// The snapshot is double-buffered: each asynchronous step fills the buffer not being read, then
+  /// publishes it, so this can be called while the next step runs. Bodies removed from the space are
+  /// left out. Returns the number of bodies in the snapshot, 0 before the first asynchronous step.
+  int readSnapshot(Float32List out, {bool velocity = false, List<Body>? bodies}) {
+    final rows = out.length ~/ (velocity ? 6 : 3);
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceReadSnapshotF32(_native, out, rows, velocity: velocity, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Same as [readSnapshot], but writes double precision values.
+  int readSnapshotFloat64(Float64List out, {bool velocity = false, List<Body>? bodies}) {
+    final rows = out.length ~/ (velocity ? 6 : 3);
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceReadSnapshotF64(_native, out, rows, velocity: velocity, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Whether the native library was built with the step profiler, see [enableProfiling].
+  static bool get profilingAvailable => cpFfiProfilingAvailable() != 0;
+
+  /// Records how long each phase of the last [history] steps took, read with [profile].
+  ///
+  /// Use it to find out whether a slow step is spent in the broadphase, the narrowphase, the solver or
+  /// elsewhere before tuning [iterations], [collisionSlop] or the broadphase. Profiled steps time every
+  /// narrowphase pair, which makes them slightly slower. Does nothing when [profilingAvailable] is false.
+  void enableProfiling({int history = 60}) {
+    if (history <= 0) {
+      throw ArgumentError.value(history, 'history', 'must be positive');
+    }
+    cpSpaceSetProfiling(_native, history);
+  }
+
+  /// Stops recording step timings and drops the recorded ones.
+  void disableProfiling() {
+    cpSpaceSetProfiling(_native, 0);
+  }
+
+  /// Whether step timings are recorded, see [enableProfiling].
+  bool get profiling => cpSpaceGetProfiling(_native) > 0;
+
+  /// The timings of the last recorded steps, oldest first.
+  List<StepProfile> get profile {
+    final values = cpSpaceGetProfile(_native, cpSpaceGetProfiling(_native));
+    return [
+      for (var i = 0; i < values.length; i += StepProfile.phaseCount) StepProfile.fromList(values, i),
+    ];
+  }
+
+  /// Counts the bodies, shapes, constraints and contacts of this space as left by its last step, in one native call.
+  ///
+  /// Unlike [toString], which reports what was added from Dart, this tells how many bodies are awake and how
+  /// many arbiters and contact points the solver handled, to correlate the cost of a step with the scene.
+  SpaceStats get stats => SpaceStats.fromList(cpSpaceGetStats(_native));
+
+  /// Serializes the state of this space into a compact binary snapshot that [restore] rewinds it to, e.g. to
+  /// roll back and resimulate frames in netcode.
+  ///
+  /// The snapshot holds the mass, position, velocity and forces of every body, the material and filter of every
+  /// shape, the state of every constraint, the cached collisions with their contact points and the sleeping
+  /// bodies, so that stepping after a restore picks up the simulation where the snapshot was taken. It refers to
+  /// the objects of this space by identity and only restores into this space while it holds the same bodies,
+  /// shapes and constraints. Unlike [readSnapshot], it cannot be taken while the space is stepping.
+  ///
+  /// The snapshot is written into [buffer] when it fits and the returned view shares its memory, so reusing one
+  /// buffer avoids allocating every frame. Otherwise a buffer of the required size is allocated.
+  Uint8List snapshot([Uint8List? buffer]) {
+    var out = buffer ?? Uint8List(0);
+    var size = cpSpaceSnapshot(_native, out);
+    if (size == 0) {
+      throw StateError('Cannot snapshot the space while it is locked or stepping');
+    }
+    if (size > out.length) {
+      out = Uint8List(size);
+      size = cpSpaceSnapshot(_native, out);
+    }
+    return Uint8List.sublistView(out, 0, size);
+  }
 
-      for (final shape in _shapes.toList()) {
-        try {
-          removeShape(shape);
-          shape.dispose();
-        } on Object {
-          _shapes.remove(shape);
-        }
+  /// Rewinds this space in place to a snapshot taken with [snapshot], without reallocating any object.
+  ///
+  /// Bodies, shapes and constraints keep their identity, so references held in Dart stay valid. Properties the
+  /// snapshot does not hold, such as body types, shape geometry, collision handlers and the fixed timestep of
+  /// [advance] keep their current value. Throws an [ArgumentError] and leaves the space untouched if [data] is
+  /// not a snapshot of this space or bodies, shapes or constraints were added or removed since it was taken.
+  void restore(Uint8List data) {
+    if (cpSpaceRestore(_native, data) != 0) {
+      return;
+    }
+    if (isLocked || isStepping) {
+      throw StateError('Cannot restore the space while it is locked or stepping');
+    }
+    throw ArgumentError('The snapshot does not match the bodies, shapes and constraints of this space');
+  }
+
+  /// Serializes only what changed in this space since the [reference] snapshot, e.g. to keep a ring buffer of
+  /// rollback frames whose memory grows with the motion in the scene rather than its size.
+  ///
+  /// Bodies, shapes, constraints and collisions left untouched since [reference], such as sleeping or static
+  /// ones, are stored as references to its records. [applySnapshotDelta] rebuilds the full snapshot from the
+  /// same [reference], which can itself be a rebuilt snapshot, and [restoreDelta] rewinds the space to it.
+  ///
+  /// The delta is written into [buffer] when it fits and the returned view shares its memory. Throws an
+  /// [ArgumentError] if [reference] is not a snapshot.
+  Uint8List snapshotDelta(Uint8List reference, [Uint8List? buffer]) {
+    var out = buffer ?? Uint8List(0);
+    var size = cpSpaceSnapshotDelta(_native, reference, out);
+    if (size < 0) {
+      throw ArgumentError('The reference is not a snapshot');
+    }
+    if (size == 0) {
+      throw StateError('Cannot snapshot the space while it is locked or stepping');
+    }
+    if (size > out.length) {
+      out = Uint8List(size);
+      size = cpSpaceSnapshotDelta(_native, reference, out);
+    }
+    return Uint8List.sublistView(out, 0, size);
+  }
+
+  /// Rebuilds the full snapshot described by a [delta] taken with [snapshotDelta] against [reference].
+  ///
+  /// The snapshot is written into [buffer] when it fits and the returned view shares its memory. Throws an
+  /// [ArgumentError] if [delta] is malformed or was taken against another reference.
+  static Uint8List applySnapshotDelta(Uint8List reference, Uint8List delta, [Uint8List? buffer]) {
+    var out = buffer ?? Uint8List(0);
+    var size = cpFfiSnapshotApplyDelta(reference, delta, out);
+    if (size > out.length) {
+      out = Uint8List(size);
+      size = cpFfiSnapshotApplyDelta(reference, delta, out);
+    }
+    if (size < 0) {
+      throw ArgumentError('The delta was not taken against this reference');
+    }
+    return Uint8List.sublistView(out, 0, size);
+  }
+
+  /// Rewinds this space in place to the state a [delta] taken with [snapshotDelta] describes, see [restore].
+  void restoreDelta(Uint8List reference, Uint8List delta) => restore(applySnapshotDelta(reference, delta));
+
+  /// Writes the position and angle of every body in this space into [out] with a single native call.
+  ///
+  /// This is much cheaper than reading [Body.position] and [Body.angle] body by body, e.g. when
+  /// rendering thousands of bodies each frame. [out] is split into equally sized columns of
+  /// `rows = out.length ~/ columns` entries: x, y, angle and, when [velocity] is true, velocity x,
+  /// velocity y and angular velocity. The value of column `c` for row `i` is at `out[c * rows + i]`.
+  ///
+  /// When [bodies] is provided, it is cleared and filled with the body written to each row.
+  ///
+  /// Returns the number of bodies in the space. Only the first `rows` bodies are written when [out]
+  /// is too small, so compare the result with `rows` to grow the buffer.
+  int exportTransforms(Float32List out, {bool velocity = false, List<Body>? bodies}) {
+    final rows = out.length ~/ (velocity ? 6 : 3);
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceExportTransformsF32(_native, out, rows, velocity: velocity, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Same as [exportTransforms], but writes double precision values.
+  int exportTransformsFloat64(Float64List out, {bool velocity = false, List<Body>? bodies}) {
+    final rows = out.length ~/ (velocity ? 6 : 3);
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceExportTransformsF64(_native, out, rows, velocity: velocity, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Whether each [step] records the bodies that moved, see [enableChangeTracking].
+  bool get changeTracking {
+    return cpSpaceGetChangeTracking(_native) != 0;
+  }
+
+  /// Makes each [step] record the bodies whose position or angle changed by more than [epsilon]
+  /// since they were last reported.
+  ///
+  /// Use [exportChangedTransforms] after stepping to read only those bodies, so that rendering or
+  /// replication work is proportional to motion rather than to the size of the world. Bodies that
+  /// are added to the space are reported after their first step. Static bodies are never reported.
+  void enableChangeTracking({double epsilon = 0.0}) {
+    cpSpaceSetChangeTracking(_native, enabled: true, epsilon: epsilon);
+  }
+
+  /// Stops recording moved bodies and releases the tracking state.
+  void disableChangeTracking() {
+    cpSpaceSetChangeTracking(_native, enabled: false);
+  }
+
+  /// Number of bodies that moved during the last [step] when change tracking is enabled.
+  int get changedBodyCount {
+    return cpSpaceGetChangedBodyCount(_native);
+  }
+
+  /// Same as [exportTransforms], but only writes the bodies that moved during the last [step].
+  ///
+  /// Returns [changedBodyCount]. Requires [enableChangeTracking].
+  int exportChangedTransforms(Float32List out, {bool velocity = false, List<Body>? bodies}) {
+    final rows = out.length ~/ (velocity ? 6 : 3);
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceExportChangedF32(_native, out, rows, velocity: velocity, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Same as [exportChangedTransforms], but writes double precision values.
+  int exportChangedTransformsFloat64(Float64List out, {bool velocity = false, List<Body>? bodies}) {
+    final rows = out.length ~/ (velocity ? 6 : 3);
+    final handles = bodies == null ? null : <int>[];
+    final count = cpSpaceExportChangedF64(_native, out, rows, velocity: velocity, handles: handles);
+    if (bodies != null) {
+      _resolveBodies(handles!, bodies);
+    }
+    return count;
+  }
+
+  /// Sets the position, angle and, when [velocity] is true, the velocity of every body in [bodies]
+  /// with a single native call.
+  ///
+  /// [state] uses the column layout of [exportTransforms] with one row per body, so column `c` for
+  /// `bodies[i]` is read from `state[c * bodies.length + i]`. Shapes attached to static and kinematic
+  /// bodies are reindexed in the same pass, so spatial queries see the new positions immediately.
+  void importStates(List<Body> bodies, Float32List state, {bool velocity = false}) {
+    _checkStateLength(bodies.length, state.length, velocity: velocity);
+    cpSpaceImportStatesF32(_native, [for (final body in bodies) body.native], state, velocity: velocity);
+  }
+
+  /// Same as [importStates], but reads double precision values.
+  void importStatesFloat64(List<Body> bodies, Float64List state, {bool velocity = false}) {
+    _checkStateLength(bodies.length, state.length, velocity: velocity);
+    cpSpaceImportStatesF64(_native, [for (final body in bodies) body.native], state, velocity: velocity);
+  }
+
+  void _checkStateLength(int rows, int length, {required bool velocity}) {
+    final required = rows * (velocity ? 6 : 3);
+    if (length < required) {
+      throw ArgumentError('State buffer holds $length values but $required are required');
+    }
+  }
+
+  void _resolveBodies(List<int> handles, List<Body> bodies) {
+    bodies.clear();
+    for (final handle in handles) {
+      bodies.add(_bodies[handle] ?? Body.fromNative(handle));
+    }
+  }
+
+  /// Removes [bodies], [shapes] and [constraints] from this space and frees them with a single
+  /// native call.
+  ///
+  /// The objects are disposed afterwards and must not be used anymore. Objects that are not in any
+  /// space are only freed. Despawn the shapes and constraints attached to a body together with it.
+  /// Throws an [ArgumentError] and leaves every object untouched if one of them belongs to another
+  /// space.
+  ///
+  /// When the space is locked, the native work is deferred until the end of the current step.
+  void despawn({
+    Iterable<Body> bodies = const [],
+    Iterable<Shape> shapes = const [],
+    Iterable<Constraint> constraints = const [],
+  }) {
+    // Each object is freed once, however many times it is passed.
+    final liveBodies = bodies.where((body) => !body.disposed).toSet();
+    final liveShapes = shapes.where((shape) => !shape.disposed).toSet();
+    final liveConstraints = constraints.where((constraint) => !constraint.disposed).toSet();
+    // The native side skips objects of other spaces, so they must not be marked as disposed here.
+    for (final body in liveBodies) {
+      _checkDespawnSpace(cpBodyGetSpace(body.native), body, 'bodies');
+    }
+    for (final shape in liveShapes) {
+      _checkDespawnSpace(cpShapeGetSpace(shape.native), shape, 'shapes');
+    }
+    for (final constraint in liveConstraints) {
+      _checkDespawnSpace(cpConstraintGetSpace(constraint.native), constraint, 'constraints');
+    }
+    cpSpaceDespawn(
+      _native,
+      constraints: [for (final constraint in liveConstraints) constraint.native],
+      shapes: [for (final shape in liveShapes) shape.native],
+      bodies: [for (final body in liveBodies) body.native],
+    );
+    for (final constraint in liveConstraints) {
+      _constraints.remove(constraint.native);
+      constraint.markDisposed();
+    }
+    for (final shape in liveShapes) {
+      _shapes.remove(shape.native);
+      shape.markDisposed();
+    }
+    for (final body in liveBodies) {
+      _bodies.remove(body.native);
+      body.markDisposed();
+    }
+  }
+
+  void _checkDespawnSpace(int space, Object object, String name) {
+    if (space != 0 && space != _native) {
+      throw ArgumentError.value(object, name, 'must not belong to another space');
+    }
+  }
+
+  /// Applies every command recorded in [commands] with a single native call.
+  ///
+  /// The buffer is left untouched so it can be executed again; call [CommandBuffer.clear] to reuse it.
+  void executeCommands(CommandBuffer commands) {
+    if (commands.isEmpty) {
+      return;
+    }
+    final executed = cpSpaceExecuteCommands(_native, commands.bytes);
+    if (executed != commands.length) {
+      throw StateError('Executed $executed of ${commands.length} commands, the buffer is malformed');
+    }
+  }
+
+  /// Starts or stops queuing collision events between shapes of collision types [typeA] and [typeB].
+  ///
+  /// Each step, the native collision handler of the pair queues one [CollisionEvent] for every
+  /// callback listed in [events], without calling back into Dart. Read them with
+  /// [drainCollisionEvents] after stepping. Pass an empty set to stop queuing events for the pair.
+  ///
+  /// The handler replaces any other handler for the same pair. Wildcard handlers still run.
+  void setCollisionEvents(int typeA, int typeB, Set<CollisionEventType> events) {
+    var mask = 0;
+    for (final event in events) {
+      mask |= event.value;
+    }
+    cpSpaceSetCollisionEvents(_native, typeA, typeB, mask);
+  }
+
+  /// Applies [rule] to collisions between shapes of collision types [typeA] and [typeB].
+  ///
+  /// The rule runs in the native collision handler of the pair, which is shared with
+  /// [setCollisionEvents], so it never calls back into Dart. Pairs rejected by a rule queue no
+  /// event until they separate. Pass [CollisionRule.none] to remove the rule.
+  void setCollisionRule(int typeA, int typeB, CollisionRule rule) {
+    final direction = rule.oneWayDirection;
+    var rules = 0;
+    if (rule.ignored) {
+      rules |= _ruleIgnore;
+    }
+    if (direction != null) {
+      rules |= _ruleOneWay;
+    }
+    if (rule.firstContactOnly) {
+      rules |= _ruleFirstContactOnly;
+    }
+    cpSpaceSetCollisionRule(_native, typeA, typeB, rules, direction?.x ?? 0, direction?.y ?? 0);
+  }
+
+  /// Applies a table of collision rules keyed by pairs of collision types, see [setCollisionRule].
+  void setCollisionRules(Map<(int, int), CollisionRule> rules) {
+    rules.forEach((types, rule) => setCollisionRule(types.$1, types.$2, rule));
+  }
+
+  /// Maximum number of collision events queued between two [drainCollisionEvents] calls.
+  ///
+  /// Events that do not fit are dropped and counted in [droppedCollisionEvents]. Default is 1024.
+  int get collisionEventCapacity => _collisionEventCapacity;
+
+  set collisionEventCapacity(int capacity) {
+    if (capacity < 1) {
+      throw ArgumentError.value(capacity, 'capacity', 'must be positive');
+    }
+    cpSpaceSetCollisionEventCapacity(_native, capacity);
+    _collisionEventCapacity = capacity;
+  }
+
+  /// Number of collision events queued and not drained yet.
+  int get pendingCollisionEventCount => cpSpaceGetCollisionEventCount(_native);
+
+  /// Number of collision events dropped because the queue was full, as of the last
+  /// [drainCollisionEvents] call.
+  int get droppedCollisionEvents => _droppedCollisionEvents;
+
+  /// Returns the queued collision events, oldest first, and empties the queue.
+  ///
+  /// Events whose shapes are no longer in this space are skipped.
+  List<CollisionEvent> drainCollisionEvents() {
+    _droppedCollisionEvents = cpSpaceGetDroppedCollisionEvents(_native);
+    final pending = cpSpaceGetCollisionEventCount(_native);
+    if (pending == 0) {
+      return const [];
+    }
+    if (_collisionEventBuffer.length < pending * 8) {
+      _collisionEventBuffer = Float64List(pending * 8);
+    }
+    final out = _collisionEventBuffer;
+    final count = cpSpaceDrainCollisionEvents(_native, out, _collisionEventShapes, pending);
+    final events = <CollisionEvent>[];
+    for (var i = 0; i < count; i++) {
+      final shapeA = _shapes[_collisionEventShapes[2 * i]];
+      final shapeB = _shapes[_collisionEventShapes[2 * i + 1]];
+      if (shapeA == null || shapeB == null) {
+        continue;
       }
+      events.add(
+        CollisionEvent(
+          type: CollisionEventType.fromValue(out[i].toInt()),
+          shapeA: shapeA,
+          shapeB: shapeB,
+          normal: Vector(out[pending + i], out[2 * pending + i]),
+          point: Vector(out[3 * pending + i], out[4 * pending + i]),
+          totalImpulse: Vector(out[5 * pending + i], out[6 * pending + i]),
+          totalKineticEnergy: out[7 * pending + i],
+        ),
+      );
+    }
+    return events;
+  }
+
+  /// Starts tracking the shapes overlapping [sensor], which must be in this space.
+  ///
+  /// After each step, the overlapping shapes are compared natively with those of the previous step and
+  /// one [SensorEvent] is queued for each shape that entered or exited. Read them with
+  /// [drainSensorEvents]. Any shape can be tracked, though this is meant for sensors.
+  ///
+  /// Removing [sensor] from the space stops tracking it. Removing a shape overlapping it drops the
+  /// overlap without an exit event.
+  void trackSensor(Shape sensor) {
+    cpSpaceSetSensorTracking(_native, sensor.native, enabled: true);
+  }
 
-      for (final body in _bodies.toList()) {
-        try {
-          removeBody(body);
-          body.dispose();
-        } on Object {
-          _bodies.remove(body);
-        }
+  /// Stops tracking the shapes overlapping [sensor] and forgets its current overlaps.
+  void untrackSensor(Shape sensor) {
+    cpSpaceSetSensorTracking(_native, sensor.native, enabled: false);
+  }
+
+  /// Returns the queued sensor events, oldest first, and empties the queue.
+  List<SensorEvent> drainSensorEvents() {
+    final pending = cpSpaceGetSensorEventCount(_native);
+    if (pending == 0) {
+      return const [];
+    }
+    final types = <int>[];
+    final handles = <int>[];
+    final count = cpSpaceDrainSensorEvents(_native, types, handles, pending);
+    final events = <SensorEvent>[];
+    for (var i = 0; i < count; i++) {
+      final sensor = _shapes[handles[2 * i]];
+      final other = _shapes[handles[2 * i + 1]];
+      if (sensor != null && other != null) {
+        events.add(SensorEvent(type: SensorEventType.fromValue(types[i]), sensor: sensor, other: other));
       }
+    }
+    return events;
+  }
+
+  /// Returns the shapes overlapping the tracked [sensor] at the end of the last step.
+  List<Shape> sensorOverlaps(Shape sensor) {
+    final handles = <int>[];
+    cpSpaceGetSensorOverlaps(_native, sensor.native, handles);
+    return [
+      for (final handle in handles)
+        if (_shapes[handle] case final shape?) shape,
+    ];
+  }
+
+  /// Finds the shapes in this space overlapping [shape], with the contact points of each overlap.
+  ///
+  /// [shape] does not need to be added to the space, but its body must be positioned where the query
+  /// should happen. Shapes whose filter rejects [shape]'s filter are skipped.
+  ///
+  /// At most [maxResults] overlaps are returned in `results`, while `total` is the number of overlapping
+  /// shapes found, which may be larger.
+  ({List<ShapeQueryInfo> results, int total}) shapeQuery(Shape shape, {int maxResults = 64}) {
+    final handles = <int>[];
+    final sets = <ContactPointSet>[];
+    final total = cpSpaceShapeQuery(_native, shape.native, maxResults, handles, sets);
+    return (
+      results: [
+        for (var i = 0; i < handles.length; i++) ShapeQueryInfo(shapePtr: handles[i], contactPointSet: sets[i]),
+      ],
+      total: total,
+    );
+  }
 
+  /// Finds the shapes within [maxDistance] of [point].
+  ///
+  /// At most [maxResults] shapes are returned in `results`, nearest first, while `total` is the number
+  /// of shapes in range, which may be larger. A negative [maxDistance] only finds shapes containing the
+  /// point at least that deep. Sensors are included.
+  ({List<PointQueryInfo> results, int total}) pointQuery(
+    Vector point,
+    double maxDistance, {
+    ShapeFilter filter = const ShapeFilter.all(),
+    int maxResults = 64,
+  }) {
+    final results = <PointQueryInfo>[];
+    final total = cpSpacePointQuery(_native, point.x, point.y, maxDistance, filter, maxResults, results);
+    return (results: results, total: total);
+  }
+
+  /// Finds the shapes along the segment from [start] to [end], thickened by [radius].
+  ///
+  /// At most [maxResults] shapes are returned in `results`, closest to [start] first, while `total` is
+  /// the number of shapes hit, which may be larger. Sensors are included.
+  ({List<SegmentQueryInfo> results, int total}) segmentQuery(
+    Vector start,
+    Vector end, {
+    double radius = 0,
+    ShapeFilter filter = const ShapeFilter.all(),
+    int maxResults = 64,
+  }) {
+    final results = <SegmentQueryInfo>[];
+    final total = cpSpaceSegmentQuery(_native, start.x, start.y, end.x, end.y, radius, filter, maxResults, results);
+    return (results: results, total: total);
+  }
+
+  /// Finds the shapes whose bounding boxes overlap [bb].
+  ///
+  /// At most [maxResults] shapes are returned in `results`, while `total` is the number of overlapping
+  /// shapes found, which may be larger.
+  ({List<Shape> results, int total}) bbQuery(
+    BoundingBox bb, {
+    ShapeFilter filter = const ShapeFilter.all(),
+    int maxResults = 64,
+  }) {
+    final handles = <int>[];
+    final total = cpSpaceBBQuery(_native, bb, filter, maxResults, handles);
+    return (
+      results: [
+        for (final handle in handles)
+          if (_shapes[handle] case final shape?) shape,
+      ],
+      total: total,
+    );
+  }
+
+  /// Sweeps [shape] along [translation] and returns the first shape it touches, or null if it can
+  /// travel the whole way.
+  ///
+  /// [shape] starts where its body places it and moves without rotating. It does not need to be added to
+  /// the space. Shapes rejected by its filter, sensors and shapes of the same body are ignored. The cast
+  /// stops once the gap to a shape is within [tolerance], so moving by `alpha * translation` leaves the
+  /// shapes just apart. A shape already overlapping [shape] is reported with an alpha of 0. Throws an
+  /// [ArgumentError] if [tolerance] is not positive.
+  ///
+  /// ```dart
+  /// final hit = space.shapeCast(player.shape, velocity * dt);
+  /// player.body.position += velocity * dt * (hit?.alpha ?? 1);
+  /// ```
+  ShapeCastInfo? shapeCast(Shape shape, Vector translation, {double tolerance = 1e-3}) {
+    if (tolerance <= 0) {
+      throw ArgumentError.value(tolerance, 'tolerance', 'must be positive');
+    }
+    return cpSpaceShapeCast(_native, shape.native, translation.x, translation.y, tolerance);
+  }
+
+  /// Writes the transforms of the shapes visible in [viewport] into an instance buffer for rendering.
+  ///
+  /// Only shapes with a non-zero [Shape.renderId] whose bounding box intersects [viewport] are visible.
+  /// They are found through the space's bounding box trees, so the cost follows what is on screen
+  /// rather than the number of bodies in the space.
+  ///
+  /// For each visible shape, the position x, position y and angle of its body are written to
+  /// [instances], three values per shape. [renderIds] and [shapes] optionally receive the render id and
+  /// the shape of each instance, null for shapes not added through this space. At most
+  /// `instances.length ~/ 3` shapes are written; returns the number of visible shapes, which may be
+  /// larger.
+  ///
+  /// ```dart
+  /// final instances = Float32List(3 * 1024);
+  /// final ids = Uint32List(1024);
+  /// final count = space.queryVisible(camera, instances, renderIds: ids);
+  /// ```
+  int queryVisible(
+    BoundingBox viewport,
+    Float32List instances, {
+    Uint32List? renderIds,
+    List<Shape?>? shapes,
+    ShapeFilter filter = const ShapeFilter.all(),
+  }) {
+    final capacity = instances.length ~/ 3;
+    if (renderIds != null && renderIds.length < capacity) {
+      throw ArgumentError('renderIds holds ${renderIds.length} values but $capacity are required');
+    }
+    final handles = shapes == null ? null : <int>[];
+    final count = cpSpaceQueryVisible(_native, viewport, filter, instances, renderIds: renderIds, shapes: handles);
+    if (shapes != null) {
+      shapes
+        ..clear()
+        ..addAll([for (final handle in handles!) _shapes[handle]]);
+    }
+    return count;
+  }
+
+  /// Finds the first shape hit by each of many segments in one native call.
+  ///
+  /// [segments] holds five values per segment: start x, start y, end x, end y and radius. For each
+  /// segment, five values are written to [hits]: the hit point x and y, the surface normal x and y and
+  /// the normalized distance along the segment. A segment that hits nothing reports its end point, a
+  /// zero normal and a distance of 1.
+  ///
+  /// [filter] applies to every segment unless [filters] holds one filter per segment. Sensors are never
+  /// hit. Returns the first shape hit by each segment, or null for a miss.
+  ///
+  /// Large batches are split across the native worker threads, see [workerThreadCount].
+  ///
+  /// ```dart
+  /// final rays = Float64List.fromList([0, 0, 100, 0, 0, 0, 0, 0, -100, 0]);
+  /// final hits = Float64List(rays.length);
+  /// final shapes = space.segmentQueryFirstBatch(rays, hits);
+  /// ```
+  List<Shape?> segmentQueryFirstBatch(
+    Float64List segments,
+    Float64List hits, {
+    ShapeFilter filter = const ShapeFilter.all(),
+    List<ShapeFilter>? filters,
+  }) {
+    final count = _checkQueryBatch(segments, 5, 'start, end and radius', filters);
+    _checkHitBuffer(hits, count);
+    final handles = <int>[];
+    cpSpaceSegmentQueryFirstBatch(_native, segments, filters ?? [filter], hits, handles);
+    return [for (final handle in handles) _shapes[handle]];
+  }
+
+  /// Finds the shape nearest to each of many points in one native call.
+  ///
+  /// [points] holds three values per query: x, y and the maximum distance to look for a shape. For each
+  /// query, five values are written to [hits]: the nearest point x and y on the shape's surface, its
+  /// distance, negative inside the shape, and the distance gradient x and y.
+  ///
+  /// [filter] applies to every query unless [filters] holds one filter per query. Sensors are ignored.
+  /// Returns the nearest shape of each query, or null if no shape is within range.
+  ///
+  /// Large batches are split across the native worker threads, see [workerThreadCount].
+  List<Shape?> pointQueryNearestBatch(
+    Float64List points,
+    Float64List hits, {
+    ShapeFilter filter = const ShapeFilter.all(),
+    List<ShapeFilter>? filters,
+  }) {
+    final count = _checkQueryBatch(points, 3, 'x, y and maximum distance', filters);
+    _checkHitBuffer(hits, count);
+    final handles = <int>[];
+    cpSpacePointQueryNearestBatch(_native, points, filters ?? [filter], hits, handles);
+    return [for (final handle in handles) _shapes[handle]];
+  }
+
+  /// Finds the shapes whose bounding boxes overlap each of many boxes in one native call.
+  ///
+  /// [boxes] holds four values per query: left, bottom, right and top. [filter] applies to every query
+  /// unless [filters] holds one filter per query. At most [maxResultsPerQuery] shapes are returned for
+  /// each box in `results`, while `totals` holds the number of overlapping shapes found, which may be
+  /// larger.
+  ///
+  /// Large batches are split across the native worker threads, see [workerThreadCount].
+  ({List<List<Shape>> results, List<int> totals}) bbQueryBatch(
+    Float64List boxes, {
+    int maxResultsPerQuery = 16,
+    ShapeFilter filter = const ShapeFilter.all(),
+    List<ShapeFilter>? filters,
+  }) {
+    final count = _checkQueryBatch(boxes, 4, 'left, bottom, right and top', filters);
+    final handles = <int>[];
+    final totals = <int>[];
+    cpSpaceBBQueryBatch(_native, boxes, filters ?? [filter], maxResultsPerQuery, handles, totals);
+    return (
+      results: [
+        for (var i = 0; i < count; i++)
+          [
+            for (var j = i * maxResultsPerQuery; j < (i + 1) * maxResultsPerQuery; j++)
+              if (_shapes[handles[j]] case final shape?) shape,
+          ],
+      ],
+      totals: totals,
+    );
+  }
+
+  int _checkQueryBatch(Float64List queries, int stride, String layout, List<ShapeFilter>? filters) {
+    if (queries.length % stride != 0) {
+      throw ArgumentError('Query list must hold $stride values per query ($layout)');
+    }
+    final count = queries.length ~/ stride;
+    if (filters != null && filters.length != count) {
+      throw ArgumentError('filters must hold $count values, got ${filters.length}');
+    }
+    return count;
+  }
+
+  void _checkHitBuffer(Float64List hits, int count) {
+    if (hits.length < count * 5) {
+      throw ArgumentError('Hit buffer holds ${hits.length} values but ${count * 5} are required');
+    }
+  }
+
+  /// Disposes of this space and all its resources.
+  ///
+  /// This will also dispose all bodies, shapes, and constraints that were added to this space.
+  /// Safe to call multiple times (idempotent).
+  void dispose() {
+    if (!_disposed) {
+      waitStep();
+      despawn(
+        bodies: _bodies.values.toList(),
+        shapes: _shapes.values.toList(),
+        constraints: _constraints.values.toList(),
+      );
       cpSpaceFree(_native);
       _disposed = true;
     }
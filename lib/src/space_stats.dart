@@ -0,0 +1,66 @@
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+
+/// Counters describing a [Space] as left by its last step, see [Space.stats].
+class SpaceStats {
+  /// Creates a new SpaceStats.
+  const SpaceStats({
+    required this.activeBodies,
+    required this.sleepingBodies,
+    required this.staticBodies,
+    required this.shapes,
+    required this.constraints,
+    required this.arbiters,
+    required this.contacts,
+    required this.cachedArbiters,
+    required this.broadphasePairs,
+  });
+
+  /// Creates a SpaceStats from the `CP_FFI_STATS` native values.
+  factory SpaceStats.fromList(List<int> values) {
+    return SpaceStats(
+      activeBodies: values[0],
+      sleepingBodies: values[1],
+      staticBodies: values[2],
+      shapes: values[3],
+      constraints: values[4],
+      arbiters: values[5],
+      contacts: values[6],
+      cachedArbiters: values[7],
+      broadphasePairs: values[8] < 0 ? null : values[8],
+    );
+  }
+
+  /// The awake dynamic and kinematic bodies, which the step integrates.
+  final int activeBodies;
+
+  /// The dynamic bodies put to sleep, see [Space.sleepTimeThreshold].
+  final int sleepingBodies;
+
+  /// The static bodies added to the space.
+  final int staticBodies;
+
+  /// The shapes of all bodies.
+  final int shapes;
+
+  /// The constraints the last step solved, the ones between sleeping bodies excluded.
+  final int constraints;
+
+  /// The colliding shape pairs the last step solved.
+  final int arbiters;
+
+  /// The contact points of [arbiters].
+  final int contacts;
+
+  /// The arbiters cached by the space, including the ones of sleeping pairs and of pairs that separated recently.
+  final int cachedArbiters;
+
+  /// The shape pairs whose bounding boxes overlapped during the last step, or null if that step was not
+  /// profiled, see [Space.enableProfiling].
+  final int? broadphasePairs;
+
+  @override
+  String toString() =>
+      'SpaceStats(activeBodies: $activeBodies, sleepingBodies: $sleepingBodies, staticBodies: $staticBodies, '
+      'shapes: $shapes, constraints: $constraints, arbiters: $arbiters, contacts: $contacts, '
+      'cachedArbiters: $cachedArbiters, broadphasePairs: $broadphasePairs)';
+}
@@ -0,0 +1,75 @@
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+
+/// The seconds one [Space.step] spent in each of its phases, see [Space.enableProfiling].
+///
+/// Spaces created with [Space.threaded] only report [extensions] and [total].
+class StepProfile {
+  /// Creates a new StepProfile.
+  const StepProfile({
+    required this.integrate,
+    required this.broadphase,
+    required this.narrowphase,
+    required this.islands,
+    required this.arbiters,
+    required this.preStep,
+    required this.solver,
+    required this.callbacks,
+    required this.extensions,
+    required this.total,
+  });
+
+  /// Creates a StepProfile from the `CP_FFI_PROFILE_PHASES` native values starting at [offset].
+  factory StepProfile.fromList(List<double> values, [int offset = 0]) {
+    return StepProfile(
+      integrate: values[offset],
+      broadphase: values[offset + 1],
+      narrowphase: values[offset + 2],
+      islands: values[offset + 3],
+      arbiters: values[offset + 4],
+      preStep: values[offset + 5],
+      solver: values[offset + 6],
+      callbacks: values[offset + 7],
+      extensions: values[offset + 8],
+      total: values[offset + 9],
+    );
+  }
+
+  /// Number of native values per step.
+  static const int phaseCount = 10;
+
+  /// Integrating the positions and velocities of the awake bodies.
+  final double integrate;
+
+  /// Updating the bounding boxes of the shapes and finding the pairs whose bounding boxes overlap.
+  final double broadphase;
+
+  /// Colliding the shapes of each pair and updating their arbiters.
+  final double narrowphase;
+
+  /// Rebuilding the contact graph, putting idle bodies to sleep and waking the others.
+  final double islands;
+
+  /// Dropping the cached arbiters of separated shapes and calling the separate callbacks.
+  final double arbiters;
+
+  /// Preparing the arbiters and constraints for the solver and applying their cached impulses.
+  final double preStep;
+
+  /// The solver iterations, see [Space.iterations].
+  final double solver;
+
+  /// The post-solve and post-step callbacks.
+  final double callbacks;
+
+  /// The wrapper's own work after the step: change tracking, sensor tracking and broadphase tuning.
+  final double extensions;
+
+  /// The whole step.
+  final double total;
+
+  @override
+  String toString() =>
+      'StepProfile(total: $total, integrate: $integrate, broadphase: $broadphase, narrowphase: $narrowphase, '
+      'islands: $islands, arbiters: $arbiters, preStep: $preStep, solver: $solver, callbacks: $callbacks, '
+      'extensions: $extensions)';
+}
@@ -0,0 +1,37 @@
+import 'package:chipmunk2d_physics_ffi/src/platform/chipmunk_bindings.dart';
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+
+/// Starts recording a native trace of the physics calls, dropping the previous one.
+///
+/// The trace holds the native extension calls, such as [Space.executeCommands] or
+/// [Space.segmentQueryFirstBatch], the calls that add, remove or reindex bodies, shapes and
+/// constraints, the body and shape setters, the phases of each [Space.step] and the chunks run by the
+/// worker threads, each on the thread that ran it. Getters and space settings are not traced. Each
+/// thread keeps its first [eventsPerThread] events. Steps are slightly slower while recording, as
+/// they time their phases like [Space.enableProfiling].
+/// Does nothing when [Space.profilingAvailable] is false.
+void startTrace({int eventsPerThread = 65536}) {
+  if (eventsPerThread <= 0) {
+    throw ArgumentError.value(eventsPerThread, 'eventsPerThread', 'must be positive');
+  }
+  cpFfiTraceStart(eventsPerThread);
+}
+
+/// Stops recording the native trace, which stays available to [writeTrace].
+void stopTrace() => cpFfiTraceStop();
+
+/// Whether a native trace is recording, see [startTrace].
+bool get isTracing => cpFfiTraceIsRecording() != 0;
+
+/// Writes the current or last trace to [path] in the Chrome trace event format, which
+/// `chrome://tracing` and the Perfetto UI can open, and returns the number of events written.
+///
+/// Call it after [stopTrace], and do not call [startTrace] from another isolate while it runs. Not
+/// supported on the web.
+int writeTrace(String path) {
+  final written = cpFfiTraceWrite(path);
+  if (written < 0) {
+    throw ArgumentError.value(path, 'path', 'cannot be opened for writing');
+  }
+  return written;
+}
@@ -0,0 +1,14 @@
+import 'package:chipmunk2d_physics_ffi/src/platform/chipmunk_bindings.dart';
+import 'package:chipmunk2d_physics_ffi/src/space.dart';
+
+/// Number of native worker threads that run large batches, such as [Space.segmentQueryFirstBatch],
+/// alongside the calling thread.
+///
+/// Defaults to one worker per CPU beyond the first. Always 0 on the web, where batches run on the
+/// calling thread.
+int get workerThreadCount => cpFfiGetWorkerThreadCount();
+
+/// Sets the number of native worker threads.
+///
+/// Use 0 to run batches on the calling thread only, or a negative value to restore the default.
+set workerThreadCount(int count) => cpFfiSetWorkerThreadCount(count);
@@ -1,16 +1,323 @@
 #include "chipmunk2d_physics_ffi.h"
 
+// The extensions below need direct access to the space and body internals.
+#include <chipmunk/chipmunk_private.h>
+#if CP_FFI_HASTY_SPACE
+#include <chipmunk/cpHastySpace.h>
+#endif
+
+// Extension state
+// Growable array of fixed-size items.
+typedef struct cpFfiBuffer {
+    void* items;
+    int count;
+    int capacity;
+} cpFfiBuffer;
+
+// A tracked sensor and a shape it overlaps.
+typedef struct cpFfiOverlap {
+    cpShape* sensor;
+    cpShape* other;
+} cpFfiOverlap;
+
+typedef struct cpFfiAsyncStep cpFfiAsyncStep;
+
+typedef struct cpFfiSensorEvent {
+    int type;
+    cpShape* sensor;
+    cpShape* other;
+} cpFfiSensorEvent;
+
+// Per-space state of the wrapper extensions, allocated on first use and stored in the space's user data.
+typedef struct cpFfiSpaceData {
+    // Last reported transform of each tracked body (cpFfiBodyRecord), keyed by body.
+    cpHashSet* bodyRecords;
+    int trackChanges;
+    cpFloat changeEpsilon;
+    cpArray* changedBodies;
+    // Collision events, queued in a ring buffer until drained.
+    struct cpFfiCollisionEvent* events;
+    int eventCapacity;
+    int eventHead;
+    int eventCount;
+    int droppedEvents;
+    // cpFfiPairHandler of every collision handler installed by the extensions.
+    cpArray* pairHandlers;
+    // Shapes whose overlaps are tracked, their overlaps at the end of the last step (cpFfiOverlap,
+    // sorted) and the enter/exit events not drained yet (cpFfiSensorEvent).
+    cpHashSet* trackedSensors;
+    cpFfiBuffer overlaps;
+    cpFfiBuffer currentOverlaps;
+    cpFfiBuffer sensorEvents;
+    // Set for spaces created by cp_hasty_space_new, which are stepped and freed by the cpHastySpace functions.
+    int hasty;
+    // Background step thread and transform snapshots, created by the first cp_space_step_async.
+    cpFfiAsyncStep* asyncStep;
+    // Fixed timestep of cp_space_advance: the time not simulated yet and the transform of each body
+    // before the last substep (cpFfiBodyRecord), keyed by body.
+    cpFloat accumulator;
+    cpFloat fixedDt;
+    cpHashSet* previousStates;
+    // Broadphase requested with cp_space_set_broadphase (CP_FFI_BROADPHASE_*) and whether the spatial
+    // indexes currently are spatial hashes, with their cell size and count. In auto mode, the choice is
+    // revisited when the number of dynamic shapes drifts from the one it was last made for.
+    int broadphase;
+    int spatialHash;
+    cpFloat hashDim;
+    int hashCount;
+    int tunedShapeCount;
+    // Ring buffer of the phase timings (CP_FFI_PROFILE_PHASES each) of the last profileCapacity steps,
+    // and the narrowphase time of the step being profiled.
+    double* profiles;
+    int profileCapacity;
+    int profileHead;
+    int profileCount;
+    double narrowphaseTime;
+    // Broadphase pairs counted by the last profiled step, and the stamp of that step.
+    int broadphasePairs;
+    cpTimestamp pairStamp;
+} cpFfiSpaceData;
+
+typedef struct cpFfiBodyRecord {
+    cpBody* body;
+    cpVect p;
+    cpFloat a;
+} cpFfiBodyRecord;
+
+static cpBool cp_ffi_body_record_eql(const void* ptr, const void* elt) {
+    return ((const cpFfiBodyRecord*)elt)->body == ptr;
+}
+
+static cpBool cp_ffi_ptr_eql(const void* ptr, const void* elt) {
+    return ptr == elt;
+}
+
+// Adds a pointer to a set of pointers, returning whether it was not in the set yet.
+static int cp_ffi_ptr_set_insert(cpHashSet* set, void* ptr) {
+    int count = cpHashSetCount(set);
+    cpHashSetInsert(set, (cpHashValue)ptr, ptr, NULL, ptr);
+    return cpHashSetCount(set) > count;
+}
+
+static void* cp_ffi_buffer_push(cpFfiBuffer* buffer, size_t size) {
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? 2 * buffer->capacity : 16;
+        buffer->items = cprealloc(buffer->items, buffer->capacity * size);
+    }
+    return (char*)buffer->items + size * buffer->count++;
+}
+
+static void* cp_ffi_body_record_trans(const void* ptr, void* unused) {
+    (void)unused;
+    cpFfiBodyRecord* record = (cpFfiBodyRecord*)cpcalloc(1, sizeof(cpFfiBodyRecord));
+    record->body = (cpBody*)ptr;
+    return record;
+}
+
+static void cp_ffi_free_elt(void* elt, void* unused) {
+    (void)unused;
+    cpfree(elt);
+}
+
+static cpFfiSpaceData* cp_ffi_space_data(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) {
+        data = (cpFfiSpaceData*)cpcalloc(1, sizeof(cpFfiSpaceData));
+        space->userData = data;
+    }
+    return data;
+}
+
+static cpFfiBodyRecord* cp_ffi_record_insert(cpHashSet** records, cpBody* body) {
+    if (!*records) *records = cpHashSetNew(0, cp_ffi_body_record_eql);
+    return (cpFfiBodyRecord*)cpHashSetInsert(*records, (cpHashValue)body, body, cp_ffi_body_record_trans, NULL);
+}
+
+static void cp_ffi_record_remove(cpHashSet* records, cpBody* body) {
+    if (records) {
+        void* record = (void*)cpHashSetRemove(records, (cpHashValue)body, body);
+        if (record) cpfree(record);
+    }
+}
+
+static void cp_ffi_records_free(cpHashSet** records) {
+    if (*records) {
+        cpHashSetEach(*records, cp_ffi_free_elt, NULL);
+        cpHashSetFree(*records);
+        *records = NULL;
+    }
+}
+
+static cpFfiBodyRecord* cp_ffi_body_record(cpFfiSpaceData* data, cpBody* body) {
+    return cp_ffi_record_insert(&data->bodyRecords, body);
+}
+
+static void cp_ffi_clear_body_records(cpFfiSpaceData* data) {
+    cp_ffi_records_free(&data->bodyRecords);
+    if (data->changedBodies) data->changedBodies->num = 0;
+}
+
+static void cp_ffi_async_step_free(cpFfiAsyncStep* async);
+static void cp_ffi_forget_snapshot_bodies(cpSpace* space, cpFfiAsyncStep* async);
+
+static void cp_ffi_space_data_free(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return;
+
+    // The step thread uses the space, so it is stopped first.
+    if (data->asyncStep) cp_ffi_async_step_free(data->asyncStep);
+    cp_ffi_clear_body_records(data);
+    cp_ffi_records_free(&data->previousStates);
+    cpfree(data->profiles);
+    if (data->changedBodies) cpArrayFree(data->changedBodies);
+    cpfree(data->events);
+    if (data->trackedSensors) cpHashSetFree(data->trackedSensors);
+    cpfree(data->overlaps.items);
+    cpfree(data->currentOverlaps.items);
+    cpfree(data->sensorEvents.items);
+    if (data->pairHandlers) {
+        cpArrayFreeEach(data->pairHandlers, cpfree);
+        cpArrayFree(data->pairHandlers);
+    }
+    cpfree(data);
+    space->userData = NULL;
+}
+
+// Keeps only the bodies of `arr` that still belong to `space`, preserving their order.
+static void cp_ffi_compact_bodies(cpArray* arr, cpSpace* space) {
+    int count = 0;
+    for (int i = 0; i < arr->num; i++) {
+        cpBody* body = (cpBody*)arr->arr[i];
+        if (body->space == space) arr->arr[count++] = body;
+    }
+    arr->num = count;
+}
+
+static void cp_ffi_forget_body_record(cpFfiSpaceData* data, cpBody* body) {
+    cp_ffi_record_remove(data->bodyRecords, body);
+    cp_ffi_record_remove(data->previousStates, body);
+}
+
+// Drops everything the extensions remember about a body leaving the space.
+static void cp_ffi_forget_body(cpSpace* space, cpBody* body) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return;
+
+    cp_ffi_forget_body_record(data, body);
+    if (data->changedBodies) cpArrayDeleteObj(data->changedBodies, body);
+    if (data->asyncStep) cp_ffi_forget_snapshot_bodies(space, data->asyncStep);
+}
+
+// Same as cp_ffi_forget_body for many bodies, which must already be detached from the space.
+static void cp_ffi_forget_bodies(cpSpace* space, cpBody** bodies, int count) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return;
+
+    for (int i = 0; i < count; i++) {
+        if (!bodies[i]->space) cp_ffi_forget_body_record(data, bodies[i]);
+    }
+    if (data->changedBodies) cp_ffi_compact_bodies(data->changedBodies, space);
+    if (data->asyncStep) cp_ffi_forget_snapshot_bodies(space, data->asyncStep);
+}
+
+// Stops tracking the given shapes that left the space and drops the overlaps and pending sensor
+// events of every shape that left it.
+static void cp_ffi_forget_shapes(cpSpace* space, cpShape** shapes, int count) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data || !data->trackedSensors) return;
+
+    for (int i = 0; i < count; i++) {
+        if (!shapes[i]->space) cpHashSetRemove(data->trackedSensors, (cpHashValue)shapes[i], shapes[i]);
+    }
+
+    cpFfiOverlap* overlaps = (cpFfiOverlap*)data->overlaps.items;
+    int kept = 0;
+    for (int i = 0; i < data->overlaps.count; i++) {
+        if (overlaps[i].sensor->space == space && overlaps[i].other->space == space) overlaps[kept++] = overlaps[i];
+    }
+    data->overlaps.count = kept;
+
+    cpFfiSensorEvent* events = (cpFfiSensorEvent*)data->sensorEvents.items;
+    kept = 0;
+    for (int i = 0; i < data->sensorEvents.count; i++) {
+        if (events[i].sensor->space == space && events[i].other->space == space) events[kept++] = events[i];
+    }
+    data->sensorEvents.count = kept;
+}
+
+static void cp_ffi_track_changes(cpSpace* space, cpFfiSpaceData* data);
+static void cp_ffi_track_sensors(cpSpace* space, cpFfiSpaceData* data);
+static void cp_ffi_tune_broadphase(cpSpace* space, cpFfiSpaceData* data, int force);
+#if CP_FFI_PROFILING
+static void cp_ffi_profiled_step(cpSpace* space, cpFfiSpaceData* data, cpFloat dt);
+static double cp_ffi_now(void);
+static int cp_ffi_tracing(void);
+static void cp_ffi_trace_record(const char* name, const char* category, double start, double end);
+static void cp_ffi_trace_release(void);
+
+// Records the time from CP_FFI_TRACE_BEGIN to CP_FFI_TRACE_END as a trace event while tracing.
+#define CP_FFI_TRACE_BEGIN() double cpFfiTraceStart = cp_ffi_tracing() ? cp_ffi_now() : 0.0
+#define CP_FFI_TRACE_END(name) do { if (cpFfiTraceStart > 0.0) cp_ffi_trace_record(name, "ffi", cpFfiTraceStart, cp_ffi_now()); } while (0)
+// Hands the trace buffer of a thread the extension started back for reuse before the thread exits.
+#define CP_FFI_TRACE_THREAD_EXIT() cp_ffi_trace_release()
+#else
+#define CP_FFI_TRACE_BEGIN() ((void)0)
+#define CP_FFI_TRACE_END(name) ((void)0)
+#define CP_FFI_TRACE_THREAD_EXIT() ((void)0)
+#endif
+
+// Runs the enabled extensions after each step.
+static void cp_ffi_space_post_step(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return;
+
+    if (data->trackChanges) cp_ffi_track_changes(space, data);
+    if (data->trackedSensors && cpHashSetCount(data->trackedSensors) > 0) cp_ffi_track_sensors(space, data);
+    if (data->broadphase == CP_FFI_BROADPHASE_AUTO) cp_ffi_tune_broadphase(space, data, 0);
+}
+
+static int cp_ffi_space_is_hasty(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data && data->hasty;
+}
+
 // Space management
 FFI_PLUGIN_EXPORT cpSpace* cp_space_new(void) {
     return cpSpaceNew();
 }
 
 FFI_PLUGIN_EXPORT void cp_space_free(cpSpace* space) {
+    int hasty = cp_ffi_space_is_hasty(space);
+    cp_ffi_space_data_free(space);
+#if CP_FFI_HASTY_SPACE
+    if (hasty) {
+        cpHastySpaceFree(space);
+        return;
+    }
+#else
+    (void)hasty;
+#endif
     cpSpaceFree(space);
 }
 
 FFI_PLUGIN_EXPORT void cp_space_step(cpSpace* space, cpFloat dt) {
+#if CP_FFI_PROFILING
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if ((data && data->profiles) || cp_ffi_tracing()) {
+        cp_ffi_profiled_step(space, cp_ffi_space_data(space), dt);
+        return;
+    }
+#endif
+#if CP_FFI_HASTY_SPACE
+    if (cp_ffi_space_is_hasty(space)) {
+        cpHastySpaceStep(space, dt);
+    } else {
+        cpSpaceStep(space, dt);
+    }
+#else
     cpSpaceStep(space, dt);
+#endif
+    cp_ffi_space_post_step(space);
 }
 
 FFI_PLUGIN_EXPORT void cp_space_set_gravity(cpSpace* space, cpVect gravity) {
@@ -50,15 +357,21 @@ FFI_PLUGIN_EXPORT void cp_space_set_collision_persistence(cpSpace* space, unsign
 }
 
 FFI_PLUGIN_EXPORT void cp_space_reindex_static(cpSpace* space) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceReindexStatic(space);
+    CP_FFI_TRACE_END("cp_space_reindex_static");
 }
 
 FFI_PLUGIN_EXPORT void cp_space_reindex_shape(cpSpace* space, cpShape* shape) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceReindexShape(space, shape);
+    CP_FFI_TRACE_END("cp_space_reindex_shape");
 }
 
 FFI_PLUGIN_EXPORT void cp_space_reindex_shapes_for_body(cpSpace* space, cpBody* body) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceReindexShapesForBody(space, body);
+    CP_FFI_TRACE_END("cp_space_reindex_shapes_for_body");
 }
 
 FFI_PLUGIN_EXPORT cpBody* cp_space_get_static_body(cpSpace* space) {
@@ -114,21 +427,109 @@ FFI_PLUGIN_EXPORT int cp_space_contains_constraint(cpSpace* space, cpConstraint*
 }
 
 FFI_PLUGIN_EXPORT void cp_space_add_constraint(cpSpace* space, cpConstraint* constraint) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceAddConstraint(space, constraint);
+    CP_FFI_TRACE_END("cp_space_add_constraint");
 }
 
 FFI_PLUGIN_EXPORT void cp_space_remove_constraint(cpSpace* space, cpConstraint* constraint) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceRemoveConstraint(space, constraint);
+    CP_FFI_TRACE_END("cp_space_remove_constraint");
 }
 
 FFI_PLUGIN_EXPORT cpShape* cp_space_segment_query_first(cpSpace* space, cpVect start, cpVect end, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo* out) {
     return cpSpaceSegmentQueryFirst(space, start, end, radius, filter, out);
 }
 
-FFI_PLUGIN_EXPORT int cp_space_shape_query(cpSpace* space, cpShape* shape, void* func, void* data) {
-    // Note: Callback-based queries are not fully supported via FFI
-    // This is a placeholder - full implementation would require callback marshalling
-    return cpSpaceShapeQuery(space, shape, NULL, data) ? 1 : 0;
+typedef struct cpFfiShapeQueryResults {
+    cpShape** shapes;
+    cpContactPointSet* sets;
+    int capacity;
+    int count;
+} cpFfiShapeQueryResults;
+
+static void cp_ffi_shape_query_hit(cpShape* shape, cpContactPointSet* points, void* data) {
+    cpFfiShapeQueryResults* results = (cpFfiShapeQueryResults*)data;
+    int i = results->count++;
+    if (i >= results->capacity) return;
+
+    if (results->shapes) results->shapes[i] = shape;
+    if (results->sets) results->sets[i] = *points;
+}
+
+// Writes up to `capacity` overlapping shapes and their contact point sets, either array may be NULL.
+// Returns the total number of overlapping shapes.
+FFI_PLUGIN_EXPORT int cp_space_shape_query(cpSpace* space, cpShape* shape, cpShape** shapes, cpContactPointSet* sets, int capacity) {
+    cpFfiShapeQueryResults results = {shapes, sets, capacity, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceShapeQuery(space, shape, cp_ffi_shape_query_hit, &results);
+    CP_FFI_TRACE_END("cp_space_shape_query");
+    return results.count;
+}
+
+typedef struct cpFfiQueryResults {
+    void* items;
+    int capacity;
+    int count;
+} cpFfiQueryResults;
+
+// Keeps the `capacity` nearest point query hits, sorted by distance.
+static void cp_ffi_point_query_hit(cpShape* shape, cpVect point, cpFloat distance, cpVect gradient, void* data) {
+    cpFfiQueryResults* results = (cpFfiQueryResults*)data;
+    cpPointQueryInfo* items = (cpPointQueryInfo*)results->items;
+    int i = results->count++ < results->capacity ? results->count - 1 : results->capacity;
+    for (; i > 0 && items[i - 1].distance > distance; i--) {
+        if (i < results->capacity) items[i] = items[i - 1];
+    }
+    if (i < results->capacity) items[i] = (cpPointQueryInfo){shape, point, distance, gradient};
+}
+
+// Keeps the `capacity` first segment query hits, sorted by alpha.
+static void cp_ffi_segment_query_hit(cpShape* shape, cpVect point, cpVect normal, cpFloat alpha, void* data) {
+    cpFfiQueryResults* results = (cpFfiQueryResults*)data;
+    cpSegmentQueryInfo* items = (cpSegmentQueryInfo*)results->items;
+    int i = results->count++ < results->capacity ? results->count - 1 : results->capacity;
+    for (; i > 0 && items[i - 1].alpha > alpha; i--) {
+        if (i < results->capacity) items[i] = items[i - 1];
+    }
+    if (i < results->capacity) items[i] = (cpSegmentQueryInfo){shape, point, normal, alpha};
+}
+
+static void cp_ffi_bb_query_hit(cpShape* shape, void* data) {
+    cpFfiQueryResults* results = (cpFfiQueryResults*)data;
+    if (results->count < results->capacity) ((cpShape**)results->items)[results->count] = shape;
+    results->count++;
+}
+
+// Writes the `capacity` shapes nearest to `point` within `maxDistance`, sorted by distance.
+// Returns the total number of shapes in range.
+FFI_PLUGIN_EXPORT int cp_space_point_query(cpSpace* space, cpVect point, cpFloat maxDistance, cpShapeFilter filter, cpPointQueryInfo* out, int capacity) {
+    cpFfiQueryResults results = {out, capacity, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpacePointQuery(space, point, maxDistance, filter, cp_ffi_point_query_hit, &results);
+    CP_FFI_TRACE_END("cp_space_point_query");
+    return results.count;
+}
+
+// Writes the `capacity` first shapes along the segment, sorted by alpha.
+// Returns the total number of shapes hit.
+FFI_PLUGIN_EXPORT int cp_space_segment_query(cpSpace* space, cpVect start, cpVect end, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo* out, int capacity) {
+    cpFfiQueryResults results = {out, capacity, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceSegmentQuery(space, start, end, radius, filter, cp_ffi_segment_query_hit, &results);
+    CP_FFI_TRACE_END("cp_space_segment_query");
+    return results.count;
+}
+
+// Writes up to `capacity` shapes whose bounding box overlaps `bb`.
+// Returns the total number of overlapping shapes.
+FFI_PLUGIN_EXPORT int cp_space_bb_query(cpSpace* space, cpBB bb, cpShapeFilter filter, cpShape** out, int capacity) {
+    cpFfiQueryResults results = {out, capacity, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceBBQuery(space, bb, filter, cp_ffi_bb_query_hit, &results);
+    CP_FFI_TRACE_END("cp_space_bb_query");
+    return results.count;
 }
 
 // Body management
@@ -149,7 +550,9 @@ FFI_PLUGIN_EXPORT void cp_body_free(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_position(cpBody* body, cpVect pos) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetPosition(body, pos);
+    CP_FFI_TRACE_END("cp_body_set_position");
 }
 
 FFI_PLUGIN_EXPORT cpVect cp_body_get_position(cpBody* body) {
@@ -157,7 +560,9 @@ FFI_PLUGIN_EXPORT cpVect cp_body_get_position(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_velocity(cpBody* body, cpVect velocity) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetVelocity(body, velocity);
+    CP_FFI_TRACE_END("cp_body_set_velocity");
 }
 
 FFI_PLUGIN_EXPORT cpVect cp_body_get_velocity(cpBody* body) {
@@ -165,7 +570,9 @@ FFI_PLUGIN_EXPORT cpVect cp_body_get_velocity(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_angle(cpBody* body, cpFloat angle) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetAngle(body, angle);
+    CP_FFI_TRACE_END("cp_body_set_angle");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_body_get_angle(cpBody* body) {
@@ -177,7 +584,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_body_get_mass(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_mass(cpBody* body, cpFloat mass) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetMass(body, mass);
+    CP_FFI_TRACE_END("cp_body_set_mass");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_body_get_moment(cpBody* body) {
@@ -185,7 +594,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_body_get_moment(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_moment(cpBody* body, cpFloat moment) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetMoment(body, moment);
+    CP_FFI_TRACE_END("cp_body_set_moment");
 }
 
 FFI_PLUGIN_EXPORT cpVect cp_body_get_center_of_gravity(cpBody* body) {
@@ -193,7 +604,9 @@ FFI_PLUGIN_EXPORT cpVect cp_body_get_center_of_gravity(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_center_of_gravity(cpBody* body, cpVect cog) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetCenterOfGravity(body, cog);
+    CP_FFI_TRACE_END("cp_body_set_center_of_gravity");
 }
 
 FFI_PLUGIN_EXPORT cpVect cp_body_get_force(cpBody* body) {
@@ -201,7 +614,9 @@ FFI_PLUGIN_EXPORT cpVect cp_body_get_force(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_force(cpBody* body, cpVect force) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetForce(body, force);
+    CP_FFI_TRACE_END("cp_body_set_force");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_body_get_angular_velocity(cpBody* body) {
@@ -209,7 +624,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_body_get_angular_velocity(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_angular_velocity(cpBody* body, cpFloat angularVelocity) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetAngularVelocity(body, angularVelocity);
+    CP_FFI_TRACE_END("cp_body_set_angular_velocity");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_body_get_torque(cpBody* body) {
@@ -217,7 +634,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_body_get_torque(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_torque(cpBody* body, cpFloat torque) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetTorque(body, torque);
+    CP_FFI_TRACE_END("cp_body_set_torque");
 }
 
 FFI_PLUGIN_EXPORT cpVect cp_body_get_rotation(cpBody* body) {
@@ -229,7 +648,9 @@ FFI_PLUGIN_EXPORT int cp_body_get_type(cpBody* body) {
 }
 
 FFI_PLUGIN_EXPORT void cp_body_set_type(cpBody* body, int type) {
+    CP_FFI_TRACE_BEGIN();
     cpBodySetType(body, (cpBodyType)type);
+    CP_FFI_TRACE_END("cp_body_set_type");
 }
 
 FFI_PLUGIN_EXPORT int cp_body_is_sleeping(cpBody* body) {
@@ -310,7 +731,9 @@ FFI_PLUGIN_EXPORT void cp_shape_free(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_friction(cpShape* shape, cpFloat friction) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetFriction(shape, friction);
+    CP_FFI_TRACE_END("cp_shape_set_friction");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_shape_get_friction(cpShape* shape) {
@@ -318,7 +741,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_shape_get_friction(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_elasticity(cpShape* shape, cpFloat elasticity) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetElasticity(shape, elasticity);
+    CP_FFI_TRACE_END("cp_shape_set_elasticity");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_shape_get_elasticity(cpShape* shape) {
@@ -330,7 +755,9 @@ FFI_PLUGIN_EXPORT cpShapeFilter cp_shape_get_filter(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_filter(cpShape* shape, cpShapeFilter filter) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetFilter(shape, filter);
+    CP_FFI_TRACE_END("cp_shape_set_filter");
 }
 
 FFI_PLUGIN_EXPORT cpShapeFilter cp_shape_filter_new(cpGroup group, cpBitmask categories, cpBitmask mask) {
@@ -354,7 +781,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_shape_get_mass(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_mass(cpShape* shape, cpFloat mass) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetMass(shape, mass);
+    CP_FFI_TRACE_END("cp_shape_set_mass");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_shape_get_density(cpShape* shape) {
@@ -362,7 +791,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_shape_get_density(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_density(cpShape* shape, cpFloat density) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetDensity(shape, density);
+    CP_FFI_TRACE_END("cp_shape_set_density");
 }
 
 FFI_PLUGIN_EXPORT cpFloat cp_shape_get_moment(cpShape* shape) {
@@ -386,7 +817,9 @@ FFI_PLUGIN_EXPORT int cp_shape_get_sensor(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_sensor(cpShape* shape, int sensor) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetSensor(shape, sensor ? cpTrue : cpFalse);
+    CP_FFI_TRACE_END("cp_shape_set_sensor");
 }
 
 FFI_PLUGIN_EXPORT cpVect cp_shape_get_surface_velocity(cpShape* shape) {
@@ -394,7 +827,9 @@ FFI_PLUGIN_EXPORT cpVect cp_shape_get_surface_velocity(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_surface_velocity(cpShape* shape, cpVect surfaceVelocity) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetSurfaceVelocity(shape, surfaceVelocity);
+    CP_FFI_TRACE_END("cp_shape_set_surface_velocity");
 }
 
 FFI_PLUGIN_EXPORT uintptr_t cp_shape_get_collision_type(cpShape* shape) {
@@ -402,7 +837,9 @@ FFI_PLUGIN_EXPORT uintptr_t cp_shape_get_collision_type(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_collision_type(cpShape* shape, uintptr_t collisionType) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetCollisionType(shape, (cpCollisionType)collisionType);
+    CP_FFI_TRACE_END("cp_shape_set_collision_type");
 }
 
 FFI_PLUGIN_EXPORT cpBody* cp_shape_get_body(cpShape* shape) {
@@ -410,7 +847,9 @@ FFI_PLUGIN_EXPORT cpBody* cp_shape_get_body(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_shape_set_body(cpShape* shape, cpBody* body) {
+    CP_FFI_TRACE_BEGIN();
     cpShapeSetBody(shape, body);
+    CP_FFI_TRACE_END("cp_shape_set_body");
 }
 
 FFI_PLUGIN_EXPORT cpSpace* cp_shape_get_space(cpShape* shape) {
@@ -454,7 +893,9 @@ FFI_PLUGIN_EXPORT cpFloat cp_segment_shape_get_radius(cpShape* shape) {
 }
 
 FFI_PLUGIN_EXPORT void cp_segment_shape_set_neighbors(cpShape* shape, cpVect prev, cpVect next) {
+    CP_FFI_TRACE_BEGIN();
     cpSegmentShapeSetNeighbors(shape, prev, next);
+    CP_FFI_TRACE_END("cp_segment_shape_set_neighbors");
 }
 
 FFI_PLUGIN_EXPORT int cp_poly_shape_get_count(cpShape* shape) {
@@ -471,19 +912,29 @@ FFI_PLUGIN_EXPORT cpFloat cp_poly_shape_get_radius(cpShape* shape) {
 
 // Space-Body-Shape relationships
 FFI_PLUGIN_EXPORT void cp_space_add_body(cpSpace* space, cpBody* body) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceAddBody(space, body);
+    CP_FFI_TRACE_END("cp_space_add_body");
 }
 
 FFI_PLUGIN_EXPORT void cp_space_remove_body(cpSpace* space, cpBody* body) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceRemoveBody(space, body);
+    cp_ffi_forget_body(space, body);
+    CP_FFI_TRACE_END("cp_space_remove_body");
 }
 
 FFI_PLUGIN_EXPORT void cp_space_add_shape(cpSpace* space, cpShape* shape) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceAddShape(space, shape);
+    CP_FFI_TRACE_END("cp_space_add_shape");
 }
 
 FFI_PLUGIN_EXPORT void cp_space_remove_shape(cpSpace* space, cpShape* shape) {
+    CP_FFI_TRACE_BEGIN();
     cpSpaceRemoveShape(space, shape);
+    cp_ffi_forget_shapes(space, &shape, 1);
+    CP_FFI_TRACE_END("cp_space_remove_shape");
 }
 
 // Vector utilities
@@ -956,3 +1407,3428 @@ FFI_PLUGIN_EXPORT cpFloat cp_moment_for_box2(cpFloat m, cpBB box) {
 FFI_PLUGIN_EXPORT int cp_convex_hull(int count, cpVect* verts, cpVect* result, int* first, cpFloat tol) {
     return cpConvexHull(count, verts, result, first, tol);
 }
+
+// Bulk state transfer
+typedef struct cpFfiExportState {
+    void* out;
+    int capacity;
+    int flags;
+    cpBody** bodies;
+    int count;
+} cpFfiExportState;
+
+static void cp_ffi_export_body_f32(cpBody* body, void* data) {
+    cpFfiExportState* state = (cpFfiExportState*)data;
+    int i = state->count++;
+    if (i >= state->capacity) return;
+
+    float* out = (float*)state->out;
+    int stride = state->capacity;
+    cpVect p = cpBodyGetPosition(body);
+    out[i] = (float)p.x;
+    out[stride + i] = (float)p.y;
+    out[2 * stride + i] = (float)cpBodyGetAngle(body);
+    if (state->flags & CP_FFI_STATE_VELOCITY) {
+        cpVect v = cpBodyGetVelocity(body);
+        out[3 * stride + i] = (float)v.x;
+        out[4 * stride + i] = (float)v.y;
+        out[5 * stride + i] = (float)cpBodyGetAngularVelocity(body);
+    }
+    if (state->bodies) state->bodies[i] = body;
+}
+
+static void cp_ffi_export_body_f64(cpBody* body, void* data) {
+    cpFfiExportState* state = (cpFfiExportState*)data;
+    int i = state->count++;
+    if (i >= state->capacity) return;
+
+    double* out = (double*)state->out;
+    int stride = state->capacity;
+    cpVect p = cpBodyGetPosition(body);
+    out[i] = p.x;
+    out[stride + i] = p.y;
+    out[2 * stride + i] = cpBodyGetAngle(body);
+    if (state->flags & CP_FFI_STATE_VELOCITY) {
+        cpVect v = cpBodyGetVelocity(body);
+        out[3 * stride + i] = v.x;
+        out[4 * stride + i] = v.y;
+        out[5 * stride + i] = cpBodyGetAngularVelocity(body);
+    }
+    if (state->bodies) state->bodies[i] = body;
+}
+
+// Returns the number of bodies in the space; only the first `capacity` are written.
+FFI_PLUGIN_EXPORT int cp_space_export_transforms_f32(cpSpace* space, float* out, int capacity, int flags, cpBody** bodies) {
+    cpFfiExportState state = {out, capacity, flags, bodies, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceEachBody(space, cp_ffi_export_body_f32, &state);
+    CP_FFI_TRACE_END("cp_space_export_transforms_f32");
+    return state.count;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_export_transforms_f64(cpSpace* space, double* out, int capacity, int flags, cpBody** bodies) {
+    cpFfiExportState state = {out, capacity, flags, bodies, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceEachBody(space, cp_ffi_export_body_f64, &state);
+    CP_FFI_TRACE_END("cp_space_export_transforms_f64");
+    return state.count;
+}
+
+// Dynamic bodies are reindexed by the next step. Static and kinematic ones are
+// reindexed after being moved so queries see them right away.
+static void cp_ffi_reindex_moved_body(cpSpace* space, cpBody* body) {
+    if (cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC && cpBodyGetSpace(body) == space && !cpSpaceIsLocked(space)) {
+        cpSpaceReindexShapesForBody(space, body);
+    }
+}
+
+static void cp_ffi_import_body(cpSpace* space, cpBody* body, cpVect p, cpFloat a, cpVect v, cpFloat w, int flags) {
+    cpBodySetPosition(body, p);
+    cpBodySetAngle(body, a);
+    if (flags & CP_FFI_STATE_VELOCITY) {
+        cpBodySetVelocity(body, v);
+        cpBodySetAngularVelocity(body, w);
+    }
+    cp_ffi_reindex_moved_body(space, body);
+}
+
+// `state` uses the export layout with `count` rows; velocity columns are read when flagged.
+FFI_PLUGIN_EXPORT void cp_space_import_states_f32(cpSpace* space, cpBody** bodies, const float* state, int count, int flags) {
+    CP_FFI_TRACE_BEGIN();
+    for (int i = 0; i < count; i++) {
+        cpVect v = cpvzero;
+        cpFloat w = 0.0;
+        if (flags & CP_FFI_STATE_VELOCITY) {
+            v = cpv(state[3 * count + i], state[4 * count + i]);
+            w = state[5 * count + i];
+        }
+        cp_ffi_import_body(space, bodies[i], cpv(state[i], state[count + i]), state[2 * count + i], v, w, flags);
+    }
+    CP_FFI_TRACE_END("cp_space_import_states_f32");
+}
+
+FFI_PLUGIN_EXPORT void cp_space_import_states_f64(cpSpace* space, cpBody** bodies, const double* state, int count, int flags) {
+    CP_FFI_TRACE_BEGIN();
+    for (int i = 0; i < count; i++) {
+        cpVect v = cpvzero;
+        cpFloat w = 0.0;
+        if (flags & CP_FFI_STATE_VELOCITY) {
+            v = cpv(state[3 * count + i], state[4 * count + i]);
+            w = state[5 * count + i];
+        }
+        cp_ffi_import_body(space, bodies[i], cpv(state[i], state[count + i]), state[2 * count + i], v, w, flags);
+    }
+    CP_FFI_TRACE_END("cp_space_import_states_f64");
+}
+
+// Change tracking
+static void cp_ffi_track_changes(cpSpace* space, cpFfiSpaceData* data) {
+    if (!data->changedBodies) data->changedBodies = cpArrayNew(0);
+    data->changedBodies->num = 0;
+
+    // Sleeping and static bodies cannot move during a step, so only the awake ones are checked.
+    cpFloat epsilon = data->changeEpsilon;
+    cpArray* bodies = space->dynamicBodies;
+    for (int i = 0; i < bodies->num; i++) {
+        cpBody* body = (cpBody*)bodies->arr[i];
+        int isNew = !data->bodyRecords || !cpHashSetFind(data->bodyRecords, (cpHashValue)body, body);
+        cpFfiBodyRecord* record = cp_ffi_body_record(data, body);
+        if (isNew || cpvdistsq(body->p, record->p) > epsilon * epsilon || cpfabs(body->a - record->a) > epsilon) {
+            record->p = body->p;
+            record->a = body->a;
+            cpArrayPush(data->changedBodies, body);
+        }
+    }
+}
+
+FFI_PLUGIN_EXPORT void cp_space_set_change_tracking(cpSpace* space, int enabled, cpFloat epsilon) {
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    data->changeEpsilon = epsilon;
+    if (data->trackChanges && !enabled) cp_ffi_clear_body_records(data);
+    data->trackChanges = enabled;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_change_tracking(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data && data->trackChanges ? 1 : 0;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_changed_body_count(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data && data->changedBodies ? data->changedBodies->num : 0;
+}
+
+// Same layout as cp_space_export_transforms_f32, restricted to the bodies that changed during the last step.
+FFI_PLUGIN_EXPORT int cp_space_export_changed_f32(cpSpace* space, float* out, int capacity, int flags, cpBody** bodies) {
+    cpFfiExportState state = {out, capacity, flags, bodies, 0};
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    CP_FFI_TRACE_BEGIN();
+    if (data && data->changedBodies) {
+        for (int i = 0; i < data->changedBodies->num; i++) cp_ffi_export_body_f32((cpBody*)data->changedBodies->arr[i], &state);
+    }
+    CP_FFI_TRACE_END("cp_space_export_changed_f32");
+    return state.count;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_export_changed_f64(cpSpace* space, double* out, int capacity, int flags, cpBody** bodies) {
+    cpFfiExportState state = {out, capacity, flags, bodies, 0};
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    CP_FFI_TRACE_BEGIN();
+    if (data && data->changedBodies) {
+        for (int i = 0; i < data->changedBodies->num; i++) cp_ffi_export_body_f64((cpBody*)data->changedBodies->arr[i], &state);
+    }
+    CP_FFI_TRACE_END("cp_space_export_changed_f64");
+    return state.count;
+}
+
+// Spawning
+typedef struct cpFfiSpawnAttributes {
+    const cpFloat* masses;
+    const cpFloat* moments;
+    const cpFloat* frictions;
+    const cpFloat* elasticities;
+    const cpShapeFilter* filters;
+    const uintptr_t* collisionTypes;
+    int uniform;
+} cpFfiSpawnAttributes;
+
+// Index of object i's value in an attribute array, which is either per object or uniform.
+#define CP_FFI_SPAWN_INDEX(uniform, bit, i) (((uniform) & (bit)) ? 0 : (i))
+
+static void cp_ffi_spawn_finish(cpSpace* space, cpBody* body, cpShape* shape, const cpFfiSpawnAttributes* attrs, int i) {
+    int uniform = attrs->uniform;
+    if (attrs->frictions) shape->u = attrs->frictions[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_FRICTION, i)];
+    if (attrs->elasticities) shape->e = attrs->elasticities[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_ELASTICITY, i)];
+    if (attrs->filters) shape->filter = attrs->filters[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_FILTER, i)];
+    if (attrs->collisionTypes) shape->type = attrs->collisionTypes[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_COLLISION_TYPE, i)];
+
+    cpSpaceAddBody(space, body);
+    cpSpaceAddShape(space, shape);
+}
+
+static cpFloat cp_ffi_spawn_mass(const cpFfiSpawnAttributes* attrs, int i) {
+    return attrs->masses ? attrs->masses[CP_FFI_SPAWN_INDEX(attrs->uniform, CP_FFI_SPAWN_UNIFORM_MASS, i)] : 1.0;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_spawn_circles(cpSpace* space, int count, const cpVect* positions, const cpFloat* radii, const cpFloat* masses, const cpFloat* moments, const cpFloat* frictions, const cpFloat* elasticities, const cpShapeFilter* filters, const uintptr_t* collisionTypes, int uniform, cpBody** bodies, cpShape** shapes) {
+    if (cpSpaceIsLocked(space)) return 0;
+
+    CP_FFI_TRACE_BEGIN();
+    cpFfiSpawnAttributes attrs = {masses, moments, frictions, elasticities, filters, collisionTypes, uniform};
+    for (int i = 0; i < count; i++) {
+        cpFloat radius = radii[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_SIZE, i)];
+        cpFloat mass = cp_ffi_spawn_mass(&attrs, i);
+        cpFloat moment = moments ? moments[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_MOMENT, i)] : cpMomentForCircle(mass, 0.0, radius, cpvzero);
+
+        cpBody* body = cpBodyNew(mass, moment);
+        cpBodySetPosition(body, positions[i]);
+        cpShape* shape = cpCircleShapeNew(body, radius, cpvzero);
+        cp_ffi_spawn_finish(space, body, shape, &attrs, i);
+
+        bodies[i] = body;
+        shapes[i] = shape;
+    }
+    CP_FFI_TRACE_END("cp_space_spawn_circles");
+    return count;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_spawn_boxes(cpSpace* space, int count, const cpVect* positions, const cpVect* sizes, cpFloat radius, const cpFloat* masses, const cpFloat* moments, const cpFloat* frictions, const cpFloat* elasticities, const cpShapeFilter* filters, const uintptr_t* collisionTypes, int uniform, cpBody** bodies, cpShape** shapes) {
+    if (cpSpaceIsLocked(space)) return 0;
+
+    CP_FFI_TRACE_BEGIN();
+    cpFfiSpawnAttributes attrs = {masses, moments, frictions, elasticities, filters, collisionTypes, uniform};
+    for (int i = 0; i < count; i++) {
+        cpVect size = sizes[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_SIZE, i)];
+        cpFloat mass = cp_ffi_spawn_mass(&attrs, i);
+        cpFloat moment = moments ? moments[CP_FFI_SPAWN_INDEX(uniform, CP_FFI_SPAWN_UNIFORM_MOMENT, i)] : cpMomentForBox(mass, size.x, size.y);
+
+        cpBody* body = cpBodyNew(mass, moment);
+        cpBodySetPosition(body, positions[i]);
+        cpShape* shape = cpBoxShapeNew(body, size.x, size.y, radius);
+        cp_ffi_spawn_finish(space, body, shape, &attrs, i);
+
+        bodies[i] = body;
+        shapes[i] = shape;
+    }
+    CP_FFI_TRACE_END("cp_space_spawn_boxes");
+    return count;
+}
+
+// Despawning
+typedef struct cpFfiDespawnContext {
+    cpSpace* space;
+    cpHashSet* shapes;
+} cpFfiDespawnContext;
+
+// Does what cpSpaceRemoveShape does to the arbiter cache, for all removed shapes in one pass.
+static cpBool cp_ffi_despawn_arbiter_filter(void* elt, void* data) {
+    cpArbiter* arb = (cpArbiter*)elt;
+    cpFfiDespawnContext* context = (cpFfiDespawnContext*)data;
+    if (!cpHashSetFind(context->shapes, (cpHashValue)arb->a, arb->a) && !cpHashSetFind(context->shapes, (cpHashValue)arb->b, arb->b)) {
+        return cpTrue;
+    }
+
+    if (arb->state != CP_ARBITER_STATE_CACHED) {
+        cpCollisionHandler* handler = arb->handler;
+        arb->state = CP_ARBITER_STATE_INVALIDATED;
+        handler->separateFunc(arb, context->space, handler->userData);
+    }
+    // Invalidated arbiters are dropped from space->arbiters in a single pass afterwards.
+    arb->state = CP_ARBITER_STATE_INVALIDATED;
+    cpArbiterUnthread(arb);
+    cpArrayPush(context->space->pooledArbiters, arb);
+    return cpFalse;
+}
+
+static void cp_ffi_despawn_shapes(cpSpace* space, cpShape** shapes, int count) {
+    cpFfiDespawnContext context = {space, NULL};
+    for (int i = 0; i < count; i++) {
+        cpShape* shape = shapes[i];
+        if (shape->space != space) continue;
+
+        cpBody* body = shape->body;
+        cpBool isStatic = (cpBodyGetType(body) == CP_BODY_TYPE_STATIC);
+        if (isStatic) {
+            cpBodyActivateStatic(body, shape);
+        } else {
+            cpBodyActivate(body);
+        }
+        cpBodyRemoveShape(body, shape);
+        cpSpatialIndexRemove(isStatic ? space->staticShapes : space->dynamicShapes, shape, shape->hashid);
+        shape->space = NULL;
+        shape->hashid = 0;
+
+        if (!context.shapes) context.shapes = cpHashSetNew(count, cp_ffi_ptr_eql);
+        cpHashSetInsert(context.shapes, (cpHashValue)shape, shape, NULL, shape);
+    }
+    if (!context.shapes) return;
+
+    // Like cpSpaceFilterArbiters, lock the space so that separate callbacks removing objects are deferred
+    // to post-step callbacks. They run at the end of the next step rather than in the middle of the despawn.
+    cpSpaceLock(space); {
+        cpHashSetFilter(space->cachedArbiters, cp_ffi_despawn_arbiter_filter, &context);
+    } cpSpaceUnlock(space, cpFalse);
+    cpHashSetFree(context.shapes);
+
+    cpArray* arbiters = space->arbiters;
+    int kept = 0;
+    for (int i = 0; i < arbiters->num; i++) {
+        cpArbiter* arb = (cpArbiter*)arbiters->arr[i];
+        if (arb->state != CP_ARBITER_STATE_INVALIDATED) arbiters->arr[kept++] = arb;
+    }
+    arbiters->num = kept;
+}
+
+static void cp_ffi_despawn_bodies(cpSpace* space, cpBody** bodies, int count) {
+    // Wake every body first so that whole sleeping components are back in the body arrays.
+    for (int i = 0; i < count; i++) {
+        if (bodies[i]->space == space && bodies[i] != space->staticBody) cpBodyActivate(bodies[i]);
+    }
+
+    int removed = 0;
+    for (int i = 0; i < count; i++) {
+        if (bodies[i]->space == space && bodies[i] != space->staticBody) {
+            bodies[i]->space = NULL;
+            removed++;
+        }
+    }
+    if (!removed) return;
+
+    cp_ffi_compact_bodies(space->dynamicBodies, space);
+    cp_ffi_compact_bodies(space->staticBodies, space);
+    cp_ffi_forget_bodies(space, bodies, count);
+}
+
+// Objects that belong to another space are left untouched.
+static void cp_ffi_despawn(cpSpace* space, cpConstraint** constraints, int constraintCount, cpShape** shapes, int shapeCount, cpBody** bodies, int bodyCount) {
+    for (int i = 0; i < constraintCount; i++) {
+        if (constraints[i]->space == space) cpSpaceRemoveConstraint(space, constraints[i]);
+    }
+    cp_ffi_despawn_shapes(space, shapes, shapeCount);
+    cp_ffi_forget_shapes(space, shapes, shapeCount);
+    cp_ffi_despawn_bodies(space, bodies, bodyCount);
+
+    // Handles passed more than once are only freed once, and never read after being freed.
+    cpHashSet* seen = cpHashSetNew(constraintCount + shapeCount + bodyCount, cp_ffi_ptr_eql);
+    for (int i = 0; i < constraintCount; i++) {
+        if (cp_ffi_ptr_set_insert(seen, constraints[i]) && !constraints[i]->space) cpConstraintFree(constraints[i]);
+    }
+    for (int i = 0; i < shapeCount; i++) {
+        if (cp_ffi_ptr_set_insert(seen, shapes[i]) && !shapes[i]->space) cpShapeFree(shapes[i]);
+    }
+    for (int i = 0; i < bodyCount; i++) {
+        if (cp_ffi_ptr_set_insert(seen, bodies[i]) && !bodies[i]->space) cpBodyFree(bodies[i]);
+    }
+    cpHashSetFree(seen);
+}
+
+// Handles of a despawn requested while the space was locked: constraints, then shapes, then bodies.
+typedef struct cpFfiDespawnJob {
+    int constraintCount;
+    int shapeCount;
+    int bodyCount;
+    void* handles[];
+} cpFfiDespawnJob;
+
+static void cp_ffi_despawn_post_step(cpSpace* space, void* key, void* unused) {
+    (void)unused;
+    cpFfiDespawnJob* job = (cpFfiDespawnJob*)key;
+    void** handles = job->handles;
+    cp_ffi_despawn(space, (cpConstraint**)handles, job->constraintCount, (cpShape**)(handles + job->constraintCount), job->shapeCount, (cpBody**)(handles + job->constraintCount + job->shapeCount), job->bodyCount);
+    cpfree(job);
+}
+
+FFI_PLUGIN_EXPORT int cp_space_despawn(cpSpace* space, cpConstraint** constraints, int constraintCount, cpShape** shapes, int shapeCount, cpBody** bodies, int bodyCount) {
+    if (!cpSpaceIsLocked(space)) {
+        CP_FFI_TRACE_BEGIN();
+        cp_ffi_despawn(space, constraints, constraintCount, shapes, shapeCount, bodies, bodyCount);
+        CP_FFI_TRACE_END("cp_space_despawn");
+        return 1;
+    }
+
+    int total = constraintCount + shapeCount + bodyCount;
+    cpFfiDespawnJob* job = (cpFfiDespawnJob*)cpcalloc(1, sizeof(cpFfiDespawnJob) + total * sizeof(void*));
+    job->constraintCount = constraintCount;
+    job->shapeCount = shapeCount;
+    job->bodyCount = bodyCount;
+    if (constraintCount) memcpy(job->handles, constraints, constraintCount * sizeof(void*));
+    if (shapeCount) memcpy(job->handles + constraintCount, shapes, shapeCount * sizeof(void*));
+    if (bodyCount) memcpy(job->handles + constraintCount + shapeCount, bodies, bodyCount * sizeof(void*));
+    cpSpaceAddPostStepCallback(space, cp_ffi_despawn_post_step, job, NULL);
+    return 0;
+}
+
+// Command buffers
+// Number of 8-byte operands following the handle of each opcode, indexed by opcode.
+static const int cpFfiCommandOperands[CP_FFI_CMD_COUNT] = {
+    [CP_FFI_CMD_BODY_SET_POSITION] = 2,
+    [CP_FFI_CMD_BODY_SET_VELOCITY] = 2,
+    [CP_FFI_CMD_BODY_SET_ANGLE] = 1,
+    [CP_FFI_CMD_BODY_SET_ANGULAR_VELOCITY] = 1,
+    [CP_FFI_CMD_BODY_SET_FORCE] = 2,
+    [CP_FFI_CMD_BODY_SET_TORQUE] = 1,
+    [CP_FFI_CMD_BODY_APPLY_FORCE_AT_WORLD_POINT] = 4,
+    [CP_FFI_CMD_BODY_APPLY_FORCE_AT_LOCAL_POINT] = 4,
+    [CP_FFI_CMD_BODY_APPLY_IMPULSE_AT_WORLD_POINT] = 4,
+    [CP_FFI_CMD_BODY_APPLY_IMPULSE_AT_LOCAL_POINT] = 4,
+    [CP_FFI_CMD_BODY_ACTIVATE] = 0,
+    [CP_FFI_CMD_SHAPE_SET_FRICTION] = 1,
+    [CP_FFI_CMD_SHAPE_SET_ELASTICITY] = 1,
+    [CP_FFI_CMD_SHAPE_SET_SURFACE_VELOCITY] = 2,
+    [CP_FFI_CMD_SHAPE_SET_FILTER] = 3,
+    [CP_FFI_CMD_SHAPE_SET_COLLISION_TYPE] = 1,
+    [CP_FFI_CMD_SHAPE_SET_SENSOR] = 1,
+    [CP_FFI_CMD_CONSTRAINT_SET_MAX_FORCE] = 1,
+    [CP_FFI_CMD_SIMPLE_MOTOR_SET_RATE] = 1,
+};
+
+// Operands are copied out of the byte stream since commands are not aligned.
+static uint64_t cp_ffi_read_word(const uint8_t* bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+static cpFloat cp_ffi_word_to_float(uint64_t word) {
+    double value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+static void cp_ffi_execute_command(cpSpace* space, int opcode, void* target, const cpFloat* f, const uint64_t* w) {
+    cpBody* body = (cpBody*)target;
+    cpShape* shape = (cpShape*)target;
+    cpConstraint* constraint = (cpConstraint*)target;
+    switch (opcode) {
+        case CP_FFI_CMD_BODY_SET_POSITION:
+            cpBodySetPosition(body, cpv(f[0], f[1]));
+            cp_ffi_reindex_moved_body(space, body);
+            break;
+        case CP_FFI_CMD_BODY_SET_VELOCITY:
+            cpBodySetVelocity(body, cpv(f[0], f[1]));
+            break;
+        case CP_FFI_CMD_BODY_SET_ANGLE:
+            cpBodySetAngle(body, f[0]);
+            cp_ffi_reindex_moved_body(space, body);
+            break;
+        case CP_FFI_CMD_BODY_SET_ANGULAR_VELOCITY:
+            cpBodySetAngularVelocity(body, f[0]);
+            break;
+        case CP_FFI_CMD_BODY_SET_FORCE:
+            cpBodySetForce(body, cpv(f[0], f[1]));
+            break;
+        case CP_FFI_CMD_BODY_SET_TORQUE:
+            cpBodySetTorque(body, f[0]);
+            break;
+        case CP_FFI_CMD_BODY_APPLY_FORCE_AT_WORLD_POINT:
+            cpBodyApplyForceAtWorldPoint(body, cpv(f[0], f[1]), cpv(f[2], f[3]));
+            break;
+        case CP_FFI_CMD_BODY_APPLY_FORCE_AT_LOCAL_POINT:
+            cpBodyApplyForceAtLocalPoint(body, cpv(f[0], f[1]), cpv(f[2], f[3]));
+            break;
+        case CP_FFI_CMD_BODY_APPLY_IMPULSE_AT_WORLD_POINT:
+            cpBodyApplyImpulseAtWorldPoint(body, cpv(f[0], f[1]), cpv(f[2], f[3]));
+            break;
+        case CP_FFI_CMD_BODY_APPLY_IMPULSE_AT_LOCAL_POINT:
+            cpBodyApplyImpulseAtLocalPoint(body, cpv(f[0], f[1]), cpv(f[2], f[3]));
+            break;
+        case CP_FFI_CMD_BODY_ACTIVATE:
+            cpBodyActivate(body);
+            break;
+        case CP_FFI_CMD_SHAPE_SET_FRICTION:
+            cpShapeSetFriction(shape, f[0]);
+            break;
+        case CP_FFI_CMD_SHAPE_SET_ELASTICITY:
+            cpShapeSetElasticity(shape, f[0]);
+            break;
+        case CP_FFI_CMD_SHAPE_SET_SURFACE_VELOCITY:
+            cpShapeSetSurfaceVelocity(shape, cpv(f[0], f[1]));
+            break;
+        case CP_FFI_CMD_SHAPE_SET_FILTER:
+            cpShapeSetFilter(shape, cpShapeFilterNew((cpGroup)w[0], (cpBitmask)w[1], (cpBitmask)w[2]));
+            break;
+        case CP_FFI_CMD_SHAPE_SET_COLLISION_TYPE:
+            cpShapeSetCollisionType(shape, (cpCollisionType)w[0]);
+            break;
+        case CP_FFI_CMD_SHAPE_SET_SENSOR:
+            cpShapeSetSensor(shape, w[0] != 0);
+            break;
+        case CP_FFI_CMD_CONSTRAINT_SET_MAX_FORCE:
+            cpConstraintSetMaxForce(constraint, f[0]);
+            break;
+        case CP_FFI_CMD_SIMPLE_MOTOR_SET_RATE:
+            cpSimpleMotorSetRate(constraint, f[0]);
+            break;
+    }
+}
+
+FFI_PLUGIN_EXPORT int cp_space_execute_commands(cpSpace* space, const uint8_t* commands, int length) {
+    CP_FFI_TRACE_BEGIN();
+    const uint8_t* cursor = commands;
+    const uint8_t* end = commands + length;
+    int executed = 0;
+    while (cursor < end) {
+        int opcode = cursor[0];
+        if (opcode <= 0 || opcode >= CP_FFI_CMD_COUNT) break;
+
+        int operands = cpFfiCommandOperands[opcode];
+        if (end - cursor < 1 + 8 * (1 + operands)) break;
+
+        void* target = (void*)(uintptr_t)cp_ffi_read_word(cursor + 1);
+        uint64_t w[4];
+        cpFloat f[4];
+        for (int i = 0; i < operands; i++) {
+            w[i] = cp_ffi_read_word(cursor + 9 + 8 * i);
+            f[i] = cp_ffi_word_to_float(w[i]);
+        }
+        cp_ffi_execute_command(space, opcode, target, f, w);
+
+        cursor += 1 + 8 * (1 + operands);
+        executed++;
+    }
+    CP_FFI_TRACE_END("cp_space_execute_commands");
+    return executed;
+}
+
+// Collision events
+typedef struct cpFfiCollisionEvent {
+    int type;
+    cpShape* a;
+    cpShape* b;
+    cpVect normal;
+    cpVect point;
+    cpVect impulse;
+    cpFloat ke;
+} cpFfiCollisionEvent;
+
+// User data of the collision handlers installed by the extensions.
+// Chipmunk shares one handler between both orders of a pair, oriented by the order it was first added
+// in. The events and the one-way direction keep the order they were requested in.
+typedef struct cpFfiPairHandler {
+    int events;
+    // Whether the events were requested for the reverse order of the handler's types.
+    int eventsSwapped;
+    int rules;
+    // In the handler's order.
+    cpVect oneWayDirection;
+} cpFfiPairHandler;
+
+#define CP_FFI_DEFAULT_EVENT_CAPACITY 1024
+
+// Resizes the event ring buffer, keeping the oldest queued events that still fit.
+static void cp_ffi_set_event_capacity(cpFfiSpaceData* data, int capacity) {
+    if (capacity < 1) capacity = 1;
+    cpFfiCollisionEvent* events = (cpFfiCollisionEvent*)cpcalloc(capacity, sizeof(cpFfiCollisionEvent));
+    int count = data->eventCount < capacity ? data->eventCount : capacity;
+    for (int i = 0; i < count; i++) {
+        events[i] = data->events[(data->eventHead + i) % data->eventCapacity];
+    }
+    data->droppedEvents += data->eventCount - count;
+    cpfree(data->events);
+    data->events = events;
+    data->eventCapacity = capacity;
+    data->eventHead = 0;
+    data->eventCount = count;
+}
+
+// `swapped` reports the shapes in the reverse order of the arbiter's.
+static void cp_ffi_push_collision_event(cpSpace* space, cpArbiter* arb, int type, int swapped) {
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    if (!data->events) cp_ffi_set_event_capacity(data, CP_FFI_DEFAULT_EVENT_CAPACITY);
+    if (data->eventCount == data->eventCapacity) {
+        data->droppedEvents++;
+        return;
+    }
+
+    cpFfiCollisionEvent* event = &data->events[(data->eventHead + data->eventCount++) % data->eventCapacity];
+    event->type = type;
+    if (swapped) {
+        cpArbiterGetShapes(arb, &event->b, &event->a);
+    } else {
+        cpArbiterGetShapes(arb, &event->a, &event->b);
+    }
+    // The contact point set follows the arbiter's shape order, unlike cpArbiterGetPointA.
+    cpContactPointSet set = cpArbiterGetContactPointSet(arb);
+    if (set.count > 0) {
+        event->normal = swapped ? cpvneg(set.normal) : set.normal;
+        event->point = swapped ? set.points[0].pointB : set.points[0].pointA;
+    } else {
+        event->normal = cpvzero;
+        event->point = cpvzero;
+    }
+    if (type == CP_FFI_COLLISION_POST_SOLVE) {
+        event->impulse = cpArbiterTotalImpulse(arb);
+        event->ke = cpArbiterTotalKE(arb);
+    } else {
+        event->impulse = cpvzero;
+        event->ke = 0.0;
+    }
+}
+
+// The handlers apply the pair's rules, record the requested events, then run the wildcard handlers
+// like Chipmunk's defaults do. Pairs rejected by a rule record no event until they separate.
+static cpBool cp_ffi_pair_begin(cpArbiter* arb, cpSpace* space, cpDataPointer userData) {
+    cpFfiPairHandler* pair = (cpFfiPairHandler*)userData;
+    if (pair->rules & CP_FFI_RULE_IGNORE) return cpFalse;
+
+    if (pair->events & CP_FFI_COLLISION_BEGIN) cp_ffi_push_collision_event(space, arb, CP_FFI_COLLISION_BEGIN, pair->eventsSwapped);
+    cpBool retA = cpArbiterCallWildcardBeginA(arb, space);
+    cpBool retB = cpArbiterCallWildcardBeginB(arb, space);
+    return retA && retB;
+}
+
+static cpBool cp_ffi_pair_pre_solve(cpArbiter* arb, cpSpace* space, cpDataPointer userData) {
+    cpFfiPairHandler* pair = (cpFfiPairHandler*)userData;
+    if ((pair->rules & CP_FFI_RULE_ONE_WAY) && cpvdot(cpArbiterGetNormal(arb), pair->oneWayDirection) < 0.0) {
+        return cpArbiterIgnore(arb);
+    }
+    if ((pair->rules & CP_FFI_RULE_FIRST_CONTACT_ONLY) && !cpArbiterIsFirstContact(arb)) return cpArbiterIgnore(arb);
+
+    if (pair->events & CP_FFI_COLLISION_PRE_SOLVE) cp_ffi_push_collision_event(space, arb, CP_FFI_COLLISION_PRE_SOLVE, pair->eventsSwapped);
+    cpBool retA = cpArbiterCallWildcardPreSolveA(arb, space);
+    cpBool retB = cpArbiterCallWildcardPreSolveB(arb, space);
+    return retA && retB;
+}
+
+static void cp_ffi_pair_post_solve(cpArbiter* arb, cpSpace* space, cpDataPointer userData) {
+    cpFfiPairHandler* pair = (cpFfiPairHandler*)userData;
+    if (pair->events & CP_FFI_COLLISION_POST_SOLVE) cp_ffi_push_collision_event(space, arb, CP_FFI_COLLISION_POST_SOLVE, pair->eventsSwapped);
+    cpArbiterCallWildcardPostSolveA(arb, space);
+    cpArbiterCallWildcardPostSolveB(arb, space);
+}
+
+static void cp_ffi_pair_separate(cpArbiter* arb, cpSpace* space, cpDataPointer userData) {
+    cpFfiPairHandler* pair = (cpFfiPairHandler*)userData;
+    if ((pair->events & CP_FFI_COLLISION_SEPARATE) && !(pair->rules & CP_FFI_RULE_IGNORE)) {
+        cp_ffi_push_collision_event(space, arb, CP_FFI_COLLISION_SEPARATE, pair->eventsSwapped);
+    }
+    cpArbiterCallWildcardSeparateA(arb, space);
+    cpArbiterCallWildcardSeparateB(arb, space);
+}
+
+// Returns the extension handler for a pair of collision types, installing it on first use, and whether
+// the handler was installed for the reverse order in `swapped`.
+static cpFfiPairHandler* cp_ffi_pair_handler(cpSpace* space, cpCollisionType typeA, cpCollisionType typeB, int* swapped) {
+    cpCollisionHandler* handler = cpSpaceAddCollisionHandler(space, typeA, typeB);
+    *swapped = handler->typeA != typeA;
+    if (handler->beginFunc != cp_ffi_pair_begin) {
+        cpFfiSpaceData* data = cp_ffi_space_data(space);
+        if (!data->pairHandlers) data->pairHandlers = cpArrayNew(0);
+        cpFfiPairHandler* pair = (cpFfiPairHandler*)cpcalloc(1, sizeof(cpFfiPairHandler));
+        cpArrayPush(data->pairHandlers, pair);
+
+        handler->beginFunc = cp_ffi_pair_begin;
+        handler->preSolveFunc = cp_ffi_pair_pre_solve;
+        handler->postSolveFunc = cp_ffi_pair_post_solve;
+        handler->separateFunc = cp_ffi_pair_separate;
+        handler->userData = pair;
+    }
+    return (cpFfiPairHandler*)handler->userData;
+}
+
+FFI_PLUGIN_EXPORT void cp_space_set_collision_events(cpSpace* space, uintptr_t typeA, uintptr_t typeB, int events) {
+    int swapped;
+    cpFfiPairHandler* pair = cp_ffi_pair_handler(space, (cpCollisionType)typeA, (cpCollisionType)typeB, &swapped);
+    pair->events = events;
+    pair->eventsSwapped = swapped;
+}
+
+FFI_PLUGIN_EXPORT void cp_space_set_collision_event_capacity(cpSpace* space, int capacity) {
+    cp_ffi_set_event_capacity(cp_ffi_space_data(space), capacity);
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_collision_event_count(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->eventCount : 0;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_dropped_collision_events(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->droppedEvents : 0;
+}
+
+// Moves up to `capacity` queued events, oldest first, into `out` and `shapes`.
+FFI_PLUGIN_EXPORT int cp_space_drain_collision_events(cpSpace* space, double* out, cpShape** shapes, int capacity) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return 0;
+
+    int count = data->eventCount < capacity ? data->eventCount : capacity;
+    for (int i = 0; i < count; i++) {
+        cpFfiCollisionEvent* event = &data->events[(data->eventHead + i) % data->eventCapacity];
+        out[i] = event->type;
+        out[capacity + i] = event->normal.x;
+        out[2 * capacity + i] = event->normal.y;
+        out[3 * capacity + i] = event->point.x;
+        out[4 * capacity + i] = event->point.y;
+        out[5 * capacity + i] = event->impulse.x;
+        out[6 * capacity + i] = event->impulse.y;
+        out[7 * capacity + i] = event->ke;
+        shapes[i] = event->a;
+        shapes[capacity + i] = event->b;
+    }
+    data->eventHead = (data->eventHead + count) % (data->eventCapacity ? data->eventCapacity : 1);
+    data->eventCount -= count;
+    if (data->eventCount == 0) data->droppedEvents = 0;
+    return count;
+}
+
+// Sensor tracking
+static void cp_ffi_collect_overlap(void* elt, void* ctx) {
+    cpArbiter* arb = (cpArbiter*)elt;
+    cpFfiSpaceData* data = (cpFfiSpaceData*)ctx;
+    // Cached arbiters are kept for shapes that stopped touching.
+    if (arb->state == CP_ARBITER_STATE_CACHED || arb->state == CP_ARBITER_STATE_INVALIDATED) return;
+
+    cpShape* a = (cpShape*)arb->a;
+    cpShape* b = (cpShape*)arb->b;
+    if (cpHashSetFind(data->trackedSensors, (cpHashValue)a, a)) {
+        cpFfiOverlap* overlap = (cpFfiOverlap*)cp_ffi_buffer_push(&data->currentOverlaps, sizeof(cpFfiOverlap));
+        overlap->sensor = a;
+        overlap->other = b;
+    }
+    if (cpHashSetFind(data->trackedSensors, (cpHashValue)b, b)) {
+        cpFfiOverlap* overlap = (cpFfiOverlap*)cp_ffi_buffer_push(&data->currentOverlaps, sizeof(cpFfiOverlap));
+        overlap->sensor = b;
+        overlap->other = a;
+    }
+}
+
+static int cp_ffi_overlap_compare(const cpFfiOverlap* a, const cpFfiOverlap* b) {
+    if (a->sensor != b->sensor) return (uintptr_t)a->sensor < (uintptr_t)b->sensor ? -1 : 1;
+    if (a->other != b->other) return (uintptr_t)a->other < (uintptr_t)b->other ? -1 : 1;
+    return 0;
+}
+
+static int cp_ffi_overlap_qsort_compare(const void* a, const void* b) {
+    return cp_ffi_overlap_compare((const cpFfiOverlap*)a, (const cpFfiOverlap*)b);
+}
+
+static void cp_ffi_push_sensor_event(cpFfiSpaceData* data, int type, const cpFfiOverlap* overlap) {
+    cpFfiSensorEvent* event = (cpFfiSensorEvent*)cp_ffi_buffer_push(&data->sensorEvents, sizeof(cpFfiSensorEvent));
+    event->type = type;
+    event->sensor = overlap->sensor;
+    event->other = overlap->other;
+}
+
+// Collects the overlaps of the tracked shapes from the arbiter cache and diffs them against the
+// previous step's sorted overlaps.
+static void cp_ffi_track_sensors(cpSpace* space, cpFfiSpaceData* data) {
+    data->currentOverlaps.count = 0;
+    cpHashSetEach(space->cachedArbiters, cp_ffi_collect_overlap, data);
+    cpFfiOverlap* current = (cpFfiOverlap*)data->currentOverlaps.items;
+    int currentCount = data->currentOverlaps.count;
+    if (currentCount > 1) qsort(current, currentCount, sizeof(cpFfiOverlap), cp_ffi_overlap_qsort_compare);
+
+    cpFfiOverlap* previous = (cpFfiOverlap*)data->overlaps.items;
+    int previousCount = data->overlaps.count;
+    int i = 0, j = 0;
+    while (i < previousCount || j < currentCount) {
+        int order = i == previousCount ? 1 : j == currentCount ? -1 : cp_ffi_overlap_compare(&previous[i], &current[j]);
+        if (order < 0) {
+            cp_ffi_push_sensor_event(data, CP_FFI_SENSOR_EXIT, &previous[i++]);
+        } else if (order > 0) {
+            cp_ffi_push_sensor_event(data, CP_FFI_SENSOR_ENTER, &current[j++]);
+        } else {
+            i++;
+            j++;
+        }
+    }
+
+    cpFfiBuffer swap = data->overlaps;
+    data->overlaps = data->currentOverlaps;
+    data->currentOverlaps = swap;
+}
+
+FFI_PLUGIN_EXPORT void cp_space_set_sensor_tracking(cpSpace* space, cpShape* shape, int enabled) {
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    if (!data->trackedSensors) data->trackedSensors = cpHashSetNew(0, cp_ffi_ptr_eql);
+    if (enabled) {
+        cpHashSetInsert(data->trackedSensors, (cpHashValue)shape, shape, NULL, shape);
+        return;
+    }
+
+    cpHashSetRemove(data->trackedSensors, (cpHashValue)shape, shape);
+    cpFfiOverlap* overlaps = (cpFfiOverlap*)data->overlaps.items;
+    int kept = 0;
+    for (int i = 0; i < data->overlaps.count; i++) {
+        if (overlaps[i].sensor != shape) overlaps[kept++] = overlaps[i];
+    }
+    data->overlaps.count = kept;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_sensor_event_count(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->sensorEvents.count : 0;
+}
+
+// Moves up to `capacity` pending events, oldest first, into `types` and `shapes`.
+FFI_PLUGIN_EXPORT int cp_space_drain_sensor_events(cpSpace* space, int* types, cpShape** shapes, int capacity) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return 0;
+
+    cpFfiSensorEvent* events = (cpFfiSensorEvent*)data->sensorEvents.items;
+    int count = data->sensorEvents.count < capacity ? data->sensorEvents.count : capacity;
+    for (int i = 0; i < count; i++) {
+        types[i] = events[i].type;
+        shapes[i] = events[i].sensor;
+        shapes[capacity + i] = events[i].other;
+    }
+    data->sensorEvents.count -= count;
+    memmove(events, events + count, data->sensorEvents.count * sizeof(cpFfiSensorEvent));
+    return count;
+}
+
+// Writes up to `capacity` shapes overlapping `sensor` at the end of the last step and returns their total number.
+FFI_PLUGIN_EXPORT int cp_space_get_sensor_overlaps(cpSpace* space, cpShape* sensor, cpShape** out, int capacity) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data) return 0;
+
+    cpFfiOverlap* overlaps = (cpFfiOverlap*)data->overlaps.items;
+    int count = 0;
+    for (int i = 0; i < data->overlaps.count; i++) {
+        if (overlaps[i].sensor != sensor) continue;
+        if (count < capacity) out[count] = overlaps[i].other;
+        count++;
+    }
+    return count;
+}
+
+// Collision rules
+FFI_PLUGIN_EXPORT void cp_space_set_collision_rule(cpSpace* space, uintptr_t typeA, uintptr_t typeB, int rules, cpVect oneWayDirection) {
+    int swapped;
+    cpFfiPairHandler* pair = cp_ffi_pair_handler(space, (cpCollisionType)typeA, (cpCollisionType)typeB, &swapped);
+    pair->rules = rules;
+    // The arbiter's normal points from the shape of the handler's first type to the other one.
+    pair->oneWayDirection = swapped ? cpvneg(oneWayDirection) : oneWayDirection;
+}
+
+// Worker pool
+// Batches are split into contiguous chunks: the calling thread runs the first one and the pool's
+// workers run the others. Without threads (wasm), every batch runs on the calling thread.
+#if defined(__EMSCRIPTEN__) || defined(__wasm__)
+#define CP_FFI_THREADS 0
+#else
+#define CP_FFI_THREADS 1
+#endif
+
+// Minimum number of items per chunk, below which waking a worker costs more than it saves.
+#define CP_FFI_PARALLEL_GRAIN 64
+#define CP_FFI_MAX_WORKER_THREADS 63
+
+typedef void (*cpFfiParallelFunc)(void* context, int start, int end);
+
+#if CP_FFI_THREADS
+#if _WIN32
+typedef SRWLOCK cpFfiMutex;
+typedef CONDITION_VARIABLE cpFfiCond;
+typedef HANDLE cpFfiThread;
+#define CP_FFI_MUTEX_INIT SRWLOCK_INIT
+#define CP_FFI_COND_INIT CONDITION_VARIABLE_INIT
+#define cp_ffi_mutex_lock(mutex) AcquireSRWLockExclusive(mutex)
+#define cp_ffi_mutex_unlock(mutex) ReleaseSRWLockExclusive(mutex)
+#define cp_ffi_cond_wait(cond, mutex) SleepConditionVariableSRW(cond, mutex, INFINITE, 0)
+#define cp_ffi_cond_broadcast(cond) WakeAllConditionVariable(cond)
+#define cp_ffi_cond_signal(cond) WakeConditionVariable(cond)
+#else
+typedef pthread_mutex_t cpFfiMutex;
+typedef pthread_cond_t cpFfiCond;
+typedef pthread_t cpFfiThread;
+#define CP_FFI_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define CP_FFI_COND_INIT PTHREAD_COND_INITIALIZER
+#define cp_ffi_mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define cp_ffi_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+#define cp_ffi_cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+#define cp_ffi_cond_broadcast(cond) pthread_cond_broadcast(cond)
+#define cp_ffi_cond_signal(cond) pthread_cond_signal(cond)
+#endif
+
+static struct {
+    // Serializes batches and resizing, so a single job is in flight at a time.
+    cpFfiMutex dispatchMutex;
+    cpFfiMutex mutex;
+    cpFfiCond workCond;
+    cpFfiCond doneCond;
+    cpFfiThread* threads;
+    // -1 until the pool is first used or sized.
+    int threadCount;
+    unsigned generation;
+    int pending;
+    int shutdown;
+    cpFfiParallelFunc func;
+    void* context;
+    int count;
+    int chunks;
+} cp_ffi_pool = {CP_FFI_MUTEX_INIT, CP_FFI_MUTEX_INIT, CP_FFI_COND_INIT, CP_FFI_COND_INIT, NULL, -1, 0, 0, 0, NULL, NULL, 0, 0};
+
+static void cp_ffi_run_chunk(cpFfiParallelFunc func, void* context, int count, int chunks, int chunk) {
+    int start = (int)((int64_t)count * chunk / chunks);
+    int end = (int)((int64_t)count * (chunk + 1) / chunks);
+    if (start < end) {
+        CP_FFI_TRACE_BEGIN();
+        func(context, start, end);
+        CP_FFI_TRACE_END("worker chunk");
+    }
+}
+
+static void cp_ffi_worker_loop(int index) {
+    unsigned seen = 0;
+    cp_ffi_mutex_lock(&cp_ffi_pool.mutex);
+    for (;;) {
+        while (cp_ffi_pool.generation == seen && !cp_ffi_pool.shutdown) {
+            cp_ffi_cond_wait(&cp_ffi_pool.workCond, &cp_ffi_pool.mutex);
+        }
+        if (cp_ffi_pool.shutdown) break;
+
+        seen = cp_ffi_pool.generation;
+        cpFfiParallelFunc func = cp_ffi_pool.func;
+        void* context = cp_ffi_pool.context;
+        int count = cp_ffi_pool.count;
+        int chunks = cp_ffi_pool.chunks;
+        cp_ffi_mutex_unlock(&cp_ffi_pool.mutex);
+
+        // Worker i runs chunk i + 1, the calling thread runs chunk 0.
+        if (index + 1 < chunks) cp_ffi_run_chunk(func, context, count, chunks, index + 1);
+
+        cp_ffi_mutex_lock(&cp_ffi_pool.mutex);
+        if (--cp_ffi_pool.pending == 0) cp_ffi_cond_signal(&cp_ffi_pool.doneCond);
+    }
+    cp_ffi_mutex_unlock(&cp_ffi_pool.mutex);
+    CP_FFI_TRACE_THREAD_EXIT();
+}
+
+#if _WIN32
+static DWORD WINAPI cp_ffi_worker_main(LPVOID arg) {
+    cp_ffi_worker_loop((int)(intptr_t)arg);
+    return 0;
+}
+#else
+static void* cp_ffi_worker_main(void* arg) {
+    cp_ffi_worker_loop((int)(intptr_t)arg);
+    return NULL;
+}
+#endif
+
+static int cp_ffi_default_worker_count(void) {
+#if _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cpus = (int)info.dwNumberOfProcessors;
+#else
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return cpus > 1 ? cpus - 1 : 0;
+}
+
+// Must be called with the dispatch mutex held.
+static void cp_ffi_pool_stop(void) {
+    cp_ffi_mutex_lock(&cp_ffi_pool.mutex);
+    cp_ffi_pool.shutdown = 1;
+    cp_ffi_cond_broadcast(&cp_ffi_pool.workCond);
+    cp_ffi_mutex_unlock(&cp_ffi_pool.mutex);
+
+    for (int i = 0; i < cp_ffi_pool.threadCount; i++) {
+#if _WIN32
+        WaitForSingleObject(cp_ffi_pool.threads[i], INFINITE);
+        CloseHandle(cp_ffi_pool.threads[i]);
+#else
+        pthread_join(cp_ffi_pool.threads[i], NULL);
+#endif
+    }
+    cpfree(cp_ffi_pool.threads);
+    cp_ffi_pool.threads = NULL;
+    cp_ffi_pool.threadCount = 0;
+    cp_ffi_pool.shutdown = 0;
+}
+
+// Must be called with the dispatch mutex held. Stops at the first thread that fails to start.
+static void cp_ffi_pool_start(int count) {
+    if (count > CP_FFI_MAX_WORKER_THREADS) count = CP_FFI_MAX_WORKER_THREADS;
+    cp_ffi_pool.threadCount = 0;
+    cp_ffi_pool.generation = 0;
+    if (count <= 0) return;
+
+    cp_ffi_pool.threads = (cpFfiThread*)cpcalloc(count, sizeof(cpFfiThread));
+    for (int i = 0; i < count; i++) {
+#if _WIN32
+        cp_ffi_pool.threads[i] = CreateThread(NULL, 0, cp_ffi_worker_main, (LPVOID)(intptr_t)i, 0, NULL);
+        if (!cp_ffi_pool.threads[i]) break;
+#else
+        if (pthread_create(&cp_ffi_pool.threads[i], NULL, cp_ffi_worker_main, (void*)(intptr_t)i) != 0) break;
+#endif
+        cp_ffi_pool.threadCount++;
+    }
+}
+#endif
+
+// Calls func(context, start, end) over contiguous ranges of at least `grain` items covering [0, count),
+// in parallel when there are at least two ranges and worker threads are available. Returns once every
+// range is done.
+static void cp_ffi_parallel_for_grain(int count, int grain, cpFfiParallelFunc func, void* context) {
+#if CP_FFI_THREADS
+    if (count >= 2 * grain) {
+        cp_ffi_mutex_lock(&cp_ffi_pool.dispatchMutex);
+        if (cp_ffi_pool.threadCount < 0) cp_ffi_pool_start(cp_ffi_default_worker_count());
+
+        int chunks = count / grain;
+        if (chunks > cp_ffi_pool.threadCount + 1) chunks = cp_ffi_pool.threadCount + 1;
+        if (chunks > 1) {
+            cp_ffi_mutex_lock(&cp_ffi_pool.mutex);
+            cp_ffi_pool.func = func;
+            cp_ffi_pool.context = context;
+            cp_ffi_pool.count = count;
+            cp_ffi_pool.chunks = chunks;
+            cp_ffi_pool.pending = cp_ffi_pool.threadCount;
+            cp_ffi_pool.generation++;
+            cp_ffi_cond_broadcast(&cp_ffi_pool.workCond);
+            cp_ffi_mutex_unlock(&cp_ffi_pool.mutex);
+
+            cp_ffi_run_chunk(func, context, count, chunks, 0);
+
+            cp_ffi_mutex_lock(&cp_ffi_pool.mutex);
+            while (cp_ffi_pool.pending > 0) cp_ffi_cond_wait(&cp_ffi_pool.doneCond, &cp_ffi_pool.mutex);
+            cp_ffi_mutex_unlock(&cp_ffi_pool.mutex);
+            cp_ffi_mutex_unlock(&cp_ffi_pool.dispatchMutex);
+            return;
+        }
+        cp_ffi_mutex_unlock(&cp_ffi_pool.dispatchMutex);
+    }
+#else
+    (void)grain;
+#endif
+    if (count > 0) func(context, 0, count);
+}
+
+static void cp_ffi_parallel_for(int count, cpFfiParallelFunc func, void* context) {
+    cp_ffi_parallel_for_grain(count, CP_FFI_PARALLEL_GRAIN, func, context);
+}
+
+// Resizes the worker pool, a negative count restoring the default of one worker per CPU beyond the first.
+FFI_PLUGIN_EXPORT void cp_ffi_set_worker_thread_count(int count) {
+#if CP_FFI_THREADS
+    cp_ffi_mutex_lock(&cp_ffi_pool.dispatchMutex);
+    if (cp_ffi_pool.threads) cp_ffi_pool_stop();
+    cp_ffi_pool_start(count < 0 ? cp_ffi_default_worker_count() : count);
+    cp_ffi_mutex_unlock(&cp_ffi_pool.dispatchMutex);
+#else
+    (void)count;
+#endif
+}
+
+FFI_PLUGIN_EXPORT int cp_ffi_get_worker_thread_count(void) {
+#if CP_FFI_THREADS
+    cp_ffi_mutex_lock(&cp_ffi_pool.dispatchMutex);
+    if (cp_ffi_pool.threadCount < 0) cp_ffi_pool_start(cp_ffi_default_worker_count());
+    int count = cp_ffi_pool.threadCount;
+    cp_ffi_mutex_unlock(&cp_ffi_pool.dispatchMutex);
+    return count;
+#else
+    return 0;
+#endif
+}
+
+// Batched queries
+// The batches only read the spatial indexes and shapes when the indexes are bounding box trees, so
+// chunks of a batch run on the worker pool. Spatial hash queries stamp the shapes they visit, so batches
+// run on the calling thread when the space uses one. The space is locked once for the whole batch.
+typedef struct cpFfiQueryBatch {
+    cpSpace* space;
+    const double* queries;
+    const cpShapeFilter* filters;
+    int filterCount;
+    cpShape** shapes;
+    double* hits;
+    int capacity;
+    int* counts;
+} cpFfiQueryBatch;
+
+static cpShapeFilter cp_ffi_batch_filter(const cpFfiQueryBatch* batch, int i) {
+    if (batch->filterCount == 0) return CP_SHAPE_FILTER_ALL;
+    return batch->filters[batch->filterCount == 1 ? 0 : i];
+}
+
+typedef struct cpFfiSegmentQueryContext {
+    cpVect start, end;
+    cpFloat radius;
+    cpShapeFilter filter;
+} cpFfiSegmentQueryContext;
+
+// Same as the SegmentQueryFirst callback of cpSpaceSegmentQueryFirst.
+static cpFloat cp_ffi_segment_query_first(cpFfiSegmentQueryContext* context, cpShape* shape, cpSegmentQueryInfo* out) {
+    cpSegmentQueryInfo info;
+    if (!cpShapeFilterReject(shape->filter, context->filter) && !shape->sensor &&
+        cpShapeSegmentQuery(shape, context->start, context->end, context->radius, &info) &&
+        info.alpha < out->alpha) {
+        *out = info;
+    }
+    return out->alpha;
+}
+
+static void cp_ffi_segment_query_range(void* data, int start, int end) {
+    cpFfiQueryBatch* batch = (cpFfiQueryBatch*)data;
+    cpFfiSegmentQueryContext context;
+    for (int i = start; i < end; i++) {
+        const double* segment = batch->queries + i * 5;
+        context.start = cpv(segment[0], segment[1]);
+        context.end = cpv(segment[2], segment[3]);
+        context.radius = segment[4];
+        context.filter = cp_ffi_batch_filter(batch, i);
+
+        cpSegmentQueryInfo info = {NULL, context.end, cpvzero, 1.0f};
+        cpSpatialIndexSegmentQuery(batch->space->staticShapes, &context, context.start, context.end, 1.0f, (cpSpatialIndexSegmentQueryFunc)cp_ffi_segment_query_first, &info);
+        cpSpatialIndexSegmentQuery(batch->space->dynamicShapes, &context, context.start, context.end, info.alpha, (cpSpatialIndexSegmentQueryFunc)cp_ffi_segment_query_first, &info);
+
+        double* hit = batch->hits + i * 5;
+        hit[0] = info.point.x;
+        hit[1] = info.point.y;
+        hit[2] = info.normal.x;
+        hit[3] = info.normal.y;
+        hit[4] = info.alpha;
+        batch->shapes[i] = (cpShape*)info.shape;
+    }
+}
+
+typedef struct cpFfiPointQueryContext {
+    cpVect point;
+    cpShapeFilter filter;
+} cpFfiPointQueryContext;
+
+// Same as the NearestPointQueryNearest callback of cpSpacePointQueryNearest.
+static cpCollisionID cp_ffi_point_query_nearest(cpFfiPointQueryContext* context, cpShape* shape, cpCollisionID id, cpPointQueryInfo* out) {
+    if (!cpShapeFilterReject(shape->filter, context->filter) && !shape->sensor) {
+        cpPointQueryInfo info;
+        cpShapePointQuery(shape, context->point, &info);
+        if (info.distance < out->distance) *out = info;
+    }
+    return id;
+}
+
+static void cp_ffi_point_query_range(void* data, int start, int end) {
+    cpFfiQueryBatch* batch = (cpFfiQueryBatch*)data;
+    cpFfiPointQueryContext context;
+    for (int i = start; i < end; i++) {
+        const double* query = batch->queries + i * 3;
+        context.point = cpv(query[0], query[1]);
+        context.filter = cp_ffi_batch_filter(batch, i);
+        cpFloat maxDistance = query[2];
+
+        cpPointQueryInfo info = {NULL, cpvzero, maxDistance, cpvzero};
+        cpBB bb = cpBBNewForCircle(context.point, cpfmax(maxDistance, 0.0f));
+        cpSpatialIndexQuery(batch->space->dynamicShapes, &context, bb, (cpSpatialIndexQueryFunc)cp_ffi_point_query_nearest, &info);
+        cpSpatialIndexQuery(batch->space->staticShapes, &context, bb, (cpSpatialIndexQueryFunc)cp_ffi_point_query_nearest, &info);
+
+        double* hit = batch->hits + i * 5;
+        hit[0] = info.point.x;
+        hit[1] = info.point.y;
+        hit[2] = info.distance;
+        hit[3] = info.gradient.x;
+        hit[4] = info.gradient.y;
+        batch->shapes[i] = (cpShape*)info.shape;
+    }
+}
+
+typedef struct cpFfiBBQueryContext {
+    cpBB bb;
+    cpShapeFilter filter;
+    cpShape** shapes;
+    int capacity;
+    int count;
+} cpFfiBBQueryContext;
+
+// Same as the BBQuery callback of cpSpaceBBQuery.
+static cpCollisionID cp_ffi_bb_query(cpFfiBBQueryContext* context, cpShape* shape, cpCollisionID id, void* unused) {
+    (void)unused;
+    if (!cpShapeFilterReject(shape->filter, context->filter) && cpBBIntersects(context->bb, shape->bb)) {
+        if (context->count < context->capacity) context->shapes[context->count] = shape;
+        context->count++;
+    }
+    return id;
+}
+
+static void cp_ffi_bb_query_range(void* data, int start, int end) {
+    cpFfiQueryBatch* batch = (cpFfiQueryBatch*)data;
+    cpFfiBBQueryContext context;
+    context.capacity = batch->capacity;
+    for (int i = start; i < end; i++) {
+        const double* query = batch->queries + i * 4;
+        context.bb = cpBBNew(query[0], query[1], query[2], query[3]);
+        context.filter = cp_ffi_batch_filter(batch, i);
+        context.shapes = batch->shapes + (size_t)i * batch->capacity;
+        context.count = 0;
+
+        cpSpatialIndexQuery(batch->space->dynamicShapes, &context, context.bb, (cpSpatialIndexQueryFunc)cp_ffi_bb_query, NULL);
+        cpSpatialIndexQuery(batch->space->staticShapes, &context, context.bb, (cpSpatialIndexQueryFunc)cp_ffi_bb_query, NULL);
+        batch->counts[i] = context.count;
+    }
+}
+
+static void cp_ffi_run_query_batch(cpFfiQueryBatch* batch, int count, cpFfiParallelFunc func) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)batch->space->userData;
+    cpSpaceLock(batch->space); {
+        if (data && data->spatialHash) {
+            if (count > 0) func(batch, 0, count);
+        } else {
+            cp_ffi_parallel_for(count, func, batch);
+        }
+    } cpSpaceUnlock(batch->space, cpTrue);
+}
+
+static int cp_ffi_count_hits(cpShape** shapes, int count) {
+    int hits = 0;
+    for (int i = 0; i < count; i++) {
+        if (shapes[i]) hits++;
+    }
+    return hits;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_segment_query_first_batch(cpSpace* space, const double* segments, int count, const cpShapeFilter* filters, int filterCount, cpShape** shapes, double* hits) {
+    cpFfiQueryBatch batch = {space, segments, filters, filterCount, shapes, hits, 0, NULL};
+    CP_FFI_TRACE_BEGIN();
+    cp_ffi_run_query_batch(&batch, count, cp_ffi_segment_query_range);
+    CP_FFI_TRACE_END("cp_space_segment_query_first_batch");
+    return cp_ffi_count_hits(shapes, count);
+}
+
+FFI_PLUGIN_EXPORT int cp_space_point_query_nearest_batch(cpSpace* space, const double* points, int count, const cpShapeFilter* filters, int filterCount, cpShape** shapes, double* hits) {
+    cpFfiQueryBatch batch = {space, points, filters, filterCount, shapes, hits, 0, NULL};
+    CP_FFI_TRACE_BEGIN();
+    cp_ffi_run_query_batch(&batch, count, cp_ffi_point_query_range);
+    CP_FFI_TRACE_END("cp_space_point_query_nearest_batch");
+    return cp_ffi_count_hits(shapes, count);
+}
+
+FFI_PLUGIN_EXPORT void cp_space_bb_query_batch(cpSpace* space, const double* bbs, int count, const cpShapeFilter* filters, int filterCount, cpShape** shapes, int capacity, int* counts) {
+    cpFfiQueryBatch batch = {space, bbs, filters, filterCount, shapes, NULL, capacity, counts};
+    CP_FFI_TRACE_BEGIN();
+    cp_ffi_run_query_batch(&batch, count, cp_ffi_bb_query_range);
+    CP_FFI_TRACE_END("cp_space_bb_query_batch");
+}
+
+// Viewport culling
+FFI_PLUGIN_EXPORT void cp_shape_set_render_id(cpShape* shape, uint32_t renderId) {
+    CP_FFI_TRACE_BEGIN();
+    cpShapeSetUserData(shape, (cpDataPointer)(uintptr_t)renderId);
+    CP_FFI_TRACE_END("cp_shape_set_render_id");
+}
+
+FFI_PLUGIN_EXPORT uint32_t cp_shape_get_render_id(cpShape* shape) {
+    return (uint32_t)(uintptr_t)cpShapeGetUserData(shape);
+}
+
+typedef struct cpFfiVisibleState {
+    float* instances;
+    uint32_t* renderIds;
+    cpShape** shapes;
+    int capacity;
+    int count;
+} cpFfiVisibleState;
+
+static void cp_ffi_visible_shape(cpShape* shape, void* data) {
+    uint32_t renderId = (uint32_t)(uintptr_t)shape->userData;
+    if (renderId == 0) return;
+
+    cpFfiVisibleState* state = (cpFfiVisibleState*)data;
+    int i = state->count++;
+    if (i >= state->capacity) return;
+
+    cpBody* body = shape->body;
+    float* instance = state->instances + 3 * i;
+    instance[0] = (float)body->p.x;
+    instance[1] = (float)body->p.y;
+    instance[2] = (float)body->a;
+    if (state->renderIds) state->renderIds[i] = renderId;
+    if (state->shapes) state->shapes[i] = shape;
+}
+
+// Writes the body position x, position y and angle of up to `capacity` visible shapes to
+// instances[3 * i], with their render ids and shapes to the optional `renderIds` and `shapes`.
+// Returns the total number of visible shapes.
+FFI_PLUGIN_EXPORT int cp_space_query_visible(cpSpace* space, cpBB viewport, cpShapeFilter filter, float* instances, uint32_t* renderIds, cpShape** shapes, int capacity) {
+    cpFfiVisibleState state = {instances, renderIds, shapes, capacity, 0};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceBBQuery(space, viewport, filter, cp_ffi_visible_shape, &state);
+    CP_FFI_TRACE_END("cp_space_query_visible");
+    return state.count;
+}
+
+// Shape casts
+#define CP_FFI_SHAPE_CAST_ITERATIONS 32
+// Smallest tolerance accepted; a cast that must close the gap exactly never converges.
+#define CP_FFI_SHAPE_CAST_MIN_TOLERANCE 1e-6f
+
+// Closest pair of features between the cast shape and another shape.
+typedef struct cpFfiSeparation {
+    cpFloat distance;
+    // Derivative of the distance with respect to the fraction of the translation.
+    cpFloat rate;
+    cpVect point;
+    cpVect normal;
+} cpFfiSeparation;
+
+// Vertices of the shape without its radius, in world coordinates.
+static int cp_ffi_core_vertex_count(const cpShape* shape) {
+    switch (shape->klass->type) {
+        case CP_CIRCLE_SHAPE: return 1;
+        case CP_SEGMENT_SHAPE: return 2;
+        case CP_POLY_SHAPE: return ((const cpPolyShape*)shape)->count;
+        default: return 0;
+    }
+}
+
+static cpVect cp_ffi_core_vertex(const cpShape* shape, int i) {
+    switch (shape->klass->type) {
+        case CP_CIRCLE_SHAPE: return ((const cpCircleShape*)shape)->tc;
+        case CP_SEGMENT_SHAPE: return i == 0 ? ((const cpSegmentShape*)shape)->ta : ((const cpSegmentShape*)shape)->tb;
+        case CP_POLY_SHAPE: return ((const cpPolyShape*)shape)->planes[i].v0;
+        default: return cpvzero;
+    }
+}
+
+static cpFloat cp_ffi_core_radius(const cpShape* shape) {
+    switch (shape->klass->type) {
+        case CP_CIRCLE_SHAPE: return ((const cpCircleShape*)shape)->r;
+        case CP_SEGMENT_SHAPE: return ((const cpSegmentShape*)shape)->r;
+        case CP_POLY_SHAPE: return ((const cpPolyShape*)shape)->r;
+        default: return 0.0f;
+    }
+}
+
+// Updates `best` with the distances from the core vertices of `from` to the surface of `to`.
+// `moving` tells whether `from` is the cast shape, which moves by `translation`.
+static void cp_ffi_vertex_separation(const cpShape* from, const cpShape* to, cpVect translation, cpBool moving, cpFfiSeparation* best) {
+    cpFloat radius = cp_ffi_core_radius(from);
+    int count = cp_ffi_core_vertex_count(from);
+    for (int i = 0; i < count; i++) {
+        cpVect v = cp_ffi_core_vertex(from, i);
+        cpPointQueryInfo info;
+        cpShapePointQuery(to, v, &info);
+        cpFloat distance = info.distance - radius;
+        // The gradient points from the surface of `to` towards `v`.
+        cpFloat rate = moving ? cpvdot(translation, info.gradient) : -cpvdot(translation, info.gradient);
+        if (distance < best->distance || (distance == best->distance && rate < best->rate)) {
+            best->distance = distance;
+            best->rate = rate;
+            if (moving) {
+                best->point = info.point;
+                best->normal = info.gradient;
+            } else {
+                best->point = cpvsub(v, cpvmult(info.gradient, radius));
+                best->normal = cpvneg(info.gradient);
+            }
+        }
+    }
+}
+
+// The closest features of two disjoint convex shapes always include a vertex of one of them.
+static cpFfiSeparation cp_ffi_separation(const cpShape* shape, const cpShape* other, cpVect translation) {
+    cpFfiSeparation separation = {INFINITY, 0.0f, cpvzero, cpvzero};
+    cp_ffi_vertex_separation(shape, other, translation, cpTrue, &separation);
+    cp_ffi_vertex_separation(other, shape, translation, cpFalse, &separation);
+    return separation;
+}
+
+static void cp_ffi_place_shape(cpShape* shape, cpVect translation, cpFloat alpha) {
+    cpTransform transform = shape->body->transform;
+    transform.tx += translation.x * alpha;
+    transform.ty += translation.y * alpha;
+    cpShapeUpdate(shape, transform);
+}
+
+// Conservative advancement: the distance between two convex shapes is a convex function of the
+// fraction of the translation, so stepping to the root of its tangent never passes the first contact.
+// Returns whether `other` is hit before `maxAlpha`, filling `out` if so. A cast that has not come within
+// `tolerance` after CP_FFI_SHAPE_CAST_ITERATIONS steps, such as a near graze, is a miss.
+static cpBool cp_ffi_cast_against(cpShape* shape, cpShape* other, cpVect translation, cpFloat tolerance, cpFloat maxAlpha, cpSegmentQueryInfo* out) {
+    cp_ffi_place_shape(shape, translation, 0.0f);
+    cpContactPointSet set = cpShapesCollide(shape, other);
+    if (set.count > 0) {
+        *out = (cpSegmentQueryInfo){other, set.points[0].pointB, cpvneg(set.normal), 0.0f};
+        return cpTrue;
+    }
+
+    cpFloat alpha = 0.0f;
+    for (int i = 0; i < CP_FFI_SHAPE_CAST_ITERATIONS; i++) {
+        cpFfiSeparation separation = cp_ffi_separation(shape, other, translation);
+        if (separation.distance <= tolerance) {
+            *out = (cpSegmentQueryInfo){other, separation.point, separation.normal, alpha};
+            return cpTrue;
+        }
+        if (separation.rate >= 0.0f) return cpFalse;
+
+        alpha += separation.distance / -separation.rate;
+        if (alpha >= maxAlpha) return cpFalse;
+        cp_ffi_place_shape(shape, translation, alpha);
+    }
+    return cpFalse;
+}
+
+typedef struct cpFfiCastCandidates {
+    cpShape* shape;
+    cpFfiBuffer shapes;
+} cpFfiCastCandidates;
+
+static void cp_ffi_cast_candidate(cpShape* other, void* data) {
+    cpFfiCastCandidates* candidates = (cpFfiCastCandidates*)data;
+    if (other == candidates->shape || other->body == candidates->shape->body || other->sensor) return;
+    *(cpShape**)cp_ffi_buffer_push(&candidates->shapes, sizeof(cpShape*)) = other;
+}
+
+// Sweeps `shape`, placed by its body's transform, along `translation` and reports the first shape it
+// touches, within `tolerance`, in `out`. The candidates are the shapes whose bounding boxes overlap the
+// swept bounding box and pass the shape's filter; sensors and shapes of the same body are skipped.
+// Tolerances below CP_FFI_SHAPE_CAST_MIN_TOLERANCE are raised to it.
+// Returns the shape hit, or NULL with an alpha of 1.
+FFI_PLUGIN_EXPORT cpShape* cp_space_shape_cast(cpSpace* space, cpShape* shape, cpVect translation, cpFloat tolerance, cpSegmentQueryInfo* out) {
+    CP_FFI_TRACE_BEGIN();
+    // Also replaces a NaN tolerance.
+    tolerance = tolerance > CP_FFI_SHAPE_CAST_MIN_TOLERANCE ? tolerance : CP_FFI_SHAPE_CAST_MIN_TOLERANCE;
+    cpBB start = cpShapeUpdate(shape, shape->body->transform);
+    cpBB swept = cpBBMerge(start, cpBBOffset(start, translation));
+    cpFfiCastCandidates candidates = {shape, {NULL, 0, 0}};
+    cpSpaceBBQuery(space, swept, shape->filter, cp_ffi_cast_candidate, &candidates);
+
+    cpSegmentQueryInfo best = {NULL, cpvadd(cpBodyGetPosition(shape->body), translation), cpvzero, 1.0f};
+    cpShape** others = (cpShape**)candidates.shapes.items;
+    for (int i = 0; i < candidates.shapes.count; i++) {
+        cpSegmentQueryInfo info;
+        if (cp_ffi_cast_against(shape, others[i], translation, tolerance, best.alpha, &info) && (!best.shape || info.alpha < best.alpha)) {
+            best = info;
+        }
+    }
+    cpfree(candidates.shapes.items);
+
+    // Restore the shape's cached geometry to its body's transform.
+    cpShapeUpdate(shape, shape->body->transform);
+    CP_FFI_TRACE_END("cp_space_shape_cast");
+    if (out) *out = best;
+    return (cpShape*)best.shape;
+}
+
+// Hasty spaces
+FFI_PLUGIN_EXPORT cpSpace* cp_hasty_space_new(void) {
+#if CP_FFI_HASTY_SPACE
+    cpSpace* space = cpHastySpaceNew();
+    cp_ffi_space_data(space)->hasty = 1;
+    return space;
+#else
+    return cpSpaceNew();
+#endif
+}
+
+FFI_PLUGIN_EXPORT void cp_hasty_space_set_threads(cpSpace* space, int threads) {
+#if CP_FFI_HASTY_SPACE
+    if (!cp_ffi_space_is_hasty(space)) return;
+    // Chipmunk only picks the CPU count itself on Apple platforms.
+    if (threads <= 0) threads = cp_ffi_default_worker_count() + 1;
+    cpHastySpaceSetThreads(space, (unsigned long)threads);
+#else
+    (void)space;
+    (void)threads;
+#endif
+}
+
+FFI_PLUGIN_EXPORT int cp_hasty_space_get_threads(cpSpace* space) {
+#if CP_FFI_HASTY_SPACE
+    if (cp_ffi_space_is_hasty(space)) return (int)cpHastySpaceGetThreads(space);
+#else
+    (void)space;
+#endif
+    return 1;
+}
+
+FFI_PLUGIN_EXPORT void cp_hasty_space_step(cpSpace* space, cpFloat dt) {
+    cp_space_step(space, dt);
+}
+
+// Multi-space stepping
+// Stepping times vary a lot between spaces, so rather than stepping a fixed range of spaces, each
+// thread of the pool keeps claiming the next space not stepped yet until none are left.
+#if _MSC_VER
+#define cp_ffi_atomic_fetch_increment(ptr) (InterlockedIncrement(ptr) - 1)
+#define cp_ffi_atomic_load(ptr) InterlockedCompareExchange(ptr, 0, 0)
+#define cp_ffi_atomic_store(ptr, value) InterlockedExchange(ptr, value)
+#else
+#define cp_ffi_atomic_fetch_increment(ptr) __atomic_fetch_add(ptr, 1, __ATOMIC_RELAXED)
+#define cp_ffi_atomic_load(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define cp_ffi_atomic_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#endif
+
+typedef struct cpFfiStepBatch {
+    cpSpace** spaces;
+    int count;
+    cpFloat dt;
+    volatile long next;
+} cpFfiStepBatch;
+
+static void cp_ffi_step_spaces(void* context, int start, int end) {
+    (void)start;
+    (void)end;
+    cpFfiStepBatch* batch = (cpFfiStepBatch*)context;
+    for (;;) {
+        long i = cp_ffi_atomic_fetch_increment(&batch->next);
+        if (i >= batch->count) break;
+        cp_space_step(batch->spaces[i], batch->dt);
+    }
+}
+
+// Steps every space by dt, spread over the worker pool, and returns once all of them are stepped.
+FFI_PLUGIN_EXPORT void cp_space_step_many(cpSpace** spaces, int count, cpFloat dt) {
+    cpFfiStepBatch batch = {spaces, count, dt, 0};
+    CP_FFI_TRACE_BEGIN();
+    cp_ffi_parallel_for_grain(count, 1, cp_ffi_step_spaces, &batch);
+    CP_FFI_TRACE_END("cp_space_step_many");
+}
+
+// Asynchronous steps
+// Each space gets its own step thread on its first asynchronous step. After each step, the thread
+// writes the transforms of every body into the back snapshot and then publishes it as the front one.
+// The front snapshot is only rewritten two steps later, and a new step only starts once the previous
+// one is done, so the thread that starts steps can read the front snapshot without locking while the
+// next step runs.
+typedef struct cpFfiSnapshotRow {
+    cpBody* body;
+    cpVect p;
+    cpFloat a;
+    cpVect v;
+    cpFloat w;
+} cpFfiSnapshotRow;
+
+struct cpFfiAsyncStep {
+    cpSpace* space;
+    cpFfiBuffer snapshots[2];
+    volatile long front;
+#if CP_FFI_THREADS
+    cpFfiThread thread;
+    cpFfiMutex mutex;
+    cpFfiCond startCond;
+    cpFfiCond doneCond;
+    int running;
+    int shutdown;
+    cpFloat dt;
+#endif
+};
+
+static void cp_ffi_snapshot_body(cpBody* body, void* data) {
+    cpFfiSnapshotRow* row = (cpFfiSnapshotRow*)cp_ffi_buffer_push((cpFfiBuffer*)data, sizeof(cpFfiSnapshotRow));
+    row->body = body;
+    row->p = cpBodyGetPosition(body);
+    row->a = cpBodyGetAngle(body);
+    row->v = cpBodyGetVelocity(body);
+    row->w = cpBodyGetAngularVelocity(body);
+}
+
+// Steps the space and publishes the resulting transforms. Only the step thread writes `front`.
+static void cp_ffi_async_step_run(cpFfiAsyncStep* async, cpFloat dt) {
+    cp_space_step(async->space, dt);
+
+    CP_FFI_TRACE_BEGIN();
+    long back = 1 - async->front;
+    async->snapshots[back].count = 0;
+    cpSpaceEachBody(async->space, cp_ffi_snapshot_body, &async->snapshots[back]);
+    cp_ffi_atomic_store(&async->front, back);
+    CP_FFI_TRACE_END("snapshot");
+}
+
+static void cp_ffi_snapshot_compact(cpFfiBuffer* snapshot, cpSpace* space) {
+    cpFfiSnapshotRow* rows = (cpFfiSnapshotRow*)snapshot->items;
+    int kept = 0;
+    for (int i = 0; i < snapshot->count; i++) {
+        if (rows[i].body->space == space) rows[kept++] = rows[i];
+    }
+    snapshot->count = kept;
+}
+
+// Drops the bodies that left the space from both snapshots, so they never hand out freed bodies.
+// Bodies are only removed between steps, while the step thread is idle.
+static void cp_ffi_forget_snapshot_bodies(cpSpace* space, cpFfiAsyncStep* async) {
+    cp_ffi_snapshot_compact(&async->snapshots[0], space);
+    cp_ffi_snapshot_compact(&async->snapshots[1], space);
+}
+
+#if CP_FFI_THREADS
+static void cp_ffi_async_step_loop(cpFfiAsyncStep* async) {
+    cp_ffi_mutex_lock(&async->mutex);
+    for (;;) {
+        while (!async->running && !async->shutdown) cp_ffi_cond_wait(&async->startCond, &async->mutex);
+        if (async->shutdown) break;
+
+        cpFloat dt = async->dt;
+        cp_ffi_mutex_unlock(&async->mutex);
+        cp_ffi_async_step_run(async, dt);
+        cp_ffi_mutex_lock(&async->mutex);
+
+        async->running = 0;
+        cp_ffi_cond_broadcast(&async->doneCond);
+    }
+    cp_ffi_mutex_unlock(&async->mutex);
+    CP_FFI_TRACE_THREAD_EXIT();
+}
+
+#if _WIN32
+static DWORD WINAPI cp_ffi_async_step_main(LPVOID arg) {
+    cp_ffi_async_step_loop((cpFfiAsyncStep*)arg);
+    return 0;
+}
+#else
+static void* cp_ffi_async_step_main(void* arg) {
+    cp_ffi_async_step_loop((cpFfiAsyncStep*)arg);
+    return NULL;
+}
+#endif
+
+// Must be called with the async mutex held.
+static void cp_ffi_async_step_join(cpFfiAsyncStep* async) {
+    while (async->running) cp_ffi_cond_wait(&async->doneCond, &async->mutex);
+}
+#endif
+
+// Returns NULL if the step thread could not be started.
+static cpFfiAsyncStep* cp_ffi_async_step(cpSpace* space) {
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    if (data->asyncStep) return data->asyncStep;
+
+    cpFfiAsyncStep* async = (cpFfiAsyncStep*)cpcalloc(1, sizeof(cpFfiAsyncStep));
+    async->space = space;
+#if CP_FFI_THREADS
+#if _WIN32
+    InitializeSRWLock(&async->mutex);
+    InitializeConditionVariable(&async->startCond);
+    InitializeConditionVariable(&async->doneCond);
+    async->thread = CreateThread(NULL, 0, cp_ffi_async_step_main, async, 0, NULL);
+    int started = async->thread != NULL;
+#else
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->startCond, NULL);
+    pthread_cond_init(&async->doneCond, NULL);
+    int started = pthread_create(&async->thread, NULL, cp_ffi_async_step_main, async) == 0;
+    if (!started) {
+        pthread_cond_destroy(&async->doneCond);
+        pthread_cond_destroy(&async->startCond);
+        pthread_mutex_destroy(&async->mutex);
+    }
+#endif
+    if (!started) {
+        cpfree(async);
+        return NULL;
+    }
+#endif
+    data->asyncStep = async;
+    return async;
+}
+
+static void cp_ffi_async_step_free(cpFfiAsyncStep* async) {
+#if CP_FFI_THREADS
+    cp_ffi_mutex_lock(&async->mutex);
+    cp_ffi_async_step_join(async);
+    async->shutdown = 1;
+    cp_ffi_cond_broadcast(&async->startCond);
+    cp_ffi_mutex_unlock(&async->mutex);
+#if _WIN32
+    WaitForSingleObject(async->thread, INFINITE);
+    CloseHandle(async->thread);
+#else
+    pthread_join(async->thread, NULL);
+    pthread_cond_destroy(&async->doneCond);
+    pthread_cond_destroy(&async->startCond);
+    pthread_mutex_destroy(&async->mutex);
+#endif
+#endif
+    cpfree(async->snapshots[0].items);
+    cpfree(async->snapshots[1].items);
+    cpfree(async);
+}
+
+// Starts stepping the space by dt on its step thread, after waiting for the previous asynchronous
+// step. Without threads (wasm), or if the thread cannot be started, the step runs before returning.
+FFI_PLUGIN_EXPORT void cp_space_step_async(cpSpace* space, cpFloat dt) {
+    cpFfiAsyncStep* async = cp_ffi_async_step(space);
+    if (!async) {
+        cp_space_step(space, dt);
+        return;
+    }
+#if CP_FFI_THREADS
+    cp_ffi_mutex_lock(&async->mutex);
+    cp_ffi_async_step_join(async);
+    async->dt = dt;
+    async->running = 1;
+    cp_ffi_cond_signal(&async->startCond);
+    cp_ffi_mutex_unlock(&async->mutex);
+#else
+    cp_ffi_async_step_run(async, dt);
+#endif
+}
+
+FFI_PLUGIN_EXPORT void cp_space_step_wait(cpSpace* space) {
+#if CP_FFI_THREADS
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data || !data->asyncStep) return;
+
+    cp_ffi_mutex_lock(&data->asyncStep->mutex);
+    cp_ffi_async_step_join(data->asyncStep);
+    cp_ffi_mutex_unlock(&data->asyncStep->mutex);
+#else
+    (void)space;
+#endif
+}
+
+FFI_PLUGIN_EXPORT int cp_space_is_stepping(cpSpace* space) {
+#if CP_FFI_THREADS
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data || !data->asyncStep) return 0;
+
+    cp_ffi_mutex_lock(&data->asyncStep->mutex);
+    int running = data->asyncStep->running;
+    cp_ffi_mutex_unlock(&data->asyncStep->mutex);
+    return running;
+#else
+    (void)space;
+    return 0;
+#endif
+}
+
+static const cpFfiBuffer* cp_ffi_front_snapshot(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data || !data->asyncStep) return NULL;
+    return &data->asyncStep->snapshots[cp_ffi_atomic_load(&data->asyncStep->front)];
+}
+
+// Uses the layout of cp_space_export_transforms_f32. Returns the number of bodies in the snapshot;
+// only the first `capacity` are written.
+FFI_PLUGIN_EXPORT int cp_space_read_snapshot_f32(cpSpace* space, float* out, int capacity, int flags, cpBody** bodies) {
+    const cpFfiBuffer* snapshot = cp_ffi_front_snapshot(space);
+    if (!snapshot) return 0;
+
+    const cpFfiSnapshotRow* rows = (const cpFfiSnapshotRow*)snapshot->items;
+    int count = snapshot->count < capacity ? snapshot->count : capacity;
+    for (int i = 0; i < count; i++) {
+        out[i] = (float)rows[i].p.x;
+        out[capacity + i] = (float)rows[i].p.y;
+        out[2 * capacity + i] = (float)rows[i].a;
+        if (flags & CP_FFI_STATE_VELOCITY) {
+            out[3 * capacity + i] = (float)rows[i].v.x;
+            out[4 * capacity + i] = (float)rows[i].v.y;
+            out[5 * capacity + i] = (float)rows[i].w;
+        }
+        if (bodies) bodies[i] = rows[i].body;
+    }
+    return snapshot->count;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_read_snapshot_f64(cpSpace* space, double* out, int capacity, int flags, cpBody** bodies) {
+    const cpFfiBuffer* snapshot = cp_ffi_front_snapshot(space);
+    if (!snapshot) return 0;
+
+    const cpFfiSnapshotRow* rows = (const cpFfiSnapshotRow*)snapshot->items;
+    int count = snapshot->count < capacity ? snapshot->count : capacity;
+    for (int i = 0; i < count; i++) {
+        out[i] = rows[i].p.x;
+        out[capacity + i] = rows[i].p.y;
+        out[2 * capacity + i] = rows[i].a;
+        if (flags & CP_FFI_STATE_VELOCITY) {
+            out[3 * capacity + i] = rows[i].v.x;
+            out[4 * capacity + i] = rows[i].v.y;
+            out[5 * capacity + i] = rows[i].w;
+        }
+        if (bodies) bodies[i] = rows[i].body;
+    }
+    return snapshot->count;
+}
+
+// Fixed timestep
+static void cp_ffi_record_previous_state(cpBody* body, void* data) {
+    cpFfiBodyRecord* record = cp_ffi_record_insert(&((cpFfiSpaceData*)data)->previousStates, body);
+    record->p = cpBodyGetPosition(body);
+    record->a = cpBodyGetAngle(body);
+}
+
+// Adds frameDt to the time not simulated yet and steps the space by fixedDt while at least fixedDt is
+// left, at most maxSubsteps times. Time left beyond maxSubsteps whole steps is dropped so a slow frame
+// cannot make the next ones slower. The transforms before the last substep are kept for interpolation.
+// Returns the number of substeps, 0 without doing anything unless fixedDt is positive. Negative frame
+// times and substep limits count as 0.
+FFI_PLUGIN_EXPORT int cp_space_advance(cpSpace* space, cpFloat frameDt, cpFloat fixedDt, int maxSubsteps) {
+    if (!(fixedDt > 0.0)) return 0;
+    if (!(frameDt > 0.0)) frameDt = 0.0;
+    if (maxSubsteps < 0) maxSubsteps = 0;
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    CP_FFI_TRACE_BEGIN();
+    data->accumulator += frameDt;
+    data->fixedDt = fixedDt;
+
+    int substeps = (int)cpffloor(data->accumulator / fixedDt);
+    if (substeps > maxSubsteps) {
+        data->accumulator -= (substeps - maxSubsteps) * fixedDt;
+        substeps = maxSubsteps;
+    }
+    for (int i = 0; i < substeps; i++) {
+        if (i == substeps - 1) cpSpaceEachBody(space, cp_ffi_record_previous_state, data);
+        cp_space_step(space, fixedDt);
+        data->accumulator -= fixedDt;
+    }
+    CP_FFI_TRACE_END("cp_space_advance");
+    return substeps;
+}
+
+// Fraction of a fixed step left in the accumulator, between 0 and 1.
+FFI_PLUGIN_EXPORT cpFloat cp_space_get_interpolation_alpha(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data || data->fixedDt <= 0.0) return 0.0;
+    return cpfclamp01(data->accumulator / data->fixedDt);
+}
+
+typedef struct cpFfiInterpolateState {
+    void* out;
+    int capacity;
+    cpBody** bodies;
+    int count;
+    cpHashSet* previousStates;
+    cpFloat alpha;
+} cpFfiInterpolateState;
+
+// Blends the body's transform before the last substep with its current one. Bodies added since then
+// have no previous transform and are written as they are.
+static void cp_ffi_interpolate_body(cpFfiInterpolateState* state, cpBody* body, cpVect* p, cpFloat* a) {
+    *p = cpBodyGetPosition(body);
+    *a = cpBodyGetAngle(body);
+    cpFfiBodyRecord* previous = state->previousStates
+        ? (cpFfiBodyRecord*)cpHashSetFind(state->previousStates, (cpHashValue)body, body)
+        : NULL;
+    if (previous) {
+        *p = cpvlerp(previous->p, *p, state->alpha);
+        *a = cpflerp(previous->a, *a, state->alpha);
+    }
+}
+
+static void cp_ffi_export_interpolated_f32(cpBody* body, void* data) {
+    cpFfiInterpolateState* state = (cpFfiInterpolateState*)data;
+    int i = state->count++;
+    if (i >= state->capacity) return;
+
+    cpVect p;
+    cpFloat a;
+    cp_ffi_interpolate_body(state, body, &p, &a);
+    float* out = (float*)state->out;
+    out[i] = (float)p.x;
+    out[state->capacity + i] = (float)p.y;
+    out[2 * state->capacity + i] = (float)a;
+    if (state->bodies) state->bodies[i] = body;
+}
+
+static void cp_ffi_export_interpolated_f64(cpBody* body, void* data) {
+    cpFfiInterpolateState* state = (cpFfiInterpolateState*)data;
+    int i = state->count++;
+    if (i >= state->capacity) return;
+
+    cpVect p;
+    cpFloat a;
+    cp_ffi_interpolate_body(state, body, &p, &a);
+    double* out = (double*)state->out;
+    out[i] = p.x;
+    out[state->capacity + i] = p.y;
+    out[2 * state->capacity + i] = a;
+    if (state->bodies) state->bodies[i] = body;
+}
+
+// Uses the layout of cp_space_export_transforms_f32 without velocity columns. Returns the number of
+// bodies in the space; only the first `capacity` are written.
+FFI_PLUGIN_EXPORT int cp_space_export_interpolated_f32(cpSpace* space, float* out, int capacity, cpBody** bodies) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    cpFfiInterpolateState state = {out, capacity, bodies, 0, data ? data->previousStates : NULL, cp_space_get_interpolation_alpha(space)};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceEachBody(space, cp_ffi_export_interpolated_f32, &state);
+    CP_FFI_TRACE_END("cp_space_export_interpolated_f32");
+    return state.count;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_export_interpolated_f64(cpSpace* space, double* out, int capacity, cpBody** bodies) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    cpFfiInterpolateState state = {out, capacity, bodies, 0, data ? data->previousStates : NULL, cp_space_get_interpolation_alpha(space)};
+    CP_FFI_TRACE_BEGIN();
+    cpSpaceEachBody(space, cp_ffi_export_interpolated_f64, &state);
+    CP_FFI_TRACE_END("cp_space_export_interpolated_f64");
+    return state.count;
+}
+
+// Broadphase
+// Auto mode only picks a spatial hash for enough dynamic shapes of similar sizes, with a cell size of
+// their mean size and ten cells per shape, as the Chipmunk documentation recommends.
+#define CP_FFI_AUTO_HASH_MIN_SHAPES 256
+// Maximum ratio of the standard deviation of the shape sizes to their mean.
+#define CP_FFI_AUTO_HASH_MAX_SIZE_SPREAD 0.5
+#define CP_FFI_AUTO_HASH_CELLS_PER_SHAPE 10
+
+static void cp_ffi_copy_shape(void* shape, void* index) {
+    cpSpatialIndexInsert((cpSpatialIndex*)index, shape, ((cpShape*)shape)->hashid);
+}
+
+// Same as the ShapeVelocityFunc cpSpaceInit sets on the dynamic tree, which extends the bounding boxes
+// of the leaves along the velocity of their body so that moving shapes are reinserted less often.
+static cpVect cp_ffi_shape_velocity(void* shape) {
+    return ((cpShape*)shape)->body->v;
+}
+
+// Chipmunk can switch a space to a spatial hash but not back, so this mirrors cpSpaceUseSpatialHash
+// and the index setup of cpSpaceInit.
+static void cp_ffi_use_bb_tree(cpSpace* space, cpFfiSpaceData* data) {
+    if (!data->spatialHash) return;
+
+    cpSpatialIndex* staticShapes = cpBBTreeNew((cpSpatialIndexBBFunc)cpShapeGetBB, NULL);
+    cpSpatialIndex* dynamicShapes = cpBBTreeNew((cpSpatialIndexBBFunc)cpShapeGetBB, staticShapes);
+    cpBBTreeSetVelocityFunc(dynamicShapes, cp_ffi_shape_velocity);
+    cpSpatialIndexEach(space->staticShapes, cp_ffi_copy_shape, staticShapes);
+    cpSpatialIndexEach(space->dynamicShapes, cp_ffi_copy_shape, dynamicShapes);
+    cpSpatialIndexFree(space->staticShapes);
+    space->staticShapes = staticShapes;
+    cpSpatialIndexFree(space->dynamicShapes);
+    space->dynamicShapes = dynamicShapes;
+
+    data->spatialHash = 0;
+    data->hashDim = 0.0;
+    data->hashCount = 0;
+}
+
+static void cp_ffi_use_spatial_hash(cpSpace* space, cpFfiSpaceData* data, cpFloat dim, int count) {
+    if (data->spatialHash) {
+        // Resizing empties the tables without rehashing the shapes they hold.
+        cpSpaceHashResize((cpSpaceHash*)space->staticShapes, dim, count);
+        cpSpaceHashResize((cpSpaceHash*)space->dynamicShapes, dim, count);
+        cpSpatialIndexReindex(space->staticShapes);
+        cpSpatialIndexReindex(space->dynamicShapes);
+    } else {
+        cpSpaceUseSpatialHash(space, dim, count);
+    }
+    data->spatialHash = 1;
+    data->hashDim = dim;
+    data->hashCount = count;
+}
+
+typedef struct cpFfiShapeSizes {
+    cpFloat sum;
+    cpFloat sumSq;
+} cpFfiShapeSizes;
+
+static void cp_ffi_sum_shape_size(void* obj, void* data) {
+    cpBB bb = cpShapeGetBB((cpShape*)obj);
+    cpFloat size = cpfmax(bb.r - bb.l, bb.t - bb.b);
+    cpFfiShapeSizes* sizes = (cpFfiShapeSizes*)data;
+    sizes->sum += size;
+    sizes->sumSq += size * size;
+}
+
+// Picks the broadphase for the current dynamic shapes, unless `force` is 0 and their number is within
+// 25% of the one the last choice was made for. A hash whose parameters are within 25% of the new ones
+// is kept as is, since resizing it rehashes every shape.
+static void cp_ffi_tune_broadphase(cpSpace* space, cpFfiSpaceData* data, int force) {
+    int count = cpSpatialIndexCount(space->dynamicShapes);
+    if (!force && 4 * abs(count - data->tunedShapeCount) <= data->tunedShapeCount) return;
+    data->tunedShapeCount = count;
+
+    cpFfiShapeSizes sizes = {0.0, 0.0};
+    cpSpatialIndexEach(space->dynamicShapes, cp_ffi_sum_shape_size, &sizes);
+    cpFloat mean = count > 0 ? sizes.sum / count : 0.0;
+    cpFloat variance = count > 0 ? cpfmax(sizes.sumSq / count - mean * mean, 0.0) : 0.0;
+    if (count < CP_FFI_AUTO_HASH_MIN_SHAPES || mean <= 0.0 || cpfsqrt(variance) > CP_FFI_AUTO_HASH_MAX_SIZE_SPREAD * mean) {
+        cp_ffi_use_bb_tree(space, data);
+        return;
+    }
+
+    int cells = CP_FFI_AUTO_HASH_CELLS_PER_SHAPE * count;
+    if (data->spatialHash && cpfabs(mean - data->hashDim) <= 0.25 * data->hashDim && 4 * abs(cells - data->hashCount) <= data->hashCount) {
+        return;
+    }
+    cp_ffi_use_spatial_hash(space, data, mean, cells);
+}
+
+// Switches the spatial indexes of the space, which must not be locked. `dim` and `count` are the cell
+// size and cell count of CP_FFI_BROADPHASE_SPATIAL_HASH and are ignored by the other modes.
+FFI_PLUGIN_EXPORT void cp_space_set_broadphase(cpSpace* space, int mode, cpFloat dim, int count) {
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    data->broadphase = mode;
+    switch (mode) {
+        case CP_FFI_BROADPHASE_SPATIAL_HASH:
+            cp_ffi_use_spatial_hash(space, data, dim, count);
+            break;
+        case CP_FFI_BROADPHASE_AUTO:
+            cp_ffi_tune_broadphase(space, data, 1);
+            break;
+        default:
+            data->broadphase = CP_FFI_BROADPHASE_BB_TREE;
+            cp_ffi_use_bb_tree(space, data);
+            break;
+    }
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_broadphase(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->broadphase : CP_FFI_BROADPHASE_BB_TREE;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_uses_spatial_hash(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->spatialHash : 0;
+}
+
+FFI_PLUGIN_EXPORT cpFloat cp_space_get_spatial_hash_dim(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->hashDim : 0.0;
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_spatial_hash_count(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->hashCount : 0;
+}
+
+// Step profiling
+#if CP_FFI_PROFILING
+static double cp_ffi_now(void) {
+#if _WIN32
+    static LARGE_INTEGER frequency;
+    if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+static cpCollisionID cp_ffi_profiled_collide(void* a, void* b, cpCollisionID id, void* context) {
+    cpSpace* space = (cpSpace*)context;
+    double start = cp_ffi_now();
+    id = cpSpaceCollideShapes((cpShape*)a, (cpShape*)b, id, space);
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    data->narrowphaseTime += cp_ffi_now() - start;
+    data->broadphasePairs++;
+    return id;
+}
+
+// Same as cpSpaceStep in Chipmunk 7.0.3, timing each phase into `phases`.
+static void cp_ffi_profiled_space_step(cpSpace* space, cpFfiSpaceData* data, cpFloat dt, double* phases) {
+    if (dt == 0.0f) return;
+
+    double t0 = cp_ffi_now();
+    space->stamp++;
+
+    cpFloat prev_dt = space->curr_dt;
+    space->curr_dt = dt;
+
+    cpArray* bodies = space->dynamicBodies;
+    cpArray* constraints = space->constraints;
+    cpArray* arbiters = space->arbiters;
+
+    for (int i = 0; i < arbiters->num; i++) {
+        cpArbiter* arb = (cpArbiter*)arbiters->arr[i];
+        arb->state = CP_ARBITER_STATE_NORMAL;
+        if (!cpBodyIsSleeping(arb->body_a) && !cpBodyIsSleeping(arb->body_b)) cpArbiterUnthread(arb);
+    }
+    arbiters->num = 0;
+
+    double t1, t2;
+    cpSpaceLock(space); {
+        for (int i = 0; i < bodies->num; i++) {
+            cpBody* body = (cpBody*)bodies->arr[i];
+            body->position_func(body, dt);
+        }
+        t1 = cp_ffi_now();
+
+        data->narrowphaseTime = 0.0;
+        data->broadphasePairs = 0;
+        data->pairStamp = space->stamp;
+        cpSpacePushFreshContactBuffer(space);
+        cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)cpShapeUpdateFunc, NULL);
+        cpSpatialIndexReindexQuery(space->dynamicShapes, cp_ffi_profiled_collide, space);
+    } cpSpaceUnlock(space, cpFalse);
+    t2 = cp_ffi_now();
+
+    cpSpaceProcessComponents(space, dt);
+    double t3 = cp_ffi_now();
+
+    double t4, t5, t6, t7, t8;
+    cpSpaceLock(space); {
+        cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+        t4 = cp_ffi_now();
+
+        cpFloat slop = space->collisionSlop;
+        cpFloat biasCoef = 1.0f - cpfpow(space->collisionBias, dt);
+        for (int i = 0; i < arbiters->num; i++) {
+            cpArbiterPreStep((cpArbiter*)arbiters->arr[i], dt, slop, biasCoef);
+        }
+        for (int i = 0; i < constraints->num; i++) {
+            cpConstraint* constraint = (cpConstraint*)constraints->arr[i];
+            cpConstraintPreSolveFunc preSolve = constraint->preSolve;
+            if (preSolve) preSolve(constraint, space);
+            constraint->klass->preStep(constraint, dt);
+        }
+        t5 = cp_ffi_now();
+
+        cpFloat damping = cpfpow(space->damping, dt);
+        cpVect gravity = space->gravity;
+        for (int i = 0; i < bodies->num; i++) {
+            cpBody* body = (cpBody*)bodies->arr[i];
+            body->velocity_func(body, gravity, damping, dt);
+        }
+        t6 = cp_ffi_now();
+
+        cpFloat dt_coef = (prev_dt == 0.0f ? 0.0f : dt / prev_dt);
+        for (int i = 0; i < arbiters->num; i++) {
+            cpArbiterApplyCachedImpulse((cpArbiter*)arbiters->arr[i], dt_coef);
+        }
+        for (int i = 0; i < constraints->num; i++) {
+            cpConstraint* constraint = (cpConstraint*)constraints->arr[i];
+            constraint->klass->applyCachedImpulse(constraint, dt_coef);
+        }
+        for (int i = 0; i < space->iterations; i++) {
+            for (int j = 0; j < arbiters->num; j++) {
+                cpArbiterApplyImpulse((cpArbiter*)arbiters->arr[j]);
+            }
+            for (int j = 0; j < constraints->num; j++) {
+                cpConstraint* constraint = (cpConstraint*)constraints->arr[j];
+                constraint->klass->applyImpulse(constraint, dt);
+            }
+        }
+        t7 = cp_ffi_now();
+
+        for (int i = 0; i < constraints->num; i++) {
+            cpConstraint* constraint = (cpConstraint*)constraints->arr[i];
+            cpConstraintPostSolveFunc postSolve = constraint->postSolve;
+            if (postSolve) postSolve(constraint, space);
+        }
+        for (int i = 0; i < arbiters->num; i++) {
+            cpArbiter* arb = (cpArbiter*)arbiters->arr[i];
+            cpCollisionHandler* handler = arb->handler;
+            handler->postSolveFunc(arb, space, handler->userData);
+        }
+    } cpSpaceUnlock(space, cpTrue);
+    t8 = cp_ffi_now();
+
+    if (cp_ffi_tracing()) {
+        cp_ffi_trace_record("integrate positions", "step", t0, t1);
+        cp_ffi_trace_record("broadphase and narrowphase", "step", t1, t2);
+        cp_ffi_trace_record("islands", "step", t2, t3);
+        cp_ffi_trace_record("arbiters", "step", t3, t4);
+        cp_ffi_trace_record("pre-step", "step", t4, t5);
+        cp_ffi_trace_record("integrate velocities", "step", t5, t6);
+        cp_ffi_trace_record("solver", "step", t6, t7);
+        cp_ffi_trace_record("callbacks", "step", t7, t8);
+    }
+
+    phases[CP_FFI_PROFILE_INTEGRATE] = (t1 - t0) + (t6 - t5);
+    phases[CP_FFI_PROFILE_NARROWPHASE] = data->narrowphaseTime;
+    phases[CP_FFI_PROFILE_BROADPHASE] = (t2 - t1) - data->narrowphaseTime;
+    phases[CP_FFI_PROFILE_ISLANDS] = t3 - t2;
+    phases[CP_FFI_PROFILE_ARBITERS] = t4 - t3;
+    phases[CP_FFI_PROFILE_PRESTEP] = t5 - t4;
+    phases[CP_FFI_PROFILE_SOLVER] = t7 - t6;
+    phases[CP_FFI_PROFILE_CALLBACKS] = t8 - t7;
+}
+
+// Runs the instrumented step for the profiler and the trace recorder. Hasty spaces step with their own
+// solver, so only their total and extension times are recorded.
+static void cp_ffi_profiled_step(cpSpace* space, cpFfiSpaceData* data, cpFloat dt) {
+    double phases[CP_FFI_PROFILE_PHASES] = {0.0};
+    double start = cp_ffi_now();
+#if CP_FFI_HASTY_SPACE
+    if (cp_ffi_space_is_hasty(space)) {
+        cpHastySpaceStep(space, dt);
+    } else {
+        cp_ffi_profiled_space_step(space, data, dt, phases);
+    }
+#else
+    cp_ffi_profiled_space_step(space, data, dt, phases);
+#endif
+    double stepped = cp_ffi_now();
+    cp_ffi_space_post_step(space);
+    double end = cp_ffi_now();
+
+    if (cp_ffi_tracing()) {
+        cp_ffi_trace_record("extensions", "step", stepped, end);
+        cp_ffi_trace_record("cp_space_step", "ffi", start, end);
+    }
+
+    if (data->profiles) {
+        phases[CP_FFI_PROFILE_EXTENSIONS] = end - stepped;
+        phases[CP_FFI_PROFILE_TOTAL] = end - start;
+        memcpy(data->profiles + (size_t)data->profileHead * CP_FFI_PROFILE_PHASES, phases, sizeof(phases));
+        data->profileHead = (data->profileHead + 1) % data->profileCapacity;
+        if (data->profileCount < data->profileCapacity) data->profileCount++;
+    }
+}
+#endif
+
+// Records the phase timings of the last `history` steps, or stops recording when `history` is 0.
+// Does nothing when the profiler is not built.
+FFI_PLUGIN_EXPORT void cp_space_set_profiling(cpSpace* space, int history) {
+#if CP_FFI_PROFILING
+    cpFfiSpaceData* data = cp_ffi_space_data(space);
+    cpfree(data->profiles);
+    data->profiles = history > 0 ? (double*)cpcalloc((size_t)history * CP_FFI_PROFILE_PHASES, sizeof(double)) : NULL;
+    data->profileCapacity = history > 0 ? history : 0;
+    data->profileHead = 0;
+    data->profileCount = 0;
+#else
+    (void)space;
+    (void)history;
+#endif
+}
+
+FFI_PLUGIN_EXPORT int cp_space_get_profiling(cpSpace* space) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    return data ? data->profileCapacity : 0;
+}
+
+// Writes the timings of the last `capacity` recorded steps, oldest first, CP_FFI_PROFILE_PHASES values
+// per step. Returns the number of steps written.
+FFI_PLUGIN_EXPORT int cp_space_get_profile(cpSpace* space, double* out, int capacity) {
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (!data || !data->profiles) return 0;
+
+    int count = data->profileCount < capacity ? data->profileCount : capacity;
+    for (int i = 0; i < count; i++) {
+        int step = (data->profileHead - count + i + data->profileCapacity) % data->profileCapacity;
+        memcpy(out + (size_t)i * CP_FFI_PROFILE_PHASES, data->profiles + (size_t)step * CP_FFI_PROFILE_PHASES, CP_FFI_PROFILE_PHASES * sizeof(double));
+    }
+    return count;
+}
+
+FFI_PLUGIN_EXPORT int cp_ffi_profiling_available(void) {
+    return CP_FFI_PROFILING;
+}
+
+// Simulation stats
+FFI_PLUGIN_EXPORT void cp_space_get_stats(cpSpace* space, int* out) {
+    memset(out, 0, CP_FFI_STATS * sizeof(int));
+    out[CP_FFI_STAT_ACTIVE_BODIES] = space->dynamicBodies->num;
+    out[CP_FFI_STAT_STATIC_BODIES] = space->staticBodies->num;
+    out[CP_FFI_STAT_SHAPES] = cpSpatialIndexCount(space->dynamicShapes) + cpSpatialIndexCount(space->staticShapes);
+    out[CP_FFI_STAT_CONSTRAINTS] = space->constraints->num;
+    out[CP_FFI_STAT_ARBITERS] = space->arbiters->num;
+    out[CP_FFI_STAT_CACHED_ARBITERS] = cpHashSetCount(space->cachedArbiters);
+
+    // Sleeping bodies are linked through their component's root.
+    cpArray* components = space->sleepingComponents;
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) {
+            out[CP_FFI_STAT_SLEEPING_BODIES]++;
+        }
+    }
+    for (int i = 0; i < space->arbiters->num; i++) {
+        out[CP_FFI_STAT_CONTACTS] += ((cpArbiter*)space->arbiters->arr[i])->count;
+    }
+
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    int counted = data && data->pairStamp != 0 && data->pairStamp == space->stamp;
+    out[CP_FFI_STAT_BROADPHASE_PAIRS] = counted ? data->broadphasePairs : -1;
+}
+
+// Tracing
+// Each thread records into its own buffer, registered once in a lock-free list and reset by its thread
+// on its first event of each trace. An event is written before the buffer's count is published, so
+// cp_ffi_trace_write only reads complete events. Buffers are never freed: the step and worker threads
+// release theirs when they exit, and new threads claim released buffers before allocating one, so the
+// list grows with the number of threads alive at once rather than with every space stepped
+// asynchronously.
+#if CP_FFI_PROFILING
+#if _MSC_VER
+#define CP_FFI_THREAD_LOCAL __declspec(thread)
+#else
+#define CP_FFI_THREAD_LOCAL __thread
+#endif
+
+typedef struct cpFfiTraceEvent {
+    const char* name;
+    const char* category;
+    double start;
+    double end;
+} cpFfiTraceEvent;
+
+typedef struct cpFfiTraceBuffer {
+    struct cpFfiTraceBuffer* next;
+    // Whether a thread records into the buffer. A released buffer keeps its events and its tid.
+    volatile long owned;
+    int tid;
+    // Trace the events belong to, see cp_ffi_trace_session.
+    volatile long session;
+    cpFfiTraceEvent* events;
+    long capacity;
+    volatile long count;
+    long dropped;
+} cpFfiTraceBuffer;
+
+// Events per thread while recording, 0 otherwise.
+static volatile long cp_ffi_trace_capacity;
+// Incremented by each cp_ffi_trace_start.
+static volatile long cp_ffi_trace_session;
+static volatile long cp_ffi_trace_threads;
+static double cp_ffi_trace_origin;
+static cpFfiTraceBuffer* cp_ffi_trace_buffers;
+static CP_FFI_THREAD_LOCAL cpFfiTraceBuffer* cp_ffi_trace_buffer;
+
+static int cp_ffi_tracing(void) {
+    return cp_ffi_atomic_load(&cp_ffi_trace_capacity) > 0;
+}
+
+static void cp_ffi_trace_register(cpFfiTraceBuffer* buffer) {
+#if _MSC_VER
+    do {
+        buffer->next = cp_ffi_trace_buffers;
+    } while (InterlockedCompareExchangePointer((PVOID volatile*)&cp_ffi_trace_buffers, buffer, buffer->next) != buffer->next);
+#else
+    buffer->next = __atomic_load_n(&cp_ffi_trace_buffers, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&cp_ffi_trace_buffers, &buffer->next, buffer, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+    }
+#endif
+}
+
+// Takes a buffer released by an exited thread, or registers a new one.
+static cpFfiTraceBuffer* cp_ffi_trace_claim(void) {
+#if _MSC_VER
+    cpFfiTraceBuffer* buffer = (cpFfiTraceBuffer*)InterlockedCompareExchangePointer((PVOID volatile*)&cp_ffi_trace_buffers, NULL, NULL);
+    for (; buffer; buffer = buffer->next) {
+        if (InterlockedCompareExchange(&buffer->owned, 1, 0) == 0) return buffer;
+    }
+#else
+    cpFfiTraceBuffer* buffer = __atomic_load_n(&cp_ffi_trace_buffers, __ATOMIC_ACQUIRE);
+    for (; buffer; buffer = buffer->next) {
+        long released = 0;
+        if (__atomic_compare_exchange_n(&buffer->owned, &released, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return buffer;
+    }
+#endif
+    buffer = (cpFfiTraceBuffer*)cpcalloc(1, sizeof(cpFfiTraceBuffer));
+    buffer->owned = 1;
+    buffer->tid = (int)cp_ffi_atomic_fetch_increment(&cp_ffi_trace_threads) + 1;
+    cp_ffi_trace_register(buffer);
+    return buffer;
+}
+
+static void cp_ffi_trace_release(void) {
+    if (!cp_ffi_trace_buffer) return;
+    cp_ffi_atomic_store(&cp_ffi_trace_buffer->owned, 0);
+    cp_ffi_trace_buffer = NULL;
+}
+
+static void cp_ffi_trace_record(const char* name, const char* category, double start, double end) {
+    long capacity = cp_ffi_atomic_load(&cp_ffi_trace_capacity);
+    if (capacity <= 0) return;
+
+    cpFfiTraceBuffer* buffer = cp_ffi_trace_buffer;
+    if (!buffer) {
+        buffer = cp_ffi_trace_claim();
+        cp_ffi_trace_buffer = buffer;
+    }
+
+    long session = cp_ffi_atomic_load(&cp_ffi_trace_session);
+    if (buffer->session != session) {
+        if (buffer->capacity != capacity) {
+            cpfree(buffer->events);
+            buffer->events = (cpFfiTraceEvent*)cpcalloc(capacity, sizeof(cpFfiTraceEvent));
+            buffer->capacity = capacity;
+        }
+        buffer->count = 0;
+        buffer->dropped = 0;
+        cp_ffi_atomic_store(&buffer->session, session);
+    }
+
+    long count = buffer->count;
+    if (count >= buffer->capacity) {
+        buffer->dropped++;
+        return;
+    }
+    buffer->events[count] = (cpFfiTraceEvent){name, category, start, end};
+    cp_ffi_atomic_store(&buffer->count, count + 1);
+}
+#endif
+
+// Starts a new trace, dropping the events of the previous one. Each thread keeps its first
+// `eventsPerThread` events. Does nothing when the profiler is not built. Threads reallocate their
+// buffer on their first event of a trace, so a trace must not be started while cp_ffi_trace_write runs.
+FFI_PLUGIN_EXPORT void cp_ffi_trace_start(int eventsPerThread) {
+#if CP_FFI_PROFILING
+    if (eventsPerThread <= 0) return;
+    cp_ffi_atomic_store(&cp_ffi_trace_capacity, 0);
+    cp_ffi_trace_origin = cp_ffi_now();
+    cp_ffi_atomic_fetch_increment(&cp_ffi_trace_session);
+    cp_ffi_atomic_store(&cp_ffi_trace_capacity, eventsPerThread);
+#else
+    (void)eventsPerThread;
+#endif
+}
+
+FFI_PLUGIN_EXPORT void cp_ffi_trace_stop(void) {
+#if CP_FFI_PROFILING
+    cp_ffi_atomic_store(&cp_ffi_trace_capacity, 0);
+#endif
+}
+
+FFI_PLUGIN_EXPORT int cp_ffi_trace_is_recording(void) {
+#if CP_FFI_PROFILING
+    return cp_ffi_tracing();
+#else
+    return 0;
+#endif
+}
+
+// Writes the events of the current or last trace to `path` in the Chrome trace event format, with
+// timestamps in microseconds since cp_ffi_trace_start. Returns the number of events written, or -1 if
+// the file cannot be opened.
+FFI_PLUGIN_EXPORT int cp_ffi_trace_write(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) return -1;
+
+    int written = 0;
+    long dropped = 0;
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"chipmunk2d_physics_ffi\"}}");
+#if CP_FFI_PROFILING
+    long session = cp_ffi_atomic_load(&cp_ffi_trace_session);
+#if _MSC_VER
+    cpFfiTraceBuffer* buffer = (cpFfiTraceBuffer*)InterlockedCompareExchangePointer((PVOID volatile*)&cp_ffi_trace_buffers, NULL, NULL);
+#else
+    cpFfiTraceBuffer* buffer = __atomic_load_n(&cp_ffi_trace_buffers, __ATOMIC_ACQUIRE);
+#endif
+    for (; buffer; buffer = buffer->next) {
+        if (cp_ffi_atomic_load(&buffer->session) != session) continue;
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", buffer->tid, buffer->tid);
+        long count = cp_ffi_atomic_load(&buffer->count);
+        for (long i = 0; i < count; i++) {
+            const cpFfiTraceEvent* event = &buffer->events[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, event->category, buffer->tid,
+                    (event->start - cp_ffi_trace_origin) * 1e6, (event->end - event->start) * 1e6);
+        }
+        written += (int)count;
+        dropped += buffer->dropped;
+    }
+#endif
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%ld}}\n", dropped);
+    fclose(file);
+    return written;
+}
+
+// Space snapshots
+// A snapshot is a cpFfiSnapshotHeader followed by the size of each sleeping component, then one section
+// of records per CP_FFI_SNAPSHOT_* kind: the body states (awake bodies in step order, static bodies, then
+// the sleeping bodies component by component), the shape states, the constraint states with the bytes
+// of their joint and the arbiters with their contacts (the ones of sleeping components, the active ones
+// in solver order, then the other cached ones). Every record is padded to 8 bytes. Objects are
+// referenced by address: a snapshot only restores into the space it was taken from, while that space
+// holds the same objects.
+#define CP_FFI_SNAPSHOT_MAGIC 0x50414e53u
+#define CP_FFI_SNAPSHOT_VERSION 1
+#define CP_FFI_SNAPSHOT_BODIES 0
+#define CP_FFI_SNAPSHOT_SHAPES 1
+#define CP_FFI_SNAPSHOT_CONSTRAINTS 2
+#define CP_FFI_SNAPSHOT_ARBITERS 3
+#define CP_FFI_SNAPSHOT_SECTIONS 4
+// The arbiter is in the space's arbiter cache.
+#define CP_FFI_SNAPSHOT_CACHED 1
+// The arbiter is in the arbiter lists of its bodies.
+#define CP_FFI_SNAPSHOT_THREADED 2
+
+typedef struct cpFfiSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    int bodyCount;
+    int awakeBodyCount;
+    int staticBodyCount;
+    int componentCount;
+    int shapeCount;
+    int constraintCount;
+    int activeConstraintCount;
+    int arbiterCount;
+    int sleepingArbiterCount;
+    int activeArbiterCount;
+    cpFloat currDt;
+    cpFloat accumulator;
+} cpFfiSnapshotHeader;
+
+typedef struct cpFfiBodyState {
+    cpBody* body;
+    cpFloat m, mInv, i, iInv;
+    cpVect cog, p, v, f;
+    cpFloat a, w, t;
+    cpTransform transform;
+    cpVect vBias;
+    cpFloat wBias;
+    cpFloat idleTime;
+} cpFfiBodyState;
+
+typedef struct cpFfiShapeState {
+    cpShape* shape;
+    cpFloat e, u;
+    cpVect surfaceV;
+    cpShapeFilter filter;
+    cpCollisionType type;
+    int sensor;
+    int padding;
+} cpFfiShapeState;
+
+typedef struct cpFfiConstraintState {
+    cpConstraint* constraint;
+    cpFloat maxForce, errorBias, maxBias;
+    int collideBodies;
+    // Bytes of joint state following the cpConstraint the joint starts with, padded to 8 in the snapshot.
+    int size;
+} cpFfiConstraintState;
+
+typedef struct cpFfiArbiterState {
+    const cpShape* a;
+    const cpShape* b;
+    cpCollisionHandler* handler;
+    cpCollisionHandler* handlerA;
+    cpCollisionHandler* handlerB;
+    cpDataPointer data;
+    cpFloat e, u;
+    cpVect surfaceVr, n;
+    int count;
+    int state;
+    int swapped;
+    int flags;
+    // Records of the next arbiters in the arbiter lists of the two bodies, or -1.
+    int nextA, nextB;
+    // Steps since the arbiter was last updated, 0 for the arbiters of sleeping components.
+    cpTimestamp age;
+    int padding;
+} cpFfiArbiterState;
+
+typedef struct cpFfiSnapshotWriter {
+    uint8_t* out;
+    size_t capacity;
+    size_t size;
+} cpFfiSnapshotWriter;
+
+// Header of a snapshot checked by cp_ffi_snapshot_validate_layout, with the offset of each record of
+// each section followed by the end of the section.
+typedef struct cpFfiSnapshotLayout {
+    cpFfiSnapshotHeader header;
+    size_t* records[CP_FFI_SNAPSHOT_SECTIONS];
+} cpFfiSnapshotLayout;
+
+// Arbiters of a snapshot being written, with their record index.
+typedef struct cpFfiSnapshotArbiter {
+    cpArbiter* arbiter;
+    int index;
+} cpFfiSnapshotArbiter;
+
+typedef struct cpFfiSnapshotArbiters {
+    cpHashSet* set;
+    cpFfiSnapshotArbiter* entries;
+    int count;
+} cpFfiSnapshotArbiters;
+
+static size_t cp_ffi_snapshot_align(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+// Appends `size` bytes while the snapshot fits in the caller's buffer, and counts them either way.
+static void cp_ffi_snapshot_write(cpFfiSnapshotWriter* writer, const void* data, size_t size) {
+    if (writer->size + size <= writer->capacity) memcpy(writer->out + writer->size, data, size);
+    writer->size += size;
+}
+
+static void cp_ffi_snapshot_pad(cpFfiSnapshotWriter* writer) {
+    static const uint8_t zeros[8] = {0};
+    cp_ffi_snapshot_write(writer, zeros, cp_ffi_snapshot_align(writer->size) - writer->size);
+}
+
+static int cp_ffi_snapshot_count(const cpFfiSnapshotHeader* header, int section) {
+    switch (section) {
+        case CP_FFI_SNAPSHOT_BODIES: return header->bodyCount;
+        case CP_FFI_SNAPSHOT_SHAPES: return header->shapeCount;
+        case CP_FFI_SNAPSHOT_CONSTRAINTS: return header->constraintCount;
+        default: return header->arbiterCount;
+    }
+}
+
+// Whether `body` keeps an arbiter or constraint whose first body is `a` while its component sleeps,
+// following cpSpaceDeactivateBody.
+static int cp_ffi_sleep_owner(cpBody* body, cpBody* a) {
+    return body == a || cpBodyGetType(a) == CP_BODY_TYPE_STATIC;
+}
+
+// Whether the arbiter belongs to a sleeping component, which keeps its contacts out of the contact buffers.
+static int cp_ffi_arbiter_sleeping(const cpArbiter* arb) {
+    return cpBodyIsSleeping(arb->body_a) || (cpBodyGetType(arb->body_a) == CP_BODY_TYPE_STATIC && cpBodyIsSleeping(arb->body_b));
+}
+
+// Size of the joint state following the cpConstraint, none for custom constraints.
+static size_t cp_ffi_joint_size(const cpConstraint* constraint) {
+    size_t size = sizeof(cpConstraint);
+    if (cpConstraintIsPinJoint(constraint)) size = sizeof(struct cpPinJoint);
+    else if (cpConstraintIsSlideJoint(constraint)) size = sizeof(struct cpSlideJoint);
+    else if (cpConstraintIsPivotJoint(constraint)) size = sizeof(struct cpPivotJoint);
+    else if (cpConstraintIsGrooveJoint(constraint)) size = sizeof(struct cpGrooveJoint);
+    else if (cpConstraintIsDampedSpring(constraint)) size = sizeof(struct cpDampedSpring);
+    else if (cpConstraintIsDampedRotarySpring(constraint)) size = sizeof(struct cpDampedRotarySpring);
+    else if (cpConstraintIsRotaryLimitJoint(constraint)) size = sizeof(struct cpRotaryLimitJoint);
+    else if (cpConstraintIsRatchetJoint(constraint)) size = sizeof(struct cpRatchetJoint);
+    else if (cpConstraintIsGearJoint(constraint)) size = sizeof(struct cpGearJoint);
+    else if (cpConstraintIsSimpleMotor(constraint)) size = sizeof(struct cpSimpleMotor);
+    return size - sizeof(cpConstraint);
+}
+
+static void cp_ffi_save_body(cpFfiSnapshotWriter* writer, cpBody* body) {
+    cpFfiBodyState state = {
+        body, body->m, body->m_inv, body->i, body->i_inv, body->cog, body->p, body->v, body->f,
+        body->a, body->w, body->t, body->transform, body->v_bias, body->w_bias, body->sleeping.idleTime,
+    };
+    cp_ffi_snapshot_write(writer, &state, sizeof(state));
+}
+
+static void cp_ffi_save_shape(void* obj, void* data) {
+    cpShape* shape = (cpShape*)obj;
+    cpFfiShapeState state = {shape, shape->e, shape->u, shape->surfaceV, shape->filter, shape->type, shape->sensor, 0};
+    cp_ffi_snapshot_write((cpFfiSnapshotWriter*)data, &state, sizeof(state));
+}
+
+static void cp_ffi_save_constraint(cpFfiSnapshotWriter* writer, cpConstraint* constraint) {
+    size_t size = cp_ffi_joint_size(constraint);
+    cpFfiConstraintState state = {
+        constraint, constraint->maxForce, constraint->errorBias, constraint->maxBias, constraint->collideBodies, (int)size,
+    };
+    cp_ffi_snapshot_write(writer, &state, sizeof(state));
+    cp_ffi_snapshot_write(writer, (const uint8_t*)constraint + sizeof(cpConstraint), size);
+    cp_ffi_snapshot_pad(writer);
+}
+
+static cpBool cp_ffi_snapshot_arbiter_eql(const void* ptr, const void* elt) {
+    return ((const cpFfiSnapshotArbiter*)elt)->arbiter == ptr;
+}
+
+static void* cp_ffi_snapshot_arbiter_trans(const void* ptr, void* data) {
+    cpFfiSnapshotArbiters* arbiters = (cpFfiSnapshotArbiters*)data;
+    cpFfiSnapshotArbiter* entry = &arbiters->entries[arbiters->count];
+    entry->arbiter = (cpArbiter*)ptr;
+    entry->index = arbiters->count++;
+    return entry;
+}
+
+static void cp_ffi_snapshot_add_arbiter(void* elt, void* data) {
+    cpFfiSnapshotArbiters* arbiters = (cpFfiSnapshotArbiters*)data;
+    cpHashSetInsert(arbiters->set, (cpHashValue)elt, elt, cp_ffi_snapshot_arbiter_trans, arbiters);
+}
+
+static int cp_ffi_snapshot_arbiter_index(cpFfiSnapshotArbiters* arbiters, cpArbiter* arb) {
+    if (!arb) return -1;
+    const cpFfiSnapshotArbiter* entry = (const cpFfiSnapshotArbiter*)cpHashSetFind(arbiters->set, (cpHashValue)arb, arb);
+    return entry ? entry->index : -1;
+}
+
+static void cp_ffi_save_arbiter(cpFfiSnapshotWriter* writer, cpSpace* space, cpFfiSnapshotArbiters* arbiters, cpArbiter* arb) {
+    const cpShape* pair[] = {arb->a, arb->b};
+    cpHashValue hash = CP_HASH_PAIR((cpHashValue)arb->a, (cpHashValue)arb->b);
+    int cached = cpHashSetFind(space->cachedArbiters, hash, pair) == arb;
+    int threaded = arb->thread_a.prev || arb->body_a->arbiterList == arb;
+    // Waking a component restamps its arbiters, so their age does not change the simulation. Leaving it
+    // out keeps the records of sleeping components identical from one snapshot to the next.
+    cpTimestamp age = cp_ffi_arbiter_sleeping(arb) ? 0 : space->stamp - arb->stamp;
+    cpFfiArbiterState state = {
+        arb->a, arb->b, arb->handler, arb->handlerA, arb->handlerB, arb->data, arb->e, arb->u, arb->surface_vr, arb->n,
+        arb->count, (int)arb->state, arb->swapped,
+        (cached ? CP_FFI_SNAPSHOT_CACHED : 0) | (threaded ? CP_FFI_SNAPSHOT_THREADED : 0),
+        threaded ? cp_ffi_snapshot_arbiter_index(arbiters, arb->thread_a.next) : -1,
+        threaded ? cp_ffi_snapshot_arbiter_index(arbiters, arb->thread_b.next) : -1,
+        age, 0,
+    };
+    cp_ffi_snapshot_write(writer, &state, sizeof(state));
+    if (arb->count) cp_ffi_snapshot_write(writer, arb->contacts, arb->count * sizeof(struct cpContact));
+}
+
+// Writes the state of the space to `out` and returns the snapshot's size. Nothing is complete unless
+// the size is at most `capacity`. Returns 0 while the space is locked or stepping asynchronously.
+FFI_PLUGIN_EXPORT int cp_space_snapshot(cpSpace* space, uint8_t* out, int capacity) {
+    if (cpSpaceIsLocked(space) || cp_space_is_stepping(space)) return 0;
+    CP_FFI_TRACE_BEGIN();
+
+    cpFfiSnapshotWriter writer = {out, capacity > 0 ? (size_t)capacity : 0, sizeof(cpFfiSnapshotHeader)};
+    cpFfiSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    cpArray* components = space->sleepingComponents;
+
+    // Bodies
+    int sleepingBodies = 0;
+    for (int i = 0; i < components->num; i++) {
+        int size = 0;
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) size++;
+        cp_ffi_snapshot_write(&writer, &size, sizeof(int));
+        sleepingBodies += size;
+    }
+    cp_ffi_snapshot_pad(&writer);
+    for (int i = 0; i < space->dynamicBodies->num; i++) cp_ffi_save_body(&writer, (cpBody*)space->dynamicBodies->arr[i]);
+    for (int i = 0; i < space->staticBodies->num; i++) cp_ffi_save_body(&writer, (cpBody*)space->staticBodies->arr[i]);
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) cp_ffi_save_body(&writer, body);
+    }
+    header.awakeBodyCount = space->dynamicBodies->num;
+    header.staticBodyCount = space->staticBodies->num;
+    header.componentCount = components->num;
+    header.bodyCount = header.awakeBodyCount + header.staticBodyCount + sleepingBodies;
+
+    // Shapes
+    cpSpatialIndexEach(space->dynamicShapes, cp_ffi_save_shape, &writer);
+    cpSpatialIndexEach(space->staticShapes, cp_ffi_save_shape, &writer);
+    header.shapeCount = cpSpatialIndexCount(space->dynamicShapes) + cpSpatialIndexCount(space->staticShapes);
+
+    // Constraints, the ones of sleeping components after the active ones.
+    header.activeConstraintCount = space->constraints->num;
+    header.constraintCount = space->constraints->num;
+    for (int i = 0; i < space->constraints->num; i++) cp_ffi_save_constraint(&writer, (cpConstraint*)space->constraints->arr[i]);
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) {
+            CP_BODY_FOREACH_CONSTRAINT(body, constraint) {
+                if (!cp_ffi_sleep_owner(body, constraint->a)) continue;
+                cp_ffi_save_constraint(&writer, constraint);
+                header.constraintCount++;
+            }
+        }
+    }
+
+    // Arbiters. They are collected active first, then cached, then from the sleeping components, and
+    // all indexed before writing so that the records can link the arbiter lists of the bodies. The ones
+    // only kept by sleeping components are written first, so that their records, links included, stay
+    // the same while the components sleep.
+    int bound = space->arbiters->num + cpHashSetCount(space->cachedArbiters);
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) {
+            CP_BODY_FOREACH_ARBITER(body, arb) bound++;
+        }
+    }
+    cpFfiSnapshotArbiters arbiters = {
+        cpHashSetNew(bound, cp_ffi_snapshot_arbiter_eql),
+        (cpFfiSnapshotArbiter*)cpcalloc(bound ? bound : 1, sizeof(cpFfiSnapshotArbiter)),
+        0,
+    };
+    for (int i = 0; i < space->arbiters->num; i++) cp_ffi_snapshot_add_arbiter(space->arbiters->arr[i], &arbiters);
+    cpHashSetEach(space->cachedArbiters, cp_ffi_snapshot_add_arbiter, &arbiters);
+    int awake = arbiters.count;
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) {
+            CP_BODY_FOREACH_ARBITER(body, arb) {
+                if (cp_ffi_sleep_owner(body, arb->body_a)) cp_ffi_snapshot_add_arbiter(arb, &arbiters);
+            }
+        }
+    }
+    int sleeping = arbiters.count - awake;
+    for (int i = 0; i < arbiters.count; i++) {
+        cpFfiSnapshotArbiter* entry = &arbiters.entries[i];
+        entry->index = i < awake ? sleeping + i : i - awake;
+    }
+    for (int i = awake; i < arbiters.count; i++) cp_ffi_save_arbiter(&writer, space, &arbiters, arbiters.entries[i].arbiter);
+    for (int i = 0; i < awake; i++) cp_ffi_save_arbiter(&writer, space, &arbiters, arbiters.entries[i].arbiter);
+    header.arbiterCount = arbiters.count;
+    header.sleepingArbiterCount = sleeping;
+    header.activeArbiterCount = space->arbiters->num;
+    cpHashSetFree(arbiters.set);
+    cpfree(arbiters.entries);
+
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    header.magic = CP_FFI_SNAPSHOT_MAGIC;
+    header.version = CP_FFI_SNAPSHOT_VERSION;
+    header.size = writer.size;
+    header.currDt = space->curr_dt;
+    header.accumulator = data ? data->accumulator : 0.0;
+    if (writer.size <= writer.capacity) memcpy(out, &header, sizeof(header));
+    CP_FFI_TRACE_END("cp_space_snapshot");
+    return (int)writer.size;
+}
+
+static cpFfiConstraintState cp_ffi_snapshot_constraint_state(const uint8_t* snapshot, size_t offset) {
+    cpFfiConstraintState state;
+    memcpy(&state, snapshot + offset, sizeof(state));
+    return state;
+}
+
+static cpFfiArbiterState cp_ffi_snapshot_arbiter_state(const uint8_t* snapshot, size_t offset) {
+    cpFfiArbiterState state;
+    memcpy(&state, snapshot + offset, sizeof(state));
+    return state;
+}
+
+// Size of the record of `section` at `offset`, or 0 if it is malformed or runs past `length`.
+static size_t cp_ffi_snapshot_record_size(const uint8_t* snapshot, size_t length, size_t offset, int section) {
+    static const size_t sizes[CP_FFI_SNAPSHOT_SECTIONS] = {
+        sizeof(cpFfiBodyState), sizeof(cpFfiShapeState), sizeof(cpFfiConstraintState), sizeof(cpFfiArbiterState),
+    };
+    size_t size = sizes[section];
+    if (offset > length || size > length - offset) return 0;
+    if (section == CP_FFI_SNAPSHOT_CONSTRAINTS) {
+        cpFfiConstraintState state = cp_ffi_snapshot_constraint_state(snapshot, offset);
+        if (state.size < 0) return 0;
+        size += cp_ffi_snapshot_align(state.size);
+    } else if (section == CP_FFI_SNAPSHOT_ARBITERS) {
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, offset);
+        if (state.count < 0 || state.count > CP_MAX_CONTACTS_PER_ARBITER) return 0;
+        size += state.count * sizeof(struct cpContact);
+    }
+    return size <= length - offset ? size : 0;
+}
+
+static void cp_ffi_snapshot_layout_free(cpFfiSnapshotLayout* layout) {
+    cpfree(layout->records[0]);
+    layout->records[0] = NULL;
+}
+
+// Checks that the snapshot is well formed and fills its layout, which must be freed with
+// cp_ffi_snapshot_layout_free either way.
+static int cp_ffi_snapshot_validate_layout(const uint8_t* snapshot, int length, cpFfiSnapshotLayout* layout) {
+    cpFfiSnapshotHeader* header = &layout->header;
+    memset(layout, 0, sizeof(cpFfiSnapshotLayout));
+    if (!snapshot || length < (int)sizeof(cpFfiSnapshotHeader)) return 0;
+    memcpy(header, snapshot, sizeof(cpFfiSnapshotHeader));
+    if (header->magic != CP_FFI_SNAPSHOT_MAGIC || header->version != CP_FFI_SNAPSHOT_VERSION || header->size != (uint64_t)length) return 0;
+    if (header->awakeBodyCount < 0 || header->staticBodyCount < 0 || header->componentCount < 0) return 0;
+    if (header->awakeBodyCount > header->bodyCount || header->staticBodyCount > header->bodyCount - header->awakeBodyCount) return 0;
+    if (header->componentCount > header->bodyCount - header->awakeBodyCount - header->staticBodyCount) return 0;
+    if (header->activeConstraintCount < 0 || header->constraintCount < header->activeConstraintCount) return 0;
+    if (header->sleepingArbiterCount < 0 || header->activeArbiterCount < 0 || header->arbiterCount < header->sleepingArbiterCount) return 0;
+    if (header->activeArbiterCount > header->arbiterCount - header->sleepingArbiterCount) return 0;
+    // Every record takes at least 40 bytes, which bounds the counts before allocating their offsets.
+    size_t records = 0;
+    for (int section = 0; section < CP_FFI_SNAPSHOT_SECTIONS; section++) {
+        int count = cp_ffi_snapshot_count(header, section);
+        if (count < 0 || count > length / 40) return 0;
+        records += count + 1;
+    }
+    if ((size_t)header->componentCount > (length - sizeof(cpFfiSnapshotHeader)) / sizeof(int)) return 0;
+
+    int sleepingBodies = 0;
+    for (int i = 0; i < header->componentCount; i++) {
+        int size;
+        memcpy(&size, snapshot + sizeof(cpFfiSnapshotHeader) + i * sizeof(int), sizeof(int));
+        if (size <= 0 || size > header->bodyCount - sleepingBodies) return 0;
+        sleepingBodies += size;
+    }
+    if (sleepingBodies != header->bodyCount - header->awakeBodyCount - header->staticBodyCount) return 0;
+
+    size_t* offsets = (size_t*)cpcalloc(records, sizeof(size_t));
+    size_t offset = cp_ffi_snapshot_align(sizeof(cpFfiSnapshotHeader) + header->componentCount * sizeof(int));
+    for (int section = 0; section < CP_FFI_SNAPSHOT_SECTIONS; section++) {
+        int count = cp_ffi_snapshot_count(header, section);
+        layout->records[section] = offsets;
+        for (int i = 0; i < count; i++) {
+            size_t size = cp_ffi_snapshot_record_size(snapshot, length, offset, section);
+            if (!size) return 0;
+            offsets[i] = offset;
+            offset += size;
+        }
+        offsets[count] = offset;
+        offsets += count + 1;
+    }
+    for (int i = 0; i < header->arbiterCount; i++) {
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, layout->records[CP_FFI_SNAPSHOT_ARBITERS][i]);
+        if (state.nextA < -1 || state.nextA >= header->arbiterCount || state.nextB < -1 || state.nextB >= header->arbiterCount) return 0;
+    }
+    return offset == (size_t)length;
+}
+
+// Counts the objects of the space missing from `set`.
+static void cp_ffi_snapshot_find_shape(void* obj, void* data) {
+    void** context = (void**)data;
+    if (!cpHashSetFind((cpHashSet*)context[0], (cpHashValue)obj, obj)) (*(int*)context[1])++;
+}
+
+// The object described by a body, shape or constraint record.
+static void* cp_ffi_snapshot_object(const uint8_t* snapshot, const cpFfiSnapshotLayout* layout, int section, int i) {
+    void* object;
+    memcpy(&object, snapshot + layout->records[section][i], sizeof(void*));
+    return object;
+}
+
+// Checks that the snapshot references exactly the bodies, shapes and constraints of the space, using a
+// set of each. The objects are only read once they are known to be in the space.
+static int cp_ffi_snapshot_validate_objects(cpSpace* space, const uint8_t* snapshot, const cpFfiSnapshotLayout* layout, cpHashSet** sets) {
+    const cpFfiSnapshotHeader* header = &layout->header;
+    cpHashSet* bodies = sets[CP_FFI_SNAPSHOT_BODIES];
+    cpHashSet* shapes = sets[CP_FFI_SNAPSHOT_SHAPES];
+    cpHashSet* constraints = sets[CP_FFI_SNAPSHOT_CONSTRAINTS];
+    if (header->arbiterCount > 0 && !space->contactBuffersHead) return 0;
+    for (int section = 0; section < CP_FFI_SNAPSHOT_ARBITERS; section++) {
+        for (int i = 0; i < cp_ffi_snapshot_count(header, section); i++) {
+            if (!cp_ffi_ptr_set_insert(sets[section], cp_ffi_snapshot_object(snapshot, layout, section, i))) return 0;
+        }
+    }
+
+    // The sets hold no duplicates, so they match the space when they have as many objects and contain
+    // every object of the space.
+    cpArray* components = space->sleepingComponents;
+    cpArray* arrays[] = {space->dynamicBodies, space->staticBodies, space->constraints};
+    int bodyCount = space->dynamicBodies->num + space->staticBodies->num;
+    int constraintCount = space->constraints->num;
+    for (int i = 0; i < 3; i++) {
+        cpHashSet* set = i < 2 ? bodies : constraints;
+        for (int j = 0; j < arrays[i]->num; j++) {
+            if (!cpHashSetFind(set, (cpHashValue)arrays[i]->arr[j], arrays[i]->arr[j])) return 0;
+        }
+    }
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) {
+            if (!cpHashSetFind(bodies, (cpHashValue)body, body)) return 0;
+            bodyCount++;
+            CP_BODY_FOREACH_CONSTRAINT(body, constraint) {
+                if (!cp_ffi_sleep_owner(body, constraint->a)) continue;
+                if (!cpHashSetFind(constraints, (cpHashValue)constraint, constraint)) return 0;
+                constraintCount++;
+            }
+        }
+    }
+    if (bodyCount != header->bodyCount || constraintCount != header->constraintCount) return 0;
+    int missing = 0;
+    void* context[] = {shapes, &missing};
+    cpSpatialIndexEach(space->dynamicShapes, cp_ffi_snapshot_find_shape, context);
+    cpSpatialIndexEach(space->staticShapes, cp_ffi_snapshot_find_shape, context);
+    int shapeCount = cpSpatialIndexCount(space->dynamicShapes) + cpSpatialIndexCount(space->staticShapes);
+    if (missing || shapeCount != header->shapeCount) return 0;
+
+    // The bodies must still have their type, the joints their layout, and the arbiters must belong to
+    // shapes of the space and link arbiters of the same bodies.
+    for (int i = 0; i < header->bodyCount; i++) {
+        cpBodyType type = cpBodyGetType((cpBody*)cp_ffi_snapshot_object(snapshot, layout, CP_FFI_SNAPSHOT_BODIES, i));
+        if (i < header->awakeBodyCount) {
+            if (type == CP_BODY_TYPE_STATIC) return 0;
+        } else if (i < header->awakeBodyCount + header->staticBodyCount) {
+            if (type != CP_BODY_TYPE_STATIC) return 0;
+        } else if (type != CP_BODY_TYPE_DYNAMIC) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < header->constraintCount; i++) {
+        cpFfiConstraintState state = cp_ffi_snapshot_constraint_state(snapshot, layout->records[CP_FFI_SNAPSHOT_CONSTRAINTS][i]);
+        if ((size_t)state.size != cp_ffi_joint_size(state.constraint)) return 0;
+    }
+    const size_t* records = layout->records[CP_FFI_SNAPSHOT_ARBITERS];
+    for (int i = 0; i < header->arbiterCount; i++) {
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, records[i]);
+        if (!cpHashSetFind(shapes, (cpHashValue)state.a, state.a) || !cpHashSetFind(shapes, (cpHashValue)state.b, state.b)) return 0;
+    }
+    for (int i = 0; i < header->arbiterCount; i++) {
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, records[i]);
+        if (!(state.flags & CP_FFI_SNAPSHOT_THREADED)) continue;
+        int next[] = {state.nextA, state.nextB};
+        cpBody* body[] = {state.a->body, state.b->body};
+        for (int j = 0; j < 2; j++) {
+            if (next[j] < 0) continue;
+            cpFfiArbiterState other = cp_ffi_snapshot_arbiter_state(snapshot, records[next[j]]);
+            if (!(other.flags & CP_FFI_SNAPSHOT_THREADED) || (other.a->body != body[j] && other.b->body != body[j])) return 0;
+        }
+    }
+    return 1;
+}
+
+// Takes an arbiter from the space's pool, allocating a block of them like Chipmunk when it is empty.
+static cpArbiter* cp_ffi_pop_arbiter(cpSpace* space) {
+    if (space->pooledArbiters->num == 0) {
+        int count = CP_BUFFER_BYTES / sizeof(cpArbiter);
+        cpArbiter* buffer = (cpArbiter*)cpcalloc(1, CP_BUFFER_BYTES);
+        cpArrayPush(space->allocatedBuffers, buffer);
+        for (int i = 0; i < count; i++) cpArrayPush(space->pooledArbiters, buffer + i);
+    }
+    return (cpArbiter*)cpArrayPop(space->pooledArbiters);
+}
+
+static cpBool cp_ffi_pool_arbiter(void* elt, void* data) {
+    cpArbiter* arb = (cpArbiter*)elt;
+    arb->contacts = NULL;
+    arb->count = 0;
+    cpArrayPush(((cpSpace*)data)->pooledArbiters, arb);
+    return cpFalse;
+}
+
+// Rewinds the space to a snapshot taken by cp_space_snapshot, in place. Returns 1 on success, and 0
+// without changing the space when the snapshot is malformed, its objects are not exactly the ones of
+// the space anymore, or the space is locked or stepping asynchronously.
+FFI_PLUGIN_EXPORT int cp_space_restore(cpSpace* space, const uint8_t* snapshot, int length) {
+    if (cpSpaceIsLocked(space) || cp_space_is_stepping(space)) return 0;
+    CP_FFI_TRACE_BEGIN();
+
+    cpFfiSnapshotLayout layout;
+    int valid = cp_ffi_snapshot_validate_layout(snapshot, length, &layout);
+    if (valid) {
+        cpHashSet* sets[] = {
+            cpHashSetNew(layout.header.bodyCount, cp_ffi_ptr_eql),
+            cpHashSetNew(layout.header.shapeCount, cp_ffi_ptr_eql),
+            cpHashSetNew(layout.header.constraintCount, cp_ffi_ptr_eql),
+        };
+        valid = cp_ffi_snapshot_validate_objects(space, snapshot, &layout, sets);
+        for (int i = 0; i < 3; i++) cpHashSetFree(sets[i]);
+    }
+    if (!valid) {
+        cp_ffi_snapshot_layout_free(&layout);
+        return 0;
+    }
+    const cpFfiSnapshotHeader* header = &layout.header;
+
+    // Return every arbiter to the pool. Sleeping components keep their arbiters out of the cache, with
+    // their contacts copied out of the contact buffers.
+    cpArray* components = space->sleepingComponents;
+    for (int i = 0; i < components->num; i++) {
+        for (cpBody* body = (cpBody*)components->arr[i]; body; body = body->sleeping.next) {
+            CP_BODY_FOREACH_ARBITER(body, arb) {
+                if (!cp_ffi_sleep_owner(body, arb->body_a)) continue;
+                cpfree(arb->contacts);
+                cp_ffi_pool_arbiter(arb, space);
+            }
+        }
+    }
+    cpHashSetFilter(space->cachedArbiters, cp_ffi_pool_arbiter, space);
+    space->arbiters->num = 0;
+    space->staticBody->arbiterList = NULL;
+
+    // Bodies, with their sleeping components.
+    space->dynamicBodies->num = 0;
+    space->staticBodies->num = 0;
+    components->num = 0;
+    const uint8_t* sizes = snapshot + sizeof(cpFfiSnapshotHeader);
+    int component = 0;
+    int remaining = 0;
+    cpBody* root = NULL;
+    cpBody* previous = NULL;
+    for (int i = 0; i < header->bodyCount; i++) {
+        cpFfiBodyState state;
+        memcpy(&state, snapshot + layout.records[CP_FFI_SNAPSHOT_BODIES][i], sizeof(state));
+        cpBody* body = state.body;
+        body->m = state.m;
+        body->m_inv = state.mInv;
+        body->i = state.i;
+        body->i_inv = state.iInv;
+        body->cog = state.cog;
+        body->p = state.p;
+        body->v = state.v;
+        body->f = state.f;
+        body->a = state.a;
+        body->w = state.w;
+        body->t = state.t;
+        body->transform = state.transform;
+        body->v_bias = state.vBias;
+        body->w_bias = state.wBias;
+        body->arbiterList = NULL;
+        body->sleeping.root = NULL;
+        body->sleeping.next = NULL;
+        body->sleeping.idleTime = state.idleTime;
+
+        if (i < header->awakeBodyCount) {
+            cpArrayPush(space->dynamicBodies, body);
+        } else if (i < header->awakeBodyCount + header->staticBodyCount) {
+            cpArrayPush(space->staticBodies, body);
+        } else {
+            if (remaining == 0) {
+                memcpy(&remaining, sizes + component++ * sizeof(int), sizeof(int));
+                root = body;
+                cpArrayPush(components, root);
+            } else {
+                previous->sleeping.next = body;
+            }
+            body->sleeping.root = root;
+            previous = body;
+            remaining--;
+        }
+    }
+
+    // Shapes, moved to the index matching the state of their body. The bounding boxes are recomputed
+    // from the restored transforms.
+    for (int i = 0; i < header->shapeCount; i++) {
+        cpFfiShapeState state;
+        memcpy(&state, snapshot + layout.records[CP_FFI_SNAPSHOT_SHAPES][i], sizeof(state));
+        cpShape* shape = state.shape;
+        shape->e = state.e;
+        shape->u = state.u;
+        shape->surfaceV = state.surfaceV;
+        shape->filter = state.filter;
+        shape->type = state.type;
+        shape->sensor = (cpBool)state.sensor;
+
+        cpBody* body = shape->body;
+        int isStatic = cpBodyGetType(body) == CP_BODY_TYPE_STATIC || cpBodyIsSleeping(body);
+        cpSpatialIndex* index = isStatic ? space->staticShapes : space->dynamicShapes;
+        cpBB bb = shape->bb;
+        cpShapeCacheBB(shape);
+        if (!cpSpatialIndexContains(index, shape, shape->hashid)) {
+            cpSpatialIndexRemove(isStatic ? space->dynamicShapes : space->staticShapes, shape, shape->hashid);
+            cpSpatialIndexInsert(index, shape, shape->hashid);
+        } else if (isStatic && (bb.l != shape->bb.l || bb.b != shape->bb.b || bb.r != shape->bb.r || bb.t != shape->bb.t)) {
+            cpSpatialIndexReindexObject(index, shape, shape->hashid);
+        }
+    }
+    cpSpatialIndexReindex(space->dynamicShapes);
+
+    // Constraints
+    space->constraints->num = 0;
+    for (int i = 0; i < header->constraintCount; i++) {
+        size_t offset = layout.records[CP_FFI_SNAPSHOT_CONSTRAINTS][i];
+        cpFfiConstraintState state = cp_ffi_snapshot_constraint_state(snapshot, offset);
+        cpConstraint* constraint = state.constraint;
+        constraint->maxForce = state.maxForce;
+        constraint->errorBias = state.errorBias;
+        constraint->maxBias = state.maxBias;
+        constraint->collideBodies = (cpBool)state.collideBodies;
+        memcpy((uint8_t*)constraint + sizeof(cpConstraint), snapshot + offset + sizeof(state), state.size);
+        if (i < header->activeConstraintCount) cpArrayPush(space->constraints, constraint);
+    }
+
+    // Arbiters, cached and threaded into the lists of their bodies as they were. The contacts go back
+    // to the contact buffers, or to their own block for the arbiters of sleeping components.
+    const size_t* records = layout.records[CP_FFI_SNAPSHOT_ARBITERS];
+    cpArbiter** arbiters = (cpArbiter**)cpcalloc(header->arbiterCount + 1, sizeof(cpArbiter*));
+    for (int i = 0; i < header->arbiterCount; i++) {
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, records[i]);
+        cpArbiter* arb = cp_ffi_pop_arbiter(space);
+        memset(arb, 0, sizeof(cpArbiter));
+        arb->e = state.e;
+        arb->u = state.u;
+        arb->surface_vr = state.surfaceVr;
+        arb->data = state.data;
+        arb->a = state.a;
+        arb->b = state.b;
+        arb->body_a = state.a->body;
+        arb->body_b = state.b->body;
+        arb->count = state.count;
+        arb->n = state.n;
+        arb->handler = state.handler;
+        arb->handlerA = state.handlerA;
+        arb->handlerB = state.handlerB;
+        arb->swapped = (cpBool)state.swapped;
+        arb->stamp = space->stamp - state.age;
+        arb->state = (enum cpArbiterState)state.state;
+
+        size_t bytes = state.count * sizeof(struct cpContact);
+        if (cp_ffi_arbiter_sleeping(arb)) {
+            arb->contacts = (struct cpContact*)cpcalloc(1, bytes);
+        } else {
+            arb->contacts = cpContactBufferGetArray(space);
+            cpSpacePushContacts(space, state.count);
+        }
+        if (bytes) memcpy(arb->contacts, snapshot + records[i] + sizeof(state), bytes);
+
+        if (state.flags & CP_FFI_SNAPSHOT_CACHED) {
+            const cpShape* pair[] = {arb->a, arb->b};
+            cpHashSetInsert(space->cachedArbiters, CP_HASH_PAIR((cpHashValue)arb->a, (cpHashValue)arb->b), pair, NULL, arb);
+        }
+        if (i >= header->sleepingArbiterCount && i < header->sleepingArbiterCount + header->activeArbiterCount) {
+            cpArrayPush(space->arbiters, arb);
+        }
+        arbiters[i] = arb;
+    }
+    for (int i = 0; i < header->arbiterCount; i++) {
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, records[i]);
+        if (!(state.flags & CP_FFI_SNAPSHOT_THREADED)) continue;
+        cpArbiter* arb = arbiters[i];
+        arb->thread_a.next = state.nextA < 0 ? NULL : arbiters[state.nextA];
+        arb->thread_b.next = state.nextB < 0 ? NULL : arbiters[state.nextB];
+        if (arb->thread_a.next) cpArbiterThreadForBody(arb->thread_a.next, arb->body_a)->prev = arb;
+        if (arb->thread_b.next) cpArbiterThreadForBody(arb->thread_b.next, arb->body_b)->prev = arb;
+    }
+    for (int i = 0; i < header->arbiterCount; i++) {
+        cpArbiter* arb = arbiters[i];
+        cpFfiArbiterState state = cp_ffi_snapshot_arbiter_state(snapshot, records[i]);
+        if (!(state.flags & CP_FFI_SNAPSHOT_THREADED)) continue;
+        if (!arb->thread_a.prev) arb->body_a->arbiterList = arb;
+        if (!arb->thread_b.prev) arb->body_b->arbiterList = arb;
+    }
+    cpfree(arbiters);
+
+    space->curr_dt = header->currDt;
+    cpFfiSpaceData* data = (cpFfiSpaceData*)space->userData;
+    if (data) data->accumulator = header->accumulator;
+    cp_ffi_snapshot_layout_free(&layout);
+    CP_FFI_TRACE_END("cp_space_restore");
+    return 1;
+}
+
+// Delta snapshots
+// A delta is a cpFfiDeltaHeader followed by the header and component sizes of the target snapshot, then
+// for each section a list of runs until the section's target count is reached. A run either copies
+// `count` consecutive records of the reference snapshot starting at `reference`, or has a reference of
+// -1 and is followed by `count` records of its own. The reference is bound by its size and checksum.
+#define CP_FFI_DELTA_MAGIC 0x41544c44u
+#define CP_FFI_DELTA_VERSION 1
+
+typedef struct cpFfiDeltaHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint64_t referenceSize;
+    uint64_t referenceChecksum;
+} cpFfiDeltaHeader;
+
+typedef struct cpFfiDeltaRun {
+    int reference;
+    int count;
+} cpFfiDeltaRun;
+
+// Record of the reference snapshot, keyed by its object, or by its shape pair for arbiters.
+typedef struct cpFfiDeltaKey {
+    const void* a;
+    const void* b;
+    int index;
+} cpFfiDeltaKey;
+
+// Run of the delta being written, flushed once the next record cannot extend it.
+typedef struct cpFfiDeltaEncoder {
+    cpFfiSnapshotWriter* writer;
+    const uint8_t* target;
+    const size_t* records;
+    cpFfiDeltaRun run;
+    int start;
+} cpFfiDeltaEncoder;
+
+// FNV-1a over the 64-bit words of a snapshot, whose records are all padded to 8 bytes.
+static uint64_t cp_ffi_snapshot_checksum(const uint8_t* snapshot, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, snapshot + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static cpFfiDeltaKey cp_ffi_delta_key(const uint8_t* snapshot, size_t offset, int section, int index) {
+    cpFfiDeltaKey key = {NULL, NULL, index};
+    memcpy(&key.a, snapshot + offset, sizeof(void*));
+    if (section == CP_FFI_SNAPSHOT_ARBITERS) memcpy(&key.b, snapshot + offset + sizeof(void*), sizeof(void*));
+    return key;
+}
+
+static cpHashValue cp_ffi_delta_key_hash(const cpFfiDeltaKey* key) {
+    return CP_HASH_PAIR((cpHashValue)key->a, (cpHashValue)key->b);
+}
+
+static cpBool cp_ffi_delta_key_eql(const void* ptr, const void* elt) {
+    const cpFfiDeltaKey* a = (const cpFfiDeltaKey*)ptr;
+    const cpFfiDeltaKey* b = (const cpFfiDeltaKey*)elt;
+    return a->a == b->a && a->b == b->b;
+}
+
+static void cp_ffi_delta_flush(cpFfiDeltaEncoder* encoder) {
+    cpFfiDeltaRun run = encoder->run;
+    if (run.count == 0) return;
+    cp_ffi_snapshot_write(encoder->writer, &run, sizeof(run));
+    if (run.reference < 0) {
+        size_t begin = encoder->records[encoder->start];
+        cp_ffi_snapshot_write(encoder->writer, encoder->target + begin, encoder->records[encoder->start + run.count] - begin);
+    }
+    encoder->run.count = 0;
+}
+
+// Appends record `i` of the target to the current run, copied from `reference` or as a literal when -1.
+static void cp_ffi_delta_push(cpFfiDeltaEncoder* encoder, int i, int reference) {
+    cpFfiDeltaRun* run = &encoder->run;
+    if (run->count > 0) {
+        if (reference < 0 && run->reference < 0) {
+            run->count++;
+            return;
+        }
+        if (reference >= 0 && run->reference >= 0 && run->reference + run->count == reference) {
+            run->count++;
+            return;
+        }
+        cp_ffi_delta_flush(encoder);
+    }
+    run->reference = reference;
+    run->count = 1;
+    encoder->start = i;
+}
+
+static void cp_ffi_delta_encode_section(cpFfiSnapshotWriter* writer, const uint8_t* reference, const cpFfiSnapshotLayout* referenceLayout,
+                                        const uint8_t* target, const cpFfiSnapshotLayout* targetLayout, int section) {
+    const size_t* references = referenceLayout->records[section];
+    int referenceCount = cp_ffi_snapshot_count(&referenceLayout->header, section);
+    int count = cp_ffi_snapshot_count(&targetLayout->header, section);
+    cpFfiDeltaEncoder encoder = {writer, target, targetLayout->records[section], {-1, 0}, 0};
+    // Records mostly keep their order, so the next reference record is tried before the key lookup,
+    // which is only built once a record moved.
+    cpHashSet* keys = NULL;
+    cpFfiDeltaKey* entries = NULL;
+    int expected = 0;
+    for (int i = 0; i < count; i++) {
+        cpFfiDeltaKey key = cp_ffi_delta_key(target, encoder.records[i], section, i);
+        int candidate = -1;
+        if (expected < referenceCount) {
+            cpFfiDeltaKey other = cp_ffi_delta_key(reference, references[expected], section, expected);
+            if (cp_ffi_delta_key_eql(&key, &other)) candidate = expected;
+        }
+        if (candidate < 0 && referenceCount > 0) {
+            if (!keys) {
+                keys = cpHashSetNew(referenceCount, cp_ffi_delta_key_eql);
+                entries = (cpFfiDeltaKey*)cpcalloc(referenceCount, sizeof(cpFfiDeltaKey));
+                for (int j = 0; j < referenceCount; j++) {
+                    entries[j] = cp_ffi_delta_key(reference, references[j], section, j);
+                    cpHashSetInsert(keys, cp_ffi_delta_key_hash(&entries[j]), &entries[j], NULL, &entries[j]);
+                }
+            }
+            const cpFfiDeltaKey* entry = (const cpFfiDeltaKey*)cpHashSetFind(keys, cp_ffi_delta_key_hash(&key), &key);
+            if (entry) candidate = entry->index;
+        }
+
+        int match = -1;
+        if (candidate >= 0) {
+            size_t size = encoder.records[i + 1] - encoder.records[i];
+            size_t referenceSize = references[candidate + 1] - references[candidate];
+            if (size == referenceSize && memcmp(target + encoder.records[i], reference + references[candidate], size) == 0) match = candidate;
+            expected = candidate + 1;
+        }
+        cp_ffi_delta_push(&encoder, i, match);
+    }
+    cp_ffi_delta_flush(&encoder);
+    if (keys) cpHashSetFree(keys);
+    cpfree(entries);
+}
+
+// Writes a delta of the space's current state against `reference`, a snapshot taken by cp_space_snapshot
+// or rebuilt by cp_ffi_snapshot_apply_delta, and returns its size. Nothing is complete unless the size
+// is at most `capacity`. Returns 0 while the space is locked or stepping asynchronously, and -1 when the
+// reference is malformed.
+FFI_PLUGIN_EXPORT int cp_space_snapshot_delta(cpSpace* space, const uint8_t* reference, int referenceLength, uint8_t* out, int capacity) {
+    if (cpSpaceIsLocked(space) || cp_space_is_stepping(space)) return 0;
+    cpFfiSnapshotLayout referenceLayout;
+    if (!cp_ffi_snapshot_validate_layout(reference, referenceLength, &referenceLayout)) {
+        cp_ffi_snapshot_layout_free(&referenceLayout);
+        return -1;
+    }
+    CP_FFI_TRACE_BEGIN();
+
+    // The full snapshot is usually about the size of the reference.
+    int targetCapacity = referenceLength + 4096;
+    uint8_t* target = (uint8_t*)cpcalloc(1, targetCapacity);
+    int targetLength = cp_space_snapshot(space, target, targetCapacity);
+    if (targetLength > targetCapacity) {
+        cpfree(target);
+        targetCapacity = targetLength;
+        target = (uint8_t*)cpcalloc(1, targetCapacity);
+        targetLength = cp_space_snapshot(space, target, targetCapacity);
+    }
+    cpFfiSnapshotLayout targetLayout;
+    cp_ffi_snapshot_validate_layout(target, targetLength, &targetLayout);
+
+    cpFfiSnapshotWriter writer = {out, capacity > 0 ? (size_t)capacity : 0, sizeof(cpFfiDeltaHeader)};
+    cp_ffi_snapshot_write(&writer, target, targetLayout.records[CP_FFI_SNAPSHOT_BODIES][0]);
+    for (int section = 0; section < CP_FFI_SNAPSHOT_SECTIONS; section++) {
+        cp_ffi_delta_encode_section(&writer, reference, &referenceLayout, target, &targetLayout, section);
+    }
+    cpFfiDeltaHeader header = {
+        CP_FFI_DELTA_MAGIC, CP_FFI_DELTA_VERSION, writer.size, (uint64_t)referenceLength,
+        cp_ffi_snapshot_checksum(reference, referenceLength),
+    };
+    if (writer.size <= writer.capacity) memcpy(out, &header, sizeof(header));
+
+    cp_ffi_snapshot_layout_free(&targetLayout);
+    cp_ffi_snapshot_layout_free(&referenceLayout);
+    cpfree(target);
+    CP_FFI_TRACE_END("cp_space_snapshot_delta");
+    return (int)writer.size;
+}
+
+// Decodes the runs of one section, returning the offset past them in the delta or 0 if they are malformed.
+static size_t cp_ffi_delta_decode_section(cpFfiSnapshotWriter* writer, const uint8_t* reference, const cpFfiSnapshotLayout* referenceLayout,
+                                          const uint8_t* delta, size_t length, size_t offset, int count, int section) {
+    const size_t* references = referenceLayout->records[section];
+    int referenceCount = cp_ffi_snapshot_count(&referenceLayout->header, section);
+    int remaining = count;
+    while (remaining > 0) {
+        cpFfiDeltaRun run;
+        if (sizeof(run) > length - offset) return 0;
+        memcpy(&run, delta + offset, sizeof(run));
+        offset += sizeof(run);
+        if (run.count <= 0 || run.count > remaining) return 0;
+        if (run.reference >= 0) {
+            if (run.reference > referenceCount - run.count) return 0;
+            size_t begin = references[run.reference];
+            cp_ffi_snapshot_write(writer, reference + begin, references[run.reference + run.count] - begin);
+        } else if (run.reference == -1) {
+            size_t begin = offset;
+            for (int i = 0; i < run.count; i++) {
+                size_t size = cp_ffi_snapshot_record_size(delta, length, offset, section);
+                if (!size) return 0;
+                offset += size;
+            }
+            cp_ffi_snapshot_write(writer, delta + begin, offset - begin);
+        } else {
+            return 0;
+        }
+        remaining -= run.count;
+    }
+    return offset;
+}
+
+// Rebuilds the full snapshot described by a delta from the reference it was taken against, writes it to
+// `out` and returns its size. Nothing is complete unless the size is at most `capacity`. Returns -1 when
+// the delta is malformed or was not taken against this reference.
+FFI_PLUGIN_EXPORT int cp_ffi_snapshot_apply_delta(const uint8_t* reference, int referenceLength, const uint8_t* delta, int deltaLength,
+                                                  uint8_t* out, int capacity) {
+    cpFfiDeltaHeader header;
+    cpFfiSnapshotHeader target;
+    if (!delta || deltaLength < (int)(sizeof(header) + sizeof(target))) return -1;
+    memcpy(&header, delta, sizeof(header));
+    memcpy(&target, delta + sizeof(header), sizeof(target));
+    if (header.magic != CP_FFI_DELTA_MAGIC || header.version != CP_FFI_DELTA_VERSION || header.size != (uint64_t)deltaLength) return -1;
+    if (target.magic != CP_FFI_SNAPSHOT_MAGIC || target.version != CP_FFI_SNAPSHOT_VERSION || target.size > 0x7fffffffu) return -1;
+    if (referenceLength < 0 || header.referenceSize != (uint64_t)referenceLength) return -1;
+    if (target.componentCount < 0 || (size_t)target.componentCount > (deltaLength - sizeof(header) - sizeof(target)) / sizeof(int)) return -1;
+    for (int section = 0; section < CP_FFI_SNAPSHOT_SECTIONS; section++) {
+        if (cp_ffi_snapshot_count(&target, section) < 0) return -1;
+    }
+
+    cpFfiSnapshotLayout referenceLayout;
+    int valid = cp_ffi_snapshot_validate_layout(reference, referenceLength, &referenceLayout);
+    if (!valid || header.referenceChecksum != cp_ffi_snapshot_checksum(reference, referenceLength)) {
+        cp_ffi_snapshot_layout_free(&referenceLayout);
+        return -1;
+    }
+    CP_FFI_TRACE_BEGIN();
+
+    size_t prefix = cp_ffi_snapshot_align(sizeof(target) + target.componentCount * sizeof(int));
+    size_t offset = sizeof(header) + prefix;
+    cpFfiSnapshotWriter writer = {out, capacity > 0 ? (size_t)capacity : 0, 0};
+    valid = offset <= (size_t)deltaLength;
+    if (valid) cp_ffi_snapshot_write(&writer, delta + sizeof(header), prefix);
+    for (int section = 0; valid && section < CP_FFI_SNAPSHOT_SECTIONS; section++) {
+        int count = cp_ffi_snapshot_count(&target, section);
+        offset = cp_ffi_delta_decode_section(&writer, reference, &referenceLayout, delta, deltaLength, offset, count, section);
+        valid = offset != 0;
+    }
+    cp_ffi_snapshot_layout_free(&referenceLayout);
+    CP_FFI_TRACE_END("cp_ffi_snapshot_apply_delta");
+    if (!valid || offset != (size_t)deltaLength || writer.size != target.size) return -1;
+    return (int)writer.size;
+}
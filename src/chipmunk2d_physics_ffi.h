@@ -1,11 +1,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if _WIN32
 #include <windows.h>
 #else
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 #endif
 
@@ -160,7 +162,10 @@ FFI_PLUGIN_EXPORT cpFloat cp_vect_get_y(cpVect v);
 // Collision detection and spatial queries
 FFI_PLUGIN_EXPORT cpShape* cp_space_point_query_nearest(cpSpace* space, cpVect point, cpFloat maxDistance, cpShapeFilter filter, cpPointQueryInfo* out);
 FFI_PLUGIN_EXPORT cpShape* cp_space_segment_query_first(cpSpace* space, cpVect start, cpVect end, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo* out);
-FFI_PLUGIN_EXPORT int cp_space_shape_query(cpSpace* space, cpShape* shape, void* func, void* data);
+FFI_PLUGIN_EXPORT int cp_space_shape_query(cpSpace* space, cpShape* shape, cpShape** shapes, cpContactPointSet* sets, int capacity);
+FFI_PLUGIN_EXPORT int cp_space_point_query(cpSpace* space, cpVect point, cpFloat maxDistance, cpShapeFilter filter, cpPointQueryInfo* out, int capacity);
+FFI_PLUGIN_EXPORT int cp_space_segment_query(cpSpace* space, cpVect start, cpVect end, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo* out, int capacity);
+FFI_PLUGIN_EXPORT int cp_space_bb_query(cpSpace* space, cpBB bb, cpShapeFilter filter, cpShape** out, int capacity);
 
 // Constraint management
 FFI_PLUGIN_EXPORT void cp_constraint_free(cpConstraint* constraint);
@@ -287,3 +292,285 @@ FFI_PLUGIN_EXPORT cpVect cp_centroid_for_poly(int count, cpVect* verts);
 FFI_PLUGIN_EXPORT cpFloat cp_moment_for_box(cpFloat m, cpFloat width, cpFloat height);
 FFI_PLUGIN_EXPORT cpFloat cp_moment_for_box2(cpFloat m, cpBB box);
 FFI_PLUGIN_EXPORT int cp_convex_hull(int count, cpVect* verts, cpVect* result, int* first, cpFloat tol);
+
+// Bulk state transfer
+// State buffers are structure-of-arrays: column c of row i lives at out[c * capacity + i].
+// Columns are x, y, angle and, when CP_FFI_STATE_VELOCITY is set, vx, vy, angular velocity.
+#define CP_FFI_STATE_VELOCITY 1
+FFI_PLUGIN_EXPORT int cp_space_export_transforms_f32(cpSpace* space, float* out, int capacity, int flags, cpBody** bodies);
+FFI_PLUGIN_EXPORT int cp_space_export_transforms_f64(cpSpace* space, double* out, int capacity, int flags, cpBody** bodies);
+FFI_PLUGIN_EXPORT void cp_space_import_states_f32(cpSpace* space, cpBody** bodies, const float* state, int count, int flags);
+FFI_PLUGIN_EXPORT void cp_space_import_states_f64(cpSpace* space, cpBody** bodies, const double* state, int count, int flags);
+
+// Change tracking
+// When enabled, every step records the bodies whose position or angle moved by more than
+// epsilon since they were last reported.
+FFI_PLUGIN_EXPORT void cp_space_set_change_tracking(cpSpace* space, int enabled, cpFloat epsilon);
+FFI_PLUGIN_EXPORT int cp_space_get_change_tracking(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_get_changed_body_count(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_export_changed_f32(cpSpace* space, float* out, int capacity, int flags, cpBody** bodies);
+FFI_PLUGIN_EXPORT int cp_space_export_changed_f64(cpSpace* space, double* out, int capacity, int flags, cpBody** bodies);
+
+// Spawning
+// Creates `count` dynamic bodies, each with one shape, and adds them to the space.
+// Attribute arrays may be NULL to use the default (mass 1, moment computed from the shape,
+// friction 0, elasticity 0, CP_SHAPE_FILTER_ALL, collision type 0). When the matching
+// CP_FFI_SPAWN_UNIFORM_* bit is set in `uniform`, an array holds a single value shared by every object.
+// Returns the number of objects spawned, 0 if the space is locked.
+#define CP_FFI_SPAWN_UNIFORM_SIZE 1
+#define CP_FFI_SPAWN_UNIFORM_MASS 2
+#define CP_FFI_SPAWN_UNIFORM_MOMENT 4
+#define CP_FFI_SPAWN_UNIFORM_FRICTION 8
+#define CP_FFI_SPAWN_UNIFORM_ELASTICITY 16
+#define CP_FFI_SPAWN_UNIFORM_FILTER 32
+#define CP_FFI_SPAWN_UNIFORM_COLLISION_TYPE 64
+FFI_PLUGIN_EXPORT int cp_space_spawn_circles(cpSpace* space, int count, const cpVect* positions, const cpFloat* radii, const cpFloat* masses, const cpFloat* moments, const cpFloat* frictions, const cpFloat* elasticities, const cpShapeFilter* filters, const uintptr_t* collisionTypes, int uniform, cpBody** bodies, cpShape** shapes);
+FFI_PLUGIN_EXPORT int cp_space_spawn_boxes(cpSpace* space, int count, const cpVect* positions, const cpVect* sizes, cpFloat radius, const cpFloat* masses, const cpFloat* moments, const cpFloat* frictions, const cpFloat* elasticities, const cpShapeFilter* filters, const uintptr_t* collisionTypes, int uniform, cpBody** bodies, cpShape** shapes);
+
+// Despawning
+// Removes the given objects from the space and frees them, constraints first, then shapes, then bodies.
+// Objects that are in no space are only freed; objects of another space are ignored.
+// When the space is locked the work is deferred until the end of the step and 0 is returned.
+FFI_PLUGIN_EXPORT int cp_space_despawn(cpSpace* space, cpConstraint** constraints, int constraintCount, cpShape** shapes, int shapeCount, cpBody** bodies, int bodyCount);
+
+// Command buffers
+// A command buffer is a byte stream of commands, each made of a one-byte CP_FFI_CMD_* opcode,
+// the handle of its target object and its operands. Handles and operands are 8-byte little-endian
+// words: operands are doubles, except for the filter group, categories and mask, the collision
+// type and the sensor flag, which are unsigned integers.
+// Returns the number of commands executed; execution stops at the first unknown or truncated command.
+#define CP_FFI_CMD_BODY_SET_POSITION 1
+#define CP_FFI_CMD_BODY_SET_VELOCITY 2
+#define CP_FFI_CMD_BODY_SET_ANGLE 3
+#define CP_FFI_CMD_BODY_SET_ANGULAR_VELOCITY 4
+#define CP_FFI_CMD_BODY_SET_FORCE 5
+#define CP_FFI_CMD_BODY_SET_TORQUE 6
+#define CP_FFI_CMD_BODY_APPLY_FORCE_AT_WORLD_POINT 7
+#define CP_FFI_CMD_BODY_APPLY_FORCE_AT_LOCAL_POINT 8
+#define CP_FFI_CMD_BODY_APPLY_IMPULSE_AT_WORLD_POINT 9
+#define CP_FFI_CMD_BODY_APPLY_IMPULSE_AT_LOCAL_POINT 10
+#define CP_FFI_CMD_BODY_ACTIVATE 11
+#define CP_FFI_CMD_SHAPE_SET_FRICTION 12
+#define CP_FFI_CMD_SHAPE_SET_ELASTICITY 13
+#define CP_FFI_CMD_SHAPE_SET_SURFACE_VELOCITY 14
+#define CP_FFI_CMD_SHAPE_SET_FILTER 15
+#define CP_FFI_CMD_SHAPE_SET_COLLISION_TYPE 16
+#define CP_FFI_CMD_SHAPE_SET_SENSOR 17
+#define CP_FFI_CMD_CONSTRAINT_SET_MAX_FORCE 18
+#define CP_FFI_CMD_SIMPLE_MOTOR_SET_RATE 19
+#define CP_FFI_CMD_COUNT 20
+FFI_PLUGIN_EXPORT int cp_space_execute_commands(cpSpace* space, const uint8_t* commands, int length);
+
+// Collision events
+// Collision handlers installed for a pair of collision types queue an event for each requested
+// CP_FFI_COLLISION_* callback into a per-space ring buffer, which is drained after the step.
+// Events that do not fit in the buffer are dropped and counted.
+// Drained events are structure-of-arrays: column c of row i lives at out[c * capacity + i].
+// Columns are type, normal x, normal y, first contact point x, first contact point y, total impulse x,
+// total impulse y and total kinetic energy. The impulse and energy are only set for post-solve events.
+// Shapes are written to shapes[i] and shapes[capacity + i], in the order of the handler's collision types.
+#define CP_FFI_COLLISION_BEGIN 1
+#define CP_FFI_COLLISION_PRE_SOLVE 2
+#define CP_FFI_COLLISION_POST_SOLVE 4
+#define CP_FFI_COLLISION_SEPARATE 8
+FFI_PLUGIN_EXPORT void cp_space_set_collision_events(cpSpace* space, uintptr_t typeA, uintptr_t typeB, int events);
+FFI_PLUGIN_EXPORT void cp_space_set_collision_event_capacity(cpSpace* space, int capacity);
+FFI_PLUGIN_EXPORT int cp_space_get_collision_event_count(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_get_dropped_collision_events(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_drain_collision_events(cpSpace* space, double* out, cpShape** shapes, int capacity);
+
+// Sensor tracking
+// After each step, the shapes overlapping every tracked shape (usually a sensor) are diffed against
+// the previous step and a CP_FFI_SENSOR_* event is queued for each shape that entered or exited.
+// Drained events are written to types[i], with the tracked shape in shapes[i] and the other shape in
+// shapes[capacity + i]. Removing a shape from the space drops its overlaps without an exit event
+// and stops tracking it.
+#define CP_FFI_SENSOR_ENTER 1
+#define CP_FFI_SENSOR_EXIT 2
+FFI_PLUGIN_EXPORT void cp_space_set_sensor_tracking(cpSpace* space, cpShape* shape, int enabled);
+FFI_PLUGIN_EXPORT int cp_space_get_sensor_event_count(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_drain_sensor_events(cpSpace* space, int* types, cpShape** shapes, int capacity);
+FFI_PLUGIN_EXPORT int cp_space_get_sensor_overlaps(cpSpace* space, cpShape* sensor, cpShape** out, int capacity);
+
+// Collision rules
+// Rules are evaluated by the native collision handler of a pair of collision types, which is shared
+// with the collision events. CP_FFI_RULE_IGNORE rejects the pair in its begin callback.
+// CP_FFI_RULE_ONE_WAY ignores the collision until separation when the normal, which points from the
+// shape of typeA to the shape of typeB, goes against oneWayDirection. CP_FFI_RULE_FIRST_CONTACT_ONLY
+// resolves the first step of contact and ignores the collision after that until separation.
+#define CP_FFI_RULE_IGNORE 1
+#define CP_FFI_RULE_ONE_WAY 2
+#define CP_FFI_RULE_FIRST_CONTACT_ONLY 4
+FFI_PLUGIN_EXPORT void cp_space_set_collision_rule(cpSpace* space, uintptr_t typeA, uintptr_t typeB, int rules, cpVect oneWayDirection);
+
+// Worker pool
+// Large batches are split across a pool of native worker threads, created on first use with one
+// worker per CPU beyond the first. Builds without threads (wasm) report 0 workers and run every batch
+// on the calling thread.
+FFI_PLUGIN_EXPORT void cp_ffi_set_worker_thread_count(int count);
+FFI_PLUGIN_EXPORT int cp_ffi_get_worker_thread_count(void);
+
+// Batched queries
+// Query i of a batch uses filters[i], or filters[0] when filterCount is 1, or collides with all shapes
+// when filterCount is 0. Large batches run on the worker pool with results written to disjoint slices
+// of the outputs, so the space must not be modified while a batch runs. Batches run on the calling
+// thread while the space uses a spatial hash, whose queries are not thread safe.
+// Segment i is read from segments[5 * i]: start x, start y, end x, end y and radius. The first shape hit
+// by segment i is written to shapes[i], or NULL on a miss, and the hit point x, point y, normal x,
+// normal y and alpha to hits[5 * i]. A miss reports the segment end and an alpha of 1, like
+// cpSpaceSegmentQueryFirst. Returns the number of segments that hit a shape.
+FFI_PLUGIN_EXPORT int cp_space_segment_query_first_batch(cpSpace* space, const double* segments, int count, const cpShapeFilter* filters, int filterCount, cpShape** shapes, double* hits);
+// Point i is read from points[3 * i]: x, y and maximum distance. The nearest shape is written to
+// shapes[i], or NULL if none is within range, and the nearest point x, point y, distance, gradient x and
+// gradient y to hits[5 * i]. Returns the number of points with a shape in range.
+FFI_PLUGIN_EXPORT int cp_space_point_query_nearest_batch(cpSpace* space, const double* points, int count, const cpShapeFilter* filters, int filterCount, cpShape** shapes, double* hits);
+// Box i is read from bbs[4 * i]: left, bottom, right and top. Up to `capacity` shapes overlapping box i
+// are written from shapes[capacity * i] and their total number to counts[i].
+FFI_PLUGIN_EXPORT void cp_space_bb_query_batch(cpSpace* space, const double* bbs, int count, const cpShapeFilter* filters, int filterCount, cpShape** shapes, int capacity, int* counts);
+
+// Viewport culling
+// A render id is a non-zero value identifying what to draw for a shape, stored in the shape's user
+// data. cp_space_query_visible walks the space's bounding box trees for the shapes with a render id
+// whose bounding box intersects the viewport, so its cost follows what is on screen rather than the
+// size of the space.
+FFI_PLUGIN_EXPORT void cp_shape_set_render_id(cpShape* shape, uint32_t renderId);
+FFI_PLUGIN_EXPORT uint32_t cp_shape_get_render_id(cpShape* shape);
+FFI_PLUGIN_EXPORT int cp_space_query_visible(cpSpace* space, cpBB viewport, cpShapeFilter filter, float* instances, uint32_t* renderIds, cpShape** shapes, int capacity);
+
+// Shape casts
+// The cast shape moves by translation from its body's transform, without rotating. On a hit, out
+// holds the shape hit, the contact point on its surface, its surface normal and the fraction of the
+// translation travelled before the gap closed within the tolerance.
+FFI_PLUGIN_EXPORT cpShape* cp_space_shape_cast(cpSpace* space, cpShape* shape, cpVect translation, cpFloat tolerance, cpSegmentQueryInfo* out);
+
+// Hasty spaces
+// A hasty space runs Chipmunk's multi-threaded solver. It is freed with cp_space_free and stepped by
+// either cp_space_step or cp_hasty_space_step. The solver only spreads over its threads once the space
+// is big enough, and Chipmunk caps the thread count at a small maximum. A thread count of 0 or less uses
+// one thread per CPU. Where the solver is not built (Windows and Web), cp_hasty_space_new returns a
+// regular space that runs on one thread.
+FFI_PLUGIN_EXPORT cpSpace* cp_hasty_space_new(void);
+FFI_PLUGIN_EXPORT void cp_hasty_space_set_threads(cpSpace* space, int threads);
+FFI_PLUGIN_EXPORT int cp_hasty_space_get_threads(cpSpace* space);
+FFI_PLUGIN_EXPORT void cp_hasty_space_step(cpSpace* space, cpFloat dt);
+
+// Multi-space stepping
+// The spaces must be distinct and must not share bodies, shapes or constraints, as they are stepped
+// concurrently. Each space is stepped like cp_space_step.
+FFI_PLUGIN_EXPORT void cp_space_step_many(cpSpace** spaces, int count, cpFloat dt);
+
+// Asynchronous steps
+// cp_space_step_async returns right away while the space is stepped, like cp_space_step, on a thread
+// of its own. Until cp_space_step_wait returns, the space and its objects must not be used, except
+// through cp_space_is_stepping and the snapshot readers. After each asynchronous step, the position,
+// angle and velocity of every body are published in a snapshot, which the thread starting the steps
+// can read without locking while the next step runs. Bodies removed from the space are dropped from it.
+FFI_PLUGIN_EXPORT void cp_space_step_async(cpSpace* space, cpFloat dt);
+FFI_PLUGIN_EXPORT void cp_space_step_wait(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_is_stepping(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_read_snapshot_f32(cpSpace* space, float* out, int capacity, int flags, cpBody** bodies);
+FFI_PLUGIN_EXPORT int cp_space_read_snapshot_f64(cpSpace* space, double* out, int capacity, int flags, cpBody** bodies);
+
+// Fixed timestep
+// cp_space_advance runs the fixed steps that fit in the elapsed frame time, carrying the remainder over
+// to the next frame. Rendering the transforms blended between the last two steps by the remainder
+// (cp_space_export_interpolated_*) keeps motion smooth at any display refresh rate.
+FFI_PLUGIN_EXPORT int cp_space_advance(cpSpace* space, cpFloat frameDt, cpFloat fixedDt, int maxSubsteps);
+FFI_PLUGIN_EXPORT cpFloat cp_space_get_interpolation_alpha(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_export_interpolated_f32(cpSpace* space, float* out, int capacity, cpBody** bodies);
+FFI_PLUGIN_EXPORT int cp_space_export_interpolated_f64(cpSpace* space, double* out, int capacity, cpBody** bodies);
+
+// Broadphase
+// A space starts with bounding box trees, which suit shapes of any size. A spatial hash is faster for
+// many shapes of similar sizes, given a cell size close to their size and a cell count of about ten
+// times their number. In auto mode, a spatial hash is picked, resized or dropped from the number and
+// sizes of the dynamic shapes when set and then after each step where that number changed by over 25%.
+#define CP_FFI_BROADPHASE_BB_TREE 0
+#define CP_FFI_BROADPHASE_SPATIAL_HASH 1
+#define CP_FFI_BROADPHASE_AUTO 2
+FFI_PLUGIN_EXPORT void cp_space_set_broadphase(cpSpace* space, int mode, cpFloat dim, int count);
+FFI_PLUGIN_EXPORT int cp_space_get_broadphase(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_uses_spatial_hash(cpSpace* space);
+FFI_PLUGIN_EXPORT cpFloat cp_space_get_spatial_hash_dim(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_get_spatial_hash_count(cpSpace* space);
+
+// Step profiling
+// Built when CP_FFI_PROFILING is set (the CP_FFI_PROFILING CMake option, on by default), otherwise
+// cp_ffi_profiling_available returns 0 and no timings are recorded. While enabled on a space, its steps
+// run an instrumented copy of cpSpaceStep that records the seconds spent in each phase below.
+// Integration covers positions and velocities, the arbiter phase the filtering of cached arbiters with
+// the separate callbacks, pre-step also applies the cached impulses, and callbacks are the post-solve
+// and post-step callbacks. Timing each narrowphase pair adds some overhead to the step. Hasty spaces
+// only record their extension and total times.
+#ifndef CP_FFI_PROFILING
+#define CP_FFI_PROFILING 0
+#endif
+#define CP_FFI_PROFILE_INTEGRATE 0
+#define CP_FFI_PROFILE_BROADPHASE 1
+#define CP_FFI_PROFILE_NARROWPHASE 2
+#define CP_FFI_PROFILE_ISLANDS 3
+#define CP_FFI_PROFILE_ARBITERS 4
+#define CP_FFI_PROFILE_PRESTEP 5
+#define CP_FFI_PROFILE_SOLVER 6
+#define CP_FFI_PROFILE_CALLBACKS 7
+#define CP_FFI_PROFILE_EXTENSIONS 8
+#define CP_FFI_PROFILE_TOTAL 9
+#define CP_FFI_PROFILE_PHASES 10
+FFI_PLUGIN_EXPORT int cp_ffi_profiling_available(void);
+FFI_PLUGIN_EXPORT void cp_space_set_profiling(cpSpace* space, int history);
+FFI_PLUGIN_EXPORT int cp_space_get_profiling(cpSpace* space);
+FFI_PLUGIN_EXPORT int cp_space_get_profile(cpSpace* space, double* out, int capacity);
+
+// Simulation stats
+// Counters describing the space as left by its last step, written by cp_space_get_stats at the indices
+// below. Active bodies are the awake dynamic and kinematic bodies the step integrates, constraints and
+// arbiters are the ones it solved, contacts are the contact points of those arbiters, and cached
+// arbiters also include the ones of sleeping and recently separated pairs. Broadphase pairs are the
+// shape pairs the broadphase passed to the narrowphase, only counted by profiled steps (see
+// cp_space_set_profiling) and -1 otherwise.
+#define CP_FFI_STAT_ACTIVE_BODIES 0
+#define CP_FFI_STAT_SLEEPING_BODIES 1
+#define CP_FFI_STAT_STATIC_BODIES 2
+#define CP_FFI_STAT_SHAPES 3
+#define CP_FFI_STAT_CONSTRAINTS 4
+#define CP_FFI_STAT_ARBITERS 5
+#define CP_FFI_STAT_CONTACTS 6
+#define CP_FFI_STAT_CACHED_ARBITERS 7
+#define CP_FFI_STAT_BROADPHASE_PAIRS 8
+#define CP_FFI_STATS 9
+FFI_PLUGIN_EXPORT void cp_space_get_stats(cpSpace* space, int* out);
+
+// Tracing
+// Records the extension calls, the phases of the steps and the chunks run by the worker threads as
+// Chrome trace events, which chrome://tracing and the Perfetto UI can load. Steps run the instrumented
+// copy of cpSpaceStep used by the profiler while recording. Each thread appends to its own buffer
+// without locking and drops its events beyond `eventsPerThread`; buffers of exited threads are reused.
+// cp_ffi_trace_start must not run concurrently with cp_ffi_trace_write. Built with the profiler; when
+// not recording, instrumented calls only check a flag.
+FFI_PLUGIN_EXPORT void cp_ffi_trace_start(int eventsPerThread);
+FFI_PLUGIN_EXPORT void cp_ffi_trace_stop(void);
+FFI_PLUGIN_EXPORT int cp_ffi_trace_is_recording(void);
+FFI_PLUGIN_EXPORT int cp_ffi_trace_write(const char* path);
+
+// Space snapshots
+// cp_space_snapshot serializes the bodies, shapes, constraints, cached arbiters with their contacts and
+// the sleeping components of a space into a compact binary blob in a caller buffer, and returns its
+// size; the blob is only complete when the size is at most `capacity`. cp_space_restore rewinds the
+// space to such a blob in place, reusing the existing objects, and returns 1. It returns 0 and leaves
+// the space untouched when the blob is malformed or the space no longer holds exactly the objects it
+// was taken with. Both return 0 while the space is locked or stepping asynchronously.
+FFI_PLUGIN_EXPORT int cp_space_snapshot(cpSpace* space, uint8_t* out, int capacity);
+FFI_PLUGIN_EXPORT int cp_space_restore(cpSpace* space, const uint8_t* snapshot, int length);
+
+// Delta snapshots
+// cp_space_snapshot_delta writes only the body, shape, constraint and arbiter records that differ from a
+// reference snapshot, so that a delta against a mostly sleeping or resting scene stays small, and returns
+// its size, 0 while the space is locked or stepping asynchronously, or -1 when the reference is
+// malformed. cp_ffi_snapshot_apply_delta rebuilds the full snapshot from the same reference, which can
+// then be restored or serve as the reference of the next delta, and returns its size or -1 when the
+// delta is malformed or was taken against another reference. Outputs are only complete when their size
+// is at most `capacity`.
+FFI_PLUGIN_EXPORT int cp_space_snapshot_delta(cpSpace* space, const uint8_t* reference, int referenceLength, uint8_t* out,
+                                              int capacity);
+FFI_PLUGIN_EXPORT int cp_ffi_snapshot_apply_delta(const uint8_t* reference, int referenceLength, const uint8_t* delta,
+                                                  int deltaLength, uint8_t* out, int capacity);
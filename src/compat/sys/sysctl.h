@@ -0,0 +1,3 @@
+// Stand-in for <sys/sysctl.h> on platforms that no longer provide it.
+// cpHastySpace.c includes it but only calls sysctlbyname on Apple platforms, which do provide it.
+#pragma once
@@ -0,0 +1,94 @@
+import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi.dart';
+import 'package:test/test.dart';
+
+void main() {
+  group('CollisionEvent', () {
+    test('creates event types from native values', () {
+      for (final type in CollisionEventType.values) {
+        expect(CollisionEventType.fromValue(type.value), type);
+      }
+      expect(() => CollisionEventType.fromValue(3), throwsArgumentError);
+    });
+
+    test('queues begin and post-solve events for a collision type pair', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final ground = SegmentShape(space.staticBody, const Vector(-10, 0), const Vector(10, 0), 0)..collisionType = 1;
+      final ball = Body.dynamic(1, momentForCircle(1, 0, 1, Vector.zero))..position = const Vector(0, 2);
+      final ballShape = CircleShape(ball, 1)..collisionType = 2;
+      space
+        ..addShape(ground)
+        ..addBody(ball)
+        ..addShape(ballShape)
+        ..setCollisionEvents(2, 1, {CollisionEventType.begin, CollisionEventType.postSolve});
+
+      final events = <CollisionEvent>[];
+      Vector? beginPosition;
+      for (var i = 0; i < 60; i++) {
+        space.step(1 / 60);
+        final drained = space.drainCollisionEvents();
+        if (drained.any((event) => event.type == CollisionEventType.begin)) beginPosition = ball.position;
+        events.addAll(drained);
+      }
+
+      final begins = events.where((event) => event.type == CollisionEventType.begin).toList();
+      expect(begins, hasLength(1));
+      expect(begins.first.shapeA, same(ballShape));
+      expect(begins.first.shapeB, same(ground));
+      // The point lies on the surface of shapeA, the ball, and the normal points from it to the ground.
+      expect((begins.first.point - beginPosition!).length, closeTo(1, 1e-3));
+      expect(begins.first.normal.y, closeTo(-1, 1e-3));
+      expect(events.any((event) => event.type == CollisionEventType.postSolve && event.totalImpulse.y != 0), true);
+      expect(events.any((event) => event.type == CollisionEventType.separate), false);
+      expect(space.pendingCollisionEventCount, 0);
+      space.dispose();
+    });
+
+    test('reports the contact point on shapeA when the pair is reversed', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final ground = SegmentShape(space.staticBody, const Vector(-10, 0), const Vector(10, 0), 0)..collisionType = 1;
+      final ball = Body.dynamic(1, momentForCircle(1, 0, 1, Vector.zero))..position = const Vector(0, 2);
+      final ballShape = CircleShape(ball, 1)..collisionType = 2;
+      space
+        ..addShape(ground)
+        ..addBody(ball)
+        ..addShape(ballShape)
+        ..setCollisionEvents(1, 2, {CollisionEventType.begin});
+
+      final events = <CollisionEvent>[];
+      for (var i = 0; i < 60; i++) {
+        space.step(1 / 60);
+        events.addAll(space.drainCollisionEvents());
+      }
+
+      expect(events, hasLength(1));
+      expect(events.first.shapeA, same(ground));
+      expect(events.first.shapeB, same(ballShape));
+      // The point lies on the ground, not on the ball sunk into it.
+      expect(events.first.point.y, closeTo(0, 1e-6));
+      expect(events.first.normal.y, closeTo(1, 1e-3));
+      space.dispose();
+    });
+
+    test('drops events that do not fit and counts them', () {
+      final space = Space()..collisionEventCapacity = 1;
+      final a = Body.dynamic(1, 1);
+      final b = Body.dynamic(1, 1)..position = const Vector(0.5, 0);
+      final shapeA = CircleShape(a, 1)..collisionType = 1;
+      final shapeB = CircleShape(b, 1)..collisionType = 1;
+      space
+        ..addBody(a)
+        ..addBody(b)
+        ..addShape(shapeA)
+        ..addShape(shapeB)
+        ..setCollisionEvents(1, 1, {CollisionEventType.begin, CollisionEventType.preSolve})
+        ..step(1 / 60);
+
+      expect(space.pendingCollisionEventCount, 1);
+      expect(space.drainCollisionEvents(), hasLength(1));
+      expect(space.droppedCollisionEvents, greaterThan(0));
+      expect(space.drainCollisionEvents(), isEmpty);
+      expect(space.droppedCollisionEvents, 0);
+      space.dispose();
+    });
+  });
+}
@@ -0,0 +1,99 @@
+import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi.dart';
+import 'package:test/test.dart';
+
+void main() {
+  group('CollisionRule', () {
+    const platformType = 1;
+    const ballType = 2;
+
+    late Space space;
+    late Body ball;
+
+    setUp(() {
+      space = Space()..gravity = const Vector(0, -100);
+      final platform = SegmentShape(space.staticBody, const Vector(-10, 0), const Vector(10, 0), 0.1)
+        ..collisionType = platformType;
+      ball = Body.dynamic(1, momentForCircle(1, 0, 0.5, Vector.zero));
+      final ballShape = CircleShape(ball, 0.5)..collisionType = ballType;
+      space
+        ..addShape(platform)
+        ..addBody(ball)
+        ..addShape(ballShape);
+    });
+
+    tearDown(() => space.dispose());
+
+    void simulate(int steps) {
+      for (var i = 0; i < steps; i++) {
+        space.step(1 / 60);
+      }
+    }
+
+    test('defaults to no rule', () {
+      const rule = CollisionRule.none;
+      expect(rule.ignored, false);
+      expect(rule.oneWayDirection, isNull);
+      expect(rule.firstContactOnly, false);
+    });
+
+    test('lets shapes pass through each other when ignored', () {
+      ball.position = const Vector(0, 1);
+      space.setCollisionRules({(platformType, ballType): CollisionRule.ignore});
+      simulate(60);
+      expect(ball.position.y, lessThan(-1));
+    });
+
+    test('only collides along the one-way direction', () {
+      space.setCollisionRule(platformType, ballType, const CollisionRule.oneWay(Vector(0, 1)));
+
+      ball
+        ..position = const Vector(0, -1)
+        ..velocity = const Vector(0, 30);
+      simulate(20);
+      expect(ball.position.y, greaterThan(1));
+
+      simulate(120);
+      expect(ball.position.y, closeTo(0.6, 0.1));
+    });
+
+    test('keeps the requested order of a pair registered in both orders', () {
+      space
+        ..setCollisionEvents(platformType, ballType, {CollisionEventType.begin})
+        ..setCollisionRule(ballType, platformType, const CollisionRule.oneWay(Vector(0, -1)));
+
+      ball
+        ..position = const Vector(0, -1)
+        ..velocity = const Vector(0, 30);
+      simulate(20);
+      expect(ball.position.y, greaterThan(1));
+      simulate(120);
+      expect(ball.position.y, closeTo(0.6, 0.1));
+      final platformFirst = space.drainCollisionEvents().last;
+      expect(platformFirst.shapeA.collisionType, platformType);
+      expect(platformFirst.normal.y, greaterThan(0));
+
+      space.setCollisionEvents(ballType, platformType, {CollisionEventType.begin});
+      ball
+        ..position = const Vector(0, 3)
+        ..velocity = Vector.zero;
+      simulate(120);
+      final ballFirst = space.drainCollisionEvents().last;
+      expect(ballFirst.shapeA.collisionType, ballType);
+      expect(ballFirst.normal.y, lessThan(0));
+    });
+
+    test('ignores contact after the first step when first contact only', () {
+      ball.position = const Vector(0, 1);
+      space.setCollisionRule(platformType, ballType, const CollisionRule(firstContactOnly: true));
+      simulate(120);
+      expect(ball.position.y, lessThan(-1));
+
+      space.setCollisionRule(platformType, ballType, CollisionRule.none);
+      ball
+        ..position = const Vector(0, 1)
+        ..velocity = Vector.zero;
+      simulate(120);
+      expect(ball.position.y, closeTo(0.6, 0.1));
+    });
+  });
+}
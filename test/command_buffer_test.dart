@@ -0,0 +1,67 @@
+import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi.dart';
+import 'package:test/test.dart';
+
+void main() {
+  group('CommandBuffer', () {
+    test('encodes commands with their operands', () {
+      final body = Body.dynamic(1, 1);
+      final commands = CommandBuffer(initialCapacity: 16)
+        ..setPosition(body, const Vector(1, 2))
+        ..activate(body)
+        ..applyImpulseAtWorldPoint(body, const Vector(1, 0), Vector.zero);
+      expect(commands.length, 3);
+      expect(commands.lengthInBytes, (1 + 8 * 3) + (1 + 8) + (1 + 8 * 5));
+      expect(commands.bytes.first, 1);
+
+      commands.clear();
+      expect(commands.isEmpty, true);
+      expect(commands.lengthInBytes, 0);
+      body.dispose();
+    });
+
+    test('applies body, shape and constraint commands in one call', () {
+      final space = Space();
+      final body = Body.dynamic(1, 1);
+      final other = Body.dynamic(1, 1);
+      final shape = CircleShape(body, 1);
+      final motor = SimpleMotor(body, other, 0);
+      space
+        ..addBody(body)
+        ..addBody(other)
+        ..addShape(shape)
+        ..addConstraint(motor);
+
+      final commands = CommandBuffer()
+        ..setPosition(body, const Vector(10, 20))
+        ..setVelocity(body, const Vector(1, 0))
+        ..applyImpulseAtLocalPoint(body, const Vector(0, 2), Vector.zero)
+        ..setAngle(body, 0.5)
+        ..setFriction(shape, 0.7)
+        ..setElasticity(shape, 0.3)
+        ..setSurfaceVelocity(shape, const Vector(4, 0))
+        ..setFilter(shape, const ShapeFilter(group: 3, categories: 2, mask: 6))
+        ..setCollisionType(shape, 42)
+        ..setSensor(shape, sensor: true)
+        ..setMaxForce(motor, 500)
+        ..setMotorRate(motor, 2);
+      space.executeCommands(commands);
+
+      expect(body.position.x, closeTo(10, 0.001));
+      expect(body.position.y, closeTo(20, 0.001));
+      expect(body.velocity.x, closeTo(1, 0.001));
+      expect(body.velocity.y, closeTo(2, 0.001));
+      expect(body.angle, closeTo(0.5, 0.001));
+      expect(shape.friction, closeTo(0.7, 0.001));
+      expect(shape.elasticity, closeTo(0.3, 0.001));
+      expect(shape.surfaceVelocity.x, closeTo(4, 0.001));
+      expect(shape.filter.group, 3);
+      expect(shape.filter.categories, 2);
+      expect(shape.filter.mask, 6);
+      expect(shape.collisionType, 42);
+      expect(shape.sensor, true);
+      expect(motor.maxForce, closeTo(500, 0.001));
+      expect(motor.rate, closeTo(2, 0.001));
+      space.dispose();
+    });
+  });
+}
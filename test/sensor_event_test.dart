@@ -0,0 +1,98 @@
+import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi.dart';
+import 'package:test/test.dart';
+
+void main() {
+  group('SensorEvent', () {
+    test('creates event types from native values', () {
+      for (final type in SensorEventType.values) {
+        expect(SensorEventType.fromValue(type.value), type);
+      }
+      expect(() => SensorEventType.fromValue(0), throwsArgumentError);
+    });
+
+    test('reports shapes entering and exiting a tracked sensor', () {
+      final space = Space();
+      final zone = BoxShape(space.staticBody, 4, 4)..sensor = true;
+      final ball = Body.dynamic(1, 1)..position = const Vector(10, 0);
+      final ballShape = CircleShape(ball, 0.5);
+      space
+        ..addShape(zone)
+        ..addBody(ball)
+        ..addShape(ballShape)
+        ..trackSensor(zone)
+        ..step(1 / 60);
+      expect(space.drainSensorEvents(), isEmpty);
+
+      ball.position = Vector.zero;
+      space.step(1 / 60);
+      final entered = space.drainSensorEvents();
+      expect(entered, hasLength(1));
+      expect(entered.first.type, SensorEventType.enter);
+      expect(entered.first.sensor, same(zone));
+      expect(entered.first.other, same(ballShape));
+      expect(space.sensorOverlaps(zone), [ballShape]);
+
+      space.step(1 / 60);
+      expect(space.drainSensorEvents(), isEmpty);
+
+      ball
+        ..position = const Vector(10, 0)
+        ..velocity = Vector.zero;
+      space.step(1 / 60);
+      final exited = space.drainSensorEvents();
+      expect(exited, hasLength(1));
+      expect(exited.first.type, SensorEventType.exit);
+      expect(space.sensorOverlaps(zone), isEmpty);
+      space.dispose();
+    });
+
+    test('drops overlaps of removed shapes without exit events', () {
+      final space = Space();
+      final zone = CircleShape(space.staticBody, 2)..sensor = true;
+      final ball = Body.dynamic(1, 1);
+      final ballShape = CircleShape(ball, 0.5);
+      space
+        ..addShape(zone)
+        ..addBody(ball)
+        ..addShape(ballShape)
+        ..trackSensor(zone)
+        ..step(1 / 60);
+      expect(space.drainSensorEvents().map((event) => event.type), [SensorEventType.enter]);
+
+      space
+        ..removeShape(ballShape)
+        ..step(1 / 60);
+      expect(space.drainSensorEvents(), isEmpty);
+      expect(space.sensorOverlaps(zone), isEmpty);
+      ballShape.dispose();
+      space.dispose();
+    });
+
+    test('keeps tracking sensors when collision events are enabled and resized', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final zone = CircleShape(space.staticBody, 4)..sensor = true;
+      final ground = SegmentShape(space.staticBody, const Vector(-10, 0), const Vector(10, 0), 0)..collisionType = 1;
+      final ball = Body.dynamic(1, momentForCircle(1, 0, 0.5, Vector.zero))..position = const Vector(0, 0.4);
+      final ballShape = CircleShape(ball, 0.5)..collisionType = 2;
+      space
+        ..addShape(zone)
+        ..addShape(ground)
+        ..addBody(ball)
+        ..addShape(ballShape)
+        ..trackSensor(zone)
+        ..setCollisionEvents(2, 1, {CollisionEventType.begin})
+        ..step(1 / 60);
+      expect(space.drainCollisionEvents(), isNotEmpty);
+
+      space
+        ..collisionEventCapacity = 8
+        ..collisionEventCapacity = 16;
+      for (var i = 0; i < 10; i++) {
+        space.step(1 / 60);
+      }
+      expect(space.drainSensorEvents().map((event) => event.type), [SensorEventType.enter]);
+      expect(space.sensorOverlaps(zone), [ballShape]);
+      space.dispose();
+    });
+  });
+}
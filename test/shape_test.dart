@@ -241,6 +241,14 @@ void main() {
         shape.dispose();
       });
 
+      test('sets and gets render id', () {
+        final shape = CircleShape(body, 10);
+        expect(shape.renderId, 0);
+        shape.renderId = 0xFFFFFFFF;
+        expect(shape.renderId, 0xFFFFFFFF);
+        shape.dispose();
+      });
+
       test('sets and gets surface velocity', () {
         final shape = CircleShape(body, 10);
         const surfaceVel = Vector(5, 0);
@@ -1,3 +1,7 @@
+import 'dart:convert';
+import 'dart:io';
+import 'dart:typed_data';
+
 import 'package:chipmunk2d_physics_ffi/chipmunk2d_physics_ffi.dart';
 import 'package:test/test.dart';
 
@@ -140,6 +144,380 @@ void main() {
       space.dispose();
     });
 
+    test('steps a threaded space like a regular one', () {
+      final space = Space.threaded(threads: 2)..gravity = const Vector(0, -100);
+      expect(space.threads, inInclusiveRange(1, 2));
+      final bodies = [
+        for (var i = 0; i < 200; i++) Body.dynamic(1, 1)..position = Vector((i % 20) * 3.0, (i ~/ 20) * 3.0),
+      ];
+      for (final body in bodies) {
+        space
+          ..addBody(body)
+          ..addShape(CircleShape(body, 1));
+      }
+      for (var i = 0; i < 10; i++) {
+        space.step(1 / 60.0);
+      }
+      expect(bodies.first.position.y, lessThan(0));
+      space.dispose();
+
+      final regular = Space();
+      expect(regular.threads, 1);
+      regular.dispose();
+    });
+
+    test('steps many spaces in one call', () {
+      final spaces = [for (var i = 0; i < 20; i++) Space()..gravity = Vector(0, -10.0 * (i + 1))];
+      final bodies = <Body>[];
+      for (final space in spaces) {
+        final body = Body.dynamic(1, 1);
+        space
+          ..addBody(body)
+          ..addShape(CircleShape(body, 1));
+        bodies.add(body);
+      }
+      Space.stepAll(spaces, 0.1);
+      for (var i = 0; i < spaces.length; i++) {
+        expect(bodies[i].velocity.y, closeTo(-1.0 * (i + 1), 0.001));
+        expect(spaces[i].currentTimeStep, closeTo(0.1, 0.001));
+      }
+      expect(() => Space.stepAll([spaces.first, spaces.first], 0.1), throwsArgumentError);
+      for (final space in spaces) {
+        space.dispose();
+      }
+    });
+
+    test('steps asynchronously and publishes a snapshot', () {
+      final space = Space()..gravity = const Vector(0, -10);
+      final body = Body.dynamic(1, 1);
+      final removed = Body.dynamic(1, 1);
+      space
+        ..addBody(body)
+        ..addBody(removed);
+      final out = Float32List(6 * 4);
+      expect(space.readSnapshot(out), 0);
+
+      space.stepAsync(0.1);
+      space.waitStep();
+      expect(space.isStepping, false);
+      expect(body.velocity.y, closeTo(-1, 0.001));
+
+      final bodies = <Body>[];
+      expect(space.readSnapshot(out, velocity: true, bodies: bodies), 2);
+      final row = bodies.indexOf(body);
+      expect(out[4 * 4 + row], closeTo(-1, 0.001));
+
+      space.stepAsync(0.1);
+      // The previous snapshot stays readable while the step runs.
+      expect(space.readSnapshot(out), 2);
+      space
+        ..waitStep()
+        ..removeBody(removed);
+      expect(space.readSnapshotFloat64(Float64List(3 * 4), bodies: bodies), 1);
+      expect(bodies.single, body);
+      expect(body.velocity.y, closeTo(-2, 0.001));
+      removed.dispose();
+      space.dispose();
+    });
+
+    test('advances by fixed steps and interpolates transforms', () {
+      final space = Space();
+      final body = Body.dynamic(1, 1)..velocity = const Vector(60, 0);
+      space.addBody(body);
+
+      expect(space.advance(0.025, fixedDt: 0.01), 2);
+      expect(space.interpolationAlpha, closeTo(0.5, 1e-6));
+      expect(body.position.x, closeTo(1.2, 1e-6));
+
+      final out = Float64List(3);
+      expect(space.exportInterpolatedTransformsFloat64(out), 1);
+      // Halfway between the last two steps, at x = 0.6 and x = 1.2.
+      expect(out[0], closeTo(0.9, 1e-6));
+
+      expect(space.advance(0.004, fixedDt: 0.01), 0);
+      expect(space.interpolationAlpha, closeTo(0.9, 1e-6));
+
+      // Time beyond maxSubsteps steps is dropped.
+      expect(space.advance(1, fixedDt: 0.01, maxSubsteps: 3), 3);
+      expect(space.interpolationAlpha, lessThan(1));
+      expect(() => space.advance(0.1, fixedDt: 0), throwsArgumentError);
+      expect(() => space.advance(0.1, maxSubsteps: -1), throwsArgumentError);
+      expect(space.advance(-1, fixedDt: 0.01), 0);
+      expect(space.interpolationAlpha, greaterThanOrEqualTo(0));
+      space.dispose();
+    });
+
+    test('switches between bounding box trees and spatial hashes', () {
+      final space = Space();
+      final body = Body.dynamic(1, 1);
+      space
+        ..addBody(body)
+        ..addShape(CircleShape(body, 1));
+      const box = BoundingBox(left: -2, bottom: -2, right: 2, top: 2);
+      expect(space.broadphase, Broadphase.bbTree);
+      expect(space.usesSpatialHash, false);
+
+      space.useSpatialHash(cellSize: 2, cellCount: 100);
+      expect(space.broadphase, Broadphase.spatialHash);
+      expect(space.usesSpatialHash, true);
+      expect(space.spatialHashCellSize, 2);
+      expect(space.spatialHashCellCount, 100);
+      expect(space.bbQuery(box).total, 1);
+
+      space.useBBTree();
+      expect(space.usesSpatialHash, false);
+      expect(space.spatialHashCellCount, 0);
+      expect(space.bbQuery(box).total, 1);
+      expect(() => space.useSpatialHash(cellSize: 0, cellCount: 100), throwsArgumentError);
+      space.dispose();
+    });
+
+    test('keeps static and dynamic shapes when resizing a spatial hash', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final ground = SegmentShape(space.staticBody, const Vector(-10, 0), const Vector(10, 0), 0.5);
+      final ball = Body.dynamic(1, 1)..position = const Vector(0, 3);
+      space
+        ..addShape(ground)
+        ..addBody(ball)
+        ..addShape(CircleShape(ball, 1))
+        ..useSpatialHash(cellSize: 2, cellCount: 100)
+        ..useSpatialHash(cellSize: 4, cellCount: 500);
+      expect(space.spatialHashCellSize, 4);
+      expect(space.bbQuery(const BoundingBox(left: -1, bottom: -1, right: 1, top: 0.5)).total, 1);
+      expect(space.bbQuery(const BoundingBox(left: -1, bottom: 2, right: 1, top: 4)).total, 1);
+
+      for (var i = 0; i < 120; i++) {
+        space.step(1 / 60.0);
+      }
+      expect(ball.position.y, closeTo(1.5, 0.2));
+      space.dispose();
+    });
+
+    test('auto broadphase picks a spatial hash for many similar shapes', () {
+      final space = Space()..useAutoBroadphase();
+      expect(space.broadphase, Broadphase.auto);
+      expect(space.usesSpatialHash, false);
+
+      for (var i = 0; i < 300; i++) {
+        final body = Body.dynamic(1, 1)..position = Vector((i % 20) * 3.0, (i ~/ 20) * 3.0);
+        space
+          ..addBody(body)
+          ..addShape(CircleShape(body, 1));
+      }
+      space.step(1 / 60.0);
+      expect(space.usesSpatialHash, true);
+      expect(space.spatialHashCellSize, closeTo(2, 0.1));
+      expect(space.spatialHashCellCount, 3000);
+      expect(space.bbQuery(const BoundingBox(left: -1, bottom: -1, right: 1, top: 1)).total, 1);
+      space.dispose();
+    });
+
+    test('records step timings per phase', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final ground = Body.static();
+      space
+        ..addBody(ground)
+        ..addShape(SegmentShape(ground, const Vector(-50, 0), const Vector(50, 0), 1));
+      for (var i = 0; i < 20; i++) {
+        final body = Body.dynamic(1, 1)..position = Vector(i * 3.0, 2);
+        space
+          ..addBody(body)
+          ..addShape(CircleShape(body, 1));
+      }
+      expect(space.profiling, false);
+      expect(space.profile, isEmpty);
+
+      space.enableProfiling(history: 3);
+      if (!Space.profilingAvailable) {
+        expect(space.profiling, false);
+        space.dispose();
+        return;
+      }
+      for (var i = 0; i < 5; i++) {
+        space.step(1 / 60.0);
+      }
+      final profile = space.profile;
+      expect(profile, hasLength(3));
+      for (final step in profile) {
+        final phases = step.integrate + step.broadphase + step.narrowphase + step.islands + step.arbiters;
+        expect(step.total, greaterThan(0));
+        expect(phases + step.preStep + step.solver + step.callbacks + step.extensions, lessThanOrEqualTo(step.total));
+      }
+
+      space.disableProfiling();
+      expect(space.profile, isEmpty);
+      space.dispose();
+    });
+
+    test('counts bodies, arbiters and contacts', () {
+      final space = Space()
+        ..gravity = const Vector(0, -100)
+        ..sleepTimeThreshold = 0.5;
+      final ground = Body.static();
+      space
+        ..addBody(ground)
+        ..addShape(SegmentShape(ground, const Vector(-50, 0), const Vector(50, 0), 1));
+      final bodies = <Body>[];
+      for (var i = 0; i < 10; i++) {
+        final body = Body.dynamic(1, 1)..position = Vector(i * 3.0, 1.9);
+        bodies.add(body);
+        space
+          ..addBody(body)
+          ..addShape(CircleShape(body, 1));
+      }
+
+      var stats = space.stats;
+      expect(stats.activeBodies, 10);
+      expect(stats.staticBodies, 1);
+      expect(stats.shapes, 11);
+      expect(stats.arbiters, 0);
+      expect(stats.broadphasePairs, isNull);
+
+      space.step(1 / 60.0);
+      stats = space.stats;
+      expect(stats.arbiters, 10);
+      expect(stats.contacts, greaterThanOrEqualTo(10));
+      expect(stats.cachedArbiters, greaterThanOrEqualTo(stats.arbiters));
+      expect(stats.broadphasePairs, isNull);
+
+      for (var i = 0; i < 300; i++) {
+        space.step(1 / 60.0);
+      }
+      stats = space.stats;
+      expect(stats.sleepingBodies, 10);
+      expect(stats.activeBodies, 0);
+      expect(stats.arbiters, 0);
+
+      bodies.first.activate();
+      space.enableProfiling(history: 1);
+      space.step(1 / 60.0);
+      if (Space.profilingAvailable) {
+        expect(space.stats.broadphasePairs, greaterThanOrEqualTo(1));
+      }
+      space.dispose();
+    });
+
+    test('writes a trace of steps and batches', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final body = Body.dynamic(1, 1);
+      space
+        ..addBody(body)
+        ..addShape(CircleShape(body, 1));
+
+      startTrace(eventsPerThread: 1000);
+      if (!Space.profilingAvailable) {
+        expect(isTracing, false);
+        space.dispose();
+        return;
+      }
+      expect(isTracing, true);
+      space
+        ..step(1 / 60.0)
+        ..pointQueryNearestBatch(Float64List.fromList([0, 0, 5, 5, 5, 1]), Float64List(10));
+      stopTrace();
+      expect(isTracing, false);
+      space.step(1 / 60.0);
+
+      final directory = Directory.systemTemp.createTempSync('chipmunk_trace');
+      final file = File('${directory.path}/trace.json');
+      final written = writeTrace(file.path);
+      final trace = jsonDecode(file.readAsStringSync()) as Map<String, dynamic>;
+      final events = (trace['traceEvents'] as List).cast<Map<String, dynamic>>();
+      final names = [for (final event in events) if (event['ph'] == 'X') event['name']];
+      expect(names, hasLength(written));
+      expect(names.where((name) => name == 'cp_space_step'), hasLength(1));
+      expect(names, containsAll(<String>['solver', 'islands', 'cp_space_point_query_nearest_batch']));
+
+      directory.deleteSync(recursive: true);
+      expect(() => writeTrace(file.path), throwsArgumentError);
+      space.dispose();
+    });
+
+    test('restores a snapshot and resimulates the same steps', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final ground = Body.static();
+      space
+        ..addBody(ground)
+        ..addShape(SegmentShape(ground, const Vector(-50, 0), const Vector(50, 0), 1));
+      final bodies = <Body>[];
+      for (var i = 0; i < 5; i++) {
+        final body = Body.dynamic(1, 1)..position = Vector(i * 0.5, 2.0 + i * 2.1);
+        bodies.add(body);
+        space
+          ..addBody(body)
+          ..addShape(BoxShape(body, 2, 2));
+      }
+      space.addConstraint(PinJoint(bodies[0], bodies[1], Vector.zero, Vector.zero));
+
+      List<double> state() => [
+        for (final body in bodies) ...[body.position.x, body.position.y, body.angle, body.velocity.x, body.velocity.y],
+      ];
+      void run(int steps) {
+        for (var i = 0; i < steps; i++) {
+          space.step(1 / 60.0);
+        }
+      }
+
+      run(30);
+      final buffer = Uint8List(64 * 1024);
+      final snapshot = space.snapshot(buffer);
+      expect(snapshot.buffer, same(buffer.buffer));
+      expect(space.snapshot(), orderedEquals(snapshot));
+      final before = state();
+      run(30);
+      final after = state();
+
+      space.restore(snapshot);
+      expect(state(), orderedEquals(before));
+      expect(space.stats.arbiters, greaterThanOrEqualTo(1));
+      run(30);
+      final resimulated = state();
+      for (var i = 0; i < after.length; i++) {
+        expect(resimulated[i], closeTo(after[i], 1e-6));
+      }
+
+      final extra = Body.dynamic(1, 1);
+      space.addBody(extra);
+      expect(() => space.restore(snapshot), throwsArgumentError);
+      expect(() => space.restore(Uint8List(16)), throwsArgumentError);
+      space.dispose();
+    });
+
+    test('encodes snapshot deltas against a reference', () {
+      final space = Space()..gravity = const Vector(0, -100);
+      final ground = Body.static();
+      space
+        ..addBody(ground)
+        ..addShape(SegmentShape(ground, const Vector(-100, 0), const Vector(100, 0), 1));
+      for (var i = 0; i < 40; i++) {
+        final body = Body.dynamic(1, 1)..position = Vector(-90.0 + i * 4, 2);
+        space
+          ..addBody(body)
+          ..addShape(BoxShape(body, 2, 2));
+        body.sleep();
+      }
+      final falling = Body.dynamic(1, 1)..position = const Vector(0, 50);
+      space
+        ..addBody(falling)
+        ..addShape(CircleShape(falling, 1));
+
+      final reference = space.snapshot();
+      space.step(1 / 60.0);
+      final position = falling.position;
+      final delta = space.snapshotDelta(reference);
+      expect(delta.length, lessThan(reference.length ~/ 4));
+      final rebuilt = Space.applySnapshotDelta(reference, delta);
+      expect(rebuilt, orderedEquals(space.snapshot()));
+      expect(space.snapshotDelta(rebuilt).length, lessThan(delta.length));
+
+      space.step(1 / 60.0);
+      space.restoreDelta(reference, delta);
+      expect(falling.position.y, position.y);
+      expect(() => Space.applySnapshotDelta(rebuilt, delta), throwsArgumentError);
+      expect(() => space.snapshotDelta(Uint8List(16)), throwsArgumentError);
+      space.dispose();
+    });
+
     test('gets current time step', () {
       final space = Space()..step(0.016);
       final timeStep = space.currentTimeStep;
@@ -183,11 +561,440 @@ void main() {
       space.dispose();
     });
 
-    // Note: Query methods (pointQuery, segmentQuery, bbQuery, shapeQuery) and
-    // iteration methods (eachBody, eachShape, eachConstraint) are not yet
+    // Note: Iteration methods (eachBody, eachShape, eachConstraint) are not yet
     // implemented in the Space API. These tests are commented out until
     // those features are added.
 
+    test('point, segment and bounding box queries report every hit', () {
+      final space = Space();
+      final ground = Body.static();
+      final near = CircleShape(ground, 1, offset: const Vector(2, 0));
+      final far = CircleShape(ground, 1, offset: const Vector(6, 0));
+      final sensor = CircleShape(ground, 1, offset: const Vector(10, 0))..sensor = true;
+      space
+        ..addBody(ground)
+        ..addShape(far)
+        ..addShape(near)
+        ..addShape(sensor);
+
+      final points = space.pointQuery(Vector.zero, 6);
+      expect(points.total, 2);
+      expect(points.results.map((info) => info.shapePtr), [near.native, far.native]);
+      expect(points.results.first.distance, closeTo(1, 0.001));
+
+      final segments = space.segmentQuery(const Vector(-5, 0), const Vector(20, 0), maxResults: 2);
+      expect(segments.total, 3);
+      expect(segments.results.map((info) => info.shapePtr), [near.native, far.native]);
+      expect(segments.results.first.point.x, closeTo(1, 0.001));
+      expect(segments.results.first.normal.x, closeTo(-1, 0.001));
+
+      final boxes = space.bbQuery(const BoundingBox(left: 5, bottom: -1, right: 12, top: 1));
+      expect(boxes.total, 2);
+      expect(boxes.results, unorderedEquals([far, sensor]));
+
+      final none = space.bbQuery(const BoundingBox(left: 5, bottom: -1, right: 12, top: 1), maxResults: 0);
+      expect(none.total, 2);
+      expect(none.results, isEmpty);
+      space.dispose();
+    });
+
+    test('shape query reports overlaps and their contact points', () {
+      final space = Space();
+      final ground = Body.static();
+      final near = CircleShape(ground, 1);
+      final far = CircleShape(ground, 1, offset: const Vector(100, 0));
+      space
+        ..addBody(ground)
+        ..addShape(near)
+        ..addShape(far);
+      final probeBody = Body.kinematic()..position = const Vector(1.5, 0);
+      final probe = CircleShape(probeBody, 1);
+
+      final query = space.shapeQuery(probe);
+      expect(query.total, 1);
+      expect(query.results.single.shapePtr, near.native);
+      final set = query.results.single.contactPointSet;
+      expect(set.count, 1);
+      expect(set.points.single.distance, closeTo(-0.5, 0.001));
+
+      final large = CircleShape(probeBody, 200);
+      final capped = space.shapeQuery(large, maxResults: 1);
+      expect(capped.total, 2);
+      expect(capped.results.length, 1);
+      probe.dispose();
+      large.dispose();
+      probeBody.dispose();
+      space.dispose();
+    });
+
+    test('runs batched first-hit segment queries', () {
+      final space = Space();
+      final ground = Body.static();
+      final circle = CircleShape(ground, 1);
+      space
+        ..addBody(ground)
+        ..addShape(circle);
+
+      final segments = Float64List.fromList([-10, 0, 10, 0, 0, -10, 5, 10, 5, 0, -10, 0, 10, 0, 0]);
+      final hits = Float64List(segments.length);
+      final shapes = space.segmentQueryFirstBatch(
+        segments,
+        hits,
+        filters: const [ShapeFilter.all(), ShapeFilter.all(), ShapeFilter.none()],
+      );
+      expect(shapes, [circle, null, null]);
+      expect(hits[0], closeTo(-1, 0.001));
+      expect(hits[2], closeTo(-1, 0.001));
+      expect(hits[4], closeTo(0.45, 0.001));
+      expect(hits[5], closeTo(10, 0.001));
+      expect(hits[9], 1);
+      expect(() => space.segmentQueryFirstBatch(segments, Float64List(5)), throwsArgumentError);
+      space.dispose();
+    });
+
+    test('runs batched nearest point and bounding box queries', () {
+      final space = Space();
+      final ground = Body.static();
+      final left = CircleShape(ground, 1, offset: const Vector(-5, 0));
+      final right = CircleShape(ground, 1, offset: const Vector(5, 0));
+      space
+        ..addBody(ground)
+        ..addShape(left)
+        ..addShape(right);
+
+      final hits = Float64List(10);
+      final nearest = space.pointQueryNearestBatch(Float64List.fromList([-3, 0, 10, 0, 10, 1]), hits);
+      expect(nearest, [left, null]);
+      expect(hits[0], closeTo(-4, 0.001));
+      expect(hits[2], closeTo(1, 0.001));
+
+      final boxes = space.bbQueryBatch(
+        Float64List.fromList([-10, -1, 10, 1, -6, -1, -4, 1, 20, 20, 30, 30]),
+        maxResultsPerQuery: 1,
+      );
+      expect(boxes.totals, [2, 1, 0]);
+      expect(boxes.results[0].length, 1);
+      expect(boxes.results[1], [left]);
+      expect(boxes.results[2], isEmpty);
+      space.dispose();
+    });
+
+    test('splits large query batches across worker threads', () {
+      final space = Space();
+      final ground = Body.static();
+      final circle = CircleShape(ground, 1);
+      space
+        ..addBody(ground)
+        ..addShape(circle);
+
+      const count = 1000;
+      final segments = Float64List(count * 5);
+      for (var i = 0; i < count; i++) {
+        segments.setAll(i * 5, [-10, i / count * 4 - 2, 10, i / count * 4 - 2, 0]);
+      }
+      final threaded = Float64List(count * 5);
+      final serial = Float64List(count * 5);
+      workerThreadCount = 3;
+      final threadedShapes = space.segmentQueryFirstBatch(segments, threaded);
+      workerThreadCount = 0;
+      final serialShapes = space.segmentQueryFirstBatch(segments, serial);
+      workerThreadCount = -1;
+
+      expect(threadedShapes, serialShapes);
+      expect(threaded, serial);
+      expect(threadedShapes.whereType<Shape>().length, greaterThan(count ~/ 3));
+      space.dispose();
+    });
+
+    test('shape cast finds the first time of impact', () {
+      final space = Space();
+      final ground = Body.static();
+      final wall = SegmentShape(ground, const Vector(5, -10), const Vector(5, 10), 0);
+      final floorBody = Body.static()..position = const Vector(0, -5);
+      final floor = BoxShape(floorBody, 10, 2);
+      space
+        ..addBody(ground)
+        ..addBody(floorBody)
+        ..addShape(wall)
+        ..addShape(floor);
+      final mover = Body.kinematic();
+      final box = BoxShape(mover, 2, 2);
+      final ball = CircleShape(mover, 1);
+
+      final wallHit = space.shapeCast(box, const Vector(10, 0))!;
+      expect(wallHit.shapePtr, wall.native);
+      expect(wallHit.alpha, closeTo(0.4, 0.001));
+      expect(wallHit.normal.x, closeTo(-1, 0.001));
+      expect(wallHit.point.x, closeTo(5, 0.001));
+
+      final floorHit = space.shapeCast(ball, const Vector(0, -10))!;
+      expect(floorHit.shapePtr, floor.native);
+      expect(floorHit.alpha, closeTo(0.3, 0.001));
+      expect(floorHit.normal.y, closeTo(1, 0.001));
+
+      expect(space.shapeCast(ball, const Vector(-10, 0)), isNull);
+      mover.position = const Vector(5, 0);
+      expect(space.shapeCast(ball, const Vector(-10, 0))!.alpha, 0);
+
+      // Passes 0.01 from the corner of the floor without touching it.
+      mover.position = const Vector(-10.7142, -8.2858);
+      expect(space.shapeCast(ball, const Vector(10, 10)), isNull);
+
+      box.dispose();
+      ball.dispose();
+      mover.dispose();
+      space.dispose();
+    });
+
+    test('shape cast hits a circle with a circle', () {
+      final space = Space();
+      final post = Body.static()..position = const Vector(6, 0);
+      final target = CircleShape(post, 1);
+      space
+        ..addBody(post)
+        ..addShape(target);
+      final mover = Body.kinematic();
+      final ball = CircleShape(mover, 1);
+
+      final hit = space.shapeCast(ball, const Vector(10, 0))!;
+      expect(hit.shapePtr, target.native);
+      expect(hit.alpha, closeTo(0.4, 0.001));
+      expect(hit.normal.x, closeTo(-1, 0.001));
+      expect(hit.point.x, closeTo(5, 0.001));
+      expect(hit.point.y, closeTo(0, 0.001));
+
+      expect(() => space.shapeCast(ball, const Vector(10, 0), tolerance: 0), throwsArgumentError);
+      expect(() => space.shapeCast(ball, const Vector(10, 0), tolerance: -1), throwsArgumentError);
+
+      ball.dispose();
+      mover.dispose();
+      space.dispose();
+    });
+
+    test('writes the shapes visible in a viewport into an instance buffer', () {
+      final space = Space();
+      final onScreen = Body.dynamic(1, 1)
+        ..position = const Vector(10, 10)
+        ..angle = 0.5;
+      final offScreen = Body.dynamic(1, 1)..position = const Vector(500, 0);
+      final visible = CircleShape(onScreen, 1)..renderId = 7;
+      final untagged = CircleShape(onScreen, 2);
+      final hidden = CircleShape(offScreen, 1)..renderId = 8;
+      space
+        ..addBody(onScreen)
+        ..addBody(offScreen)
+        ..addShape(visible)
+        ..addShape(untagged)
+        ..addShape(hidden);
+
+      final instances = Float32List(3 * 4);
+      final ids = Uint32List(4);
+      final shapes = <Shape?>[];
+      const camera = BoundingBox(left: 0, bottom: 0, right: 100, top: 100);
+      final count = space.queryVisible(camera, instances, renderIds: ids, shapes: shapes);
+      expect(count, 1);
+      expect(instances[0], closeTo(10, 0.001));
+      expect(instances[1], closeTo(10, 0.001));
+      expect(instances[2], closeTo(0.5, 0.001));
+      expect(ids[0], 7);
+      expect(shapes, [visible]);
+      space.dispose();
+    });
+
+    test('exports body transforms in one call', () {
+      final space = Space();
+      final body = Body.dynamic(1, 1)
+        ..position = const Vector(10, 20)
+        ..angle = 0.5
+        ..velocity = const Vector(3, 4)
+        ..angularVelocity = 2;
+      space.addBody(body);
+      final out = Float32List(6);
+      final bodies = <Body>[];
+      expect(space.exportTransforms(out, velocity: true, bodies: bodies), 1);
+      expect(out, [10, 20, 0.5, 3, 4, 2]);
+      expect(bodies.single, same(body));
+
+      final out64 = Float64List(3);
+      expect(space.exportTransformsFloat64(out64), 1);
+      expect(out64, [10, 20, 0.5]);
+      space.dispose();
+    });
+
+    test('export reports body count when buffer is too small', () {
+      final space = Space();
+      for (var i = 0; i < 3; i++) {
+        space.addBody(Body.dynamic(1, 1)..position = Vector(i.toDouble(), 0));
+      }
+      final out = Float32List(6);
+      expect(space.exportTransforms(out), 3);
+      space.dispose();
+    });
+
+    test('imports body states in one call', () {
+      final space = Space();
+      final dynamicBody = Body.dynamic(1, 1);
+      final kinematicBody = Body.kinematic();
+      final shape = CircleShape(kinematicBody, 1);
+      space
+        ..addBody(dynamicBody)
+        ..addBody(kinematicBody)
+        ..addShape(shape);
+
+      final state = Float32List.fromList([
+        ...[1, 10], // x
+        ...[2, 20], // y
+        ...[0, 0.5], // angle
+        ...[3, 0], // velocity x
+        ...[4, 0], // velocity y
+        ...[0, 1], // angular velocity
+      ]);
+      space.importStates([dynamicBody, kinematicBody], state, velocity: true);
+
+      expect(dynamicBody.position.x, closeTo(1, 0.001));
+      expect(dynamicBody.position.y, closeTo(2, 0.001));
+      expect(dynamicBody.velocity.x, closeTo(3, 0.001));
+      expect(dynamicBody.velocity.y, closeTo(4, 0.001));
+      expect(kinematicBody.position.x, closeTo(10, 0.001));
+      expect(kinematicBody.angle, closeTo(0.5, 0.001));
+      expect(kinematicBody.angularVelocity, closeTo(1, 0.001));
+      // The kinematic body's shape is reindexed without stepping.
+      expect(shape.boundingBox.left, closeTo(9, 0.001));
+      space.dispose();
+    });
+
+    test('import rejects a short state buffer', () {
+      final space = Space();
+      final body = Body.dynamic(1, 1);
+      space.addBody(body);
+      expect(() => space.importStates([body], Float32List(2)), throwsArgumentError);
+      space.dispose();
+    });
+
+    test('tracks bodies that moved during a step', () {
+      final space = Space()..enableChangeTracking(epsilon: 0.01);
+      expect(space.changeTracking, true);
+      final moving = Body.dynamic(1, 1)..velocity = const Vector(10, 0);
+      final resting = Body.dynamic(1, 1)..position = const Vector(5, 5);
+      space
+        ..addBody(moving)
+        ..addBody(resting)
+        ..step(1 / 60);
+      // Newly added bodies are reported once.
+      expect(space.changedBodyCount, 2);
+
+      space.step(1 / 60);
+      final out = Float32List(3);
+      final bodies = <Body>[];
+      expect(space.exportChangedTransforms(out, bodies: bodies), 1);
+      expect(bodies.single, same(moving));
+      expect(out[0], closeTo(moving.position.x, 0.001));
+
+      space
+        ..removeBody(moving)
+        ..step(1 / 60);
+      expect(space.changedBodyCount, 0);
+
+      space.disableChangeTracking();
+      expect(space.changeTracking, false);
+      moving.dispose();
+      space.dispose();
+    });
+
+    test('spawns circles in one call', () {
+      final space = Space();
+      final spawned = space.spawnCircles(
+        [0, 0, 10, 0, 20, 0],
+        radii: [2],
+        masses: [1, 2, 3],
+        frictions: [0.5],
+        filters: [ShapeFilter.group(7)],
+        collisionTypes: [4],
+      );
+      expect(spawned.bodies, hasLength(3));
+      expect(spawned.shapes, hasLength(3));
+      expect(spawned.bodies[1].position.x, closeTo(10, 0.001));
+      expect(spawned.bodies[2].mass, closeTo(3, 0.001));
+      expect(spawned.shapes[0].radius, closeTo(2, 0.001));
+      expect(spawned.shapes[2].friction, closeTo(0.5, 0.001));
+      expect(spawned.shapes[1].filter.group, 7);
+      expect(spawned.shapes[1].collisionType, 4);
+      expect(space.containsBody(spawned.bodies[0]), true);
+      expect(space.containsShape(spawned.shapes[0]), true);
+      space.dispose();
+    });
+
+    test('spawns boxes in one call', () {
+      final space = Space();
+      final spawned = space.spawnBoxes([0, 0, 5, 5], sizes: [2, 4]);
+      expect(spawned.bodies, hasLength(2));
+      final bb = spawned.shapes[1].boundingBox;
+      expect(bb.right - bb.left, closeTo(2, 0.001));
+      expect(bb.top - bb.bottom, closeTo(4, 0.001));
+      space.dispose();
+    });
+
+    test('spawn rejects mismatched attribute lists', () {
+      final space = Space();
+      expect(() => space.spawnCircles([0, 0, 1, 1], radii: [1, 2, 3]), throwsArgumentError);
+      expect(() => space.spawnCircles([0, 0, 1], radii: [1]), throwsArgumentError);
+      space.dispose();
+    });
+
+    test('despawns bodies, shapes and constraints in one call', () {
+      final space = Space();
+      final a = Body.dynamic(1, 1);
+      final b = Body.dynamic(1, 1)..position = const Vector(0, 3);
+      final shapeA = CircleShape(a, 1);
+      final shapeB = CircleShape(b, 1);
+      final joint = PinJoint(a, b, Vector.zero, Vector.zero);
+      final kept = Body.dynamic(1, 1);
+      space
+        ..addBody(a)
+        ..addBody(b)
+        ..addBody(kept)
+        ..addShape(shapeA)
+        ..addShape(shapeB)
+        ..addConstraint(joint)
+        ..step(1 / 60)
+        ..despawn(bodies: [a, b, a], shapes: [shapeA, shapeB, shapeB], constraints: [joint, joint]);
+
+      expect(a.disposed, true);
+      expect(shapeB.disposed, true);
+      expect(joint.disposed, true);
+      expect(space.containsBody(kept), true);
+      expect(space.toString(), contains('bodies: 1, shapes: 0, constraints: 0'));
+      space.step(1 / 60);
+      space.dispose();
+      expect(kept.disposed, true);
+    });
+
+    test('despawn rejects objects of another space', () {
+      final space = Space();
+      final other = Space();
+      final body = Body.dynamic(1, 1);
+      final shape = CircleShape(body, 1);
+      final free = Body.dynamic(1, 1);
+      other
+        ..addBody(body)
+        ..addShape(shape);
+
+      expect(() => space.despawn(bodies: [free, body]), throwsArgumentError);
+      expect(() => space.despawn(shapes: [shape]), throwsArgumentError);
+      expect(free.disposed, false);
+      expect(body.disposed, false);
+      expect(shape.disposed, false);
+      expect(other.containsShape(shape), true);
+
+      other.despawn(bodies: [body], shapes: [shape]);
+      space.despawn(bodies: [free]);
+      expect(body.disposed, true);
+      expect(free.disposed, true);
+      expect(other.toString(), contains('bodies: 0, shapes: 0, constraints: 0'));
+      space.dispose();
+      other.dispose();
+    });
+
     test('disposed flag is set after disposal', () {
       final space = Space();
       expect(space.disposed, false);